@@ -67,6 +67,8 @@ typedef struct {
   gboolean creating_new_layer;
   VikTrwLayer *vtl;
   gpointer options;
+  BabelFeed *feed;       /* Input of filters */
+  BabelFeed *feed_track;
 } w_and_interface_t;
 
 
@@ -143,6 +145,10 @@ static void get_from_anything ( w_and_interface_t *wi )
   if ( source_interface->process_func )
     result = source_interface->process_func ( wi->vtl, cmd, extra, (BabelStatusFunc) progress_func, wi->w, wi->options );
 
+  gdk_threads_enter();
+  free_feeds ( wi );
+  gdk_threads_leave();
+
   g_free ( cmd );
   g_free ( extra );
   g_free ( wi->options );
@@ -176,33 +182,17 @@ static void get_from_anything ( w_and_interface_t *wi )
 }
 
 
-static gchar *write_tmp_trwlayer ( VikTrwLayer *vtl )
+/* Once the filter has finished with its input */
+static void free_feeds ( w_and_interface_t *wi )
 {
-  int fd_src;
-  gchar *name_src;
-  FILE *f;
-  g_assert ((fd_src = g_file_open_tmp("tmp-viking.XXXXXX", &name_src, NULL)) >= 0);
-  g_debug ("%s: temporary file: %s", __FUNCTION__, name_src);
-  f = fdopen(fd_src, "w");
-  a_gpx_write_file(vtl, f, NULL);
-  fclose(f);
-  f = NULL;
-  return name_src;
-}
-
-/* TODO: write with name of old track */
-static gchar *write_tmp_track ( VikTrack *track )
-{
-  int fd_src;
-  gchar *name_src;
-  FILE *f;
-  g_assert ((fd_src = g_file_open_tmp("tmp-viking.XXXXXX", &name_src, NULL)) >= 0);
-  g_debug ("%s: temporary file: %s", __FUNCTION__, name_src);
-  f = fdopen(fd_src, "w");
-  a_gpx_write_track_file(track, f, NULL); /* Thank you Guilhem! Just when I needed this function... -- Evan */
-  fclose(f);
-  f = NULL;
-  return name_src;
+  if ( wi->feed ) {
+    a_babel_feed_free ( wi->feed );
+    wi->feed = NULL;
+  }
+  if ( wi->feed_track ) {
+    a_babel_feed_free ( wi->feed_track );
+    wi->feed_track = NULL;
+  }
 }
 
 /* TODO: cleanup, getr rid of redundancy */
@@ -227,6 +217,8 @@ static void acquire ( VikWindow *vw, VikLayersPanel *vlp, VikViewport *vvp, VikD
   /* for UI builder */
   gpointer pass_along_data;
   VikLayerParamData *paramdatas = NULL;
+  BabelFeed *feed = NULL;
+  BabelFeed *feed_track = NULL;
 
   w_and_interface_t *wi;
 
@@ -285,30 +277,24 @@ static void acquire ( VikWindow *vw, VikLayersPanel *vlp, VikViewport *vvp, VikD
 
   /* CREATE INPUT DATA & GET COMMAND STRING */
 
+  // Input is written by other threads as the filter reads it
   if ( source_interface->inputtype == VIK_DATASOURCE_INPUTTYPE_TRWLAYER ) {
-    gchar *name_src = write_tmp_trwlayer ( vtl );
+    feed = a_babel_feed_new ( vtl, NULL );
 
     ((VikDataSourceGetCmdStringFuncWithInput) source_interface->get_cmd_string_func)
-	( pass_along_data, &cmd, &extra, name_src );
-
-    g_free ( name_src );
-    /* TODO: delete the tmp file? or delete it only after we're done with it? */
+	( pass_along_data, &cmd, &extra, feed ? a_babel_feed_get_filename ( feed ) : "" );
   } else if ( source_interface->inputtype == VIK_DATASOURCE_INPUTTYPE_TRWLAYER_TRACK ) {
-    gchar *name_src = write_tmp_trwlayer ( vtl );
-    gchar *name_src_track = write_tmp_track ( track );
+    feed = a_babel_feed_new ( vtl, NULL );
+    feed_track = a_babel_feed_new ( NULL, track );
 
     ((VikDataSourceGetCmdStringFuncWithInputInput) source_interface->get_cmd_string_func)
-	( pass_along_data, &cmd, &extra, name_src, name_src_track );
-
-    g_free ( name_src );
-    g_free ( name_src_track );
+	( pass_along_data, &cmd, &extra, feed ? a_babel_feed_get_filename ( feed ) : "",
+	  feed_track ? a_babel_feed_get_filename ( feed_track ) : "" );
   } else if ( source_interface->inputtype == VIK_DATASOURCE_INPUTTYPE_TRACK ) {
-    gchar *name_src_track = write_tmp_track ( track );
+    feed_track = a_babel_feed_new ( NULL, track );
 
     ((VikDataSourceGetCmdStringFuncWithInput) source_interface->get_cmd_string_func)
-	( pass_along_data, &cmd, &extra, name_src_track );
-
-    g_free ( name_src_track );
+	( pass_along_data, &cmd, &extra, feed_track ? a_babel_feed_get_filename ( feed_track ) : "" );
   } else if ( source_interface->get_cmd_string_func )
     source_interface->get_cmd_string_func ( pass_along_data, &cmd, &extra, &options );
 
@@ -334,6 +320,8 @@ static void acquire ( VikWindow *vw, VikLayersPanel *vlp, VikViewport *vvp, VikD
   wi->options = options;
   wi->vtl = vtl;
   wi->creating_new_layer = (!vtl);
+  wi->feed = feed;
+  wi->feed_track = feed_track;
 
   dialog = gtk_dialog_new_with_buttons ( "", GTK_WINDOW(vw), 0, GTK_STOCK_OK, GTK_RESPONSE_ACCEPT, GTK_STOCK_CANCEL, GTK_RESPONSE_REJECT, NULL );
   gtk_dialog_set_response_sensitive ( GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT, FALSE );
@@ -400,6 +388,7 @@ static void acquire ( VikWindow *vw, VikLayersPanel *vlp, VikViewport *vvp, VikD
     }
     else {
       // This shouldn't happen...
+      free_feeds ( wi );
       gtk_label_set_text ( GTK_LABEL(w->status), _("Unable to create command\nAcquire method failed.") );
       gtk_dialog_run (GTK_DIALOG (dialog));
     }
@@ -411,6 +400,7 @@ static void acquire ( VikWindow *vw, VikLayersPanel *vlp, VikViewport *vvp, VikD
       if ( !result )
         a_dialog_msg ( GTK_WINDOW(vw), GTK_MESSAGE_ERROR, _("Error: acquisition failed."), NULL );
     }
+    free_feeds ( wi );
     g_free ( cmd );
     g_free ( extra );
     g_free ( options );
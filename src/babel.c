@@ -43,6 +43,13 @@
 #include <string.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <fcntl.h>
+#ifdef HAVE_MKFIFO
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <pthread.h>
+#endif
 
 /* TODO in the future we could have support for other shells (change command strings), or not use a shell at all */
 #define BASH_LOCATION "/bin/bash"
@@ -67,6 +74,228 @@ GList *a_babel_file_list;
  */
 GList *a_babel_device_list;
 
+/*
+ * GPX is passed to and from the external programs through named pipes,
+ *  so Viking writes or reads it while the program is running
+ *  rather than going through a temporary file on disk.
+ * Where there are no named pipes, temporary files are used instead.
+ */
+typedef struct {
+  gchar *name;
+  gboolean is_fifo;
+  GThread *thread;    /* Using the pipe while the program runs */
+  GMutex *mutex;
+  GCond *cond;
+  gboolean done;      /* The thread has finished */
+  gboolean cancelled; /* The program has finished */
+} BabelPipe;
+
+struct _BabelFeed {
+  BabelPipe pipe;
+  GString *gpx; /* Made beforehand, as the layer is not to be read from other threads */
+};
+
+typedef struct {
+  BabelPipe pipe;
+  VikTrwLayer *vt;
+  gboolean ret;
+} BabelSink;
+
+/**
+ * babel_pipe_init:
+ * @want_fifo: Whether to make a named pipe, if possible, rather than a temporary file
+ */
+static gboolean babel_pipe_init ( BabelPipe *bp, gboolean want_fifo )
+{
+  gint fd;
+
+  memset ( bp, 0, sizeof(*bp) );
+  if ((fd = g_file_open_tmp("tmp-viking.XXXXXX", &bp->name, NULL)) < 0)
+    return FALSE;
+  g_debug ("%s: temporary file: %s", __FUNCTION__, bp->name);
+  close(fd);
+
+#ifdef HAVE_MKFIFO
+  if ( want_fifo ) {
+    // Replace the file by a pipe of the same name
+    g_remove ( bp->name );
+    bp->is_fifo = mkfifo ( bp->name, 0600 ) == 0;
+    if ( ! bp->is_fifo )
+      g_warning ("%s: could not make the pipe %s", __FUNCTION__, bp->name);
+  }
+#endif
+
+  bp->mutex = g_mutex_new ();
+  bp->cond = g_cond_new ();
+  bp->done = TRUE;
+  return TRUE;
+}
+
+static void babel_pipe_start ( BabelPipe *bp, GThreadFunc func )
+{
+  bp->done = FALSE;
+  bp->thread = g_thread_create ( func, bp, TRUE, NULL );
+  if ( ! bp->thread )
+    bp->done = TRUE;
+}
+
+static void babel_pipe_set_done ( BabelPipe *bp )
+{
+  g_mutex_lock ( bp->mutex );
+  bp->done = TRUE;
+  g_cond_signal ( bp->cond );
+  g_mutex_unlock ( bp->mutex );
+}
+
+static gboolean babel_pipe_is_cancelled ( BabelPipe *bp )
+{
+  gboolean cancelled;
+  g_mutex_lock ( bp->mutex );
+  cancelled = bp->cancelled;
+  g_mutex_unlock ( bp->mutex );
+  return cancelled;
+}
+
+/**
+ * babel_pipe_join:
+ * @other_end: The opening mode of the end the thread is not using
+ *
+ * Wait for the thread once the program has finished.
+ * Should the program have never opened the pipe, the thread would wait
+ *  for it forever, so keep opening the other end ourselves until the
+ *  thread is done.
+ */
+static void babel_pipe_join ( BabelPipe *bp, gint other_end )
+{
+  GTimeVal tv;
+
+  if ( ! bp->thread )
+    return;
+
+  g_mutex_lock ( bp->mutex );
+  bp->cancelled = TRUE;
+  while ( ! bp->done ) {
+#ifdef HAVE_MKFIFO
+    gint fd = g_open ( bp->name, other_end | O_NONBLOCK, 0 );
+    if ( fd >= 0 )
+      close ( fd );
+#endif
+    g_get_current_time ( &tv );
+    g_time_val_add ( &tv, 10000 );
+    g_cond_timed_wait ( bp->cond, bp->mutex, &tv );
+  }
+  g_mutex_unlock ( bp->mutex );
+
+  g_thread_join ( bp->thread );
+  bp->thread = NULL;
+}
+
+static void babel_pipe_clear ( BabelPipe *bp )
+{
+  g_remove ( bp->name );
+  g_free ( bp->name );
+  g_cond_free ( bp->cond );
+  g_mutex_free ( bp->mutex );
+}
+
+static gpointer babel_feed_thread ( BabelFeed *feed )
+{
+  FILE *f;
+#ifdef HAVE_MKFIFO
+  // Should the program stop reading, only fail the writes here
+  //  rather than Viking being stopped by the signal
+  sigset_t set;
+  sigemptyset ( &set );
+  sigaddset ( &set, SIGPIPE );
+  pthread_sigmask ( SIG_BLOCK, &set, NULL );
+#endif
+
+  // Waits until the program opens the pipe
+  f = g_fopen ( feed->pipe.name, "w" );
+  if ( f ) {
+    if ( ! babel_pipe_is_cancelled ( &feed->pipe ) )
+      fwrite ( feed->gpx->str, 1, feed->gpx->len, f );
+    fclose ( f );
+  }
+
+  babel_pipe_set_done ( &feed->pipe );
+  return NULL;
+}
+
+/**
+ * a_babel_feed_new:
+ * @vtl: The layer to write as GPX
+ * @trk: Or the track to write, when @vtl is %NULL
+ *
+ * Provides the GPX for an external program to read, from a named pipe
+ *  written to by another thread as the program reads it.
+ * The GPX is made before returning, so the layer or track may be
+ *  changed afterwards without affecting what the program reads.
+ *
+ * Returns: %NULL if the pipe or file could not be made
+ */
+BabelFeed *a_babel_feed_new ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  BabelFeed *feed = g_new0 ( BabelFeed, 1 );
+
+  if ( ! babel_pipe_init ( &feed->pipe, TRUE ) ) {
+    g_free ( feed );
+    return NULL;
+  }
+
+  if ( vtl )
+    feed->gpx = a_gpx_write_string ( vtl, NULL );
+  else
+    feed->gpx = a_gpx_write_track_string ( trk, NULL );
+
+  if ( feed->pipe.is_fifo )
+    babel_pipe_start ( &feed->pipe, (GThreadFunc) babel_feed_thread );
+  else {
+    FILE *f = g_fopen ( feed->pipe.name, "w" );
+    if ( f ) {
+      fwrite ( feed->gpx->str, 1, feed->gpx->len, f );
+      fclose ( f );
+    }
+  }
+  return feed;
+}
+
+/**
+ * a_babel_feed_get_filename:
+ *
+ * Returns: The name for the program to read the GPX from
+ */
+const gchar *a_babel_feed_get_filename ( BabelFeed *feed )
+{
+  return feed->pipe.name;
+}
+
+/**
+ * a_babel_feed_free:
+ *
+ * Call once the program reading it has finished.
+ */
+void a_babel_feed_free ( BabelFeed *feed )
+{
+  babel_pipe_join ( &feed->pipe, O_RDONLY );
+  babel_pipe_clear ( &feed->pipe );
+  g_string_free ( feed->gpx, TRUE );
+  g_free ( feed );
+}
+
+static gpointer babel_sink_thread ( BabelSink *sink )
+{
+  // Waits until the program opens the pipe
+  FILE *f = g_fopen ( sink->pipe.name, "r" );
+  if ( f ) {
+    sink->ret = a_gpx_read_file ( sink->vt, f );
+    fclose ( f );
+  }
+
+  babel_pipe_set_done ( &sink->pipe );
+  return NULL;
+}
+
 /**
  * a_babel_convert:
  * @vt:        The TRW layer to modify. All data will be deleted, and replaced by what gpsbabel outputs.
@@ -84,21 +313,15 @@ GList *a_babel_device_list;
  */
 gboolean a_babel_convert( VikTrwLayer *vt, const char *babelargs, BabelStatusFunc cb, gpointer user_data, gpointer not_used )
 {
-  int fd_src;
-  FILE *f;
-  gchar *name_src = NULL;
+  BabelFeed *feed;
   gboolean ret = FALSE;
   gchar *bargs = g_strconcat(babelargs, " -i gpx", NULL);
 
-  if ((fd_src = g_file_open_tmp("tmp-viking.XXXXXX", &name_src, NULL)) >= 0) {
-    g_debug ("%s: temporary file: %s", __FUNCTION__, name_src);
-    f = fdopen(fd_src, "w");
-    a_gpx_write_file(vt, f, NULL);
-    fclose(f);
-    f = NULL;
-    ret = a_babel_convert_from ( vt, bargs, name_src, cb, user_data, not_used );
-    g_remove(name_src);
-    g_free(name_src);
+  // The feed is a copy of the layer as it is now,
+  //  so adding gpsbabel's output to it does not change the input
+  if ((feed = a_babel_feed_new ( vt, NULL ))) {
+    ret = a_babel_convert_from ( vt, bargs, a_babel_feed_get_filename ( feed ), cb, user_data, not_used );
+    a_babel_feed_free ( feed );
   }
 
   g_free(bargs);
@@ -169,20 +392,27 @@ static gboolean babel_general_convert( BabelStatusFunc cb, gchar **args, gpointe
  *    for use with the power off command - 'command_off'
  * @cb: callback that is run upon new data from STDOUT (?)
  *     (TODO: STDERR would be nice since we usually redirect STDOUT)
+ * @sink: Where the command writes its GPX output
  * @user_data: passed along to cb
  *
  * Runs args[0] with the arguments and uses the GPX module
  * to import the GPX data into layer vt. Assumes that upon
- * running the command, the data will appear in the (usually
- * temporary) file name_dst.
+ * running the command, the data will appear in the named
+ * pipe (or temporary file) of @sink. A pipe is read while
+ * the command runs, so the layer fills as it goes.
  *
  * Returns: %TRUE on success
  */
-static gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, const gchar *name_dst, gpointer user_data )
+static gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, BabelSink *sink, gpointer user_data )
 {
   gboolean ret = FALSE;
   FILE *f = NULL;
-    
+
+  sink->vt = vt;
+  sink->ret = FALSE;
+  if ( vt && sink->pipe.is_fifo )
+    babel_pipe_start ( &sink->pipe, (GThreadFunc) babel_sink_thread );
+
   if (babel_general_convert(cb, args, user_data)) {
 
     /* No data actually required but still need to have run gpsbabel anyway
@@ -190,13 +420,21 @@ static gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb,
     if ( vt == NULL )
       return TRUE;
 
-    f = g_fopen(name_dst, "r");
-    if (f) {
-      ret = a_gpx_read_file ( vt, f );
-      fclose(f);
-      f = NULL;
+    if ( sink->pipe.is_fifo ) {
+      babel_pipe_join ( &sink->pipe, O_WRONLY );
+      ret = sink->ret;
+    }
+    else {
+      f = g_fopen(sink->pipe.name, "r");
+      if (f) {
+        ret = a_gpx_read_file ( vt, f );
+        fclose(f);
+        f = NULL;
+      }
     }
   }
+  else
+    babel_pipe_join ( &sink->pipe, O_WRONLY );
     
   return ret;
 }
@@ -219,14 +457,12 @@ static gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb,
 gboolean a_babel_convert_from( VikTrwLayer *vt, const char *babelargs, const char *from, BabelStatusFunc cb, gpointer user_data, gpointer not_used )
 {
   int i,j;
-  int fd_dst;
-  gchar *name_dst = NULL;
+  BabelSink sink;
   gboolean ret = FALSE;
   gchar *args[64];
 
-  if ((fd_dst = g_file_open_tmp("tmp-viking.XXXXXX", &name_dst, NULL)) >= 0) {
-    g_debug ("%s: temporary file: %s", __FUNCTION__, name_dst);
-    close(fd_dst);
+  // Nothing to read back when there is no layer
+  if ( babel_pipe_init ( &sink.pipe, vt != NULL ) ) {
 
     if (gpsbabel_loc ) {
       gchar **sub_args = g_strsplit(babelargs, " ", 0);
@@ -245,16 +481,15 @@ gboolean a_babel_convert_from( VikTrwLayer *vt, const char *babelargs, const cha
       args[i++] = "-f";
       args[i++] = (char *)from;
       args[i++] = "-F";
-      args[i++] = name_dst;
+      args[i++] = sink.pipe.name;
       args[i] = NULL;
 
-      ret = babel_general_convert_from ( vt, cb, args, name_dst, user_data );
+      ret = babel_general_convert_from ( vt, cb, args, &sink, user_data );
 
       g_strfreev(sub_args);
     } else
       g_critical("gpsbabel not found in PATH");
-    g_remove(name_dst);
-    g_free(name_dst);
+    babel_pipe_clear ( &sink.pipe );
   }
 
   return ret;
@@ -276,22 +511,19 @@ gboolean a_babel_convert_from( VikTrwLayer *vt, const char *babelargs, const cha
  */
 gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_cmd, const char *input_file_type, BabelStatusFunc cb, gpointer user_data, gpointer not_used )
 {
-  int fd_dst;
-  gchar *name_dst = NULL;
+  BabelSink sink;
   gboolean ret = FALSE;
   gchar **args;  
 
-  if ((fd_dst = g_file_open_tmp("tmp-viking.XXXXXX", &name_dst, NULL)) >= 0) {
-    g_debug ("%s: temporary file: %s", __FUNCTION__, name_dst);
+  if ( babel_pipe_init ( &sink.pipe, vt != NULL ) ) {
     gchar *shell_command;
     if ( input_file_type )
       shell_command = g_strdup_printf("%s | %s -i %s -f - -o gpx -F %s",
-        input_cmd, gpsbabel_loc, input_file_type, name_dst);
+        input_cmd, gpsbabel_loc, input_file_type, sink.pipe.name);
     else
-      shell_command = g_strdup_printf("%s > %s", input_cmd, name_dst);
+      shell_command = g_strdup_printf("%s > %s", input_cmd, sink.pipe.name);
 
     g_debug("%s: %s", __FUNCTION__, shell_command);
-    close(fd_dst);
 
     args = g_malloc(sizeof(gchar *)*4);
     args[0] = BASH_LOCATION;
@@ -299,11 +531,10 @@ gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_
     args[2] = shell_command;
     args[3] = NULL;
 
-    ret = babel_general_convert_from ( vt, cb, args, name_dst, user_data );
+    ret = babel_general_convert_from ( vt, cb, args, &sink, user_data );
     g_free ( args );
     g_free ( shell_command );
-    g_remove(name_dst);
-    g_free(name_dst);
+    babel_pipe_clear ( &sink.pipe );
   }
 
   return ret;
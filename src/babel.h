@@ -101,6 +101,12 @@ gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_
 gboolean a_babel_convert_from_url ( VikTrwLayer *vt, const char *url, const char *input_type, BabelStatusFunc cb, gpointer user_data, DownloadMapOptions *options );
 gboolean a_babel_convert_to( VikTrwLayer *vt, VikTrack *track, const char *babelargs, const char *file, BabelStatusFunc cb, gpointer user_data );
 
+typedef struct _BabelFeed BabelFeed;
+
+BabelFeed *a_babel_feed_new ( VikTrwLayer *vtl, VikTrack *trk );
+const gchar *a_babel_feed_get_filename ( BabelFeed *feed );
+void a_babel_feed_free ( BabelFeed *feed );
+
 void a_babel_init ();
 void a_babel_uninit ();
 
@@ -35,6 +35,7 @@ static GtkListStore *bgstore = NULL;
 static GSList *windows_to_update = NULL;
 
 static gint bgitemcount = 0;
+static gint bgjobcount = 0; /* Jobs queued or running */
 
 #define VIK_BG_NUM_ARGS 7
 
@@ -122,6 +123,7 @@ static void thread_helper ( gpointer args[VIK_BG_NUM_ARGS], gpointer user_data )
   gdk_threads_leave();
 
   thread_die ( args );
+  g_atomic_int_add ( &bgjobcount, -1 );
 }
 
 /**
@@ -161,9 +163,26 @@ void a_background_thread ( GtkWindow *parent, const gchar *message, vik_thr_func
 		       -1 );
 
   /* run the thread in the background */
+  g_atomic_int_inc ( &bgjobcount );
   g_thread_pool_push( thread_pool, args, NULL );
 }
 
+/**
+ * a_background_wait_all:
+ *
+ * Wait for all the background jobs to finish,
+ *  for when there is no main loop to carry on with meanwhile (eg command line rendering).
+ * To be called holding the GDK lock, as the jobs need it to finish.
+ */
+void a_background_wait_all ()
+{
+  while ( g_atomic_int_get ( &bgjobcount ) ) {
+    gdk_threads_leave ();
+    g_usleep ( 10000 );
+    gdk_threads_enter ();
+  }
+}
+
 /**
  * a_background_show_window:
  *
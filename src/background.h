@@ -37,6 +37,7 @@ void a_background_thread ( GtkWindow *parent, const gchar *message, vik_thr_func
 int a_background_thread_progress ( gpointer callbackdata, gdouble fraction );
 int a_background_testcancel ( gpointer callbackdata );
 void a_background_show_window ();
+void a_background_wait_all ();
 void a_background_init ();
 void a_background_uninit ();
 void a_background_add_window (VikWindow *vw);
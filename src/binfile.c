@@ -0,0 +1,783 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+
+#include "binfile.h"
+#include "viklayer.h"
+#include "vikgpslayer.h"
+#include "viktrwlayer.h"
+#include "viktreeview.h"
+#include "util.h"
+
+/* Compatibility */
+#if ! GLIB_CHECK_VERSION(2,22,0)
+#define g_mapped_file_unref g_mapped_file_free
+#endif
+
+/*
+ * The binary form of a Viking file, which is much quicker to load than the
+ *  text form as there is nothing to parse.
+ *
+ * After the header everything is in blocks of a tag, the length and then
+ *  the contents, each starting on an 8 byte boundary. So any block can be
+ *  skipped over without reading it, and the arrays in it can be used from
+ *  a mapping of the file as they are:
+ *
+ *  VIEWPORT
+ *  LAYER           type and visibility, then:
+ *    PARAMS        as from vik_layer_marshall_params_for_file()
+ *    TRW_DATA      only for TrackWaypoint layers:
+ *      WAYPOINT    as from vik_waypoint_marshall()
+ *      TRACK       count, flags and strings, then each column of #VikTrackColumns
+ *    LAYER         children of Aggregate and GPS layers
+ *
+ * Values are kept as they are in memory, so a file can only be read on
+ *  a machine with the same byte order and sizes, as checked by the header.
+ */
+
+#define BINFILE_VERSION 1
+#define BIN_BYTE_ORDER 0x01020304
+#define BIN_ALIGN 8
+
+enum {
+  BIN_BLOCK_VIEWPORT = 1,
+  BIN_BLOCK_LAYER,
+  BIN_BLOCK_PARAMS,
+  BIN_BLOCK_TRW_DATA,
+  BIN_BLOCK_WAYPOINT,
+  BIN_BLOCK_TRACK,
+};
+
+typedef struct {
+  gchar magic[4];
+  guint32 version;
+  guint32 byte_order;
+  guint16 sizeof_waypoint;
+  guint8 sizeof_coord;
+  guint8 sizeof_time_t;
+} BinHeader;
+
+typedef struct {
+  guint32 tag;
+  guint32 reserved;
+  guint64 length; /* Of the contents, not including any padding after */
+} BinBlock;
+
+#define BIN_VIEWPORT_DRAW_SCALE      (1<<0)
+#define BIN_VIEWPORT_DRAW_CENTERMARK (1<<1)
+#define BIN_VIEWPORT_DRAW_HIGHLIGHT  (1<<2)
+#define BIN_VIEWPORT_TOP_VISIBLE     (1<<3)
+
+/* Followed by the background and highlight colors */
+typedef struct {
+  gdouble xmpp;
+  gdouble ympp;
+  gdouble lat;
+  gdouble lon;
+  gint32 mode;
+  guint32 flags;
+} BinViewport;
+
+typedef struct {
+  gint32 type;
+  gint32 visible;
+} BinLayer;
+
+#define BIN_TRACK_VISIBLE    (1<<0)
+#define BIN_TRACK_IS_ROUTE   (1<<1)
+#define BIN_TRACK_HAS_COLOR  (1<<2)
+#define BIN_TRACK_GPS_FIELDS (1<<3)
+
+/* Followed by the name, comment and description, then the columns */
+typedef struct {
+  guint32 n_points;
+  guint32 flags;
+  guint16 red;
+  guint16 green;
+  guint16 blue;
+  guint16 reserved;
+} BinTrack;
+
+/* Writing */
+
+static void write_padding ( FILE *f )
+{
+  static const gchar zeros[BIN_ALIGN] = { 0 };
+  long pos = ftell ( f );
+  if ( pos % BIN_ALIGN )
+    fwrite ( zeros, 1, BIN_ALIGN - pos % BIN_ALIGN, f );
+}
+
+/* Returns: Where the block starts, to be passed to end_block() */
+static long begin_block ( FILE *f, guint32 tag )
+{
+  BinBlock block = { tag, 0, 0 };
+  long start;
+  write_padding ( f );
+  start = ftell ( f );
+  fwrite ( &block, sizeof(block), 1, f );
+  return start;
+}
+
+/* Go back and fill in the length once the contents are written */
+static void end_block ( FILE *f, long start )
+{
+  long end = ftell ( f );
+  guint64 length = end - start - sizeof(BinBlock);
+  fseek ( f, start + G_STRUCT_OFFSET(BinBlock, length), SEEK_SET );
+  fwrite ( &length, sizeof(length), 1, f );
+  fseek ( f, end, SEEK_SET );
+}
+
+static void write_string ( FILE *f, const gchar *s )
+{
+  guint32 len = s ? strlen ( s ) + 1 : 0;
+  fwrite ( &len, sizeof(len), 1, f );
+  if ( len )
+    fwrite ( s, 1, len, f );
+}
+
+static void write_column ( FILE *f, gconstpointer data, gsize size )
+{
+  write_padding ( f );
+  if ( size )
+    fwrite ( data, 1, size, f );
+}
+
+static void write_viewport ( FILE *f, VikAggregateLayer *top, VikViewport *vp )
+{
+  BinViewport bv;
+  struct LatLon ll;
+  long start = begin_block ( f, BIN_BLOCK_VIEWPORT );
+
+  vik_coord_to_latlon ( vik_viewport_get_center ( vp ), &ll );
+  memset ( &bv, 0, sizeof(bv) );
+  bv.xmpp = vik_viewport_get_xmpp ( vp );
+  bv.ympp = vik_viewport_get_ympp ( vp );
+  bv.lat = ll.lat;
+  bv.lon = ll.lon;
+  bv.mode = vik_viewport_get_drawmode ( vp );
+  bv.flags = (vik_viewport_get_draw_scale ( vp ) ? BIN_VIEWPORT_DRAW_SCALE : 0) |
+             (vik_viewport_get_draw_centermark ( vp ) ? BIN_VIEWPORT_DRAW_CENTERMARK : 0) |
+             (vik_viewport_get_draw_highlight ( vp ) ? BIN_VIEWPORT_DRAW_HIGHLIGHT : 0) |
+             (VIK_LAYER(top)->visible ? BIN_VIEWPORT_TOP_VISIBLE : 0);
+  fwrite ( &bv, sizeof(bv), 1, f );
+  write_string ( f, vik_viewport_get_background_color ( vp ) );
+  write_string ( f, vik_viewport_get_highlight_color ( vp ) );
+
+  end_block ( f, start );
+}
+
+static void write_waypoint ( gpointer id, VikWaypoint *wp, FILE *f )
+{
+  guint8 *data;
+  guint len;
+  long start = begin_block ( f, BIN_BLOCK_WAYPOINT );
+
+  vik_waypoint_marshall ( wp, &data, &len );
+  fwrite ( data, 1, len, f );
+  g_free ( data );
+
+  end_block ( f, start );
+}
+
+static void write_track ( gpointer id, VikTrack *trk, FILE *f )
+{
+  VikTrackColumns *cols = vik_track_columns_new_from_track ( trk );
+  guint n = cols->n_points;
+  BinTrack bt;
+  long start = begin_block ( f, BIN_BLOCK_TRACK );
+
+  memset ( &bt, 0, sizeof(bt) );
+  bt.n_points = n;
+  bt.flags = (trk->visible ? BIN_TRACK_VISIBLE : 0) |
+             (trk->is_route ? BIN_TRACK_IS_ROUTE : 0) |
+             (trk->has_color ? BIN_TRACK_HAS_COLOR : 0) |
+             (cols->speeds ? BIN_TRACK_GPS_FIELDS : 0);
+  bt.red = trk->color.red;
+  bt.green = trk->color.green;
+  bt.blue = trk->color.blue;
+  fwrite ( &bt, sizeof(bt), 1, f );
+  write_string ( f, trk->name );
+  write_string ( f, trk->comment );
+  write_string ( f, trk->description );
+
+  write_column ( f, cols->coords, n * sizeof(VikCoord) );
+  write_column ( f, cols->timestamps, n * sizeof(time_t) );
+  write_column ( f, cols->altitudes, n * sizeof(gdouble) );
+  write_column ( f, cols->flags, n * sizeof(guint8) );
+  if ( cols->speeds ) {
+    write_column ( f, cols->speeds, n * sizeof(gdouble) );
+    write_column ( f, cols->courses, n * sizeof(gdouble) );
+    write_column ( f, cols->nsats, n * sizeof(guint16) );
+    write_column ( f, cols->fix_modes, n * sizeof(gint8) );
+    write_column ( f, cols->hdops, n * sizeof(gdouble) );
+    write_column ( f, cols->vdops, n * sizeof(gdouble) );
+    write_column ( f, cols->pdops, n * sizeof(gdouble) );
+  }
+
+  end_block ( f, start );
+  vik_track_columns_free ( cols );
+}
+
+static void write_layer ( FILE *f, VikLayer *vl )
+{
+  BinLayer bl = { vl->type, vl->visible };
+  const GList *children = NULL;
+  guint8 *data;
+  gint len;
+  long start = begin_block ( f, BIN_BLOCK_LAYER );
+  long sub;
+
+  fwrite ( &bl, sizeof(bl), 1, f );
+
+  sub = begin_block ( f, BIN_BLOCK_PARAMS );
+  vik_layer_marshall_params_for_file ( vl, &data, &len );
+  fwrite ( data, 1, len, f );
+  g_free ( data );
+  end_block ( f, sub );
+
+  if ( vl->type == VIK_LAYER_TRW ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(vl);
+    sub = begin_block ( f, BIN_BLOCK_TRW_DATA );
+    g_hash_table_foreach ( vik_trw_layer_get_waypoints ( vtl ), (GHFunc) write_waypoint, f );
+    g_hash_table_foreach ( vik_trw_layer_get_tracks ( vtl ), (GHFunc) write_track, f );
+    g_hash_table_foreach ( vik_trw_layer_get_routes ( vtl ), (GHFunc) write_track, f );
+    end_block ( f, sub );
+  }
+  else if ( vl->type == VIK_LAYER_AGGREGATE )
+    children = vik_aggregate_layer_get_children ( VIK_AGGREGATE_LAYER(vl) );
+  else if ( vl->type == VIK_LAYER_GPS )
+    children = vik_gps_layer_get_children ( VIK_GPS_LAYER(vl) );
+
+  for ( ; children; children = children->next )
+    write_layer ( f, VIK_LAYER(children->data) );
+
+  end_block ( f, start );
+}
+
+/**
+ * a_binfile_write:
+ * @f: Must be a file that can be seeked in
+ *
+ * Returns: FALSE if writing failed
+ */
+gboolean a_binfile_write ( VikAggregateLayer *top, VikViewport *vp, FILE *f )
+{
+  BinHeader header;
+  const GList *children;
+
+  memset ( &header, 0, sizeof(header) );
+  memcpy ( header.magic, BINFILE_MAGIC, sizeof(header.magic) );
+  header.version = BINFILE_VERSION;
+  header.byte_order = BIN_BYTE_ORDER;
+  header.sizeof_waypoint = sizeof(VikWaypoint);
+  header.sizeof_coord = sizeof(VikCoord);
+  header.sizeof_time_t = sizeof(time_t);
+  fwrite ( &header, sizeof(header), 1, f );
+
+  write_viewport ( f, top, vp );
+
+  for ( children = vik_aggregate_layer_get_children ( top ); children; children = children->next )
+    write_layer ( f, VIK_LAYER(children->data) );
+
+  return fflush ( f ) == 0 && ! ferror ( f );
+}
+
+/* Reading */
+
+typedef struct {
+  const guint8 *base; /* Start of the file, for alignment */
+  const guint8 *p;
+  const guint8 *end;
+  gboolean bad;       /* Something ran past the end */
+} BinReader;
+
+static gconstpointer bin_read ( BinReader *r, gsize size )
+{
+  const guint8 *p = r->p;
+  if ( size > (gsize) (r->end - r->p) ) {
+    r->p = r->end;
+    r->bad = TRUE;
+    return NULL;
+  }
+  r->p += size;
+  return p;
+}
+
+static void bin_align ( BinReader *r )
+{
+  gsize pad = (BIN_ALIGN - (r->p - r->base) % BIN_ALIGN) % BIN_ALIGN;
+  r->p = pad < (gsize) (r->end - r->p) ? r->p + pad : r->end;
+}
+
+static gconstpointer bin_read_column ( BinReader *r, gsize size )
+{
+  bin_align ( r );
+  return bin_read ( r, size );
+}
+
+static gchar *bin_read_string ( BinReader *r )
+{
+  const guint8 *p = bin_read ( r, sizeof(guint32) );
+  const gchar *s;
+  guint32 len;
+
+  if ( ! p )
+    return NULL;
+  memcpy ( &len, p, sizeof(len) );
+  if ( len == 0 )
+    return NULL;
+  s = bin_read ( r, len );
+  if ( ! s || s[len-1] != '\0' ) {
+    r->bad = TRUE;
+    return NULL;
+  }
+  return g_strdup ( s );
+}
+
+/**
+ * bin_next_block:
+ * @sub: Set to read the contents of the block
+ *
+ * Returns: FALSE at the end of @r
+ */
+static gboolean bin_next_block ( BinReader *r, guint32 *tag, BinReader *sub )
+{
+  const BinBlock *block;
+
+  bin_align ( r );
+  if ( r->p == r->end )
+    return FALSE;
+  if ( ! ( block = bin_read ( r, sizeof(BinBlock) ) ) )
+    return FALSE;
+  if ( block->length > (guint64) (r->end - r->p) ) {
+    r->p = r->end;
+    r->bad = TRUE;
+    return FALSE;
+  }
+
+  *tag = block->tag;
+  sub->base = r->base;
+  sub->p = r->p;
+  sub->end = r->p + block->length;
+  sub->bad = FALSE;
+  r->p = sub->end;
+  return TRUE;
+}
+
+static gboolean read_viewport ( BinReader *r, VikViewport *vp, gboolean *top_visible )
+{
+  const BinViewport *bv = bin_read ( r, sizeof(BinViewport) );
+  gchar *color;
+  struct LatLon ll;
+
+  if ( ! bv )
+    return FALSE;
+
+  if ( bv->mode >= 0 && bv->mode < VIK_VIEWPORT_NUM_DRAWMODES )
+    vik_viewport_set_drawmode ( vp, bv->mode );
+  vik_viewport_set_xmpp ( vp, bv->xmpp );
+  vik_viewport_set_ympp ( vp, bv->ympp );
+  vik_viewport_set_draw_scale ( vp, (bv->flags & BIN_VIEWPORT_DRAW_SCALE) != 0 );
+  vik_viewport_set_draw_centermark ( vp, (bv->flags & BIN_VIEWPORT_DRAW_CENTERMARK) != 0 );
+  vik_viewport_set_draw_highlight ( vp, (bv->flags & BIN_VIEWPORT_DRAW_HIGHLIGHT) != 0 );
+  *top_visible = (bv->flags & BIN_VIEWPORT_TOP_VISIBLE) != 0;
+
+  if ( ( color = bin_read_string ( r ) ) ) {
+    vik_viewport_set_background_color ( vp, color );
+    g_free ( color );
+  }
+  if ( ( color = bin_read_string ( r ) ) ) {
+    vik_viewport_set_highlight_color ( vp, color );
+    g_free ( color );
+  }
+
+  if ( bv->lat != 0.0 || bv->lon != 0.0 ) {
+    ll.lat = bv->lat;
+    ll.lon = bv->lon;
+    vik_viewport_set_center_latlon ( vp, &ll );
+  }
+  return ! r->bad;
+}
+
+/* The trackpoints are made straight from the columns in the file */
+static VikTrack *read_track ( BinReader *r )
+{
+  const BinTrack *bt = bin_read ( r, sizeof(BinTrack) );
+  VikTrackColumns cols;
+  VikTrack *trk;
+  guint n;
+
+  if ( ! bt )
+    return NULL;
+  n = bt->n_points;
+  // Make sure the sizes below can't overflow
+  if ( n > (gsize) (r->end - r->p) / sizeof(VikCoord) ) {
+    r->bad = TRUE;
+    return NULL;
+  }
+
+  trk = vik_track_new ();
+  trk->visible = (bt->flags & BIN_TRACK_VISIBLE) != 0;
+  trk->is_route = (bt->flags & BIN_TRACK_IS_ROUTE) != 0;
+  trk->has_color = (bt->flags & BIN_TRACK_HAS_COLOR) != 0;
+  trk->color.red = bt->red;
+  trk->color.green = bt->green;
+  trk->color.blue = bt->blue;
+  trk->name = bin_read_string ( r );
+  trk->comment = bin_read_string ( r );
+  trk->description = bin_read_string ( r );
+
+  memset ( &cols, 0, sizeof(cols) );
+  cols.n_points = cols.n_allocated = n;
+  cols.coords = (VikCoord *) bin_read_column ( r, n * sizeof(VikCoord) );
+  cols.timestamps = (time_t *) bin_read_column ( r, n * sizeof(time_t) );
+  cols.altitudes = (gdouble *) bin_read_column ( r, n * sizeof(gdouble) );
+  cols.flags = (guint8 *) bin_read_column ( r, n * sizeof(guint8) );
+  if ( bt->flags & BIN_TRACK_GPS_FIELDS ) {
+    cols.speeds = (gdouble *) bin_read_column ( r, n * sizeof(gdouble) );
+    cols.courses = (gdouble *) bin_read_column ( r, n * sizeof(gdouble) );
+    cols.nsats = (guint16 *) bin_read_column ( r, n * sizeof(guint16) );
+    cols.fix_modes = (gint8 *) bin_read_column ( r, n * sizeof(gint8) );
+    cols.hdops = (gdouble *) bin_read_column ( r, n * sizeof(gdouble) );
+    cols.vdops = (gdouble *) bin_read_column ( r, n * sizeof(gdouble) );
+    cols.pdops = (gdouble *) bin_read_column ( r, n * sizeof(gdouble) );
+  }
+
+  if ( r->bad ) {
+    vik_track_free ( trk );
+    return NULL;
+  }
+  trk->trackpoints = vik_track_columns_to_trackpoints ( &cols );
+  return trk;
+}
+
+/* Parallel reading of tracks */
+
+typedef struct {
+  GMutex *mutex;
+  GCond *cond;
+  guint left;
+} TrackBatch;
+
+typedef struct {
+  TrackBatch *batch;
+  BinReader r;
+  VikTrack *trk;
+} TrackJob;
+
+static GThreadPool *track_pool = NULL;
+static GStaticMutex track_pool_mutex = G_STATIC_MUTEX_INIT;
+
+static void track_job_thread ( TrackJob *job, gpointer user_data )
+{
+  TrackBatch *batch = job->batch;
+
+  job->trk = read_track ( &job->r );
+
+  g_mutex_lock ( batch->mutex );
+  if ( --batch->left == 0 )
+    g_cond_signal ( batch->cond );
+  g_mutex_unlock ( batch->mutex );
+}
+
+static void read_tracks ( TrackJob *jobs, guint n )
+{
+  TrackBatch batch;
+  guint i;
+
+  if ( n < 2 || ! g_thread_supported () ) {
+    for ( i = 0; i < n; i++ )
+      jobs[i].trk = read_track ( &jobs[i].r );
+    return;
+  }
+
+  g_static_mutex_lock ( &track_pool_mutex );
+  if ( ! track_pool )
+    track_pool = g_thread_pool_new ( (GFunc) track_job_thread, NULL, util_get_number_of_cpus(), FALSE, NULL );
+  g_static_mutex_unlock ( &track_pool_mutex );
+
+  batch.mutex = g_mutex_new ();
+  batch.cond = g_cond_new ();
+  batch.left = n;
+
+  for ( i = 0; i < n; i++ ) {
+    jobs[i].batch = &batch;
+    g_thread_pool_push ( track_pool, &jobs[i], NULL );
+  }
+
+  g_mutex_lock ( batch.mutex );
+  while ( batch.left )
+    g_cond_wait ( batch.cond, batch.mutex );
+  g_mutex_unlock ( batch.mutex );
+
+  g_cond_free ( batch.cond );
+  g_mutex_free ( batch.mutex );
+}
+
+/*
+ * Whether the waypoint in r, as from vik_waypoint_marshall(), lies within it.
+ * The name, comment, description, image and symbol each follow the
+ *  waypoint as a length and then that many bytes ending in a nul.
+ */
+static gboolean bin_check_waypoint ( BinReader r )
+{
+  const guint8 *p;
+  guint32 len;
+  guint i;
+
+  bin_read ( &r, sizeof(VikWaypoint) );
+  for ( i = 0; i < 5 && ! r.bad; i++ ) {
+    if ( ! ( p = bin_read ( &r, sizeof(len) ) ) )
+      break;
+    memcpy ( &len, p, sizeof(len) );
+    if ( len && ( p = bin_read ( &r, len ) ) && p[len-1] != '\0' )
+      r.bad = TRUE;
+  }
+  return ! r.bad;
+}
+
+/* Reads a length and skips that many bytes, of at most max */
+static void bin_skip_sized ( BinReader *r, gsize max )
+{
+  const guint8 *p = bin_read ( r, sizeof(gint) );
+  gint len;
+
+  if ( ! p )
+    return;
+  memcpy ( &len, p, sizeof(len) );
+  if ( len < 0 || (gsize) len > max )
+    r->bad = TRUE;
+  else
+    bin_read ( r, len );
+}
+
+/*
+ * Whether the parameters in r, as from vik_layer_marshall_params_for_file(),
+ *  lie within it: the name and then each parameter of the layer type, each
+ *  as a length and that many bytes, and string lists as a count of those.
+ */
+static gboolean bin_check_params ( BinReader r, VikLayerTypeEnum type )
+{
+  VikLayerInterface *iface = vik_layer_get_interface ( type );
+  const guint8 *p;
+  guint16 i;
+  gint j, n;
+
+  bin_skip_sized ( &r, G_MAXINT );
+  if ( ! iface->params || ! iface->set_param )
+    return ! r.bad;
+
+  for ( i = 0; i < iface->params_count && ! r.bad; i++ ) {
+    switch ( iface->params[i].type ) {
+      case VIK_LAYER_PARAM_STRING:
+        bin_skip_sized ( &r, G_MAXINT );
+        break;
+      case VIK_LAYER_PARAM_STRING_LIST:
+        if ( ! ( p = bin_read ( &r, sizeof(n) ) ) )
+          break;
+        memcpy ( &n, p, sizeof(n) );
+        if ( n < 0 )
+          r.bad = TRUE;
+        for ( j = 0; j < n && ! r.bad; j++ )
+          bin_skip_sized ( &r, G_MAXINT );
+        break;
+      default:
+        bin_skip_sized ( &r, sizeof(VikLayerParamData) );
+        break;
+    }
+  }
+  return ! r.bad;
+}
+
+static gboolean read_trw_data ( BinReader *r, VikTrwLayer *vtl )
+{
+  GArray *jobs = g_array_new ( FALSE, TRUE, sizeof(TrackJob) );
+  gboolean ok = TRUE;
+  BinReader sub;
+  guint32 tag;
+  guint i;
+
+  while ( bin_next_block ( r, &tag, &sub ) ) {
+    if ( tag == BIN_BLOCK_WAYPOINT ) {
+      VikWaypoint *wp;
+      gchar *name;
+      if ( ! bin_check_waypoint ( sub ) ) {
+        ok = FALSE;
+        continue;
+      }
+      wp = vik_waypoint_unmarshall ( (guint8 *) sub.p, sub.end - sub.p );
+      name = g_strdup ( wp->name );
+      vik_trw_layer_add_waypoint ( vtl, name, wp );
+      g_free ( name );
+    }
+    else if ( tag == BIN_BLOCK_TRACK ) {
+      TrackJob job = { NULL, sub, NULL };
+      g_array_append_val ( jobs, job );
+    }
+  }
+
+  read_tracks ( (TrackJob *) jobs->data, jobs->len );
+
+  // Added here rather than by each job, as the layer is not to be used from other threads
+  for ( i = 0; i < jobs->len; i++ ) {
+    VikTrack *trk = g_array_index ( jobs, TrackJob, i ).trk;
+    gchar *name;
+    if ( ! trk ) {
+      ok = FALSE;
+      continue;
+    }
+    name = g_strdup ( trk->name );
+    if ( trk->is_route )
+      vik_trw_layer_add_route ( vtl, name, trk );
+    else
+      vik_trw_layer_add_track ( vtl, name, trk );
+    g_free ( name );
+  }
+
+  g_array_free ( jobs, TRUE );
+  return ok && ! r->bad;
+}
+
+static gboolean read_layer ( BinReader *r, VikLayer *parent, VikViewport *vp )
+{
+  const BinLayer *bl = bin_read ( r, sizeof(BinLayer) );
+  gboolean ok = TRUE;
+  VikLayer *vl;
+  BinReader sub;
+  guint32 tag;
+
+  if ( ! bl )
+    return FALSE;
+  if ( bl->type < 0 || bl->type >= VIK_LAYER_NUM_TYPES ) {
+    g_warning ( "%s: Unknown layer type %d", __FUNCTION__, bl->type );
+    return FALSE;
+  }
+
+  if ( parent->type == VIK_LAYER_GPS ) {
+    if ( bl->type != VIK_LAYER_TRW ) {
+      g_warning ( "%s: Layer type %d inside a GPS layer", __FUNCTION__, bl->type );
+      return FALSE;
+    }
+    vl = VIK_LAYER(vik_gps_layer_get_a_child ( VIK_GPS_LAYER(parent) ));
+  }
+  else
+    vl = vik_layer_create ( bl->type, vp, NULL, FALSE );
+  vl->visible = bl->visible;
+
+  while ( bin_next_block ( r, &tag, &sub ) ) {
+    switch ( tag ) {
+      case BIN_BLOCK_PARAMS:
+        if ( bin_check_params ( sub, vl->type ) )
+          vik_layer_unmarshall_params_for_file ( vl, (guint8 *) sub.p, sub.end - sub.p, vp );
+        else
+          ok = FALSE;
+        break;
+      case BIN_BLOCK_TRW_DATA:
+        if ( vl->type == VIK_LAYER_TRW && ! read_trw_data ( &sub, VIK_TRW_LAYER(vl) ) )
+          ok = FALSE;
+        break;
+      case BIN_BLOCK_LAYER:
+        if ( vl->type != VIK_LAYER_AGGREGATE && vl->type != VIK_LAYER_GPS ) {
+          g_warning ( "%s: Layer inside non-Aggregate Layer (type %d)", __FUNCTION__, vl->type );
+          ok = FALSE;
+        }
+        else if ( ! read_layer ( &sub, vl, vp ) )
+          ok = FALSE;
+        break;
+      default:
+        // Skip over anything from a later version
+        break;
+    }
+  }
+
+  if ( parent->type == VIK_LAYER_AGGREGATE ) {
+    vik_aggregate_layer_add_layer ( VIK_AGGREGATE_LAYER(parent), vl );
+    vik_layer_post_read ( vl, vp, TRUE );
+  }
+  return ok && ! r->bad;
+}
+
+/**
+ * a_binfile_read:
+ *
+ * Read in a file written by a_binfile_write(), adding its layers to @top.
+ * The file is mapped into memory rather than read, and the tracks are
+ *  made from it in parallel.
+ */
+VikLoadType_t a_binfile_read ( VikAggregateLayer *top, VikViewport *vp, const gchar *filename )
+{
+  GMappedFile *mf;
+  const BinHeader *header;
+  BinReader r, sub;
+  gboolean ok = TRUE;
+  gboolean top_visible = VIK_LAYER(top)->visible;
+  guint32 tag;
+
+  if ( ! ( mf = g_mapped_file_new ( filename, FALSE, NULL ) ) )
+    return LOAD_TYPE_READ_FAILURE;
+
+  r.base = r.p = (const guint8 *) g_mapped_file_get_contents ( mf );
+  r.end = r.p + g_mapped_file_get_length ( mf );
+  r.bad = FALSE;
+
+  header = bin_read ( &r, sizeof(BinHeader) );
+  if ( ! header || memcmp ( header->magic, BINFILE_MAGIC, sizeof(header->magic) ) != 0 ) {
+    g_mapped_file_unref ( mf );
+    return LOAD_TYPE_UNSUPPORTED_FAILURE;
+  }
+  if ( header->byte_order != BIN_BYTE_ORDER ||
+       header->sizeof_waypoint != sizeof(VikWaypoint) ||
+       header->sizeof_coord != sizeof(VikCoord) ||
+       header->sizeof_time_t != sizeof(time_t) ) {
+    g_warning ( "%s: %s was written on an incompatible system", __FUNCTION__, filename );
+    g_mapped_file_unref ( mf );
+    return LOAD_TYPE_UNSUPPORTED_FAILURE;
+  }
+  g_debug ( "%s: reading file version %d", __FUNCTION__, header->version );
+  // However we'll still carry on and attempt to read whatever we can
+  if ( header->version > BINFILE_VERSION )
+    ok = FALSE;
+
+  while ( bin_next_block ( &r, &tag, &sub ) ) {
+    if ( tag == BIN_BLOCK_VIEWPORT ) {
+      if ( ! read_viewport ( &sub, vp, &top_visible ) )
+        ok = FALSE;
+    }
+    else if ( tag == BIN_BLOCK_LAYER ) {
+      if ( ! read_layer ( &sub, VIK_LAYER(top), vp ) )
+        ok = FALSE;
+    }
+  }
+  if ( r.bad )
+    ok = FALSE;
+
+  VIK_LAYER(top)->visible = top_visible;
+  if ( ( ! VIK_LAYER(top)->visible ) && VIK_LAYER(top)->realized )
+    vik_treeview_item_set_visible ( VIK_LAYER(top)->vt, &(VIK_LAYER(top)->iter), FALSE );
+
+  g_mapped_file_unref ( mf );
+  return ok ? LOAD_TYPE_VIK_SUCCESS : LOAD_TYPE_VIK_FAILURE_NON_FATAL;
+}
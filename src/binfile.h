@@ -0,0 +1,40 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_BINFILE_H
+#define _VIKING_BINFILE_H
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "file.h"
+#include "vikaggregatelayer.h"
+#include "vikviewport.h"
+
+G_BEGIN_DECLS
+
+/* Same length as the magic of the text format */
+#define BINFILE_MAGIC "VIKB"
+#define BINFILE_EXT ".vikb"
+
+gboolean a_binfile_write ( VikAggregateLayer *top, VikViewport *vp, FILE *f );
+VikLoadType_t a_binfile_read ( VikAggregateLayer *top, VikViewport *vp, const gchar *filename );
+
+G_END_DECLS
+
+#endif
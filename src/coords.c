@@ -68,6 +68,24 @@ char *a_coords_dtostr ( double d )
   return buffer;
 }
 
+/**
+ * As a_coords_dtostr(), but into the given buffer, and with only
+ *  as many digits as are needed to read back the same value.
+ *
+ * So 45.1 is written as such, rather than as 45.100000000000001
+ */
+void a_coords_dtostr_buffer ( double d, char buffer[G_ASCII_DTOSTR_BUF_SIZE] )
+{
+  /* Most values are read from text with no more than 15 digits */
+  g_ascii_formatd ( buffer, G_ASCII_DTOSTR_BUF_SIZE, "%.15g", d );
+  if ( g_ascii_strtod ( buffer, NULL ) == d )
+    return;
+  g_ascii_formatd ( buffer, G_ASCII_DTOSTR_BUF_SIZE, "%.16g", d );
+  if ( g_ascii_strtod ( buffer, NULL ) == d )
+    return;
+  g_ascii_dtostr ( buffer, G_ASCII_DTOSTR_BUF_SIZE, d );
+}
+
 #define PIOVER180 0.01745329252
 
 #define K0 0.9996
@@ -85,7 +103,7 @@ int a_coords_utm_equal( const struct UTM *utm1, const struct UTM *utm2 )
 
 double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 )
 {
-  static struct LatLon tmp1, tmp2;
+  struct LatLon tmp1, tmp2;
   if ( utm1->zone == utm2->zone ) {
     return sqrt ( pow ( utm1->easting - utm2->easting, 2 ) + pow ( utm1->northing - utm2->northing, 2 ) );
   } else {
@@ -97,7 +115,7 @@ double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 )
 
 double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 )
 {
-  static struct LatLon tmp1, tmp2;
+  struct LatLon tmp1, tmp2;
   gdouble tmp3;
   tmp1.lat = ll1->lat * PIOVER180;
   tmp1.lon = ll1->lon * PIOVER180;
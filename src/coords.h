@@ -66,6 +66,7 @@ double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2
  * The returned value must be freed by g_free.
  */
 char *a_coords_dtostr ( double d );
+void a_coords_dtostr_buffer ( double d, char buffer[G_ASCII_DTOSTR_BUF_SIZE] );
 
 /**
  * Convert a LatLon to strings.
@@ -113,19 +113,14 @@ void curl_download_uninit()
   curl_global_cleanup();
 }
 
-int curl_download_uri ( const char *uri, FILE *f, DownloadMapOptions *options, DownloadFileOptions *file_options, void *handle )
+/**
+ * Set up the handle for transferring the uri into the file
+ * Any additional headers are returned in curl_send_headers, to be freed after the transfer
+ */
+static void curl_download_setup ( CURL *curl, const char *uri, FILE *f, DownloadMapOptions *options, DownloadFileOptions *file_options, struct curl_slist **curl_send_headers )
 {
-  CURL *curl;
-  struct curl_slist *curl_send_headers = NULL;
-  CURLcode res = CURLE_FAILED_INIT;
   const gchar *cookie_file;
 
-  g_debug("%s: uri=%s", __PRETTY_FUNCTION__, uri);
-
-  curl = handle ? handle : curl_easy_init ();
-  if ( !curl ) {
-    return DOWNLOAD_ERROR;
-  }
   if (vik_verbose)
     curl_easy_setopt ( curl, CURLOPT_VERBOSE, 1 );
   curl_easy_setopt ( curl, CURLOPT_NOSIGNAL, 1 ); // Yep, we're a multi-threaded program so don't let signals mess it up!
@@ -157,8 +152,8 @@ int curl_download_uri ( const char *uri, FILE *f, DownloadMapOptions *options, D
           /* add an header on the HTTP request */
           char str[60];
           g_snprintf(str, 60, "If-None-Match: %s", file_options->etag);
-          curl_send_headers = curl_slist_append(curl_send_headers, str);
-          curl_easy_setopt ( curl, CURLOPT_HTTPHEADER , curl_send_headers);
+          *curl_send_headers = curl_slist_append(*curl_send_headers, str);
+          curl_easy_setopt ( curl, CURLOPT_HTTPHEADER , *curl_send_headers);
         }
         /* store the new etag from the server in an option value */
         curl_easy_setopt ( curl, CURLOPT_WRITEHEADER, &(file_options->new_etag));
@@ -169,13 +164,18 @@ int curl_download_uri ( const char *uri, FILE *f, DownloadMapOptions *options, D
   curl_easy_setopt ( curl, CURLOPT_USERAGENT, curl_download_user_agent );
   if ((cookie_file = get_cookie_file(FALSE)) != NULL)
     curl_easy_setopt(curl, CURLOPT_COOKIEFILE, cookie_file);
-  res = curl_easy_perform ( curl );
+}
 
+/**
+ * Convert the outcome of a transfer into one of the DOWNLOAD_* values
+ */
+static int curl_download_result ( CURL *curl, CURLcode res, const char *uri )
+{
   if (res == 0) {
     glong response;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
     if (response == 304) {         // 304 = Not Modified
-      res = DOWNLOAD_NO_NEWER_FILE;
+      return DOWNLOAD_NO_NEWER_FILE;
     } else if (response == 200 ||  // http: 200 = Ok
                response == 226) {  // ftp:  226 = sucess
       gdouble size;
@@ -183,16 +183,32 @@ int curl_download_uri ( const char *uri, FILE *f, DownloadMapOptions *options, D
          when the server has a (incorrect) time earlier than the time on the file we already have */
       curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &size);
       if (size == 0)
-        res = DOWNLOAD_ERROR;
+        return DOWNLOAD_ERROR;
       else
-        res = DOWNLOAD_NO_ERROR;
+        return DOWNLOAD_NO_ERROR;
     } else {
       g_warning("%s: http response: %ld for uri %s\n", __FUNCTION__, response, uri);
-      res = DOWNLOAD_ERROR;
+      return DOWNLOAD_ERROR;
     }
-  } else {
-    res = DOWNLOAD_ERROR;
   }
+  return DOWNLOAD_ERROR;
+}
+
+int curl_download_uri ( const char *uri, FILE *f, DownloadMapOptions *options, DownloadFileOptions *file_options, void *handle )
+{
+  CURL *curl;
+  struct curl_slist *curl_send_headers = NULL;
+  int res;
+
+  g_debug("%s: uri=%s", __PRETTY_FUNCTION__, uri);
+
+  curl = handle ? handle : curl_easy_init ();
+  if ( !curl ) {
+    return DOWNLOAD_ERROR;
+  }
+  curl_download_setup ( curl, uri, f, options, file_options, &curl_send_headers );
+  res = curl_download_result ( curl, curl_easy_perform ( curl ), uri );
+
   if (!handle)
      curl_easy_cleanup ( curl );
   if (curl_send_headers) {
@@ -226,3 +242,156 @@ void curl_download_handle_cleanup ( void *handle )
 {
   curl_easy_cleanup(handle);
 }
+
+/*
+ * Several transfers running at the same time, driven by the curl multi interface.
+ * Transfers share the multi handle's connection cache, so connections to a host get reused.
+ */
+struct _CurlDownloadMulti {
+  CURLM *multi;
+  GList *transfers;
+};
+
+typedef struct {
+  CURL *curl;
+  gchar *uri;
+  struct curl_slist *curl_send_headers;
+  CurlDownloadMultiFunc func;
+  gpointer user_data;
+} CurlDownloadTransfer;
+
+/**
+ * curl_download_multi_new:
+ * @max_host_connections: Maximum number of connections to open to the same host
+ */
+CurlDownloadMulti *curl_download_multi_new ( guint max_host_connections )
+{
+  CurlDownloadMulti *cdm = g_new0 ( CurlDownloadMulti, 1 );
+  cdm->multi = curl_multi_init ();
+  curl_multi_setopt ( cdm->multi, CURLMOPT_MAXCONNECTS, (long) max_host_connections );
+#if LIBCURL_VERSION_NUM >= 0x071e00
+  curl_multi_setopt ( cdm->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) max_host_connections );
+#endif
+  return cdm;
+}
+
+/**
+ * curl_download_multi_add:
+ * @func: Called with the DOWNLOAD_* result once the transfer has finished (or been aborted)
+ *
+ * Start transferring the uri into the file.
+ * The file (and any options) must remain valid until @func has been called.
+ *
+ * Returns: FALSE if the transfer couldn't be started, in which case @func is not called.
+ */
+gboolean curl_download_multi_add ( CurlDownloadMulti *cdm, const char *uri, FILE *f, DownloadMapOptions *options, DownloadFileOptions *file_options, CurlDownloadMultiFunc func, gpointer user_data )
+{
+  CurlDownloadTransfer *cdt;
+  CURL *curl;
+
+  g_debug("%s: uri=%s", __PRETTY_FUNCTION__, uri);
+
+  curl = curl_easy_init ();
+  if ( !curl )
+    return FALSE;
+
+  cdt = g_new0 ( CurlDownloadTransfer, 1 );
+  cdt->curl = curl;
+  cdt->uri = g_strdup ( uri );
+  cdt->func = func;
+  cdt->user_data = user_data;
+
+  curl_download_setup ( curl, uri, f, options, file_options, &cdt->curl_send_headers );
+  curl_easy_setopt ( curl, CURLOPT_PRIVATE, cdt );
+
+  if ( curl_multi_add_handle ( cdm->multi, curl ) != CURLM_OK ) {
+    curl_easy_cleanup ( curl );
+    if ( cdt->curl_send_headers )
+      curl_slist_free_all ( cdt->curl_send_headers );
+    g_free ( cdt->uri );
+    g_free ( cdt );
+    return FALSE;
+  }
+  cdm->transfers = g_list_prepend ( cdm->transfers, cdt );
+  return TRUE;
+}
+
+static void curl_download_multi_finish ( CurlDownloadMulti *cdm, CurlDownloadTransfer *cdt, int result )
+{
+  curl_multi_remove_handle ( cdm->multi, cdt->curl );
+  cdm->transfers = g_list_remove ( cdm->transfers, cdt );
+  curl_easy_cleanup ( cdt->curl );
+  if ( cdt->curl_send_headers )
+    curl_slist_free_all ( cdt->curl_send_headers );
+
+  cdt->func ( result, cdt->user_data );
+
+  g_free ( cdt->uri );
+  g_free ( cdt );
+}
+
+/**
+ * curl_download_multi_perform:
+ * @timeout_ms: Maximum time to wait for network activity
+ *
+ * Make progress on the transfers, calling the completion function of the finished ones.
+ *
+ * Returns: the number of transfers still in progress
+ */
+guint curl_download_multi_perform ( CurlDownloadMulti *cdm, gint timeout_ms )
+{
+  int running = 0;
+  int msgs_left;
+  CURLMsg *msg;
+  fd_set fdread, fdwrite, fdexcep;
+  int maxfd = -1;
+  long curl_timeout = -1;
+
+  while ( curl_multi_perform ( cdm->multi, &running ) == CURLM_CALL_MULTI_PERFORM )
+    ;
+
+  while ( (msg = curl_multi_info_read ( cdm->multi, &msgs_left )) ) {
+    if ( msg->msg == CURLMSG_DONE ) {
+      CurlDownloadTransfer *cdt = NULL;
+      curl_easy_getinfo ( msg->easy_handle, CURLINFO_PRIVATE, (char **)&cdt );
+      curl_download_multi_finish ( cdm, cdt, curl_download_result ( cdt->curl, msg->data.result, cdt->uri ) );
+    }
+  }
+
+  if ( running == 0 )
+    return g_list_length ( cdm->transfers );
+
+  /* Wait for some activity */
+  FD_ZERO ( &fdread );
+  FD_ZERO ( &fdwrite );
+  FD_ZERO ( &fdexcep );
+  curl_multi_fdset ( cdm->multi, &fdread, &fdwrite, &fdexcep, &maxfd );
+  curl_multi_timeout ( cdm->multi, &curl_timeout );
+  if ( curl_timeout >= 0 && curl_timeout < timeout_ms )
+    timeout_ms = curl_timeout;
+
+  if ( maxfd == -1 )
+    /* Nothing to wait on yet (eg resolving host names) */
+    g_usleep ( 1000 * MIN(timeout_ms, 100) );
+  else {
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    select ( maxfd+1, &fdread, &fdwrite, &fdexcep, &tv );
+  }
+
+  return g_list_length ( cdm->transfers );
+}
+
+/**
+ * curl_download_multi_free:
+ *
+ * Transfers still in progress are aborted, with their completion function called with DOWNLOAD_ERROR.
+ */
+void curl_download_multi_free ( CurlDownloadMulti *cdm )
+{
+  while ( cdm->transfers )
+    curl_download_multi_finish ( cdm, cdm->transfers->data, DOWNLOAD_ERROR );
+  curl_multi_cleanup ( cdm->multi );
+  g_free ( cdm );
+}
@@ -35,6 +35,14 @@ int curl_download_uri ( const char *uri, FILE *f, DownloadMapOptions *options, D
 void * curl_download_handle_init ();
 void curl_download_handle_cleanup ( void * handle );
 
+typedef struct _CurlDownloadMulti CurlDownloadMulti;
+typedef void (*CurlDownloadMultiFunc) ( int result, gpointer user_data );
+
+CurlDownloadMulti *curl_download_multi_new ( guint max_host_connections );
+gboolean curl_download_multi_add ( CurlDownloadMulti *cdm, const char *uri, FILE *f, DownloadMapOptions *options, DownloadFileOptions *file_options, CurlDownloadMultiFunc func, gpointer user_data );
+guint curl_download_multi_perform ( CurlDownloadMulti *cdm, gint timeout_ms );
+void curl_download_multi_free ( CurlDownloadMulti *cdm );
+
 G_END_DECLS
 
 #endif
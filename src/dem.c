@@ -323,9 +323,13 @@ end:
 	return(unzip_data);
 }
 
+/*
+ * Samples are kept as they are in the file: for an uncompressed .hgt the grid
+ *  is the mapped file itself, so a tile costs no copy nor memory of its own
+ *  until its pages are used.
+ */
 static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basename, gboolean zip)
 {
-  gint i, j;
   VikDEM *dem;
   off_t file_size;
   gint16 *dem_mem = NULL;
@@ -337,7 +341,7 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
   gint arcsec;
   GError *error = NULL;
 
-  dem = g_malloc(sizeof(VikDEM));
+  dem = g_malloc0(sizeof(VikDEM));
 
   dem->horiz_units = VIK_DEM_HORIZ_LL_ARCSECONDS;
   dem->orig_vert_units = VIK_DEM_VERT_DECIMETERS;
@@ -353,9 +357,6 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
   dem->max_north = 3600 + dem->min_north;
   dem->max_east = 3600 + dem->min_east;
 
-  dem->columns = g_ptr_array_new();
-  dem->n_columns = 0;
-
   if ((mf = g_mapped_file_new(file_name, FALSE, &error)) == NULL) {
     g_critical(_("Couldn't map file %s: %s"), file_name, error->message);
     g_error_free(error);
@@ -369,9 +370,11 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
     void *unzip_mem = NULL;
     gulong ucsize;
 
-    if ((unzip_mem = unzip_hgt_file(dem_file, &ucsize)) == NULL) {
-      g_mapped_file_unref(mf);
-      g_ptr_array_free(dem->columns, TRUE);
+    unzip_mem = unzip_hgt_file(dem_file, &ucsize);
+    /* Only the uncompressed copy is needed from now on */
+    g_mapped_file_unref(mf);
+    mf = NULL;
+    if (unzip_mem == NULL) {
       g_free(dem);
       return NULL;
     }
@@ -388,35 +391,33 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
     arcsec = 1;
   else {
     g_warning("%s(): file %s does not have right size", __PRETTY_FUNCTION__, basename);
-    g_mapped_file_unref(mf);
+    if (zip)
+      g_free(dem_mem);
+    else
+      g_mapped_file_unref(mf);
     g_free(dem);
     return NULL;
   }
 
   num_rows = (arcsec == 3) ? num_rows_3sec : num_rows_1sec;
   dem->east_scale = dem->north_scale = arcsec;
+  dem->n_columns = dem->n_rows = num_rows;
+  dem->grid = dem_mem;
 
-  for ( i = 0; i < num_rows; i++ ) {
-    dem->n_columns++;
-    g_ptr_array_add ( dem->columns, g_malloc(sizeof(VikDEMColumn)) );
-    GET_COLUMN(dem,i)->east_west = dem->min_east + arcsec*i;
-    GET_COLUMN(dem,i)->south = dem->min_north;
-    GET_COLUMN(dem,i)->n_points = num_rows;
-    GET_COLUMN(dem,i)->points = g_malloc(sizeof(gint16)*num_rows);
+  if (zip) {
+    /* Our own copy: convert it once, in a loop simple enough to be vectorised */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    gint i, n = num_rows * num_rows;
+    for ( i = 0; i < n; i++ )
+      dem_mem[i] = GINT16_FROM_BE(dem_mem[i]);
+#endif
+    dem->grid_big_endian = FALSE;
   }
-
-  int ent = 0;
-  for ( i = (num_rows - 1); i >= 0; i-- ) {
-    for ( j = 0; j < num_rows; j++ ) {
-      GET_COLUMN(dem,j)->points[i] = GINT16_FROM_BE(dem_mem[ent]);
-      ent++;
-    }
-
+  else {
+    dem->mapped_file = mf;
+    dem->grid_big_endian = TRUE;
   }
 
-  if (zip)
-    g_free(dem_mem);
-  g_mapped_file_unref(mf);
   return dem;
 }
 
@@ -445,7 +446,7 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
   }
 
       /* Create Structure */
-  rv = g_malloc(sizeof(VikDEM));
+  rv = g_malloc0(sizeof(VikDEM));
 
       /* Header */
   f = g_fopen(file, "r");
@@ -504,20 +505,49 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
 void vik_dem_free ( VikDEM *dem )
 {
   guint i;
-  for ( i = 0; i < dem->n_columns; i++)
-    g_free ( GET_COLUMN(dem, i)->points );
-  g_ptr_array_free ( dem->columns, TRUE );
+  if ( dem->columns ) {
+    for ( i = 0; i < dem->n_columns; i++)
+      g_free ( GET_COLUMN(dem, i)->points );
+    g_ptr_array_free ( dem->columns, TRUE );
+  }
+  if ( dem->mapped_file )
+    g_mapped_file_unref ( dem->mapped_file );
+  else
+    g_free ( dem->grid );
   g_free ( dem );
 }
 
 gint16 vik_dem_get_xy ( VikDEM *dem, guint col, guint row )
 {
+  if ( dem->grid ) {
+    gint16 elev;
+    if ( col >= dem->n_columns || row >= dem->n_rows )
+      return VIK_DEM_INVALID_ELEVATION;
+    /* rows are counted from the south */
+    elev = dem->grid[(dem->n_rows - 1 - row) * dem->n_columns + col];
+    return dem->grid_big_endian ? GINT16_FROM_BE(elev) : elev;
+  }
+
   if ( col < dem->n_columns )
     if ( row < GET_COLUMN(dem, col)->n_points )
       return GET_COLUMN(dem, col)->points[row];
   return VIK_DEM_INVALID_ELEVATION;
 }
 
+/**
+ * vik_dem_get_n_points:
+ *
+ * Returns: the number of samples in the column, from the south
+ */
+guint vik_dem_get_n_points ( VikDEM *dem, guint col )
+{
+  if ( col >= dem->n_columns )
+    return 0;
+  if ( dem->grid )
+    return dem->n_rows;
+  return GET_COLUMN(dem, col)->n_points;
+}
+
 gint16 vik_dem_get_east_north ( VikDEM *dem, gdouble east, gdouble north )
 {
   gint col, row;
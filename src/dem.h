@@ -37,7 +37,13 @@ G_BEGIN_DECLS
 
 typedef struct {
   guint n_columns;
-  GPtrArray *columns;
+  GPtrArray *columns; /* of VikDEMColumn, NULL when the samples are in grid */
+
+  /* SRTM samples: a single row major array, northernmost row first as in the .hgt file */
+  gint16 *grid;
+  guint n_rows;
+  gboolean grid_big_endian; /* grid is the mapped file itself, so still needs byte swapping */
+  GMappedFile *mapped_file;
 
   guint8 horiz_units;
   guint8 orig_vert_units; /* original, always converted to meters when loading. */
@@ -66,6 +72,7 @@ typedef struct {
 VikDEM *vik_dem_new_from_file(const gchar *file);
 void vik_dem_free ( VikDEM *dem );
 gint16 vik_dem_get_xy ( VikDEM *dem, guint x, guint y );
+guint vik_dem_get_n_points ( VikDEM *dem, guint col );
 
 gint16 vik_dem_get_east_north ( VikDEM *dem, gdouble east, gdouble north );
 gint16 vik_dem_get_simple_interpol ( VikDEM *dem, gdouble east, gdouble north );
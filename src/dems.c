@@ -19,29 +19,142 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  *
  */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
 #include <glib.h>
 
 #include "dems.h"
 #include "background.h"
+#include "util.h"
 
 typedef struct {
   VikDEM *dem;
   guint ref_count;
+  gdouble resolution; /* approximate distance between samples in metres */
+  gint min_lat, max_lat, min_lon, max_lon; /* the degree cells covered */
 } LoadedDEM;
 
 GHashTable *loaded_dems = NULL;
 /* filename -> DEM */
 
+/* Elevations may be looked up by worker threads while DEMs are loaded or unloaded */
+static GStaticRWLock dems_lock = G_STATIC_RW_LOCK_INIT;
+
+/*
+ * Spatial index of the loaded DEMs: a whole degree cell of lat/lon -> GList of
+ *  the DEMs overlapping it, most detailed first.
+ * DEM24k files in UTM are indexed by the cells of their lat/lon bounding box.
+ */
+static GHashTable *dem_cells = NULL;
+
+/* Never 0, so it can't be mistaken for a NULL key */
+#define CELL_INDEX(lat,lon) ( ((lat) + 91) * 362 + ((lon) + 181) )
+#define CELL_KEY(lat,lon) GINT_TO_POINTER( CELL_INDEX(lat,lon) )
+
+/* Metres per arcsecond of latitude */
+#define ARCSECOND_METRES 30.87
+
+static void loaded_dem_bounds ( LoadedDEM *ldem )
+{
+  VikDEM *dem = ldem->dem;
+  gdouble min_lat, max_lat, min_lon, max_lon;
+
+  if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
+    struct UTM utm;
+    struct LatLon ll;
+    gint i;
+    utm.zone = dem->utm_zone;
+    utm.letter = dem->utm_letter;
+    min_lat = min_lon = G_MAXDOUBLE;
+    max_lat = max_lon = -G_MAXDOUBLE;
+    /* The corners are enough for the small extents of these files */
+    for ( i = 0; i < 4; i++ ) {
+      utm.easting = (i & 1) ? dem->max_east : dem->min_east;
+      utm.northing = (i & 2) ? dem->max_north : dem->min_north;
+      a_coords_utm_to_latlon ( &utm, &ll );
+      min_lat = MIN ( min_lat, ll.lat );
+      max_lat = MAX ( max_lat, ll.lat );
+      min_lon = MIN ( min_lon, ll.lon );
+      max_lon = MAX ( max_lon, ll.lon );
+    }
+    ldem->resolution = dem->north_scale;
+  } else {
+    min_lat = dem->min_north / 3600.0;
+    max_lat = dem->max_north / 3600.0;
+    min_lon = dem->min_east / 3600.0;
+    max_lon = dem->max_east / 3600.0;
+    ldem->resolution = dem->north_scale * ARCSECOND_METRES;
+  }
+
+  /* Inclusive: a point on the northern or eastern edge is still in the DEM */
+  ldem->min_lat = CLAMP ( (gint) floor ( min_lat ), -90, 90 );
+  ldem->max_lat = CLAMP ( (gint) floor ( max_lat ), -90, 90 );
+  ldem->min_lon = CLAMP ( (gint) floor ( min_lon ), -180, 180 );
+  ldem->max_lon = CLAMP ( (gint) floor ( max_lon ), -180, 180 );
+}
+
+static gint loaded_dem_compare ( LoadedDEM *a, LoadedDEM *b )
+{
+  if ( a->resolution < b->resolution )
+    return -1;
+  return a->resolution > b->resolution;
+}
+
+static void dem_cells_add ( LoadedDEM *ldem )
+{
+  gint lat, lon;
+
+  if ( ! dem_cells )
+    dem_cells = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) g_list_free );
+
+  loaded_dem_bounds ( ldem );
+  for ( lat = ldem->min_lat; lat <= ldem->max_lat; lat++ )
+    for ( lon = ldem->min_lon; lon <= ldem->max_lon; lon++ ) {
+      GList *list = g_hash_table_lookup ( dem_cells, CELL_KEY(lat,lon) );
+      list = g_list_insert_sorted ( list, ldem, (GCompareFunc) loaded_dem_compare );
+      g_hash_table_steal ( dem_cells, CELL_KEY(lat,lon) );
+      g_hash_table_insert ( dem_cells, CELL_KEY(lat,lon), list );
+    }
+}
+
+static void dem_cells_remove ( LoadedDEM *ldem )
+{
+  gint lat, lon;
+
+  if ( ! dem_cells )
+    return;
+
+  for ( lat = ldem->min_lat; lat <= ldem->max_lat; lat++ )
+    for ( lon = ldem->min_lon; lon <= ldem->max_lon; lon++ ) {
+      GList *list = g_hash_table_lookup ( dem_cells, CELL_KEY(lat,lon) );
+      list = g_list_remove ( list, ldem );
+      g_hash_table_steal ( dem_cells, CELL_KEY(lat,lon) );
+      if ( list )
+        g_hash_table_insert ( dem_cells, CELL_KEY(lat,lon), list );
+    }
+}
+
 static void loaded_dem_free ( LoadedDEM *ldem )
 {
+  dem_cells_remove ( ldem );
   vik_dem_free ( ldem->dem );
   g_free ( ldem );
 }
 
 void a_dems_uninit ()
 {
+  g_static_rw_lock_writer_lock ( &dems_lock );
   if ( loaded_dems )
     g_hash_table_destroy ( loaded_dems );
+  loaded_dems = NULL;
+  if ( dem_cells )
+    g_hash_table_destroy ( dem_cells );
+  dem_cells = NULL;
+  g_static_rw_lock_writer_unlock ( &dems_lock );
 }
 
 /* To load a dem. if it was already loaded, will simply
@@ -50,6 +163,9 @@ void a_dems_uninit ()
 VikDEM *a_dems_load(const gchar *filename)
 {
   LoadedDEM *ldem;
+  VikDEM *dem;
+
+  g_static_rw_lock_writer_lock ( &dems_lock );
 
   /* dems init hash table */
   if ( ! loaded_dems )
@@ -58,29 +174,55 @@ VikDEM *a_dems_load(const gchar *filename)
   ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
   if ( ldem ) {
     ldem->ref_count++;
+    g_static_rw_lock_writer_unlock ( &dems_lock );
     return ldem->dem;
+  }
+  g_static_rw_lock_writer_unlock ( &dems_lock );
+
+  /* Reading the file may take a while, don't hold up elevation lookups meanwhile */
+  dem = vik_dem_new_from_file ( filename );
+  if ( ! dem )
+    return NULL;
+
+  g_static_rw_lock_writer_lock ( &dems_lock );
+  ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
+  if ( ldem ) {
+    /* Loaded by another thread in the meantime */
+    ldem->ref_count++;
+    vik_dem_free ( dem );
+    dem = ldem->dem;
   } else {
-    VikDEM *dem = vik_dem_new_from_file ( filename );
-    if ( ! dem )
-      return NULL;
     ldem = g_malloc ( sizeof(LoadedDEM) );
     ldem->ref_count = 1;
     ldem->dem = dem;
     g_hash_table_insert ( loaded_dems, g_strdup(filename), ldem );
-    return dem;
+    dem_cells_add ( ldem );
   }
+  g_static_rw_lock_writer_unlock ( &dems_lock );
+  return dem;
 }
 
 void a_dems_unref(const gchar *filename)
 {
-  LoadedDEM *ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
-  if ( !ldem ) {
-    /* This is fine - probably means the loaded list was aborted / not completed for some reason */
-    return;
+  LoadedDEM *ldem;
+
+  g_static_rw_lock_writer_lock ( &dems_lock );
+  ldem = loaded_dems ? (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  /* Not found is fine - probably means the loaded list was aborted / not completed for some reason */
+  if ( ldem ) {
+    ldem->ref_count--;
+    if ( ldem->ref_count == 0 )
+      g_hash_table_remove ( loaded_dems, filename );
   }
-  ldem->ref_count--;
-  if ( ldem->ref_count == 0 )
-    g_hash_table_remove ( loaded_dems, filename );
+  g_static_rw_lock_writer_unlock ( &dems_lock );
+}
+
+static VikDEM *dems_get ( const gchar *filename )
+{
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  if ( ldem )
+    return ldem->dem;
+  return NULL;
 }
 
 /* to get a DEM that was already loaded.
@@ -89,10 +231,11 @@ void a_dems_unref(const gchar *filename)
  */
 VikDEM *a_dems_get(const gchar *filename)
 {
-  LoadedDEM *ldem = g_hash_table_lookup ( loaded_dems, filename );
-  if ( ldem )
-    return ldem->dem;
-  return NULL;
+  VikDEM *dem;
+  g_static_rw_lock_reader_lock ( &dems_lock );
+  dem = dems_get ( filename );
+  g_static_rw_lock_reader_unlock ( &dems_lock );
+  return dem;
 }
 
 
@@ -167,14 +310,15 @@ GList *a_dems_list_copy ( GList *dems )
 
 gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord )
 {
-  static struct UTM utm_tmp;
-  static struct LatLon ll_tmp;
+  struct UTM utm_tmp;
+  struct LatLon ll_tmp;
   GList *iter = dems;
   VikDEM *dem;
-  gint elev;
+  gint elev = VIK_DEM_INVALID_ELEVATION;
 
+  g_static_rw_lock_reader_lock ( &dems_lock );
   while ( iter ) {
-    dem = a_dems_get ( (gchar *) iter->data );
+    dem = dems_get ( (gchar *) iter->data );
     if ( dem ) {
       if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
         vik_coord_to_latlon ( coord, &ll_tmp );
@@ -182,72 +326,270 @@ gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord )
         ll_tmp.lon *= 3600;
         elev = vik_dem_get_east_north(dem, ll_tmp.lon, ll_tmp.lat);
         if ( elev != VIK_DEM_INVALID_ELEVATION )
-          return elev;
+          break;
       } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
         vik_coord_to_utm ( coord, &utm_tmp );
         if ( utm_tmp.zone == dem->utm_zone &&
              (elev = vik_dem_get_east_north(dem, utm_tmp.easting, utm_tmp.northing)) != VIK_DEM_INVALID_ELEVATION )
-            return elev;
+          break;
       }
     }
     iter = iter->next;
   }
-  return VIK_DEM_INVALID_ELEVATION;
+  g_static_rw_lock_reader_unlock ( &dems_lock );
+  return elev;
 }
 
-typedef struct {
-  const VikCoord *coord;
-  VikDemInterpol method;
-  gint elev;
-} CoordElev;
-
-static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
+/*
+ * @utm: Filled in on the first use, when *have_utm is FALSE
+ */
+static gint16 dem_get_elev ( VikDEM *dem, const VikCoord *coord, const struct LatLon *ll,
+                             struct UTM *utm, gboolean *have_utm, VikDemInterpol method )
 {
-  VikDEM *dem = ldem->dem;
   gdouble lat, lon;
 
   if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
-    struct LatLon ll_tmp;
-    vik_coord_to_latlon (ce->coord, &ll_tmp );
-    lat = ll_tmp.lat * 3600;
-    lon = ll_tmp.lon * 3600;
-  } else if (dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS) {
-    static struct UTM utm_tmp;
-    if (utm_tmp.zone != dem->utm_zone)
-      return FALSE;
-    vik_coord_to_utm (ce->coord, &utm_tmp);
-    lat = utm_tmp.northing;
-    lon = utm_tmp.easting;
+    lat = ll->lat * 3600;
+    lon = ll->lon * 3600;
+  } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
+    if ( ! *have_utm ) {
+      vik_coord_to_utm ( coord, utm );
+      *have_utm = TRUE;
+    }
+    if ( utm->zone != dem->utm_zone )
+      return VIK_DEM_INVALID_ELEVATION;
+    lat = utm->northing;
+    lon = utm->easting;
   } else
-    return FALSE;
+    return VIK_DEM_INVALID_ELEVATION;
 
-  switch (ce->method) {
+  switch (method) {
     case VIK_DEM_INTERPOL_NONE:
-      ce->elev = vik_dem_get_east_north(dem, lon, lat);
-      break;
+      return vik_dem_get_east_north(dem, lon, lat);
     case VIK_DEM_INTERPOL_SIMPLE:
-      ce->elev = vik_dem_get_simple_interpol(dem, lon, lat);
-      break;
+      return vik_dem_get_simple_interpol(dem, lon, lat);
     case VIK_DEM_INTERPOL_BEST:
-      ce->elev = vik_dem_get_shepard_interpol(dem, lon, lat);
-      break;
+      return vik_dem_get_shepard_interpol(dem, lon, lat);
   }
-  return (ce->elev != VIK_DEM_INVALID_ELEVATION);
+  return VIK_DEM_INVALID_ELEVATION;
 }
 
-/* TODO: keep a (sorted) linked list of DEMs and select the best resolution one */
+/*
+ * @candidates: The DEMs of the cell of the coordinate, best first
+ */
+static gint16 dems_get_elev ( GList *candidates, const VikCoord *coord, const struct LatLon *ll, VikDemInterpol method )
+{
+  struct UTM utm;
+  gboolean have_utm = FALSE;
+  GList *iter;
+
+  for ( iter = candidates; iter; iter = iter->next ) {
+    gint16 elev = dem_get_elev ( ((LoadedDEM *) iter->data)->dem, coord, ll, &utm, &have_utm, method );
+    if ( elev != VIK_DEM_INVALID_ELEVATION )
+      return elev;
+  }
+  return VIK_DEM_INVALID_ELEVATION;
+}
+
+/**
+ * a_dems_get_elev_by_coord:
+ *
+ * Returns: the elevation from the most detailed loaded DEM covering the coordinate
+ */
 gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
 {
-  CoordElev ce;
+  struct LatLon ll;
+  gint16 elev = VIK_DEM_INVALID_ELEVATION;
 
-  if (!loaded_dems)
-    return VIK_DEM_INVALID_ELEVATION;
+  g_static_rw_lock_reader_lock ( &dems_lock );
+  if ( dem_cells ) {
+    vik_coord_to_latlon ( coord, &ll );
+    elev = dems_get_elev ( g_hash_table_lookup ( dem_cells, CELL_KEY((gint) floor(ll.lat), (gint) floor(ll.lon)) ),
+                           coord, &ll, method );
+  }
+  g_static_rw_lock_reader_unlock ( &dems_lock );
+  return elev;
+}
 
-  ce.coord = coord;
-  ce.method = method;
-  ce.elev = VIK_DEM_INVALID_ELEVATION;
+/*
+ * Batches of coordinates are processed in two stages by a pool of threads:
+ *  the coordinates are converted and assigned their cell, then, grouped by
+ *  cell so each thread works on few DEMs at a time, their elevation is interpolated.
+ */
 
-  if(!g_hash_table_find(loaded_dems, (GHRFunc)get_elev_by_coord, &ce))
-    return VIK_DEM_INVALID_ELEVATION;
-  return ce.elev;
+/* Smaller batches are done in the calling thread */
+#define ELEV_CHUNK 8192
+
+enum { ELEV_STAGE_CONVERT, ELEV_STAGE_INTERPOLATE };
+
+typedef struct {
+  const VikCoord *coords;
+  gint16 *elevs;
+  VikDemInterpol method;
+  struct LatLon *lls;
+  gint *cells;
+  guint *order; /* points sorted by cell */
+  gint stage;
+  gint cancelled;
+  gint chunks_left;
+  GMutex *mutex;
+  GCond *cond;
+} ElevBatch;
+
+typedef struct {
+  ElevBatch *batch;
+  guint start, end;
+} ElevChunk;
+
+static GThreadPool *elev_pool = NULL;
+static GStaticMutex elev_pool_mutex = G_STATIC_MUTEX_INIT;
+
+static void elev_convert ( ElevBatch *batch, guint start, guint end )
+{
+  guint i;
+  for ( i = start; i < end; i++ ) {
+    vik_coord_to_latlon ( &batch->coords[i], &batch->lls[i] );
+    batch->cells[i] = CELL_INDEX((gint) floor(batch->lls[i].lat), (gint) floor(batch->lls[i].lon));
+  }
+}
+
+/* Called with dems_lock held for reading */
+static void elev_interpolate ( ElevBatch *batch, guint start, guint end )
+{
+  gint last_cell = 0; /* never a valid cell */
+  GList *candidates = NULL;
+  guint j;
+  for ( j = start; j < end; j++ ) {
+    guint i = batch->order ? batch->order[j] : j;
+    if ( batch->cells[i] != last_cell ) {
+      candidates = dem_cells ? g_hash_table_lookup ( dem_cells, GINT_TO_POINTER(batch->cells[i]) ) : NULL;
+      last_cell = batch->cells[i];
+    }
+    batch->elevs[i] = dems_get_elev ( candidates, &batch->coords[i], &batch->lls[i], batch->method );
+  }
+}
+
+static void elev_chunk_thread ( ElevChunk *chunk, gpointer user_data )
+{
+  ElevBatch *batch = chunk->batch;
+
+  if ( ! g_atomic_int_get ( &batch->cancelled ) ) {
+    if ( batch->stage == ELEV_STAGE_CONVERT )
+      elev_convert ( batch, chunk->start, chunk->end );
+    else
+      elev_interpolate ( batch, chunk->start, chunk->end );
+  }
+
+  g_mutex_lock ( batch->mutex );
+  batch->chunks_left--;
+  g_cond_signal ( batch->cond );
+  g_mutex_unlock ( batch->mutex );
+  g_slice_free ( ElevChunk, chunk );
+}
+
+/*
+ * Run a stage over all the points, checking for cancellation of the background job meanwhile
+ * Returns: FALSE if cancelled
+ */
+static gboolean elev_run_stage ( ElevBatch *batch, guint n, gint stage, gpointer threaddata )
+{
+  guint start;
+
+  batch->stage = stage;
+  batch->chunks_left = (n + ELEV_CHUNK - 1) / ELEV_CHUNK;
+  for ( start = 0; start < n; start += ELEV_CHUNK ) {
+    ElevChunk *chunk = g_slice_new ( ElevChunk );
+    chunk->batch = batch;
+    chunk->start = start;
+    chunk->end = MIN ( start + ELEV_CHUNK, n );
+    g_thread_pool_push ( elev_pool, chunk, NULL );
+  }
+
+  g_mutex_lock ( batch->mutex );
+  while ( batch->chunks_left > 0 ) {
+    GTimeVal timeout;
+    g_get_current_time ( &timeout );
+    g_time_val_add ( &timeout, 100000 );
+    if ( ! g_cond_timed_wait ( batch->cond, batch->mutex, &timeout ) && threaddata ) {
+      g_mutex_unlock ( batch->mutex );
+      if ( a_background_testcancel ( threaddata ) )
+        g_atomic_int_set ( &batch->cancelled, 1 );
+      g_mutex_lock ( batch->mutex );
+    }
+  }
+  g_mutex_unlock ( batch->mutex );
+
+  return ! batch->cancelled;
+}
+
+static gint elev_order_compare ( gconstpointer a, gconstpointer b, gpointer cells )
+{
+  gint ca = ((gint *) cells)[*(guint *) a];
+  gint cb = ((gint *) cells)[*(guint *) b];
+  if ( ca != cb )
+    return ca < cb ? -1 : 1;
+  /* Keep the order of the track within a cell */
+  return *(guint *) a < *(guint *) b ? -1 : *(guint *) a > *(guint *) b;
+}
+
+/**
+ * a_dems_get_elev_by_coords:
+ * @coords:     Array of @n coordinates
+ * @elevs:      Array of @n elevations to fill in, VIK_DEM_INVALID_ELEVATION where there is no DEM
+ * @threaddata: When run from a background job, to stop early if the job is cancelled
+ *
+ * As a_dems_get_elev_by_coord() for many coordinates at once, spread over all processors.
+ *
+ * Returns: 0 on success, -1 if cancelled
+ */
+int a_dems_get_elev_by_coords ( const VikCoord *coords, guint n, VikDemInterpol method, gint16 *elevs, gpointer threaddata )
+{
+  ElevBatch batch;
+  guint i;
+  int ret = 0;
+
+  memset ( &batch, 0, sizeof(batch) );
+  batch.coords = coords;
+  batch.elevs = elevs;
+  batch.method = method;
+  batch.lls = g_new ( struct LatLon, n );
+  batch.cells = g_new ( gint, n );
+
+  g_static_rw_lock_reader_lock ( &dems_lock );
+
+  if ( n <= ELEV_CHUNK ) {
+    elev_convert ( &batch, 0, n );
+    elev_interpolate ( &batch, 0, n );
+  }
+  else {
+    g_static_mutex_lock ( &elev_pool_mutex );
+    if ( ! elev_pool )
+      elev_pool = g_thread_pool_new ( (GFunc) elev_chunk_thread, NULL, util_get_number_of_cpus(), FALSE, NULL );
+    g_static_mutex_unlock ( &elev_pool_mutex );
+
+    batch.mutex = g_mutex_new ();
+    batch.cond = g_cond_new ();
+
+    if ( elev_run_stage ( &batch, n, ELEV_STAGE_CONVERT, threaddata ) ) {
+      /* Group by cell, for a small working set of DEMs per thread */
+      batch.order = g_new ( guint, n );
+      for ( i = 0; i < n; i++ )
+        batch.order[i] = i;
+      g_qsort_with_data ( batch.order, n, sizeof(guint), elev_order_compare, batch.cells );
+
+      elev_run_stage ( &batch, n, ELEV_STAGE_INTERPOLATE, threaddata );
+    }
+    if ( batch.cancelled )
+      ret = -1;
+
+    g_free ( batch.order );
+    g_cond_free ( batch.cond );
+    g_mutex_free ( batch.mutex );
+  }
+
+  g_static_rw_lock_reader_unlock ( &dems_lock );
+
+  g_free ( batch.cells );
+  g_free ( batch.lls );
+  return ret;
 }
@@ -0,0 +1,246 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <time.h>
+#include <glib.h>
+#include "dircache.h"
+
+/*
+ * Answers "does this file exist?" for map tiles from snapshots of the
+ *  listing of their directory, so redrawing a sparsely cached area doesn't
+ *  stat() every missing tile again and again.
+ *
+ * Snapshots are updated when tiles are downloaded or removed by Viking,
+ *  and read again after DIRCACHE_MAX_AGE to notice changes made by others.
+ */
+
+/* Total number of file names kept, over all the directories */
+#define DIRCACHE_MAX_NAMES 200000
+/* Seconds after which a directory is listed again */
+#define DIRCACHE_MAX_AGE 120
+
+typedef struct {
+  gchar *path;
+  GHashTable *names; /* NULL when the directory doesn't exist */
+  time_t read_at;
+  GList *link; /* in lru */
+} DirSnapshot;
+
+static GHashTable *dirs = NULL;
+/* Most recently used first */
+static GQueue *lru = NULL;
+static guint names_count = 0;
+static GMutex *dc_mutex = NULL;
+
+static guint snapshot_size ( DirSnapshot *snap )
+{
+  return snap->names ? g_hash_table_size ( snap->names ) : 0;
+}
+
+static void snapshot_free ( DirSnapshot *snap )
+{
+  if ( snap->names )
+    g_hash_table_destroy ( snap->names );
+  g_free ( snap->path );
+  g_slice_free ( DirSnapshot, snap );
+}
+
+static void snapshot_remove ( DirSnapshot *snap )
+{
+  names_count -= snapshot_size ( snap );
+  g_queue_delete_link ( lru, snap->link );
+  /* Frees the snapshot */
+  g_hash_table_remove ( dirs, snap->path );
+}
+
+void a_dircache_init ()
+{
+  dirs = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify) snapshot_free );
+  lru = g_queue_new ();
+  dc_mutex = g_mutex_new ();
+}
+
+/*
+ * Returns: the names of the directory, or NULL if it doesn't exist or is too big to be kept
+ */
+static DirSnapshot *snapshot_read ( const gchar *path )
+{
+  DirSnapshot *snap = g_slice_new0 ( DirSnapshot );
+  GDir *dir = g_dir_open ( path, 0, NULL );
+
+  snap->path = g_strdup ( path );
+  snap->read_at = time ( NULL );
+
+  if ( dir ) {
+    const gchar *name;
+    snap->names = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+    while ( (name = g_dir_read_name ( dir )) ) {
+      g_hash_table_insert ( snap->names, g_strdup ( name ), GINT_TO_POINTER(1) );
+      if ( g_hash_table_size ( snap->names ) > DIRCACHE_MAX_NAMES / 2 ) {
+        g_dir_close ( dir );
+        snapshot_free ( snap );
+        return NULL;
+      }
+    }
+    g_dir_close ( dir );
+  }
+  return snap;
+}
+
+/* Keep the most recently used directories within the bound */
+static void snapshots_trim ( void )
+{
+  while ( names_count > DIRCACHE_MAX_NAMES && g_queue_get_length ( lru ) > 1 )
+    snapshot_remove ( g_queue_peek_tail ( lru ) );
+}
+
+/**
+ * a_dircache_file_exists:
+ *
+ * Equivalent of g_file_test ( filename, G_FILE_TEST_EXISTS ),
+ *  but usually without any filesystem access.
+ */
+gboolean a_dircache_file_exists ( const gchar *filename )
+{
+  gchar *path, *name;
+  DirSnapshot *snap;
+  gboolean exists;
+
+  if ( ! dirs )
+    return g_file_test ( filename, G_FILE_TEST_EXISTS );
+
+  path = g_path_get_dirname ( filename );
+  name = g_path_get_basename ( filename );
+
+  g_mutex_lock ( dc_mutex );
+  snap = g_hash_table_lookup ( dirs, path );
+  if ( snap && time ( NULL ) - snap->read_at > DIRCACHE_MAX_AGE ) {
+    snapshot_remove ( snap );
+    snap = NULL;
+  }
+  if ( ! snap ) {
+    /* Listing without the lock would let a concurrent download go unnoticed */
+    snap = snapshot_read ( path );
+    if ( snap ) {
+      g_hash_table_insert ( dirs, snap->path, snap );
+      g_queue_push_head ( lru, snap );
+      snap->link = g_queue_peek_head_link ( lru );
+      names_count += snapshot_size ( snap );
+      snapshots_trim ();
+    }
+  }
+  else if ( snap->link != lru->head ) {
+    g_queue_unlink ( lru, snap->link );
+    g_queue_push_head_link ( lru, snap->link );
+  }
+
+  if ( snap )
+    exists = snap->names && g_hash_table_lookup ( snap->names, name );
+  else
+    exists = g_file_test ( filename, G_FILE_TEST_EXISTS );
+  g_mutex_unlock ( dc_mutex );
+
+  g_free ( name );
+  g_free ( path );
+  return exists;
+}
+
+/**
+ * a_dircache_file_added:
+ *
+ * To be called when Viking has written the file, eg on completion of a download.
+ */
+void a_dircache_file_added ( const gchar *filename )
+{
+  gchar *path;
+  DirSnapshot *snap;
+
+  if ( ! dirs )
+    return;
+
+  path = g_path_get_dirname ( filename );
+  g_mutex_lock ( dc_mutex );
+  snap = g_hash_table_lookup ( dirs, path );
+  if ( snap ) {
+    gchar *name = g_path_get_basename ( filename );
+    /* The directory may have been created for this file */
+    if ( ! snap->names )
+      snap->names = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+    if ( g_hash_table_lookup ( snap->names, name ) )
+      g_free ( name );
+    else {
+      /* Owns the name */
+      g_hash_table_insert ( snap->names, name, GINT_TO_POINTER(1) );
+      names_count++;
+      snapshots_trim ();
+    }
+  }
+  g_mutex_unlock ( dc_mutex );
+  g_free ( path );
+}
+
+/**
+ * a_dircache_file_removed:
+ *
+ * To be called when Viking has deleted the file.
+ */
+void a_dircache_file_removed ( const gchar *filename )
+{
+  gchar *path;
+  DirSnapshot *snap;
+
+  if ( ! dirs )
+    return;
+
+  path = g_path_get_dirname ( filename );
+  g_mutex_lock ( dc_mutex );
+  snap = g_hash_table_lookup ( dirs, path );
+  if ( snap && snap->names ) {
+    gchar *name = g_path_get_basename ( filename );
+    if ( g_hash_table_remove ( snap->names, name ) )
+      names_count--;
+    g_free ( name );
+  }
+  g_mutex_unlock ( dc_mutex );
+  g_free ( path );
+}
+
+void a_dircache_flush ()
+{
+  if ( ! dirs )
+    return;
+  g_mutex_lock ( dc_mutex );
+  while ( ! g_queue_is_empty ( lru ) )
+    snapshot_remove ( g_queue_peek_head ( lru ) );
+  g_mutex_unlock ( dc_mutex );
+}
+
+void a_dircache_uninit ()
+{
+  a_dircache_flush ();
+  g_hash_table_destroy ( dirs );
+  dirs = NULL;
+  g_queue_free ( lru );
+  lru = NULL;
+  g_mutex_free ( dc_mutex );
+  dc_mutex = NULL;
+}
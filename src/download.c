@@ -42,6 +42,7 @@
 #include "download.h"
 
 #include "curl_download.h"
+#include "dircache.h"
 #include "preferences.h"
 #include "globals.h"
 
@@ -100,8 +101,27 @@ gboolean a_check_kml_file(FILE* f)
   return check_file_first_line(f, kml_str);
 }
 
-static GList *file_list = NULL;
-static GMutex *file_list_mutex = NULL;
+/*
+ * Downloads in progress, keyed by their temporary filename.
+ * The table is split into shards, each with its own lock,
+ *  so download threads rarely contend for the same lock.
+ */
+#define DOWNLOAD_LOCK_SHARDS 16
+
+/* Shared by the thread downloading a file and any threads waiting for it */
+typedef struct {
+  gint ref_count; /* protected by the shard mutex */
+  gboolean done;
+  int result;
+  GCond *cond;
+} DownloadInFlight;
+
+typedef struct {
+  GMutex *mutex;
+  GHashTable *files;
+} DownloadLockShard;
+
+static DownloadLockShard lock_shards[DOWNLOAD_LOCK_SHARDS];
 
 /* spin button scales */
 VikLayerParamScale params_scales[] = {
@@ -118,37 +138,122 @@ void a_download_init (void)
 	tmp.u = VIK_CONFIG_DEFAULT_TILE_AGE;
 	a_preferences_register(prefs, tmp, VIKING_PREFERENCES_GROUP_KEY);
 
-	file_list_mutex = g_mutex_new();
+	gint i;
+	for ( i = 0; i < DOWNLOAD_LOCK_SHARDS; i++ ) {
+		lock_shards[i].mutex = g_mutex_new();
+		lock_shards[i].files = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+	}
+}
+
+static DownloadLockShard *lock_shard ( const char *fn )
+{
+	return &lock_shards[g_str_hash ( fn ) % DOWNLOAD_LOCK_SHARDS];
 }
 
-static gboolean lock_file(const char *fn)
+static void in_flight_unref ( DownloadInFlight *dif )
 {
+	/* Called with the shard mutex held */
+	if ( --dif->ref_count == 0 ) {
+		g_cond_free ( dif->cond );
+		g_free ( dif );
+	}
+}
+
+/**
+ * Returns: TRUE if the caller now owns the download of the file.
+ *  Otherwise, if @in_flight is not NULL, it is set to the handle of the download in progress,
+ *  which must be passed to wait_file().
+ */
+static gboolean lock_file ( const char *fn, DownloadInFlight **in_flight )
+{
+	DownloadLockShard *shard = lock_shard ( fn );
+	DownloadInFlight *dif;
 	gboolean locked = FALSE;
-	g_mutex_lock(file_list_mutex);
-	if (g_list_find_custom(file_list, fn, (GCompareFunc)g_strcmp0) == NULL)
-	{
+
+	g_mutex_lock ( shard->mutex );
+	dif = g_hash_table_lookup ( shard->files, fn );
+	if ( dif == NULL ) {
 		// The filename is not yet locked
-		file_list = g_list_append(file_list, (gpointer)fn),
+		dif = g_new0 ( DownloadInFlight, 1 );
+		dif->ref_count = 1;
+		dif->cond = g_cond_new ();
+		g_hash_table_insert ( shard->files, g_strdup(fn), dif );
 		locked = TRUE;
 	}
-	g_mutex_unlock(file_list_mutex);
+	else if ( in_flight ) {
+		dif->ref_count++;
+		*in_flight = dif;
+	}
+	g_mutex_unlock ( shard->mutex );
 	return locked;
 }
 
-static void unlock_file(const char *fn)
+/**
+ * Wait for the download in progress to finish
+ * Returns: its result
+ */
+static int wait_file ( const char *fn, DownloadInFlight *dif )
 {
-	g_mutex_lock(file_list_mutex);
-	file_list = g_list_remove(file_list, (gconstpointer)fn);
-	g_mutex_unlock(file_list_mutex);
+	DownloadLockShard *shard = lock_shard ( fn );
+	int result;
+
+	g_mutex_lock ( shard->mutex );
+	while ( ! dif->done )
+		g_cond_wait ( dif->cond, shard->mutex );
+	result = dif->result;
+	in_flight_unref ( dif );
+	g_mutex_unlock ( shard->mutex );
+	return result;
 }
 
-static int download( const char *hostname, const char *uri, const char *fn, DownloadMapOptions *options, gboolean ftp, void *handle)
+/**
+ * Release the file, waking up any threads waiting for it with the result of the download
+ */
+static void unlock_file ( const char *fn, int result )
 {
-  FILE *f;
-  int ret;
+	DownloadLockShard *shard = lock_shard ( fn );
+	DownloadInFlight *dif;
+
+	g_mutex_lock ( shard->mutex );
+	dif = g_hash_table_lookup ( shard->files, fn );
+	if ( dif ) {
+		g_hash_table_remove ( shard->files, fn );
+		dif->done = TRUE;
+		dif->result = result;
+		g_cond_broadcast ( dif->cond );
+		in_flight_unref ( dif );
+	}
+	g_mutex_unlock ( shard->mutex );
+}
+
+/* A file being downloaded into its temporary file */
+typedef struct {
+  gchar *fn;
   gchar *tmpfilename;
-  gboolean failure = FALSE;
-  DownloadFileOptions file_options = {0, NULL, NULL};
+  FILE *f;
+  DownloadMapOptions *options;
+  DownloadFileOptions file_options;
+} DownloadRequest;
+
+static void download_request_clear ( DownloadRequest *req )
+{
+  g_free ( req->fn );
+  g_free ( req->tmpfilename );
+  g_free ( req->file_options.etag );
+  g_free ( req->file_options.new_etag );
+}
+
+/**
+ * Check whether the file needs downloading and if so open its (locked) temporary file
+ * If @wait is TRUE and another thread is already downloading the file, wait for it to finish.
+ * Returns: 0 when the download should go ahead, 1 if the download has been done by another thread,
+ *  otherwise the same error values as download()
+ */
+static int download_prepare ( const char *fn, DownloadMapOptions *options, gboolean wait, DownloadRequest *req )
+{
+  DownloadInFlight *in_flight = NULL;
+
+  memset ( req, 0, sizeof(DownloadRequest) );
 
   /* Check file */
   if ( g_file_test ( fn, G_FILE_TEST_EXISTS ) == TRUE )
@@ -170,19 +275,19 @@ static int download( const char *hostname, const char *uri, const char *fn, Down
     }
 
     if (options->check_file_server_time) {
-      file_options.time_condition = file_time;
+      req->file_options.time_condition = file_time;
     }
     if (options->use_etag) {
       gchar *etag_filename = g_strdup_printf("%s.etag", fn);
       gsize etag_length = 0;
-      g_file_get_contents (etag_filename, &(file_options.etag), &etag_length, NULL);
+      g_file_get_contents (etag_filename, &(req->file_options.etag), &etag_length, NULL);
       g_free (etag_filename);
       etag_filename = NULL;
 
       /* check if etag is short enough */
       if (etag_length > 100) {
-        g_free(file_options.etag);
-        file_options.etag = NULL;
+        g_free(req->file_options.etag);
+        req->file_options.etag = NULL;
       }
 
       /* TODO: should check that etag is a valid string */
@@ -194,83 +299,109 @@ static int download( const char *hostname, const char *uri, const char *fn, Down
     g_free ( dir );
   }
 
-  tmpfilename = g_strdup_printf("%s.tmp", fn);
-  if (!lock_file ( tmpfilename ) )
+  req->tmpfilename = g_strdup_printf("%s.tmp", fn);
+  if (!lock_file ( req->tmpfilename, wait ? &in_flight : NULL ) )
   {
-    g_debug("%s: Couldn't take lock on temporary file \"%s\"\n", __FUNCTION__, tmpfilename);
-    g_free ( tmpfilename );
-    if (options->use_etag)
-      g_free ( file_options.etag );
-    return -4;
+    int ret = -4;
+    if ( in_flight ) {
+      /* Share the outcome of the download already in progress */
+      g_debug("%s: Waiting for download of \"%s\" in progress\n", __FUNCTION__, fn);
+      ret = ( wait_file ( req->tmpfilename, in_flight ) == 0 ) ? 1 : -1;
+    }
+    else
+      g_debug("%s: Couldn't take lock on temporary file \"%s\"\n", __FUNCTION__, req->tmpfilename);
+    download_request_clear ( req );
+    return ret;
   }
-  f = g_fopen ( tmpfilename, "w+b" );  /* truncate file and open it */
-  if ( ! f ) {
-    g_warning("Couldn't open temporary file \"%s\": %s", tmpfilename, g_strerror(errno));
-    g_free ( tmpfilename );
-    if (options->use_etag)
-      g_free ( file_options.etag );
+  req->f = g_fopen ( req->tmpfilename, "w+b" );  /* truncate file and open it */
+  if ( ! req->f ) {
+    g_warning("Couldn't open temporary file \"%s\": %s", req->tmpfilename, g_strerror(errno));
+    unlock_file ( req->tmpfilename, -4 );
+    download_request_clear ( req );
     return -4;
   }
 
-  /* Call the backend function */
-  ret = curl_download_get_url ( hostname, uri, f, options, ftp, &file_options, handle );
+  req->fn = g_strdup ( fn );
+  req->options = options;
+  return 0;
+}
+
+/**
+ * Check the transferred file and move it into place
+ * @ret: The result of the transfer (DOWNLOAD_*)
+ * Returns: 0 on success, -1 on failure
+ */
+static int download_finish ( DownloadRequest *req, int ret )
+{
+  DownloadMapOptions *options = req->options;
+  gboolean failure = FALSE;
 
   if (ret != DOWNLOAD_NO_ERROR && ret != DOWNLOAD_NO_NEWER_FILE) {
     g_debug("%s: download failed: curl_download_get_url=%d", __FUNCTION__, ret);
     failure = TRUE;
   }
 
-  if (!failure && options != NULL && options->check_file != NULL && ! options->check_file(f)) {
+  if (!failure && options != NULL && options->check_file != NULL && ! options->check_file(req->f)) {
     g_debug("%s: file content checking failed", __FUNCTION__);
     failure = TRUE;
   }
 
-  fclose ( f );
-  f = NULL;
+  fclose ( req->f );
+  req->f = NULL;
 
   if (failure)
   {
-    g_warning(_("Download error: %s"), fn);
-    g_remove ( tmpfilename );
-    unlock_file ( tmpfilename );
-    g_free ( tmpfilename );
-    if (options->use_etag) {
-      g_free ( file_options.etag );
-      g_free ( file_options.new_etag );
-    }
+    g_warning(_("Download error: %s"), req->fn);
+    g_remove ( req->tmpfilename );
+    unlock_file ( req->tmpfilename, -1 );
+    download_request_clear ( req );
     return -1;
   }
 
-  if (options->use_etag) {
-    if (file_options.new_etag) {
+  if (options != NULL && options->use_etag) {
+    if (req->file_options.new_etag) {
       /* server returned an etag value */
-      gchar *etag_filename = g_strdup_printf("%s.etag", fn);
-      g_file_set_contents (etag_filename, file_options.new_etag, -1, NULL);
+      gchar *etag_filename = g_strdup_printf("%s.etag", req->fn);
+      g_file_set_contents (etag_filename, req->file_options.new_etag, -1, NULL);
       g_free (etag_filename);
       etag_filename = NULL;
     }
   }
 
   if (ret == DOWNLOAD_NO_NEWER_FILE)  {
-    g_remove ( tmpfilename );
+    g_remove ( req->tmpfilename );
 #if GLIB_CHECK_VERSION(2,18,0)
-    g_utime ( fn, NULL ); /* update mtime of local copy */
+    g_utime ( req->fn, NULL ); /* update mtime of local copy */
 #else
-    utimes ( fn, NULL ); /* update mtime of local copy */
+    utimes ( req->fn, NULL ); /* update mtime of local copy */
 #endif
   } else {
-    g_rename ( tmpfilename, fn ); /* move completely-downloaded file to permanent location */
-  }
-  unlock_file ( tmpfilename );
-  g_free ( tmpfilename );
-
-  if (options->use_etag) {
-    g_free ( file_options.etag );
-    g_free ( file_options.new_etag );
+    g_rename ( req->tmpfilename, req->fn ); /* move completely-downloaded file to permanent location */
+    a_dircache_file_added ( req->fn );
   }
+  unlock_file ( req->tmpfilename, 0 );
+  download_request_clear ( req );
   return 0;
 }
 
+static int download( const char *hostname, const char *uri, const char *fn, DownloadMapOptions *options, gboolean ftp, void *handle)
+{
+  DownloadRequest req;
+  int ret;
+
+  ret = download_prepare ( fn, options, TRUE, &req );
+  if ( ret == 1 )
+    /* Done by another thread */
+    return 0;
+  if ( ret != 0 )
+    return ret;
+
+  /* Call the backend function */
+  ret = curl_download_get_url ( hostname, uri, req.f, options, ftp, &req.file_options, handle );
+
+  return download_finish ( &req, ret );
+}
+
 /* success = 0, -1 = couldn't connect, -2 HTTP error, -3 file exists, -4 couldn't write to file... */
 /* uri: like "/uri.html?whatever" */
 /* only reason for the "wrapper" is so we can do redirects. */
@@ -284,6 +415,125 @@ int a_ftp_download_get_url ( const char *hostname, const char *uri, const char *
   return download ( hostname, uri, fn, opt, TRUE, handle );
 }
 
+/*
+ * Several downloads in parallel
+ */
+struct _DownloadMulti {
+  CurlDownloadMulti *cdm;
+  guint max_connections;
+  guint count;
+};
+
+typedef struct {
+  DownloadMulti *dm;
+  DownloadRequest req;
+  DownloadMultiFunc func;
+  gpointer user_data;
+} DownloadMultiItem;
+
+/**
+ * a_download_multi_new:
+ * @max_connections: Maximum number of connections to the same host
+ */
+DownloadMulti *a_download_multi_new ( guint max_connections )
+{
+  DownloadMulti *dm = g_new0 ( DownloadMulti, 1 );
+  dm->max_connections = MAX(max_connections, 1);
+  dm->cdm = curl_download_multi_new ( dm->max_connections );
+  return dm;
+}
+
+static void download_multi_done ( int result, DownloadMultiItem *item )
+{
+  /* Keep the filename for the callback */
+  gchar *fn = g_strdup ( item->req.fn );
+
+  if ( download_finish ( &item->req, result ) == 0 )
+    item->func ( fn, 0, item->user_data );
+  else
+    item->func ( fn, -1, item->user_data );
+
+  item->dm->count--;
+  g_free ( fn );
+  g_free ( item );
+}
+
+/**
+ * a_download_multi_add:
+ * @ftp:       Download by FTP rather than HTTP, as a_ftp_download_get_url()
+ * @func:      Called with the filename and the result (0 = success, -1 = failure) once the download has finished
+ *
+ * Start downloading the file in the background of the other transfers.
+ * @opt must remain valid until @func has been called.
+ *
+ * Returns: 0 if the download has been started, otherwise the same values as a_http_download_get_url()
+ *  and @func will not be called.
+ */
+int a_download_multi_add ( DownloadMulti *dm, const char *hostname, const char *uri, const char *fn, DownloadMapOptions *opt, gboolean ftp, DownloadMultiFunc func, gpointer user_data )
+{
+  DownloadMultiItem *item = g_new0 ( DownloadMultiItem, 1 );
+  gchar *full;
+  int ret;
+
+  /* Can't block the other transfers, so a file already being downloaded is reported as locked (-4) */
+  ret = download_prepare ( fn, opt, FALSE, &item->req );
+  if ( ret != 0 ) {
+    g_free ( item );
+    return ret;
+  }
+
+  item->dm = dm;
+  item->func = func;
+  item->user_data = user_data;
+
+  full = g_strdup_printf ( "%s://%s%s", (ftp?"ftp":"http"), hostname, uri );
+  if ( curl_download_multi_add ( dm->cdm, full, item->req.f, opt, &item->req.file_options, (CurlDownloadMultiFunc) download_multi_done, item ) )
+    dm->count++;
+  else {
+    download_finish ( &item->req, DOWNLOAD_ERROR );
+    g_free ( item );
+    ret = -1;
+  }
+  g_free ( full );
+  return ret;
+}
+
+/**
+ * a_download_multi_has_free_slot:
+ *
+ * Returns: TRUE if another download can be added without exceeding the connection limit
+ */
+gboolean a_download_multi_has_free_slot ( DownloadMulti *dm )
+{
+  return dm->count < dm->max_connections;
+}
+
+/**
+ * a_download_multi_wait:
+ * @timeout_ms: Maximum time to wait for network activity
+ *
+ * Make progress on the downloads, calling the completion function of those finished.
+ *
+ * Returns: number of downloads still in progress
+ */
+guint a_download_multi_wait ( DownloadMulti *dm, gint timeout_ms )
+{
+  if ( dm->count == 0 )
+    return 0;
+  return curl_download_multi_perform ( dm->cdm, timeout_ms );
+}
+
+/**
+ * a_download_multi_free:
+ *
+ * Any downloads still in progress are aborted and reported as failed.
+ */
+void a_download_multi_free ( DownloadMulti *dm )
+{
+  curl_download_multi_free ( dm->cdm );
+  g_free ( dm );
+}
+
 void * a_download_handle_init ()
 {
   return curl_download_handle_init ();
@@ -96,6 +96,16 @@ void a_download_handle_cleanup ( void *handle );
 
 gchar *a_download_uri_to_tmp_file ( const gchar *uri, DownloadMapOptions *options );
 
+/* Parallel downloads */
+typedef struct _DownloadMulti DownloadMulti;
+typedef void (*DownloadMultiFunc) ( const gchar *fn, int result, gpointer user_data );
+
+DownloadMulti *a_download_multi_new ( guint max_connections );
+int a_download_multi_add ( DownloadMulti *dm, const char *hostname, const char *uri, const char *fn, DownloadMapOptions *opt, gboolean ftp, DownloadMultiFunc func, gpointer user_data );
+gboolean a_download_multi_has_free_slot ( DownloadMulti *dm );
+guint a_download_multi_wait ( DownloadMulti *dm, gint timeout_ms );
+void a_download_multi_free ( DownloadMulti *dm );
+
 /* Error messages returned by download functions */
 enum { DOWNLOAD_NO_ERROR = 0,
        DOWNLOAD_NO_NEWER_FILE,
@@ -27,6 +27,7 @@
 
 #include "gpx.h"
 #include "babel.h"
+#include "binfile.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -598,7 +599,7 @@ gboolean check_file_magic_vik ( const gchar *filename )
   gboolean result = FALSE;
   FILE *ff = xfopen ( filename, "r" );
   if ( ff ) {
-    result = check_magic ( ff, VIK_MAGIC );
+    result = check_magic ( ff, VIK_MAGIC ) || check_magic ( ff, BINFILE_MAGIC );
     xfclose ( ff );
   }
   return result;
@@ -627,6 +628,11 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top, VikViewport *vp, const gchar
     else
       load_answer = LOAD_TYPE_VIK_FAILURE_NON_FATAL;
   }
+  // The binary form is mapped rather than read, so can't come from stdin
+  else if ( f != stdin && check_magic ( f, BINFILE_MAGIC ) )
+  {
+    load_answer = a_binfile_read ( top, vp, filename );
+  }
   else
   {
 	// For all other file types which consist of tracks, routes and/or waypoints,
@@ -674,13 +680,29 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top, VikViewport *vp, const gchar
   return load_answer;
 }
 
+/**
+ * a_file_save:
+ *
+ * Saves in the binary form when @filename ends in .vikb,
+ *  otherwise in the text form.
+ */
 gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename )
 {
   FILE *f;
+  gboolean ans = TRUE;
 
   if (strncmp(filename, "file://", 7) == 0)
     filename = filename + 7;
 
+  if ( check_file_ext ( filename, BINFILE_EXT ) ) {
+    f = g_fopen(filename, "wb");
+    if ( ! f )
+      return FALSE;
+    ans = a_binfile_write ( top, VIK_VIEWPORT(vp), f );
+    fclose(f);
+    return ans;
+  }
+
   f = g_fopen(filename, "w");
 
   if ( ! f )
@@ -694,6 +716,31 @@ gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filenam
   return TRUE;
 }
 
+/**
+ * a_file_convert:
+ *
+ * Load a file and save it again in the form given by the extension of
+ *  @out_filename, see a_file_save(). Mainly to change between the text
+ *  and binary forms of Viking files.
+ */
+gboolean a_file_convert ( const gchar *in_filename, const gchar *out_filename )
+{
+  VikViewport *vvp = vik_viewport_new ();
+  VikAggregateLayer *top = vik_aggregate_layer_new ();
+  VikLoadType_t load_answer;
+  gboolean ans = FALSE;
+
+  g_object_ref_sink ( vvp );
+
+  load_answer = a_file_load ( top, vvp, in_filename );
+  if ( load_answer == LOAD_TYPE_VIK_SUCCESS || load_answer == LOAD_TYPE_OTHER_SUCCESS )
+    ans = a_file_save ( top, vvp, out_filename );
+
+  g_object_unref ( top );
+  g_object_unref ( vvp );
+  return ans;
+}
+
 
 const gchar *a_file_basename ( const gchar *filename )
 {
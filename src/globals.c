@@ -39,6 +39,7 @@ static gchar * params_units_speed[] = {"km/h", "mph", "m/s", "knots", NULL};
 static gchar * params_units_height[] = {"Metres", "Feet", NULL};
 static VikLayerParamScale params_scales_lat[] = { {-90.0, 90.0, 0.05, 2} };
 static VikLayerParamScale params_scales_long[] = { {-180.0, 180.0, 0.05, 2} };
+static VikLayerParamScale params_scales_redraw[] = { {0, 1000, 5, 0} };
  
 static VikLayerParam prefs1[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "degree_format", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Degree format:"), VIK_LAYER_WIDGET_COMBOBOX, params_degree_formats, NULL, NULL },
@@ -66,6 +67,9 @@ static VikLayerParam prefs6[] = {
 static VikLayerParam prefs7[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "default_longitude", VIK_LAYER_PARAM_DOUBLE, VIK_LAYER_GROUP_NONE, N_("Default longitude:"),  VIK_LAYER_WIDGET_SPINBUTTON, params_scales_long, NULL, NULL },
 };
+static VikLayerParam prefs8[] = {
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "redraw_interval", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Minimum time between redraws (ms):"),  VIK_LAYER_WIDGET_SPINBUTTON, params_scales_redraw, NULL, NULL },
+};
 
 /* External/Export Options */
 
@@ -117,6 +121,10 @@ void a_vik_preferences_init ()
   tmp.d = -74.007130;
   a_preferences_register(prefs7, tmp, VIKING_PREFERENCES_GROUP_KEY);
 
+  // About a display frame
+  tmp.u = 20;
+  a_preferences_register(prefs8, tmp, VIKING_PREFERENCES_GROUP_KEY);
+
   // New Tab
   a_preferences_register_group ( VIKING_PREFERENCES_IO_GROUP_KEY, _("Export/External") );
 
@@ -188,6 +196,13 @@ gdouble a_vik_get_default_long ( )
   return data;
 }
 
+guint a_vik_get_redraw_interval ( )
+{
+  guint data;
+  data = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "redraw_interval")->u;
+  return data;
+}
+
 /* External/Export Options */
 
 vik_kml_export_units_t a_vik_get_kml_export_units ( )
@@ -124,6 +124,9 @@ typedef enum {
 gdouble a_vik_get_default_lat ( );
 gdouble a_vik_get_default_long ( );
 
+/* Layer updates arriving quicker than this are drawn together */
+guint a_vik_get_redraw_interval ( );
+
 /* KML export preferences */
 typedef enum {
   VIK_KML_EXPORT_UNITS_METRIC,
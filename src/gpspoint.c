@@ -28,6 +28,7 @@
 #endif
 
 #include "viking.h"
+#include "vikwritebuf.h"
 
 #include <ctype.h>
 #ifdef HAVE_STRING_H
@@ -38,13 +39,13 @@
 /* strtod */
 
 typedef struct {
-  FILE *f;
+  VikWriteBuf *wb;
   gboolean is_route;
 } TP_write_info_type;
 
-static void a_gpspoint_write_track ( const gpointer id, const VikTrack *t, FILE *f );
+static void a_gpspoint_write_track ( const VikTrack *t, VikWriteBuf *wb, gpointer user_data );
 static void a_gpspoint_write_trackpoint ( VikTrackpoint *tp, TP_write_info_type *write_info );
-static void a_gpspoint_write_waypoint ( const gpointer id, const VikWaypoint *wp, FILE *f );
+static void a_gpspoint_write_waypoint ( const gpointer id, const VikWaypoint *wp, VikWriteBuf *wb );
 
 
 /* outline for file gpspoint.c
@@ -303,6 +304,7 @@ gboolean a_gpspoint_read_file(VikTrwLayer *trw, FILE *f ) {
         tp->fix_mode = line_fix;
       }
       current_track->trackpoints = g_list_append ( current_track->trackpoints, tp );
+      vik_track_changed ( current_track );
     }
 
     if (line_name) 
@@ -491,101 +493,103 @@ static void gpspoint_process_key_and_value ( const gchar *key, gint key_len, con
   }
 }
 
-static void a_gpspoint_write_waypoint ( const gpointer id, const VikWaypoint *wp, FILE *f )
+static void a_gpspoint_write_waypoint ( const gpointer id, const VikWaypoint *wp, VikWriteBuf *wb )
 {
-  static struct LatLon ll;
-  gchar *s_lat, *s_lon;
+  struct LatLon ll;
   // Sanity clause
   if ( wp && !(wp->name) ) {
     return;
   }
   vik_coord_to_latlon ( &(wp->coord), &ll );
-  s_lat = a_coords_dtostr(ll.lat);
-  s_lon = a_coords_dtostr(ll.lon);
-  fprintf ( f, "type=\"waypoint\" latitude=\"%s\" longitude=\"%s\" name=\"%s\"", s_lat, s_lon, wp->name );
-  g_free ( s_lat ); 
-  g_free ( s_lon );
+  vik_write_buf_append ( wb, "type=\"waypoint\" latitude=\"" );
+  vik_write_buf_append_double ( wb, ll.lat );
+  vik_write_buf_append ( wb, "\" longitude=\"" );
+  vik_write_buf_append_double ( wb, ll.lon );
+  vik_write_buf_printf ( wb, "\" name=\"%s\"", wp->name );
 
   if ( wp->altitude != VIK_DEFAULT_ALTITUDE ) {
-    gchar *s_alt = a_coords_dtostr(wp->altitude);
-    fprintf ( f, " altitude=\"%s\"", s_alt );
-    g_free(s_alt);
+    vik_write_buf_append ( wb, " altitude=\"" );
+    vik_write_buf_append_double ( wb, wp->altitude );
+    vik_write_buf_append ( wb, "\"" );
   }
   if ( wp->comment )
   {
     gchar *tmp_comment = slashdup(wp->comment);
-    fprintf ( f, " comment=\"%s\"", tmp_comment );
+    vik_write_buf_printf ( wb, " comment=\"%s\"", tmp_comment );
     g_free ( tmp_comment );
   }
   if ( wp->description )
   {
     gchar *tmp_description = slashdup(wp->description);
-    fprintf ( f, " description=\"%s\"", tmp_description );
+    vik_write_buf_printf ( wb, " description=\"%s\"", tmp_description );
     g_free ( tmp_description );
   }
   if ( wp->image )
   {
     gchar *tmp_image = slashdup(wp->image);
-    fprintf ( f, " image=\"%s\"", tmp_image );
+    vik_write_buf_printf ( wb, " image=\"%s\"", tmp_image );
     g_free ( tmp_image );
   }
   if ( wp->symbol )
   {
-    fprintf ( f, " symbol=\"%s\"", wp->symbol );
+    vik_write_buf_printf ( wb, " symbol=\"%s\"", wp->symbol );
   }
   if ( ! wp->visible )
-    fprintf ( f, " visible=\"n\"" );
-  fprintf ( f, "\n" );
+    vik_write_buf_append ( wb, " visible=\"n\"" );
+  vik_write_buf_append ( wb, "\n" );
+}
+
+static void a_gpspoint_write_double ( VikWriteBuf *wb, const gchar *key, gdouble d )
+{
+  vik_write_buf_append ( wb, key );
+  vik_write_buf_append_double ( wb, d );
+  vik_write_buf_append ( wb, "\"" );
+}
+
+static void a_gpspoint_write_int ( VikWriteBuf *wb, const gchar *key, glong i )
+{
+  vik_write_buf_append ( wb, key );
+  vik_write_buf_append_int ( wb, i );
+  vik_write_buf_append ( wb, "\"" );
 }
 
 static void a_gpspoint_write_trackpoint ( VikTrackpoint *tp, TP_write_info_type *write_info )
 {
-  static struct LatLon ll;
-  gchar *s_lat, *s_lon;
+  struct LatLon ll;
+  VikWriteBuf *wb = write_info->wb;
   vik_coord_to_latlon ( &(tp->coord), &ll );
 
-  FILE *f = write_info->f;
-
-  /* TODO: modify a_coords_dtostr() to accept (optional) buffer
-   * instead of doing malloc/free everytime */
-  s_lat = a_coords_dtostr(ll.lat);
-  s_lon = a_coords_dtostr(ll.lon);
-  fprintf ( f, "type=\"%spoint\" latitude=\"%s\" longitude=\"%s\"", write_info->is_route ? "route" : "track", s_lat, s_lon );
-  g_free ( s_lat ); 
-  g_free ( s_lon );
+  vik_write_buf_append ( wb, write_info->is_route ? "type=\"routepoint\"" : "type=\"trackpoint\"" );
+  a_gpspoint_write_double ( wb, " latitude=\"", ll.lat );
+  a_gpspoint_write_double ( wb, " longitude=\"", ll.lon );
 
-  if ( tp->altitude != VIK_DEFAULT_ALTITUDE ) {
-    gchar *s_alt = a_coords_dtostr(tp->altitude);
-    fprintf ( f, " altitude=\"%s\"", s_alt );
-    g_free(s_alt);
-  }
+  if ( tp->altitude != VIK_DEFAULT_ALTITUDE )
+    a_gpspoint_write_double ( wb, " altitude=\"", tp->altitude );
   if ( tp->has_timestamp )
-    fprintf ( f, " unixtime=\"%ld\"", tp->timestamp );
+    a_gpspoint_write_int ( wb, " unixtime=\"", tp->timestamp );
   if ( tp->newsegment )
-    fprintf ( f, " newsegment=\"yes\"" );
+    vik_write_buf_append ( wb, " newsegment=\"yes\"" );
 
   if (!isnan(tp->speed) || !isnan(tp->course) || tp->nsats > 0) {
-    fprintf ( f, " extended=\"yes\"" );
-    if (!isnan(tp->speed)) {
-      gchar *s_speed = a_coords_dtostr(tp->speed);
-      fprintf ( f, " speed=\"%s\"", s_speed );
-      g_free(s_speed);
-    }
-    if (!isnan(tp->course)) {
-      gchar *s_course = a_coords_dtostr(tp->course);
-      fprintf ( f, " course=\"%s\"", s_course );
-      g_free(s_course);
-    }
+    vik_write_buf_append ( wb, " extended=\"yes\"" );
+    if (!isnan(tp->speed))
+      a_gpspoint_write_double ( wb, " speed=\"", tp->speed );
+    if (!isnan(tp->course))
+      a_gpspoint_write_double ( wb, " course=\"", tp->course );
     if (tp->nsats > 0)
-      fprintf ( f, " sat=\"%d\"", tp->nsats );
+      a_gpspoint_write_int ( wb, " sat=\"", tp->nsats );
     if (tp->fix_mode > 0)
-      fprintf ( f, " fix=\"%d\"", tp->fix_mode );
+      a_gpspoint_write_int ( wb, " fix=\"", tp->fix_mode );
   }
-  fprintf ( f, "\n" );
+  vik_write_buf_append ( wb, "\n" );
 }
 
 
-static void a_gpspoint_write_track ( const gpointer id, const VikTrack *trk, FILE *f )
+/*
+ * Only reads the track, as several tracks may be written at once,
+ *  see vik_write_buf_append_items()
+ */
+static void a_gpspoint_write_track ( const VikTrack *trk, VikWriteBuf *wb, gpointer user_data )
 {
   // Sanity clauses
   if ( !trk )
@@ -593,43 +597,50 @@ static void a_gpspoint_write_track ( const gpointer id, const VikTrack *trk, FIL
   if ( !(trk->name) )
     return;
 
-  fprintf ( f, "type=\"%s\" name=\"%s\"", trk->is_route ? "route" : "track", trk->name);
+  vik_write_buf_printf ( wb, "type=\"%s\" name=\"%s\"", trk->is_route ? "route" : "track", trk->name);
 
   if ( trk->comment ) {
     gchar *tmp = slashdup(trk->comment);
-    fprintf ( f, " comment=\"%s\"", tmp );
+    vik_write_buf_printf ( wb, " comment=\"%s\"", tmp );
     g_free ( tmp );
   }
 
   if ( trk->description ) {
     gchar *tmp = slashdup(trk->description);
-    fprintf ( f, " description=\"%s\"", tmp );
+    vik_write_buf_printf ( wb, " description=\"%s\"", tmp );
     g_free ( tmp );
   }
 
   if ( trk->has_color ) {
-    fprintf ( f, " color=#%.2x%.2x%.2x", (int)(trk->color.red/256),(int)(trk->color.green/256),(int)(trk->color.blue/256));
+    vik_write_buf_printf ( wb, " color=#%.2x%.2x%.2x", (int)(trk->color.red/256),(int)(trk->color.green/256),(int)(trk->color.blue/256));
   }
 
   if ( ! trk->visible ) {
-    fprintf ( f, " visible=\"n\"" );
+    vik_write_buf_append ( wb, " visible=\"n\"" );
   }
-  fprintf ( f, "\n" );
+  vik_write_buf_append ( wb, "\n" );
 
-  TP_write_info_type tp_write_info = { f, trk->is_route };
+  TP_write_info_type tp_write_info = { wb, trk->is_route };
   g_list_foreach ( trk->trackpoints, (GFunc) a_gpspoint_write_trackpoint, &tp_write_info );
-  fprintf ( f, "type=\"%send\"\n", trk->is_route ? "route" : "track" );
+  vik_write_buf_printf ( wb, "type=\"%send\"\n", trk->is_route ? "route" : "track" );
 }
 
 void a_gpspoint_write_file ( VikTrwLayer *trw, FILE *f )
 {
-  GHashTable *tracks = vik_trw_layer_get_tracks ( trw );
-  GHashTable *routes = vik_trw_layer_get_routes ( trw );
+  VikWriteBuf *wb = vik_write_buf_new ( f );
+  // g_hash_table_get_values: glib 2.14+
+  GList *tracks = g_hash_table_get_values ( vik_trw_layer_get_tracks ( trw ) );
+  GList *routes = g_hash_table_get_values ( vik_trw_layer_get_routes ( trw ) );
   GHashTable *waypoints = vik_trw_layer_get_waypoints ( trw );
 
-  fprintf ( f, "type=\"waypointlist\"\n" );
-  g_hash_table_foreach ( waypoints, (GHFunc) a_gpspoint_write_waypoint, f );
-  fprintf ( f, "type=\"waypointlistend\"\n" );
-  g_hash_table_foreach ( tracks, (GHFunc) a_gpspoint_write_track, f );
-  g_hash_table_foreach ( routes, (GHFunc) a_gpspoint_write_track, f );
+  vik_write_buf_append ( wb, "type=\"waypointlist\"\n" );
+  g_hash_table_foreach ( waypoints, (GHFunc) a_gpspoint_write_waypoint, wb );
+  vik_write_buf_append ( wb, "type=\"waypointlistend\"\n" );
+  // Tracks are formatted in parallel
+  vik_write_buf_append_items ( wb, tracks, (VikWriteBufItemFunc) a_gpspoint_write_track, NULL );
+  vik_write_buf_append_items ( wb, routes, (VikWriteBufItemFunc) a_gpspoint_write_track, NULL );
+
+  g_list_free ( tracks );
+  g_list_free ( routes );
+  vik_write_buf_free ( wb );
 }
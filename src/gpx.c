@@ -34,6 +34,7 @@
 
 #include "gpx.h"
 #include "viking.h"
+#include "vikwritebuf.h"
 #include <expat.h>
 #ifdef HAVE_STRING_H
 #include <string.h>
@@ -90,7 +91,7 @@ typedef struct tag_mapping {
 
 typedef struct {
 	GpxWritingOptions *options;
-	FILE *file;
+	VikWriteBuf *wb;
 } GpxWritingContext;
 
 /*
@@ -144,13 +145,19 @@ tag_mapping tag_path_map[] = {
         {0}
 };
 
+/* tag_path_map indexed by tag name, built on first use */
+static GHashTable *tag_path_hash = NULL;
+
 static tag_type get_tag(const char *t)
 {
-        tag_mapping *tm;
-        for (tm = tag_path_map; tm->tag_type != 0; tm++)
-                if (0 == strcmp(tm->tag_name, t))
-                        return tm->tag_type;
-        return tt_unknown;
+        if ( ! tag_path_hash ) {
+                tag_mapping *tm;
+                tag_path_hash = g_hash_table_new ( g_str_hash, g_str_equal );
+                for (tm = tag_path_map; tm->tag_type != 0; tm++)
+                        g_hash_table_insert ( tag_path_hash, (gpointer) tm->tag_name, GINT_TO_POINTER(tm->tag_type) );
+        }
+        /* tt_unknown is 0, as is a failed lookup */
+        return GPOINTER_TO_INT ( g_hash_table_lookup ( tag_path_hash, t ) );
 }
 
 /******************************************/
@@ -158,11 +165,13 @@ static tag_type get_tag(const char *t)
 tag_type current_tag = tt_unknown;
 GString *xpath = NULL;
 GString *c_cdata = NULL;
+/* tag of each element enclosing the current one, so ending an element needs no lookup */
+GArray *tag_stack = NULL;
 
 /* current ("c_") objects */
 VikTrackpoint *c_tp = NULL;
 VikWaypoint *c_wp = NULL;
-VikTrack *c_tr = NULL;
+VikTrack *c_tr = NULL; /* trackpoints are prepended while reading, reversed at the end of the track */
 
 gchar *c_wp_name = NULL;
 gchar *c_tr_name = NULL;
@@ -203,6 +212,7 @@ static void gpx_start(VikTrwLayer *vtl, const char *el, const char **attr)
 
   g_string_append_c ( xpath, '/' );
   g_string_append ( xpath, el );
+  g_array_append_val ( tag_stack, current_tag );
   current_tag = get_tag ( xpath->str );
 
   switch ( current_tag ) {
@@ -239,7 +249,7 @@ static void gpx_start(VikTrwLayer *vtl, const char *el, const char **attr)
            c_tp->newsegment = TRUE;
            f_tr_newseg = FALSE;
          }
-         c_tr->trackpoints = g_list_append ( c_tr->trackpoints, c_tp );
+         c_tr->trackpoints = g_list_prepend ( c_tr->trackpoints, c_tp );
        }
        break;
 
@@ -279,6 +289,81 @@ static void gpx_start(VikTrwLayer *vtl, const char *el, const char **attr)
   }
 }
 
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+#define DIGITS2(s) (((s)[0]-'0')*10 + ((s)[1]-'0'))
+
+/*
+ * Converts the usual form of GPX times, "YYYY-MM-DDThh:mm:ss[.sss][Z|+hh:mm|-hh:mm]",
+ *  without allocating nor calling mktime(), which looks up the timezone every time.
+ * Returns: FALSE for anything else, to be left to g_time_val_from_iso8601()
+ */
+static gboolean iso8601_to_time ( const gchar *s, glong *t )
+{
+  gint year, month, day, hour, min, sec, offset = 0;
+  glong era, yoe, doy, doe, days;
+
+  while ( g_ascii_isspace ( *s ) )
+    s++;
+
+  if ( ! (IS_DIGIT(s[0]) && IS_DIGIT(s[1]) && IS_DIGIT(s[2]) && IS_DIGIT(s[3]) && s[4] == '-' &&
+          IS_DIGIT(s[5]) && IS_DIGIT(s[6]) && s[7] == '-' && IS_DIGIT(s[8]) && IS_DIGIT(s[9]) &&
+          (s[10] == 'T' || s[10] == 't' || s[10] == ' ') &&
+          IS_DIGIT(s[11]) && IS_DIGIT(s[12]) && s[13] == ':' && IS_DIGIT(s[14]) && IS_DIGIT(s[15]) && s[16] == ':' &&
+          IS_DIGIT(s[17]) && IS_DIGIT(s[18])) )
+    return FALSE;
+
+  year = DIGITS2(s) * 100 + DIGITS2(s+2);
+  month = DIGITS2(s+5);
+  day = DIGITS2(s+8);
+  hour = DIGITS2(s+11);
+  min = DIGITS2(s+14);
+  sec = DIGITS2(s+17);
+  s += 19;
+
+  if ( month < 1 || month > 12 || day < 1 || day > 31 || hour > 24 || min > 59 || sec > 60 )
+    return FALSE;
+
+  /* fractions of seconds are dropped, as by g_time_val_from_iso8601() into tv_sec */
+  if ( *s == '.' || *s == ',' ) {
+    s++;
+    while ( IS_DIGIT(*s) )
+      s++;
+  }
+
+  if ( *s == 'Z' || *s == 'z' )
+    s++;
+  else if ( (*s == '+' || *s == '-') && IS_DIGIT(s[1]) && IS_DIGIT(s[2]) ) {
+    gint sign = (*s == '-') ? -1 : 1;
+    offset = DIGITS2(s+1) * 3600;
+    s += 3;
+    if ( *s == ':' )
+      s++;
+    if ( IS_DIGIT(s[0]) && IS_DIGIT(s[1]) ) {
+      offset += DIGITS2(s) * 60;
+      s += 2;
+    }
+    offset *= sign;
+  }
+  else
+    return FALSE; /* local time */
+
+  while ( g_ascii_isspace ( *s ) )
+    s++;
+  if ( *s )
+    return FALSE;
+
+  /* days since 1970-01-01 in the proleptic Gregorian calendar */
+  year -= (month <= 2);
+  era = (year >= 0 ? year : year - 399) / 400;
+  yoe = year - era * 400;
+  doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  days = era * 146097 + doe - 719468;
+
+  *t = days * 86400 + hour * 3600 + min * 60 + sec - offset;
+  return TRUE;
+}
+
 static void gpx_end(VikTrwLayer *vtl, const char *el)
 {
   static GTimeVal tp_time;
@@ -301,6 +386,7 @@ static void gpx_end(VikTrwLayer *vtl, const char *el)
      case tt_rte:
        if ( ! c_tr_name )
          c_tr_name = g_strdup_printf("VIKING_TR%d", unnamed_tracks++);
+       c_tr->trackpoints = g_list_reverse ( c_tr->trackpoints );
        vik_trw_layer_filein_add_track ( vtl, c_tr_name, c_tr );
        g_free ( c_tr_name );
        c_tr = NULL;
@@ -366,7 +452,7 @@ static void gpx_end(VikTrwLayer *vtl, const char *el)
        break;
 
      case tt_trk_trkseg_trkpt_time:
-       if ( g_time_val_from_iso8601(c_cdata->str, &tp_time) ) {
+       if ( iso8601_to_time(c_cdata->str, &tp_time.tv_sec) || g_time_val_from_iso8601(c_cdata->str, &tp_time) ) {
          c_tp->timestamp = tp_time.tv_sec;
          c_tp->has_timestamp = TRUE;
        }
@@ -416,7 +502,8 @@ static void gpx_end(VikTrwLayer *vtl, const char *el)
      default: break;
   }
 
-  current_tag = get_tag ( xpath->str );
+  current_tag = g_array_index ( tag_stack, tag_type, tag_stack->len - 1 );
+  g_array_set_size ( tag_stack, tag_stack->len - 1 );
 }
 
 static void gpx_cdata(void *dta, const XML_Char *s, int len)
@@ -451,34 +538,58 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
 // make like a "stack" of tag names
 // like gpspoint's separated like /gpx/wpt/whatever
 
+/* Big reads, straight into expat's own buffer */
+#define GPX_READ_SIZE (256*1024)
+
 gboolean a_gpx_read_file( VikTrwLayer *vtl, FILE *f ) {
   XML_Parser parser = XML_ParserCreate(NULL);
   int done=0, len;
   enum XML_Status status = XML_STATUS_ERROR;
+  void *buf;
 
   XML_SetElementHandler(parser, (XML_StartElementHandler) gpx_start, (XML_EndElementHandler) gpx_end);
   XML_SetUserData(parser, vtl); /* in the future we could remove all global variables */
   XML_SetCharacterDataHandler(parser, (XML_CharacterDataHandler) gpx_cdata);
 
-  gchar buf[4096];
-
   g_assert ( f != NULL && vtl != NULL );
 
   xpath = g_string_new ( "" );
   c_cdata = g_string_new ( "" );
+  tag_stack = g_array_new ( FALSE, FALSE, sizeof(tag_type) );
+  current_tag = tt_unknown;
 
   unnamed_waypoints = 0;
   unnamed_tracks = 0;
 
   while (!done) {
-    len = fread(buf, 1, sizeof(buf)-7, f);
+    if ( ! (buf = XML_GetBuffer(parser, GPX_READ_SIZE)) )
+      break;
+    len = fread(buf, 1, GPX_READ_SIZE, f);
     done = feof(f) || !len;
-    status = XML_Parse(parser, buf, len, done);
+    status = XML_ParseBuffer(parser, len, done);
+    if ( status == XML_STATUS_ERROR )
+      break;
   }
- 
+
+  /* Whatever was being read when the file ended early */
+  if ( c_tr ) {
+    vik_track_free ( c_tr );
+    c_tr = NULL;
+  }
+  if ( c_wp ) {
+    vik_waypoint_free ( c_wp );
+    c_wp = NULL;
+  }
+  g_free ( c_tr_name );
+  c_tr_name = NULL;
+  g_free ( c_wp_name );
+  c_wp_name = NULL;
+
   XML_ParserFree (parser);
   g_string_free ( xpath, TRUE );
   g_string_free ( c_cdata, TRUE );
+  g_array_free ( tag_stack, TRUE );
+  tag_stack = NULL;
 
   return status != XML_STATUS_ERROR;
 }
@@ -658,19 +769,17 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
   if (context->options && !context->options->hidden && !wp->visible)
     return;
 
-  FILE *f = context->file;
-  static struct LatLon ll;
-  gchar *s_lat,*s_lon;
+  VikWriteBuf *wb = context->wb;
+  struct LatLon ll;
   gchar *tmp;
   vik_coord_to_latlon ( &(wp->coord), &ll );
-  s_lat = a_coords_dtostr( ll.lat );
-  s_lon = a_coords_dtostr( ll.lon );
   // NB 'hidden' is not part of any GPX standard - this appears to be a made up Viking 'extension'
   //  luckily most other GPX processing software ignores things they don't understand
-  fprintf ( f, "<wpt lat=\"%s\" lon=\"%s\"%s>\n",
-               s_lat, s_lon, wp->visible ? "" : " hidden=\"hidden\"" );
-  g_free ( s_lat );
-  g_free ( s_lon );
+  vik_write_buf_append ( wb, "<wpt lat=\"" );
+  vik_write_buf_append_double ( wb, ll.lat );
+  vik_write_buf_append ( wb, "\" lon=\"" );
+  vik_write_buf_append_double ( wb, ll.lon );
+  vik_write_buf_append ( wb, wp->visible ? "\">\n" : "\" hidden=\"hidden\">\n" );
 
   // Sanity clause
   if ( wp->name )
@@ -678,149 +787,127 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
   else
     tmp = g_strdup ("waypoint");
 
-  fprintf ( f, "  <name>%s</name>\n", tmp );
+  vik_write_buf_printf ( wb, "  <name>%s</name>\n", tmp );
   g_free ( tmp);
 
   if ( wp->altitude != VIK_DEFAULT_ALTITUDE )
   {
-    tmp = a_coords_dtostr ( wp->altitude );
-    fprintf ( f, "  <ele>%s</ele>\n", tmp );
-    g_free ( tmp );
+    vik_write_buf_append ( wb, "  <ele>" );
+    vik_write_buf_append_double ( wb, wp->altitude );
+    vik_write_buf_append ( wb, "</ele>\n" );
   }
   if ( wp->comment )
   {
     tmp = entitize(wp->comment);
-    fprintf ( f, "  <cmt>%s</cmt>\n", tmp );
+    vik_write_buf_printf ( wb, "  <cmt>%s</cmt>\n", tmp );
     g_free ( tmp );
   }
   if ( wp->description )
   {
     tmp = entitize(wp->description);
-    fprintf ( f, "  <desc>%s</desc>\n", tmp );
+    vik_write_buf_printf ( wb, "  <desc>%s</desc>\n", tmp );
     g_free ( tmp );
   }
   if ( wp->image )
   {
     tmp = entitize(wp->image);
-    fprintf ( f, "  <link>%s</link>\n", tmp );
+    vik_write_buf_printf ( wb, "  <link>%s</link>\n", tmp );
     g_free ( tmp );
   }
   if ( wp->symbol ) 
   {
     tmp = entitize(wp->symbol);
-    fprintf ( f, "  <sym>%s</sym>\n", tmp);
+    vik_write_buf_printf ( wb, "  <sym>%s</sym>\n", tmp);
     g_free ( tmp );
   }
 
-  fprintf ( f, "</wpt>\n" );
+  vik_write_buf_append ( wb, "</wpt>\n" );
 }
 
-static void gpx_write_trackpoint ( VikTrackpoint *tp, GpxWritingContext *context )
+static void gpx_write_element_double ( VikWriteBuf *wb, const gchar *open, gdouble d, const gchar *close )
+{
+  vik_write_buf_append ( wb, open );
+  vik_write_buf_append_double ( wb, d );
+  vik_write_buf_append ( wb, close );
+}
+
+/*
+ * Called from several threads at once, see gpx_write_track()
+ */
+static void gpx_write_trackpoint ( VikTrackpoint *tp, gboolean first, VikWriteBuf *wb, GpxWritingOptions *options )
 {
-  FILE *f = context->file;
-  static struct LatLon ll;
-  gchar *s_lat,*s_lon, *s_alt, *s_dop;
-  gchar *time_iso8601;
+  struct LatLon ll;
+  gboolean is_route = options && options->is_route;
   vik_coord_to_latlon ( &(tp->coord), &ll );
 
   // No such thing as a rteseg! So make sure we don't put them in
-  if ( context->options && !context->options->is_route && tp->newsegment )
-    fprintf ( f, "  </trkseg>\n  <trkseg>\n" );
+  // Nor before the first point, which has already opened a trkseg
+  if ( !is_route && tp->newsegment && !first )
+    vik_write_buf_append ( wb, "  </trkseg>\n  <trkseg>\n" );
 
-  s_lat = a_coords_dtostr( ll.lat );
-  s_lon = a_coords_dtostr( ll.lon );
-  fprintf ( f, "  <%spt lat=\"%s\" lon=\"%s\">\n", (context->options && context->options->is_route) ? "rte" : "trk", s_lat, s_lon );
-  g_free ( s_lat ); s_lat = NULL;
-  g_free ( s_lon ); s_lon = NULL;
+  vik_write_buf_append ( wb, is_route ? "  <rtept lat=\"" : "  <trkpt lat=\"" );
+  vik_write_buf_append_double ( wb, ll.lat );
+  vik_write_buf_append ( wb, "\" lon=\"" );
+  vik_write_buf_append_double ( wb, ll.lon );
+  vik_write_buf_append ( wb, "\">\n" );
 
-  s_alt = NULL;
   if ( tp->altitude != VIK_DEFAULT_ALTITUDE )
-  {
-    s_alt = a_coords_dtostr ( tp->altitude );
-  }
-  else if ( context->options != NULL && context->options->force_ele )
-  {
-    s_alt = a_coords_dtostr ( 0 );
-  }
-  if (s_alt != NULL)
-    fprintf ( f, "    <ele>%s</ele>\n", s_alt );
-  g_free ( s_alt ); s_alt = NULL;
-  
-  time_iso8601 = NULL;
+    gpx_write_element_double ( wb, "    <ele>", tp->altitude, "</ele>\n" );
+  else if ( options != NULL && options->force_ele )
+    gpx_write_element_double ( wb, "    <ele>", 0, "</ele>\n" );
+
   if ( tp->has_timestamp ) {
-    GTimeVal timestamp;
-    timestamp.tv_sec = tp->timestamp;
-    timestamp.tv_usec = 0;
-  
-    time_iso8601 = g_time_val_to_iso8601 ( &timestamp );
+    vik_write_buf_append ( wb, "    <time>" );
+    vik_write_buf_append_iso8601 ( wb, tp->timestamp );
+    vik_write_buf_append ( wb, "</time>\n" );
   }
-  else if ( context->options != NULL && context->options->force_time )
+  else if ( options != NULL && options->force_time )
   {
     GTimeVal current;
+    gchar *time_iso8601;
     g_get_current_time ( &current );
   
     time_iso8601 = g_time_val_to_iso8601 ( &current );
+    vik_write_buf_printf ( wb, "    <time>%s</time>\n", time_iso8601 );
+    g_free ( time_iso8601 );
   }
-  if ( time_iso8601 != NULL )
-    fprintf ( f, "    <time>%s</time>\n", time_iso8601 );
-  g_free(time_iso8601);
-  time_iso8601 = NULL;
   
-  if (!isnan(tp->course)) {
-    gchar *s_course = a_coords_dtostr(tp->course);
-    fprintf ( f, "    <course>%s</course>\n", s_course );
-    g_free(s_course);
-  }
-  if (!isnan(tp->speed)) {
-    gchar *s_speed = a_coords_dtostr(tp->speed);
-    fprintf ( f, "    <speed>%s</speed>\n", s_speed );
-    g_free(s_speed);
-  }
+  if (!isnan(tp->course))
+    gpx_write_element_double ( wb, "    <course>", tp->course, "</course>\n" );
+  if (!isnan(tp->speed))
+    gpx_write_element_double ( wb, "    <speed>", tp->speed, "</speed>\n" );
   if (tp->fix_mode == VIK_GPS_MODE_2D)
-    fprintf ( f, "    <fix>2d</fix>\n");
+    vik_write_buf_append ( wb, "    <fix>2d</fix>\n");
   if (tp->fix_mode == VIK_GPS_MODE_3D)
-    fprintf ( f, "    <fix>3d</fix>\n");
-  if (tp->nsats > 0)
-    fprintf ( f, "    <sat>%d</sat>\n", tp->nsats );
-
-  s_dop = NULL;
-  if ( tp->hdop != VIK_DEFAULT_DOP )
-  {
-    s_dop = a_coords_dtostr ( tp->hdop );
+    vik_write_buf_append ( wb, "    <fix>3d</fix>\n");
+  if (tp->nsats > 0) {
+    vik_write_buf_append ( wb, "    <sat>" );
+    vik_write_buf_append_int ( wb, tp->nsats );
+    vik_write_buf_append ( wb, "</sat>\n" );
   }
-  if (s_dop != NULL)
-    fprintf ( f, "    <hdop>%s</hdop>\n", s_dop );
-  g_free ( s_dop ); s_dop = NULL;
 
+  if ( tp->hdop != VIK_DEFAULT_DOP )
+    gpx_write_element_double ( wb, "    <hdop>", tp->hdop, "</hdop>\n" );
   if ( tp->vdop != VIK_DEFAULT_DOP )
-  {
-    s_dop = a_coords_dtostr ( tp->vdop );
-  }
-  if (s_dop != NULL)
-    fprintf ( f, "    <vdop>%s</vdop>\n", s_dop );
-  g_free ( s_dop ); s_dop = NULL;
-
+    gpx_write_element_double ( wb, "    <vdop>", tp->vdop, "</vdop>\n" );
   if ( tp->pdop != VIK_DEFAULT_DOP )
-  {
-    s_dop = a_coords_dtostr ( tp->pdop );
-  }
-  if (s_dop != NULL)
-    fprintf ( f, "    <pdop>%s</pdop>\n", s_dop );
-  g_free ( s_dop ); s_dop = NULL;
+    gpx_write_element_double ( wb, "    <pdop>", tp->pdop, "</pdop>\n" );
 
-  fprintf ( f, "  </%spt>\n", (context->options && context->options->is_route) ? "rte" : "trk" );
+  vik_write_buf_append ( wb, is_route ? "  </rtept>\n" : "  </trkpt>\n" );
 }
 
-
-static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
+/*
+ * Only reads the track and options, as several tracks may be written at once,
+ *  see vik_write_buf_append_items()
+ */
+static void gpx_write_track ( VikTrack *t, VikWriteBuf *wb, GpxWritingOptions *options )
 {
   // Don't write invisible tracks when specified
-  if (context->options && !context->options->hidden && !t->visible)
+  if (options && !options->hidden && !t->visible)
     return;
 
-  FILE *f = context->file;
   gchar *tmp;
-  gboolean first_tp_is_newsegment = FALSE; /* must temporarily make it not so, but we want to restore state. not that it matters. */
+  GList *iter;
 
   // Sanity clause
   if ( t->name )
@@ -830,56 +917,52 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
 
   // NB 'hidden' is not part of any GPX standard - this appears to be a made up Viking 'extension'
   //  luckily most other GPX processing software ignores things they don't understand
-  fprintf ( f, "<%s%s>\n  <name>%s</name>\n",
-	    t->is_route ? "rte" : "trk",
-	    t->visible ? "" : " hidden=\"hidden\"",
-	    tmp );
+  vik_write_buf_printf ( wb, "<%s%s>\n  <name>%s</name>\n",
+                         t->is_route ? "rte" : "trk",
+                         t->visible ? "" : " hidden=\"hidden\"",
+                         tmp );
   g_free ( tmp );
 
   if ( t->comment )
   {
     tmp = entitize ( t->comment );
-    fprintf ( f, "  <cmt>%s</cmt>\n", tmp );
+    vik_write_buf_printf ( wb, "  <cmt>%s</cmt>\n", tmp );
     g_free ( tmp );
   }
 
   if ( t->description )
   {
     tmp = entitize ( t->description );
-    fprintf ( f, "  <desc>%s</desc>\n", tmp );
+    vik_write_buf_printf ( wb, "  <desc>%s</desc>\n", tmp );
     g_free ( tmp );
   }
 
   /* No such thing as a rteseg! */
   if ( !t->is_route )
-    fprintf ( f, "  <trkseg>\n" );
+    vik_write_buf_append ( wb, "  <trkseg>\n" );
 
-  if ( t->trackpoints && t->trackpoints->data ) {
-    first_tp_is_newsegment = VIK_TRACKPOINT(t->trackpoints->data)->newsegment;
-    VIK_TRACKPOINT(t->trackpoints->data)->newsegment = FALSE; /* so we won't write </trkseg><trkseg> already */
-    g_list_foreach ( t->trackpoints, (GFunc) gpx_write_trackpoint, context );
-    VIK_TRACKPOINT(t->trackpoints->data)->newsegment = first_tp_is_newsegment; /* restore state */
-  }
+  for ( iter = t->trackpoints; iter; iter = iter->next )
+    gpx_write_trackpoint ( VIK_TRACKPOINT(iter->data), iter == t->trackpoints, wb, options );
 
   /* NB apparently no such thing as a rteseg! */
   if (!t->is_route)
-    fprintf ( f, "  </trkseg>\n");
+    vik_write_buf_append ( wb, "  </trkseg>\n");
 
-  fprintf ( f, "</%s>\n", t->is_route ? "rte" : "trk" );
+  vik_write_buf_printf ( wb, "</%s>\n", t->is_route ? "rte" : "trk" );
 }
 
-static void gpx_write_header( FILE *f )
+static void gpx_write_header( VikWriteBuf *wb )
 {
-  fprintf(f, "<?xml version=\"1.0\"?>\n"
+  vik_write_buf_append ( wb, "<?xml version=\"1.0\"?>\n"
           "<gpx version=\"1.0\" creator=\"Viking -- http://viking.sf.net/\"\n"
           "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n"
           "xmlns=\"http://www.topografix.com/GPX/1/0\"\n"
           "xsi:schemaLocation=\"http://www.topografix.com/GPX/1/0 http://www.topografix.com/GPX/1/0/gpx.xsd\">\n");
 }
 
-static void gpx_write_footer( FILE *f )
+static void gpx_write_footer( VikWriteBuf *wb )
 {
-  fprintf(f, "</gpx>\n");
+  vik_write_buf_append ( wb, "</gpx>\n");
 }
 
 static int gpx_waypoint_compare(const void *x, const void *y)
@@ -927,11 +1010,11 @@ static int gpx_track_compare_timestamp (const void *x, const void *y)
   return 0;
 }
 
-void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options )
+static void gpx_write_layer ( VikTrwLayer *vtl, VikWriteBuf *wb, GpxWritingOptions *options )
 {
-  GpxWritingContext context = { options, f };
+  GpxWritingContext context = { options, wb };
 
-  gpx_write_header ( f );
+  gpx_write_header ( context.wb );
 
   // gather waypoints in a list, then sort
   // g_hash_table_get_values: glib 2.14+
@@ -959,34 +1042,64 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options )
   // g_list_concat doesn't copy memory properly
   // so process each list separately
 
-  GpxWritingContext context_tmp = context;
+  GpxWritingOptions *opt = context.options;
   GpxWritingOptions opt_tmp = { FALSE, FALSE, FALSE };
   // Force trackpoints on tracks
-  if ( !context.options )
-    context_tmp.options = &opt_tmp;
-  context_tmp.options->is_route = FALSE;
+  if ( !opt )
+    opt = &opt_tmp;
+  opt->is_route = FALSE;
 
-  // Loop around each list and write each one
-  for (iter = g_list_first (gl); iter != NULL; iter = g_list_next (iter)) {
-    gpx_write_track ( (VikTrack*)iter->data, &context_tmp );
-  }
+  // Write each one, the tracks being formatted in parallel
+  vik_write_buf_append_items ( context.wb, gl, (VikWriteBufItemFunc) gpx_write_track, opt );
 
   // Routes (to get routepoints)
-  context_tmp.options->is_route = TRUE;
-  for (iter = g_list_first (glrte); iter != NULL; iter = g_list_next (iter)) {
-    gpx_write_track ( (VikTrack*)iter->data, &context_tmp );
-  }
+  opt->is_route = TRUE;
+  vik_write_buf_append_items ( context.wb, glrte, (VikWriteBufItemFunc) gpx_write_track, opt );
 
   g_list_free ( gl );
   g_list_free ( glrte );
 
-  gpx_write_footer ( f );
+  gpx_write_footer ( context.wb );
+}
+
+static void gpx_write_single_track ( VikTrack *trk, VikWriteBuf *wb, GpxWritingOptions *options )
+{
+  gpx_write_header ( wb );
+  gpx_write_track ( trk, wb, options );
+  gpx_write_footer ( wb );
+}
+
+void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options )
+{
+  VikWriteBuf *wb = vik_write_buf_new ( f );
+  gpx_write_layer ( vtl, wb, options );
+  vik_write_buf_free ( wb );
 }
 
 void a_gpx_write_track_file ( VikTrack *trk, FILE *f, GpxWritingOptions *options )
 {
-  GpxWritingContext context = {options, f};
-  gpx_write_header ( f );
-  gpx_write_track ( trk, &context );
-  gpx_write_footer ( f );
+  VikWriteBuf *wb = vik_write_buf_new ( f );
+  gpx_write_single_track ( trk, wb, options );
+  vik_write_buf_free ( wb );
+}
+
+/**
+ * a_gpx_write_string:
+ *
+ * As a_gpx_write_file(), into memory.
+ *
+ * Returns: The GPX, to be freed with g_string_free()
+ */
+GString *a_gpx_write_string ( VikTrwLayer *vtl, GpxWritingOptions *options )
+{
+  VikWriteBuf *wb = vik_write_buf_new ( NULL );
+  gpx_write_layer ( vtl, wb, options );
+  return vik_write_buf_free_to_string ( wb );
+}
+
+GString *a_gpx_write_track_string ( VikTrack *trk, GpxWritingOptions *options )
+{
+  VikWriteBuf *wb = vik_write_buf_new ( NULL );
+  gpx_write_single_track ( trk, wb, options );
+  return vik_write_buf_free_to_string ( wb );
 }
@@ -39,6 +39,8 @@ typedef struct {
 gboolean a_gpx_read_file ( VikTrwLayer *trw, FILE *f );
 void a_gpx_write_file ( VikTrwLayer *trw, FILE *f, GpxWritingOptions *options );
 void a_gpx_write_track_file ( VikTrack *trk, FILE *f, GpxWritingOptions *options );
+GString *a_gpx_write_string ( VikTrwLayer *trw, GpxWritingOptions *options );
+GString *a_gpx_write_track_string ( VikTrack *trk, GpxWritingOptions *options );
 
 G_END_DECLS
 
@@ -26,6 +26,7 @@
 #include "viking.h"
 #include "icons/icons.h"
 #include "mapcache.h"
+#include "dircache.h"
 #include "background.h"
 #include "dems.h"
 #include "babel.h"
@@ -34,6 +35,7 @@
 #include "viklayer_defaults.h"
 #include "globals.h"
 #include "vikmapslayer.h"
+#include "render.h"
 
 #ifdef VIK_CONFIG_GEOCACHES
 void a_datasource_gc_init();
@@ -97,15 +99,77 @@ static int myXErrorHandler(Display *display, XErrorEvent *theEvent)
 }
 #endif
 
+static gchar *convert_filename = NULL;
+static gchar *render_filename = NULL;
+static gchar *render_bbox = NULL;
+static gdouble render_zoom = 0.0;
+
 /* Options */
 static GOptionEntry entries[] = 
 {
   { "debug", 'd', 0, G_OPTION_ARG_NONE, &vik_debug, N_("Enable debug output"), NULL },
   { "verbose", 'V', 0, G_OPTION_ARG_NONE, &vik_verbose, N_("Enable verbose output"), NULL },
   { "version", 'v', 0, G_OPTION_ARG_NONE, &vik_version, N_("Show version"), NULL },
+  { "convert", 0, 0, G_OPTION_ARG_FILENAME, &convert_filename, N_("Save the file given as FILE and exit, as a text or binary (.vikb) Viking file according to its extension"), N_("FILE") },
+  { "render", 0, 0, G_OPTION_ARG_FILENAME, &render_filename, N_("Draw the area given by --bbox of the files given into the image FILE (.png or .jpg) and exit, without showing any window (an X display is still needed, e.g. from xvfb-run)"), N_("FILE") },
+  { "bbox", 0, 0, G_OPTION_ARG_STRING, &render_bbox, N_("Area to render, in degrees"), N_("SOUTH,WEST,NORTH,EAST") },
+  { "zoom", 0, 0, G_OPTION_ARG_DOUBLE, &render_zoom, N_("Metres per pixel to render at (default: as in the files)"), N_("MPP") },
   { NULL }
 };
 
+/*
+ * Load the files given and draw the area asked for into an image
+ */
+static gboolean render_files ( int argc, char *argv[] )
+{
+  VikViewport *vvp;
+  VikAggregateLayer *top;
+  LatLonBBox bbox;
+  gchar **parts = NULL;
+  gboolean ok = TRUE;
+  int i;
+
+  if ( render_bbox )
+    parts = g_strsplit ( render_bbox, ",", -1 );
+  if ( ! parts || g_strv_length ( parts ) != 4 ) {
+    g_fprintf ( stderr, _("The area to render is needed, as --bbox=SOUTH,WEST,NORTH,EAST\n") );
+    g_strfreev ( parts );
+    return FALSE;
+  }
+  bbox.south = g_ascii_strtod ( parts[0], NULL );
+  bbox.west = g_ascii_strtod ( parts[1], NULL );
+  bbox.north = g_ascii_strtod ( parts[2], NULL );
+  bbox.east = g_ascii_strtod ( parts[3], NULL );
+  g_strfreev ( parts );
+
+  gdk_threads_enter ();
+  // Only for loading into and as the starting point, as the image is drawn through one of its own
+  vvp = vik_viewport_new_offscreen ( NULL, 1, 1 );
+  vik_viewport_set_draw_highlight ( vvp, FALSE );
+  top = vik_aggregate_layer_new ();
+
+  for ( i = 1; i < argc && ok; i++ ) {
+    if ( a_file_load ( top, vvp, argv[i] ) <= LOAD_TYPE_UNSUPPORTED_FAILURE ) {
+      g_fprintf ( stderr, _("Unable to load %s\n"), argv[i] );
+      ok = FALSE;
+    }
+  }
+  // Such as DEM files, which are loaded in the background
+  a_background_wait_all ();
+
+  if ( ok ) {
+    gboolean as_jpeg = check_file_ext ( render_filename, ".jpg" ) || check_file_ext ( render_filename, ".jpeg" );
+    ok = a_render_bbox_file ( top, vvp, &bbox, render_zoom, render_filename, ! as_jpeg );
+    if ( ! ok )
+      g_fprintf ( stderr, _("Unable to render %s\n"), render_filename );
+  }
+
+  g_object_unref ( top );
+  g_object_unref ( vvp );
+  gdk_threads_leave ();
+  return ok;
+}
+
 int main( int argc, char *argv[] )
 {
   VikWindow *first_window;
@@ -176,12 +240,31 @@ int main( int argc, char *argv[] )
 
   maps_layer_init ();
   a_mapcache_init ();
+  a_dircache_init ();
   a_background_init ();
 
 #ifdef VIK_CONFIG_GEOCACHES
   a_datasource_gc_init();
 #endif
 
+  if ( convert_filename ) {
+    if ( argc != 2 ) {
+      g_fprintf ( stderr, _("Exactly one file to convert is needed\n") );
+      return EXIT_FAILURE;
+    }
+    if ( ! a_file_convert ( argv[1], convert_filename ) ) {
+      g_fprintf ( stderr, _("Unable to convert %s to %s\n"), argv[1], convert_filename );
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  if ( render_filename ) {
+    gboolean ok = render_files ( argc, argv );
+    a_background_uninit ();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
   /* Set the icon */
   main_icon = gdk_pixbuf_from_pixdata(&viking_pixbuf, FALSE, NULL);
   gtk_window_set_default_icon(main_icon);
@@ -213,7 +296,9 @@ int main( int argc, char *argv[] )
   a_babel_uninit ();
 
   a_background_uninit ();
+  maps_layer_uninit ();
   a_mapcache_uninit ();
+  a_dircache_uninit ();
   a_dems_uninit ();
   a_layer_defaults_uninit ();
   a_preferences_uninit ();
@@ -31,14 +31,54 @@
 
 #include "config.h"
 
-typedef struct _List {
-  struct _List *next;
-  gchar *key;
-} List;
-
-/* a circular linked list, a pointer to the tail, and the tail points to the head */
-/* this is so we can free the last */
-static List *queue_tail = NULL;
+/*
+ * Tiles are identified by a packed binary key rather than a formatted string,
+ *  so a lookup is a hash of a few integers and no allocation.
+ * Shrink factors are quantised to 1/1000th, which is the precision the old
+ *  "%.3f" string key used.
+ */
+typedef struct {
+  gint x, y, z;
+  guint zoom;
+  gint32 xshrink, yshrink;
+  guint8 type;
+  guint8 alpha;
+} CacheKey;
+
+/*
+ * Key of the secondary index: a tile regardless of alpha and shrink factors
+ */
+typedef struct {
+  gint x, y, z;
+  guint zoom;
+  guint8 type;
+} TileKey;
+
+struct _TileEntry;
+
+/*
+ * Every cached tile is also a node of a doubly linked LRU list:
+ *  the head is the most recently used, the tail is the next to be evicted.
+ * It is also a node in the list of all cached variants of the same tile.
+ */
+typedef struct _CacheItem {
+  CacheKey key;
+  GdkPixbuf *pixbuf;
+  guint32 size;
+  struct _CacheItem *prev;
+  struct _CacheItem *next;
+  struct _TileEntry *tile;
+  struct _CacheItem *vprev;
+  struct _CacheItem *vnext;
+} CacheItem;
+
+typedef struct _TileEntry {
+  TileKey key;
+  CacheItem *variants;
+} TileEntry;
+
+static CacheItem *lru_head = NULL;
+static CacheItem *lru_tail = NULL;
 static int queue_count = 0;
 
 static guint32 queue_size = 0;
@@ -46,11 +86,12 @@ static guint32 max_queue_size = VIK_CONFIG_MAPCACHE_SIZE * 1024 * 1024;
 
 
 static GHashTable *cache = NULL;
+/* TileKey -> TileEntry, so invalidating a tile only visits its own variants */
+static GHashTable *tiles = NULL;
 
 static GMutex *mc_mutex = NULL;
 
-#define HASHKEY_FORMAT_STRING "%d-%d-%d-%d-%d-%d-%.3f-%.3f"
-#define HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA "%d-%d-%d-%d-%d-"
+#define SHRINKFACTOR_QUANTUM 1000.0
 
 static VikLayerParamScale params_scales[] = {
   /* min, max, step, digits (decimal places) */
@@ -61,6 +102,72 @@ static VikLayerParam prefs[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "mapcache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map cache memory size (MB):"), VIK_LAYER_WIDGET_HSCALE, params_scales, NULL, NULL },
 };
 
+static guint cache_key_hash ( gconstpointer v )
+{
+  const CacheKey *key = v;
+  /* Simple multiplicative mixing of the fields, x and y vary the most */
+  guint h = (guint) key->x;
+  h = h * 31 + (guint) key->y;
+  h = h * 31 + (guint) key->z;
+  h = h * 31 + key->zoom;
+  h = h * 31 + key->type;
+  h = h * 31 + key->alpha;
+  h = h * 31 + (guint) key->xshrink;
+  h = h * 31 + (guint) key->yshrink;
+  return h;
+}
+
+static gboolean cache_key_equal ( gconstpointer v1, gconstpointer v2 )
+{
+  const CacheKey *k1 = v1;
+  const CacheKey *k2 = v2;
+  return ( k1->x == k2->x && k1->y == k2->y && k1->z == k2->z &&
+           k1->zoom == k2->zoom && k1->type == k2->type && k1->alpha == k2->alpha &&
+           k1->xshrink == k2->xshrink && k1->yshrink == k2->yshrink );
+}
+
+static guint tile_key_hash ( gconstpointer v )
+{
+  const TileKey *key = v;
+  guint h = (guint) key->x;
+  h = h * 31 + (guint) key->y;
+  h = h * 31 + (guint) key->z;
+  h = h * 31 + key->zoom;
+  h = h * 31 + key->type;
+  return h;
+}
+
+static gboolean tile_key_equal ( gconstpointer v1, gconstpointer v2 )
+{
+  const TileKey *k1 = v1;
+  const TileKey *k2 = v2;
+  return ( k1->x == k2->x && k1->y == k2->y && k1->z == k2->z &&
+           k1->zoom == k2->zoom && k1->type == k2->type );
+}
+
+static void tile_entry_free ( TileEntry *te )
+{
+  g_slice_free ( TileEntry, te );
+}
+
+static void cache_key_fill ( CacheKey *key, gint x, gint y, gint z, guint8 type, guint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  key->x = x;
+  key->y = y;
+  key->z = z;
+  key->zoom = zoom;
+  key->type = type;
+  key->alpha = alpha;
+  key->xshrink = (gint32) (xshrinkfactor * SHRINKFACTOR_QUANTUM + 0.5);
+  key->yshrink = (gint32) (yshrinkfactor * SHRINKFACTOR_QUANTUM + 0.5);
+}
+
+static void cache_item_free ( CacheItem *ci )
+{
+  g_object_unref ( ci->pixbuf );
+  g_slice_free ( CacheItem, ci );
+}
+
 void a_mapcache_init ()
 {
   VikLayerParamData tmp;
@@ -68,168 +175,253 @@ void a_mapcache_init ()
   a_preferences_register(prefs, tmp, VIKING_PREFERENCES_GROUP_KEY);
 
   mc_mutex = g_mutex_new();
-  cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_object_unref );
+  /* The key is embedded in the item, so only the value needs freeing */
+  cache = g_hash_table_new_full ( cache_key_hash, cache_key_equal, NULL, (GDestroyNotify) cache_item_free );
+  tiles = g_hash_table_new_full ( tile_key_hash, tile_key_equal, NULL, (GDestroyNotify) tile_entry_free );
 }
 
-static void cache_add(gchar *key, GdkPixbuf *pixbuf)
+/* The following list functions must be called with mc_mutex held */
+
+static void lru_unlink ( CacheItem *ci )
 {
-  /* TODO: Check if already exists */
-  g_hash_table_insert ( cache, key, pixbuf );
-  queue_size += gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
-  queue_size += 100;
-  queue_count++;
+  if ( ci->prev )
+    ci->prev->next = ci->next;
+  else
+    lru_head = ci->next;
+  if ( ci->next )
+    ci->next->prev = ci->prev;
+  else
+    lru_tail = ci->prev;
+  ci->prev = ci->next = NULL;
 }
 
-static void cache_remove(const gchar *key)
+static void lru_push_head ( CacheItem *ci )
 {
-    GdkPixbuf *buf = g_hash_table_lookup ( cache, key );
-    if (buf) {
-      queue_size -= gdk_pixbuf_get_rowstride(buf) * gdk_pixbuf_get_height(buf);
-      queue_size -= 100;
-      queue_count --;
-      g_hash_table_remove ( cache, key );
-    }
+  ci->prev = NULL;
+  ci->next = lru_head;
+  if ( lru_head )
+    lru_head->prev = ci;
+  lru_head = ci;
+  if ( ! lru_tail )
+    lru_tail = ci;
 }
 
-/* returns key from head, adds on newtailkey to tail. */
-static gchar *list_shift_add_entry ( gchar *newtailkey )
+static void tile_index_add ( CacheItem *ci )
 {
-  gchar *oldheadkey = queue_tail->next->key;
-  queue_tail->next->key = newtailkey;
-  queue_tail = queue_tail->next;
-  return oldheadkey;
+  TileKey key;
+  TileEntry *te;
+
+  key.x = ci->key.x;
+  key.y = ci->key.y;
+  key.z = ci->key.z;
+  key.zoom = ci->key.zoom;
+  key.type = ci->key.type;
+
+  te = g_hash_table_lookup ( tiles, &key );
+  if ( ! te ) {
+    te = g_slice_new ( TileEntry );
+    te->key = key;
+    te->variants = NULL;
+    g_hash_table_insert ( tiles, &te->key, te );
+  }
+
+  ci->tile = te;
+  ci->vprev = NULL;
+  ci->vnext = te->variants;
+  if ( te->variants )
+    te->variants->vprev = ci;
+  te->variants = ci;
 }
 
-static gchar *list_shift ()
+static void tile_index_remove ( CacheItem *ci )
 {
-  gchar *oldheadkey = queue_tail->next->key;
-  List *oldhead = queue_tail->next;
-  queue_tail->next = queue_tail->next->next;
-  g_free ( oldhead );
-  return oldheadkey;
+  TileEntry *te = ci->tile;
+
+  if ( ci->vprev )
+    ci->vprev->vnext = ci->vnext;
+  else
+    te->variants = ci->vnext;
+  if ( ci->vnext )
+    ci->vnext->vprev = ci->vprev;
+
+  if ( ! te->variants )
+    /* Frees the entry */
+    g_hash_table_remove ( tiles, &te->key );
+  ci->tile = NULL;
 }
 
-/* adds key to tail */
-static void list_add_entry ( gchar *key )
+static void cache_remove ( CacheItem *ci )
 {
-  List *newlist = g_malloc ( sizeof ( List ) );
-  newlist->key = key;
-  if ( queue_tail ) {
-    newlist->next = queue_tail->next;
-    queue_tail->next = newlist;
-    queue_tail = newlist;
-  } else {
-    newlist->next = newlist;
-    queue_tail = newlist;
-  }
+  lru_unlink ( ci );
+  tile_index_remove ( ci );
+  queue_size -= ci->size;
+  queue_count--;
+  /* Frees the item */
+  g_hash_table_remove ( cache, &ci->key );
 }
 
+/**
+ * a_mapcache_add:
+ *
+ * Add the pixbuf to the cache. The cache takes its own reference to the pixbuf.
+ */
 void a_mapcache_add ( GdkPixbuf *pixbuf, gint x, gint y, gint z, guint8 type, guint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor )
 {
-  gchar *key = g_strdup_printf ( HASHKEY_FORMAT_STRING, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor );
+  CacheItem *ci = g_slice_new ( CacheItem );
+  CacheItem *old;
   static int tmp = 0;
 
+  cache_key_fill ( &ci->key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor );
+  ci->pixbuf = g_object_ref ( pixbuf );
+  ci->size = gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf) + 100;
+  ci->prev = ci->next = NULL;
+
   g_mutex_lock(mc_mutex);
-  cache_add(key, pixbuf);
+
+  /* Another thread may have loaded the same tile in the meantime */
+  old = g_hash_table_lookup ( cache, &ci->key );
+  if ( old )
+    cache_remove ( old );
+
+  g_hash_table_insert ( cache, &ci->key, ci );
+  lru_push_head ( ci );
+  tile_index_add ( ci );
+  queue_size += ci->size;
+  queue_count++;
 
   // TODO: that should be done on preference change only...
   max_queue_size = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_size")->u * 1024 * 1024;
 
-  if ( queue_size > max_queue_size ) {
-    gchar *oldkey = list_shift_add_entry ( key );
-    cache_remove(oldkey);
+  /* Evict least recently used tiles, but always keep the one just added */
+  while ( queue_size > max_queue_size && lru_tail != lru_head )
+    cache_remove ( lru_tail );
 
-    while ( queue_size > max_queue_size &&
-        (queue_tail->next != queue_tail) ) { /* make sure there's more than one thing to delete */
-      oldkey = list_shift ();
-      cache_remove(oldkey);
-    }
+  g_mutex_unlock(mc_mutex);
 
-    /* chop off 'start' etc */
-  } else {
-    list_add_entry ( key );
-    /* business as usual */
+  if ( (++tmp == 100 ))  { g_debug("%s: queue count=%d size=%u", __FUNCTION__, queue_count, queue_size ); tmp=0; }
+}
+
+/**
+ * a_mapcache_get:
+ *
+ * Returns: a new reference to the cached pixbuf (or NULL if not cached).
+ *  The caller must g_object_unref() it when finished with it.
+ *
+ * A hit moves the tile to the front of the eviction list.
+ * Safe to call from any thread.
+ */
+GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint8 type, guint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  CacheKey key;
+  CacheItem *ci;
+  GdkPixbuf *pixbuf = NULL;
+
+  cache_key_fill ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor );
+
+  g_mutex_lock(mc_mutex);
+  ci = g_hash_table_lookup ( cache, &key );
+  if ( ci ) {
+    if ( ci != lru_head ) {
+      lru_unlink ( ci );
+      lru_push_head ( ci );
+    }
+    pixbuf = g_object_ref ( ci->pixbuf );
   }
   g_mutex_unlock(mc_mutex);
 
-  if ( (++tmp == 100 ))  { g_print("DEBUG: queue count=%d size=%u\n", queue_count, queue_size ); tmp=0; }
+  return pixbuf;
 }
 
-GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint8 type, guint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor )
+/* Must be called with mc_mutex held */
+static void remove_tile ( TileKey *key )
 {
-  static char key[48];
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor );
-  return g_hash_table_lookup ( cache, key );
+  TileEntry *te = g_hash_table_lookup ( tiles, key );
+  /* Removing the last variant frees the entry, so stop before touching it again */
+  while ( te ) {
+    gboolean last = ( te->variants->vnext == NULL );
+    cache_remove ( te->variants );
+    if ( last )
+      break;
+  }
 }
 
+/**
+ * a_mapcache_remove_all_shrinkfactors:
+ *
+ * Remove every cached variant (alpha and shrink factors) of a tile.
+ * Costs O(number of variants), not O(cache size).
+ */
 void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint8 type, guint zoom )
 {
-  char key[40];
-  List *loop = queue_tail;
-  List *tmp;
-  gint len;
+  TileKey key;
+  key.x = x;
+  key.y = y;
+  key.z = z;
+  key.zoom = zoom;
+  key.type = type;
 
-  if ( queue_tail == NULL )
-    return;
+  g_mutex_lock(mc_mutex);
+  remove_tile ( &key );
+  g_mutex_unlock(mc_mutex);
+}
 
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA, x, y, z, type, zoom );
-  len = strlen(key);
+/**
+ * a_mapcache_remove_rectangle:
+ *
+ * Remove every cached variant of all the tiles from (x0,y0) to (x1,y1) inclusive.
+ * Intended for invalidating a batch of downloaded tiles in one go.
+ */
+void a_mapcache_remove_rectangle ( gint x0, gint y0, gint x1, gint y1, gint z, guint8 type, guint zoom )
+{
+  gint xmin = MIN(x0, x1), xmax = MAX(x0, x1);
+  gint ymin = MIN(y0, y1), ymax = MAX(y0, y1);
+  guint64 area = (guint64)(xmax - xmin + 1) * (ymax - ymin + 1);
 
   g_mutex_lock(mc_mutex);
-  /* TODO: check logic here */
-  do {
-    tmp = loop->next;
-    if ( strncmp(tmp->key, key, len) == 0 )
-    {
-      cache_remove(tmp->key);
-      if ( tmp == loop ) /* we deleted the last thing in the queue! */
-        loop = queue_tail = NULL;
-      else {
-        loop->next = tmp->next;
-        if ( tmp == queue_tail )
-          queue_tail = tmp->next;
-      }
-      g_free ( tmp );
-      tmp = NULL;
+  if ( area <= g_hash_table_size ( tiles ) ) {
+    /* Probe each tile of the rectangle */
+    TileKey key;
+    key.z = z;
+    key.zoom = zoom;
+    key.type = type;
+    for ( key.x = xmin; key.x <= xmax; key.x++ )
+      for ( key.y = ymin; key.y <= ymax; key.y++ )
+        remove_tile ( &key );
+  }
+  else {
+    /* Rectangle bigger than the cache: cheaper to check every cached tile */
+    CacheItem *ci, *next;
+    for ( ci = lru_head; ci; ci = next ) {
+      next = ci->next;
+      if ( ci->key.z == z && ci->key.type == type && ci->key.zoom == zoom &&
+           ci->key.x >= xmin && ci->key.x <= xmax &&
+           ci->key.y >= ymin && ci->key.y <= ymax )
+        cache_remove ( ci );
     }
-    else
-      loop = tmp;
-
-  } while ( loop && (loop != queue_tail || tmp == NULL) );
-
-  /* loop thru list, looking for the one, compare first whatever chars */
-  cache_remove(key);
+  }
   g_mutex_unlock(mc_mutex);
 }
 
 void a_mapcache_flush ()
 {
-  List *loop = queue_tail;
-  List *tmp;
-
-  if ( queue_tail == NULL )
-    return;
-
   g_mutex_lock(mc_mutex);
-  do {
-    tmp = loop->next;
-    cache_remove(tmp->key);
-    if ( tmp == queue_tail ) /* we deleted the last thing in the queue */
-      loop = queue_tail = NULL;
-    else
-      loop->next = tmp->next;
-    g_free ( tmp );
-    tmp = NULL;
-  } while ( loop );
-
+  g_hash_table_remove_all ( tiles );
+  g_hash_table_remove_all ( cache );
+  lru_head = lru_tail = NULL;
+  queue_count = 0;
+  queue_size = 0;
   g_mutex_unlock(mc_mutex);
 }
 
 void a_mapcache_uninit ()
 {
+  g_hash_table_destroy ( tiles );
+  tiles = NULL;
   g_hash_table_destroy ( cache );
-  /* free list */
   cache = NULL;
+  lru_head = lru_tail = NULL;
+  queue_count = 0;
+  queue_size = 0;
+  g_mutex_free ( mc_mutex );
+  mc_mutex = NULL;
 }
-
-
@@ -31,6 +31,7 @@ void a_mapcache_init ();
 void a_mapcache_add ( GdkPixbuf *pixbuf, gint x, gint y, gint z, guint8 type, guint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor );
 GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint8 type, guint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor );
 void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint8 type, guint zoom );
+void a_mapcache_remove_rectangle ( gint x0, gint y0, gint x1, gint y1, gint z, guint8 type, guint zoom );
 void a_mapcache_flush ();
 void a_mapcache_uninit ();
 
@@ -0,0 +1,162 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * MBTiles files (http://mapbox.com/developers/mbtiles/) store all the tiles
+ *  of a map in a single SQLite database, indexed by zoom, column and row.
+ * Compared to one file per tile this avoids millions of inodes and a stat()
+ *  plus open() for every tile drawn.
+ *
+ * Tools/viking-cache-mbtile.py converts between a Viking cache directory and MBTiles.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <sqlite3.h>
+
+#include "mbtiles.h"
+
+struct _VikMBTiles {
+  gint ref_count;
+  sqlite3 *db;
+  sqlite3_stmt *get_stmt;
+  sqlite3_stmt *exists_stmt;
+  /* Statements are shared by the drawing and the tile decoding threads */
+  GMutex *mutex;
+};
+
+/**
+ * vik_mbtiles_open:
+ *
+ * Returns: the opened file (with a reference count of 1), or NULL if it isn't a usable MBTiles file
+ */
+VikMBTiles *vik_mbtiles_open ( const gchar *filename )
+{
+  sqlite3 *db = NULL;
+  VikMBTiles *mbt;
+
+  if ( sqlite3_open_v2 ( filename, &db, SQLITE_OPEN_READONLY, NULL ) != SQLITE_OK ) {
+    g_warning ( _("Couldn't open MBTiles file %s: %s"), filename, db ? sqlite3_errmsg ( db ) : "" );
+    sqlite3_close ( db );
+    return NULL;
+  }
+
+  mbt = g_new0 ( VikMBTiles, 1 );
+  mbt->ref_count = 1;
+  mbt->db = db;
+
+  if ( sqlite3_prepare_v2 ( db, "SELECT tile_data FROM tiles WHERE zoom_level=? AND tile_column=? AND tile_row=?", -1, &mbt->get_stmt, NULL ) != SQLITE_OK ||
+       sqlite3_prepare_v2 ( db, "SELECT 1 FROM tiles WHERE zoom_level=? AND tile_column=? AND tile_row=?", -1, &mbt->exists_stmt, NULL ) != SQLITE_OK ) {
+    g_warning ( _("%s is not an MBTiles file: %s"), filename, sqlite3_errmsg ( db ) );
+    sqlite3_finalize ( mbt->get_stmt );
+    sqlite3_finalize ( mbt->exists_stmt );
+    sqlite3_close ( db );
+    g_free ( mbt );
+    return NULL;
+  }
+
+  mbt->mutex = g_mutex_new ();
+  return mbt;
+}
+
+VikMBTiles *vik_mbtiles_ref ( VikMBTiles *mbt )
+{
+  g_atomic_int_inc ( &mbt->ref_count );
+  return mbt;
+}
+
+void vik_mbtiles_unref ( VikMBTiles *mbt )
+{
+  if ( g_atomic_int_dec_and_test ( &mbt->ref_count ) ) {
+    sqlite3_finalize ( mbt->get_stmt );
+    sqlite3_finalize ( mbt->exists_stmt );
+    sqlite3_close ( mbt->db );
+    g_mutex_free ( mbt->mutex );
+    g_free ( mbt );
+  }
+}
+
+/* MBTiles rows follow the TMS scheme, so are numbered from the south */
+static void bind_tile ( sqlite3_stmt *stmt, gint x, gint y, gint zoom )
+{
+  sqlite3_reset ( stmt );
+  sqlite3_bind_int ( stmt, 1, zoom );
+  sqlite3_bind_int ( stmt, 2, x );
+  sqlite3_bind_int ( stmt, 3, (1 << zoom) - 1 - y );
+}
+
+/**
+ * vik_mbtiles_has_tile:
+ * @zoom: The standard (OSM/Google) zoom level, ie 0 is the whole world in one tile
+ */
+gboolean vik_mbtiles_has_tile ( VikMBTiles *mbt, gint x, gint y, gint zoom )
+{
+  gboolean found;
+  g_mutex_lock ( mbt->mutex );
+  bind_tile ( mbt->exists_stmt, x, y, zoom );
+  found = ( sqlite3_step ( mbt->exists_stmt ) == SQLITE_ROW );
+  sqlite3_reset ( mbt->exists_stmt );
+  g_mutex_unlock ( mbt->mutex );
+  return found;
+}
+
+/**
+ * vik_mbtiles_get_pixbuf:
+ * @zoom: The standard (OSM/Google) zoom level
+ *
+ * Returns: the decoded tile, or NULL if it isn't in the file
+ */
+GdkPixbuf *vik_mbtiles_get_pixbuf ( VikMBTiles *mbt, gint x, gint y, gint zoom )
+{
+  GdkPixbuf *pixbuf = NULL;
+  guchar *data = NULL;
+  gint len = 0;
+
+  /* Only copy the blob under the lock, decoding can be done in parallel */
+  g_mutex_lock ( mbt->mutex );
+  bind_tile ( mbt->get_stmt, x, y, zoom );
+  if ( sqlite3_step ( mbt->get_stmt ) == SQLITE_ROW ) {
+    len = sqlite3_column_bytes ( mbt->get_stmt, 0 );
+    data = g_memdup ( sqlite3_column_blob ( mbt->get_stmt, 0 ), len );
+  }
+  sqlite3_reset ( mbt->get_stmt );
+  g_mutex_unlock ( mbt->mutex );
+
+  if ( data && len > 0 ) {
+    GError *error = NULL;
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+    gboolean written = gdk_pixbuf_loader_write ( loader, data, len, &error );
+    /* Always close the loader, but keep the first error */
+    if ( gdk_pixbuf_loader_close ( loader, written ? &error : NULL ) && written ) {
+      pixbuf = gdk_pixbuf_loader_get_pixbuf ( loader );
+      if ( pixbuf )
+        g_object_ref ( pixbuf );
+    }
+    else if ( error ) {
+      g_warning ( _("Couldn't decode tile %d/%d/%d: %s"), zoom, x, y, error->message );
+      g_error_free ( error );
+    }
+    g_object_unref ( loader );
+  }
+  g_free ( data );
+
+  return pixbuf;
+}
@@ -0,0 +1,39 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_MBTILES_H
+#define __VIKING_MBTILES_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/* A read only MBTiles file: all the tiles of a map packed in one SQLite database */
+typedef struct _VikMBTiles VikMBTiles;
+
+VikMBTiles *vik_mbtiles_open ( const gchar *filename );
+VikMBTiles *vik_mbtiles_ref ( VikMBTiles *mbt );
+void vik_mbtiles_unref ( VikMBTiles *mbt );
+gboolean vik_mbtiles_has_tile ( VikMBTiles *mbt, gint x, gint y, gint zoom );
+GdkPixbuf *vik_mbtiles_get_pixbuf ( VikMBTiles *mbt, gint x, gint y, gint zoom );
+
+G_END_DECLS
+
+#endif
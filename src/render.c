@@ -0,0 +1,316 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "render.h"
+#include "vikmapslayer.h"
+#include "util.h"
+
+/*
+ * Rendering layers into images, through offscreen viewports of their own,
+ *  so the window's viewport is left alone (and no window is needed at all).
+ *
+ * Large images are drawn a chunk at a time, so no pixmap bigger than a chunk
+ *  is needed. Drawing has to stay in this thread, but saving the images of a
+ *  directory (ie compressing them) is spread over all processors.
+ */
+
+/* Largest pixmap drawn into */
+#define RENDER_CHUNK_SIZE 2048
+
+static GThreadPool *save_pool = NULL;
+static GStaticMutex save_pool_mutex = G_STATIC_MUTEX_INIT;
+
+typedef struct {
+  GMutex *mutex;
+  GCond *cond;
+  guint left;
+  guint failed;
+} SaveBatch;
+
+typedef struct {
+  SaveBatch *batch;
+  GdkPixbuf *pixbuf;
+  gchar *filename;
+  gboolean save_as_png;
+} SaveJob;
+
+static gboolean save_pixbuf ( GdkPixbuf *pixbuf, const gchar *filename, gboolean save_as_png )
+{
+  GError *error = NULL;
+
+  gdk_pixbuf_save ( pixbuf, filename, save_as_png ? "png" : "jpeg", &error, NULL );
+  if ( error ) {
+    g_warning ( "Unable to write to file %s: %s", filename, error->message );
+    g_error_free ( error );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/*
+ * Draw the layers into the @width by @height area of @pixbuf at @x, @y,
+ *  where the whole of @pixbuf is centred on @center
+ */
+static void render_chunk ( VikAggregateLayer *top, VikViewport *vp, const VikCoord *center, GdkPixbuf *pixbuf,
+                           gint x, gint y, gint width, gint height )
+{
+  VikCoord chunk_center;
+
+  if ( vik_viewport_get_width ( vp ) != width || vik_viewport_get_height ( vp ) != height )
+    vik_viewport_configure_manually ( vp, width, height );
+
+  // Where the middle of the chunk is, from the middle of the whole image
+  vik_viewport_set_center_coord ( vp, center );
+  vik_viewport_screen_to_coord ( vp, x + width/2 - gdk_pixbuf_get_width ( pixbuf )/2 + width/2,
+                                 y + height/2 - gdk_pixbuf_get_height ( pixbuf )/2 + height/2, &chunk_center );
+  vik_viewport_set_center_coord ( vp, &chunk_center );
+
+  vik_viewport_clear ( vp );
+  if ( VIK_LAYER(top)->visible )
+    vik_layer_draw ( VIK_LAYER(top), vp );
+
+  // As on screen, but for the whole image (the centre mark is only for finding the way on screen)
+  if ( x == 0 && y + height == gdk_pixbuf_get_height ( pixbuf ) )
+    vik_viewport_draw_scale ( vp );
+  if ( x + width == gdk_pixbuf_get_width ( pixbuf ) ) {
+    if ( y + height == gdk_pixbuf_get_height ( pixbuf ) )
+      vik_viewport_draw_copyright ( vp );
+    if ( y == 0 )
+      vik_viewport_draw_logo ( vp );
+  }
+
+  gdk_pixbuf_get_from_drawable ( pixbuf, GDK_DRAWABLE(vik_viewport_get_pixmap ( vp )), NULL, 0, 0, x, y, width, height );
+}
+
+static GdkPixbuf *render_pixbuf ( VikAggregateLayer *top, VikViewport *vp, guint width, guint height )
+{
+  VikCoord center = *vik_viewport_get_center ( vp );
+  GdkPixbuf *pixbuf;
+  guint x, y;
+
+  pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, width, height );
+  if ( ! pixbuf ) {
+    g_warning ( "Failed to generate image size: %d x %d", width, height );
+    return NULL;
+  }
+
+  /* draw all layers, with the map tiles loaded in this pass */
+  maps_layer_set_synchronous_decode ( TRUE );
+  for ( y = 0; y < height; y += RENDER_CHUNK_SIZE )
+    for ( x = 0; x < width; x += RENDER_CHUNK_SIZE )
+      render_chunk ( top, vp, &center, pixbuf, x, y, MIN ( RENDER_CHUNK_SIZE, width - x ), MIN ( RENDER_CHUNK_SIZE, height - y ) );
+  maps_layer_set_synchronous_decode ( FALSE );
+
+  vik_viewport_set_center_coord ( vp, &center );
+  return pixbuf;
+}
+
+static VikViewport *render_viewport_new ( VikViewport *like, gdouble zoom )
+{
+  VikViewport *vp = vik_viewport_new_offscreen ( like, 1, 1 );
+  if ( zoom > 0 )
+    vik_viewport_set_zoom ( vp, zoom );
+  return vp;
+}
+
+/**
+ * a_render_pixbuf:
+ * @like: Viewport to render the same place as, and in the same way
+ * @zoom: Metres per pixel, or 0 for that of @like
+ *
+ * Returns: a new image of the layers, or NULL if one that size can't be made
+ */
+GdkPixbuf *a_render_pixbuf ( VikAggregateLayer *top, VikViewport *like, guint width, guint height, gdouble zoom )
+{
+  VikViewport *vp = render_viewport_new ( like, zoom );
+  GdkPixbuf *pixbuf = render_pixbuf ( top, vp, width, height );
+  g_object_unref ( vp );
+  return pixbuf;
+}
+
+/**
+ * a_render_image_file:
+ *
+ * Save an image of the layers as PNG or JPEG, as described for a_render_pixbuf().
+ */
+gboolean a_render_image_file ( VikAggregateLayer *top, VikViewport *like, const gchar *filename, guint width, guint height, gdouble zoom, gboolean save_as_png )
+{
+  GdkPixbuf *pixbuf = a_render_pixbuf ( top, like, width, height, zoom );
+  gboolean ok;
+
+  if ( ! pixbuf )
+    return FALSE;
+  ok = save_pixbuf ( pixbuf, filename, save_as_png );
+  g_object_unref ( pixbuf );
+  return ok;
+}
+
+static void save_job_thread ( SaveJob *job, gpointer user_data )
+{
+  SaveBatch *batch = job->batch;
+  gboolean ok = save_pixbuf ( job->pixbuf, job->filename, job->save_as_png );
+
+  g_object_unref ( job->pixbuf );
+  g_free ( job->filename );
+  g_slice_free ( SaveJob, job );
+
+  g_mutex_lock ( batch->mutex );
+  if ( ! ok )
+    batch->failed++;
+  batch->left--;
+  g_cond_signal ( batch->cond );
+  g_mutex_unlock ( batch->mutex );
+}
+
+/**
+ * a_render_image_dir:
+ * @tiles_w, @tiles_h: Number of images across and down, around the centre of @like
+ *
+ * Save images of the layers side by side into @dirname, named yN-xN.png (or .jpg).
+ * Each image is saved by another thread while the next is drawn.
+ *
+ * Returns: the number of images that could not be made
+ */
+guint a_render_image_dir ( VikAggregateLayer *top, VikViewport *like, const gchar *dirname, guint width, guint height, gdouble zoom, gboolean save_as_png, guint tiles_w, guint tiles_h )
+{
+  VikViewport *vp = render_viewport_new ( like, zoom );
+  VikCoord center = *vik_viewport_get_center ( vp );
+  gboolean threaded = g_thread_supported ();
+  guint window = 2 * util_get_number_of_cpus ();
+  SaveBatch batch;
+  guint x, y;
+
+  g_mkdir ( dirname, 0777 );
+
+  if ( threaded ) {
+    g_static_mutex_lock ( &save_pool_mutex );
+    if ( ! save_pool )
+      save_pool = g_thread_pool_new ( (GFunc) save_job_thread, NULL, util_get_number_of_cpus(), FALSE, NULL );
+    g_static_mutex_unlock ( &save_pool_mutex );
+    batch.mutex = g_mutex_new ();
+    batch.cond = g_cond_new ();
+  }
+  batch.left = 0;
+  batch.failed = 0;
+
+  for ( y = 1; y <= tiles_h; y++ ) {
+    for ( x = 1; x <= tiles_w; x++ ) {
+      gchar *filename = g_strdup_printf ( "%s%cy%d-x%d.%s", dirname, G_DIR_SEPARATOR, y, x, save_as_png ? "png" : "jpg" );
+      GdkPixbuf *pixbuf;
+      VikCoord tile_center;
+
+      /* move to correct place. */
+      vik_viewport_set_center_coord ( vp, &center );
+      vik_viewport_screen_to_coord ( vp, vik_viewport_get_width ( vp )/2 + (gint) (((gdouble)x - ((gdouble)tiles_w+1)/2) * width),
+                                     vik_viewport_get_height ( vp )/2 + (gint) (((gdouble)y - ((gdouble)tiles_h+1)/2) * height), &tile_center );
+      vik_viewport_set_center_coord ( vp, &tile_center );
+
+      pixbuf = render_pixbuf ( top, vp, width, height );
+      if ( ! pixbuf ) {
+        batch.failed++;
+        g_free ( filename );
+      }
+      else if ( ! threaded ) {
+        if ( ! save_pixbuf ( pixbuf, filename, save_as_png ) )
+          batch.failed++;
+        g_object_unref ( pixbuf );
+        g_free ( filename );
+      }
+      else {
+        SaveJob *job = g_slice_new ( SaveJob );
+        job->batch = &batch;
+        job->pixbuf = pixbuf;
+        job->filename = filename;
+        job->save_as_png = save_as_png;
+
+        // Only so many images waiting to be saved, to limit the memory used
+        g_mutex_lock ( batch.mutex );
+        while ( batch.left >= window )
+          g_cond_wait ( batch.cond, batch.mutex );
+        batch.left++;
+        g_mutex_unlock ( batch.mutex );
+        g_thread_pool_push ( save_pool, job, NULL );
+      }
+    }
+  }
+
+  if ( threaded ) {
+    g_mutex_lock ( batch.mutex );
+    while ( batch.left )
+      g_cond_wait ( batch.cond, batch.mutex );
+    g_mutex_unlock ( batch.mutex );
+    g_cond_free ( batch.cond );
+    g_mutex_free ( batch.mutex );
+  }
+
+  g_object_unref ( vp );
+  return batch.failed;
+}
+
+/**
+ * a_render_bbox_file:
+ * @like: Viewport to render in the same way as, or NULL
+ * @zoom: Metres per pixel, or 0 for that of @like
+ *
+ * Save an image of the layers as PNG or JPEG, covering @bbox,
+ *  and so of a size given by the zoom.
+ */
+gboolean a_render_bbox_file ( VikAggregateLayer *top, VikViewport *like, const LatLonBBox *bbox, gdouble zoom, const gchar *filename, gboolean save_as_png )
+{
+  VikViewport *vp = render_viewport_new ( like, zoom );
+  struct LatLon ll;
+  VikCoord c;
+  gint x1, y1, x2, y2;
+  GdkPixbuf *pixbuf;
+  gboolean ok = FALSE;
+
+  ll.lat = (bbox->north + bbox->south) / 2;
+  ll.lon = (bbox->east + bbox->west) / 2;
+  vik_viewport_set_center_latlon ( vp, &ll );
+
+  // Corners on screen give the size, and where the middle of the image is
+  ll.lat = bbox->north;
+  ll.lon = bbox->west;
+  vik_coord_load_from_latlon ( &c, vik_viewport_get_coord_mode ( vp ), &ll );
+  vik_viewport_coord_to_screen ( vp, &c, &x1, &y1 );
+  ll.lat = bbox->south;
+  ll.lon = bbox->east;
+  vik_coord_load_from_latlon ( &c, vik_viewport_get_coord_mode ( vp ), &ll );
+  vik_viewport_coord_to_screen ( vp, &c, &x2, &y2 );
+
+  if ( x2 > x1 && y2 > y1 ) {
+    vik_viewport_set_center_screen ( vp, (x1 + x2) / 2, (y1 + y2) / 2 );
+    pixbuf = render_pixbuf ( top, vp, x2 - x1, y2 - y1 );
+    if ( pixbuf ) {
+      ok = save_pixbuf ( pixbuf, filename, save_as_png );
+      g_object_unref ( pixbuf );
+    }
+  }
+  else
+    g_warning ( "Nothing to render for %f,%f,%f,%f", bbox->south, bbox->west, bbox->north, bbox->east );
+
+  g_object_unref ( vp );
+  return ok;
+}
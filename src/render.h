@@ -0,0 +1,38 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_RENDER_H
+#define _VIKING_RENDER_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "bbox.h"
+#include "vikaggregatelayer.h"
+#include "vikviewport.h"
+
+G_BEGIN_DECLS
+
+GdkPixbuf *a_render_pixbuf ( VikAggregateLayer *top, VikViewport *like, guint width, guint height, gdouble zoom );
+gboolean a_render_image_file ( VikAggregateLayer *top, VikViewport *like, const gchar *filename, guint width, guint height, gdouble zoom, gboolean save_as_png );
+guint a_render_image_dir ( VikAggregateLayer *top, VikViewport *like, const gchar *dirname, guint width, guint height, gdouble zoom, gboolean save_as_png, guint tiles_w, guint tiles_h );
+gboolean a_render_bbox_file ( VikAggregateLayer *top, VikViewport *like, const LatLonBBox *bbox, gdouble zoom, const gchar *filename, gboolean save_as_png );
+
+G_END_DECLS
+
+#endif
@@ -27,6 +27,9 @@
 
 #include <glib/gi18n.h>
 #include <glib/gprintf.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 #include "util.h"
 #include "dialog.h"
@@ -171,3 +174,22 @@ gboolean split_string_from_file_on_equals ( const gchar *buf, gchar **key, gchar
 
   return TRUE;
 }
+
+/**
+ * util_get_number_of_cpus:
+ *
+ * Returns: the number of processors online, to size pools of worker threads
+ */
+guint util_get_number_of_cpus ()
+{
+#if defined(WINDOWS)
+  SYSTEM_INFO info;
+  GetSystemInfo ( &info );
+  return MAX ( info.dwNumberOfProcessors, 1 );
+#elif defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+  glong count = sysconf ( _SC_NPROCESSORS_ONLN );
+  return count < 1 ? 1 : count;
+#else
+  return 2;
+#endif
+}
@@ -38,6 +38,8 @@ GList * str_array_to_glist(gchar* data[]);
 
 gboolean split_string_from_file_on_equals ( const gchar *buf, gchar **key, gchar **val );
 
+guint util_get_number_of_cpus ();
+
 G_END_DECLS
 
 #endif
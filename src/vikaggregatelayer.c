@@ -286,29 +286,19 @@ void vik_aggregate_layer_move_layer ( VikAggregateLayer *val, GtkTreeIter *child
 }
 
 /* Draw the aggregate layer. If vik viewport is in half_drawn mode, this means we are only
- * to draw the layers above and including the trigger layer.
- * To do this we don't draw any layers if in half drawn mode, unless we find the
- * trigger layer, in which case we pull up the saved pixmap, turn off half drawn mode and
- * start drawing layers.
- * Also, if we were never in half drawn mode, we save a snapshot
- * of the pixmap before drawing the trigger layer so we can use it again
- * later.
+ * to draw the layers above and including the lowest changed layer.
+ * To do this we don't draw any layers if in half drawn mode, until the viewport finds
+ * a changed layer, in which case it pulls up the surface retained for it
+ * (what was drawn before it), turns off half drawn mode and we start drawing layers.
+ * Otherwise the viewport retains a surface for each layer as it is drawn.
  */
 void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
 {
   GList *iter = val->children;
   VikLayer *vl;
-  VikLayer *trigger = VIK_LAYER(vik_viewport_get_trigger( vp ));
   while ( iter ) {
     vl = VIK_LAYER(iter->data);
-    if ( vl == trigger ) {
-      if ( vik_viewport_get_half_drawn ( vp ) ) {
-        vik_viewport_set_half_drawn ( vp, FALSE );
-        vik_viewport_snapshot_load( vp );
-      } else {
-        vik_viewport_snapshot_save( vp );
-      }
-    }
+    vik_viewport_surface_reach ( vp, vl, vl->visible );
     if ( vl->type == VIK_LAYER_AGGREGATE || vl->type == VIK_LAYER_GPS || ! vik_viewport_get_half_drawn( vp ) )
       vik_layer_draw ( vl, vp );
     iter = iter->next;
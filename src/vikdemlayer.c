@@ -43,6 +43,7 @@
 #include "vikdemlayer.h"
 #include "dem.h"
 #include "dems.h"
+#include "util.h"
 #include "icons/icons.h"
 
 #define MAPS_CACHE_DIR maps_layer_default_dir()
@@ -68,6 +69,10 @@ static gboolean dem_layer_set_param ( VikDEMLayer *vdl, guint16 id, VikLayerPara
 static VikLayerParamData dem_layer_get_param ( VikDEMLayer *vdl, guint16 id, gboolean is_file_operation );
 static void dem_layer_post_read ( VikLayer *vl, VikViewport *vp, gboolean from_file );
 static void srtm_draw_existence ( VikViewport *vp );
+static void dem_layer_tiles_init ( VikDEMLayer *vdl );
+static void dem_layer_tiles_changed ( VikDEMLayer *vdl );
+static void dem_layer_tiles_free ( VikDEMLayer *vdl );
+static void dem_layer_draw_tiles ( VikDEMLayer *vdl, VikViewport *vp, GList *dems );
 
 #ifdef VIK_CONFIG_DEM24K
 static void dem24k_draw_existence ( VikViewport *vp );
@@ -156,7 +161,7 @@ static gchar *dem_height_colors[] = {
 "#f7f7f7", "#fbfbfb", "#ffffff"
 };
 
-static const guint DEM_N_HEIGHT_COLORS = sizeof(dem_height_colors)/sizeof(dem_height_colors[0]);
+#define DEM_N_HEIGHT_COLORS G_N_ELEMENTS(dem_height_colors)
 
 /*
 "#9b793c", "#9e8549", "#a29156", "#a69d63", "#ada569", "#b4ad6f", "#bcb676", "#c2c07d", "#c8ca84", "#cfd58b",
@@ -179,7 +184,7 @@ static gchar *dem_gradient_colors[] = {
 "#FFFFFF"
 };
 
-static const guint DEM_N_GRADIENT_COLORS = sizeof(dem_gradient_colors)/sizeof(dem_gradient_colors[0]);
+#define DEM_N_GRADIENT_COLORS G_N_ELEMENTS(dem_gradient_colors)
 
 
 VikLayerInterface vik_dem_layer_interface = {
@@ -251,6 +256,15 @@ struct _VikDEMLayer {
   GdkColor color;
   guint source;
   guint type;
+
+  /* Drawn tiles, see dem_layer_draw_tiles() */
+  GHashTable *tiles;
+  GQueue *tiles_lru;
+  gsize tiles_dems;
+  guint8 *height_lut;
+  guint8 *gradient_lut;
+  guint8 height_palette[DEM_N_HEIGHT_COLORS][4];
+  GdkPixbuf *screen;
 };
 
 GType vik_dem_layer_get_type ()
@@ -382,10 +396,12 @@ gboolean dem_layer_set_param ( VikDEMLayer *vdl, guint16 id, VikLayerParamData d
       if ( vdl->files ) {
         // Thread Load
         dem_load_thread_data *dltd = g_malloc ( sizeof(dem_load_thread_data) );
+        // Offscreen viewports (as used by --render) are their own toplevel
+        GtkWidget *top = gtk_widget_get_toplevel ( GTK_WIDGET(vp) );
         dltd->vdl = vdl;
         dltd->vdl->files = data.sl;
 
-        a_background_thread ( VIK_GTK_WINDOW_FROM_WIDGET(vp),
+        a_background_thread ( GTK_IS_WINDOW(top) ? GTK_WINDOW(top) : NULL,
                               _("DEM Loading"),
                               (vik_thr_func) dem_layer_load_list_thread,
                               dltd,
@@ -396,6 +412,9 @@ gboolean dem_layer_set_param ( VikDEMLayer *vdl, guint16 id, VikLayerParamData d
       break;
     }
   }
+  // Any change but the download source changes how the layer looks
+  if ( id != PARAM_SOURCE )
+    dem_layer_tiles_changed ( vdl );
   return TRUE;
 }
 
@@ -448,6 +467,8 @@ static VikDEMLayer *dem_layer_new ( VikViewport *vvp )
   // Ensure the base GC is available so the default colour can be applied
   if ( vvp ) vdl->gcs[0] = vik_viewport_new_gc ( vvp, "#0000FF", 1 );
 
+  dem_layer_tiles_init ( vdl );
+
   vik_layer_set_defaults ( VIK_LAYER(vdl), vvp );
 
   return vdl;
@@ -465,8 +486,6 @@ static inline guint16 get_height_difference(gint16 elev, gint16 new_elev)
 
 static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *dem )
 {
-  VikDEMColumn *column, *prevcolumn, *nextcolumn;
-
   struct LatLon dem_northeast, dem_southwest;
   gdouble max_lat, max_lon, min_lat, min_lon;
 
@@ -578,26 +597,27 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
       // NOTE: ( counter.lon <= end_lon + ESCALE_DEG*SKIP_FACTOR ) is neccessary so in high zoom modes,
       // the leftmost column does also get drawn, if the center point is out of viewport.
       if ( x < dem->n_columns ) {
-        column = g_ptr_array_index ( dem->columns, x );
+        guint n_points = vik_dem_get_n_points ( dem, x );
         // get previous and next column. catch out-of-bound.
+        guint prev_x, next_x;
 	gint32 new_x = x;
 	new_x -= gradient_skip_factor;
         if(new_x < 1)
-          prevcolumn = g_ptr_array_index ( dem->columns, x+1);
+          prev_x = x+1;
         else
-          prevcolumn = g_ptr_array_index ( dem->columns, new_x);
+          prev_x = new_x;
 	new_x = x;
 	new_x += gradient_skip_factor;
         if(new_x >= dem->n_columns)
-          nextcolumn = g_ptr_array_index ( dem->columns, x-1);
+          next_x = x-1;
         else
-          nextcolumn = g_ptr_array_index ( dem->columns, new_x);
+          next_x = new_x;
 
         for ( y=start_y, counter.lat = start_lat; counter.lat <= end_lat; counter.lat += nscale_deg * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
+          if ( y > n_points )
             break;
 
-          elev = column->points[y];
+          elev = vik_dem_get_xy ( dem, x, y );
 
 	  // calculate bounding box for drawing
 	  gint box_x, box_y, box_width, box_height;
@@ -649,19 +669,19 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 		new_y = y - gradient_skip_factor;
 		if(new_y < 0)
 			new_y = y;
-		change += get_height_difference(elev, prevcolumn->points[new_y]);
-		change += get_height_difference(elev, column->points[new_y]);
-		change += get_height_difference(elev, nextcolumn->points[new_y]);
+		change += get_height_difference(elev, vik_dem_get_xy(dem, prev_x, new_y));
+		change += get_height_difference(elev, vik_dem_get_xy(dem, x, new_y));
+		change += get_height_difference(elev, vik_dem_get_xy(dem, next_x, new_y));
 
-		change += get_height_difference(elev, prevcolumn->points[y]);
-		change += get_height_difference(elev, nextcolumn->points[y]);
+		change += get_height_difference(elev, vik_dem_get_xy(dem, prev_x, y));
+		change += get_height_difference(elev, vik_dem_get_xy(dem, next_x, y));
 
 		new_y = y + gradient_skip_factor;
-		if(new_y >= column->n_points)
+		if(new_y >= n_points)
 			new_y = y;
-		change += get_height_difference(elev, prevcolumn->points[new_y]);
-		change += get_height_difference(elev, column->points[new_y]);
-		change += get_height_difference(elev, nextcolumn->points[new_y]);
+		change += get_height_difference(elev, vik_dem_get_xy(dem, prev_x, new_y));
+		change += get_height_difference(elev, vik_dem_get_xy(dem, x, new_y));
+		change += get_height_difference(elev, vik_dem_get_xy(dem, next_x, new_y));
 
 		change = change / ((skip_factor > 1) ? log(skip_factor) : 0.55); // FIXME: better calc.
 
@@ -750,11 +770,11 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 
     for ( x=start_x, counter.easting = start_eas; counter.easting <= end_eas; counter.easting += dem->east_scale * skip_factor, x += skip_factor ) {
       if ( x > 0 && x < dem->n_columns ) {
-        column = g_ptr_array_index ( dem->columns, x );
+        guint n_points = vik_dem_get_n_points ( dem, x );
         for ( y=start_y, counter.northing = start_nor; counter.northing <= end_nor; counter.northing += dem->north_scale * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
+          if ( y > n_points )
             continue;
-          elev = column->points[y];
+          elev = vik_dem_get_xy ( dem, x, y );
           if ( elev != VIK_DEM_INVALID_ELEVATION && elev < vdl->min_elev )
             elev=vdl->min_elev;
           if ( elev != VIK_DEM_INVALID_ELEVATION && elev > vdl->max_elev )
@@ -777,6 +797,528 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
   }
 }
 
+/**************************************************************
+ **** TILED DRAWING
+ **************************************************************/
+
+/*
+ * Rather than a rectangle per sample, the layer is drawn into RGBA tiles
+ *  which line up from one draw to the next, so they can be kept and only
+ *  the new ones drawn when scrolling. Missing tiles are drawn on all processors
+ *  and the visible part of all of them is then drawn in one go.
+ *
+ * Tiles are in 'world pixels': coordinates scaled to the viewport's
+ *  zoom without the offset of its centre, so the same in any view at that zoom.
+ * Expedia mode has no such thing, so is still drawn a sample at a time.
+ */
+
+#define DEM_TILE_SIZE 256
+/* Tiles are 256KB each */
+#define DEM_TILE_CACHE_SIZE 128
+/* Pixels per degree at 1 metre per pixel, as in vik_viewport_coord_to_screen() */
+#define DEM_TILE_PIXELS_PER_DEGREE (65536.0 / 180 * 256.0)
+
+typedef struct {
+  gint x, y;
+  gdouble xmpp, ympp;
+  gint mode;
+  gint zone;
+} DemTileKey;
+
+typedef struct {
+  DemTileKey key;
+  GdkPixbuf *pixbuf; /* NULL when no DEM covers it */
+} DemTile;
+
+typedef struct {
+  VikDEM *dem;
+  struct LatLon sw, ne;
+} DemSource;
+
+/* What tiles are drawn from, shared by all the threads drawing them */
+typedef struct {
+  GList *sources; /* of DemSource */
+  guint type;
+  const guint8 *lut;     /* Colour index of each elevation (height) or change (gradient) */
+  guint8 (*palette)[4];
+  gint mode;
+  gchar zone, letter;
+  gdouble xmpp, ympp;
+  gint tiles_left;
+  GMutex *mutex;
+  GCond *cond;
+} DemRender;
+
+typedef struct {
+  DemRender *render;
+  DemTile *tile;
+} DemTileJob;
+
+static guint8 dem_height_palette[DEM_N_HEIGHT_COLORS][4];
+static guint8 dem_gradient_palette[DEM_N_GRADIENT_COLORS][4];
+
+static GThreadPool *dem_tile_pool = NULL;
+static GStaticMutex dem_tile_pool_mutex = G_STATIC_MUTEX_INIT;
+
+static void dem_palette_init ( guint8 (*palette)[4], gchar **colors, guint n )
+{
+  guint i;
+  for ( i = 0; i < n; i++ ) {
+    GdkColor color;
+    gdk_color_parse ( colors[i], &color );
+    palette[i][0] = color.red >> 8;
+    palette[i][1] = color.green >> 8;
+    palette[i][2] = color.blue >> 8;
+    palette[i][3] = 0xff;
+  }
+}
+
+static guint dem_tile_key_hash ( const DemTileKey *key )
+{
+  guint h = (guint) key->x;
+  h = h * 31 + (guint) key->y;
+  h = h * 31 + (guint) key->mode;
+  h = h * 31 + (guint) key->zone;
+  h = h * 31 + (guint) (key->xmpp * 1000);
+  return h;
+}
+
+static gboolean dem_tile_key_equal ( const DemTileKey *k1, const DemTileKey *k2 )
+{
+  return k1->x == k2->x && k1->y == k2->y && k1->xmpp == k2->xmpp && k1->ympp == k2->ympp &&
+         k1->mode == k2->mode && k1->zone == k2->zone;
+}
+
+static void dem_tile_free ( DemTile *tile )
+{
+  if ( tile->pixbuf )
+    g_object_unref ( tile->pixbuf );
+  g_slice_free ( DemTile, tile );
+}
+
+/*
+ * Throw away all drawn tiles, as the layer will look different
+ */
+static void dem_layer_tiles_clear ( VikDEMLayer *vdl )
+{
+  g_queue_clear ( vdl->tiles_lru );
+  g_hash_table_remove_all ( vdl->tiles );
+  vdl->tiles_dems = 0;
+}
+
+/*
+ * The colour index of every possible value, worked out like the sample at a time drawing
+ */
+static void dem_layer_make_luts ( VikDEMLayer *vdl )
+{
+  gdouble min_elev = vdl->min_elev;
+  gdouble max_elev = MAX ( vdl->max_elev, vdl->min_elev + 1 );
+  gint i;
+
+  for ( i = 0; i < 65536; i++ ) {
+    gint elev = i - 32768;
+    gint change = i;
+
+    if ( elev <= 0 || elev < min_elev )
+      vdl->height_lut[i] = 0;
+    else
+      vdl->height_lut[i] = (gint) floor ( ((MIN(elev, max_elev) - min_elev)/(max_elev - min_elev))*(DEM_N_HEIGHT_COLORS-2) ) + 1;
+
+    if ( change < min_elev )
+      change = ceil ( min_elev );
+    if ( change > max_elev )
+      change = max_elev;
+    vdl->gradient_lut[i] = (gint) floor ( ((change - min_elev)/(max_elev - min_elev))*(DEM_N_GRADIENT_COLORS-2) ) + 1;
+  }
+}
+
+/* Tile pixel centres in the viewport's coordinates, along x or y */
+static void dem_tile_coords ( DemRender *render, gint start, gboolean along_x, gdouble *coords )
+{
+  gint i;
+  for ( i = 0; i < DEM_TILE_SIZE; i++ ) {
+    gdouble world = start + i + 0.5;
+    if ( render->mode == VIK_VIEWPORT_DRAWMODE_UTM )
+      coords[i] = along_x ? world * render->xmpp : -world * render->ympp;
+    else if ( along_x )
+      coords[i] = world * render->xmpp / DEM_TILE_PIXELS_PER_DEGREE;
+    else if ( render->mode == VIK_VIEWPORT_DRAWMODE_MERCATOR )
+      coords[i] = DEMERCLAT ( -world * render->ympp / DEM_TILE_PIXELS_PER_DEGREE );
+    else
+      coords[i] = -world * render->ympp / DEM_TILE_PIXELS_PER_DEGREE;
+  }
+}
+
+static void dem_tile_to_latlon ( DemRender *render, gdouble x, gdouble y, struct LatLon *ll )
+{
+  if ( render->mode == VIK_VIEWPORT_DRAWMODE_UTM ) {
+    struct UTM utm = { y, x, render->zone, render->letter };
+    a_coords_utm_to_latlon ( &utm, ll );
+  }
+  else {
+    ll->lat = y;
+    ll->lon = x;
+  }
+}
+
+static inline gint dem_sample_index ( gdouble value, gdouble min, gdouble scale, guint n )
+{
+  gdouble i = floor ( (value - min) / scale + 0.5 );
+  return ( i < 0 || i >= n ) ? -1 : (gint) i;
+}
+
+static inline gint16 dem_sample ( VikDEM *dem, gint col, gint row )
+{
+  if ( col < 0 || row < 0 )
+    return VIK_DEM_INVALID_ELEVATION;
+  return vik_dem_get_xy ( dem, col, row );
+}
+
+/*
+ * Sum of height differences with the samples all around, @skip samples away
+ */
+static gint dem_sample_change ( VikDEM *dem, gint col, gint row, gint skip, gint16 elev )
+{
+  gint prev_col = MAX ( col - skip, 0 );
+  gint next_col = MIN ( col + skip, (gint) dem->n_columns - 1 );
+  gint prev_row = MAX ( row - skip, 0 );
+  gint next_row = MIN ( row + skip, (gint) vik_dem_get_n_points ( dem, col ) - 1 );
+  gint change = 0;
+
+  change += get_height_difference ( elev, dem_sample ( dem, prev_col, prev_row ) );
+  change += get_height_difference ( elev, dem_sample ( dem, col, prev_row ) );
+  change += get_height_difference ( elev, dem_sample ( dem, next_col, prev_row ) );
+  change += get_height_difference ( elev, dem_sample ( dem, prev_col, row ) );
+  change += get_height_difference ( elev, dem_sample ( dem, next_col, row ) );
+  change += get_height_difference ( elev, dem_sample ( dem, prev_col, next_row ) );
+  change += get_height_difference ( elev, dem_sample ( dem, col, next_row ) );
+  change += get_height_difference ( elev, dem_sample ( dem, next_col, next_row ) );
+
+  return change / ((skip > 1) ? log(skip) : 0.55);
+}
+
+static void dem_tile_draw_dem ( DemRender *render, VikDEM *dem, gdouble *xs, gdouble *ys, guchar *pixels, gint rowstride )
+{
+  gboolean arcsecs = dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS;
+  gdouble factor = arcsecs ? 3600.0 : 1.0;
+  gint skip = MAX ( 1, ceil ( render->xmpp / (arcsecs ? 80 : 10) ) );
+  gint cols[DEM_TILE_SIZE], rows[DEM_TILE_SIZE];
+  gboolean separable;
+  gint i, j;
+
+  /* When the DEM's axes are the viewport's, each tile column is a DEM column and each row a row */
+  if ( arcsecs )
+    separable = render->mode != VIK_VIEWPORT_DRAWMODE_UTM;
+  else
+    separable = render->mode == VIK_VIEWPORT_DRAWMODE_UTM && render->zone == dem->utm_zone &&
+                (render->letter >= 'N') == (dem->utm_letter >= 'N');
+
+  if ( separable ) {
+    for ( i = 0; i < DEM_TILE_SIZE; i++ ) {
+      cols[i] = dem_sample_index ( xs[i] * factor, dem->min_east, dem->east_scale, dem->n_columns );
+      rows[i] = dem_sample_index ( ys[i] * factor, dem->min_north, dem->north_scale, G_MAXINT );
+    }
+  }
+
+  for ( j = 0; j < DEM_TILE_SIZE; j++ ) {
+    guchar *p = pixels + j * rowstride;
+    for ( i = 0; i < DEM_TILE_SIZE; i++, p += 4 ) {
+      gint col, row;
+      gint16 elev;
+      guint8 index;
+
+      if ( separable ) {
+        col = cols[i];
+        row = rows[j];
+      }
+      else {
+        struct LatLon ll;
+        dem_tile_to_latlon ( render, xs[i], ys[j], &ll );
+        if ( arcsecs ) {
+          col = dem_sample_index ( ll.lon * 3600.0, dem->min_east, dem->east_scale, dem->n_columns );
+          row = dem_sample_index ( ll.lat * 3600.0, dem->min_north, dem->north_scale, G_MAXINT );
+        }
+        else {
+          struct UTM utm;
+          a_coords_latlon_to_utm ( &ll, &utm );
+          if ( utm.zone != dem->utm_zone )
+            continue;
+          col = dem_sample_index ( utm.easting, dem->min_east, dem->east_scale, dem->n_columns );
+          row = dem_sample_index ( utm.northing, dem->min_north, dem->north_scale, G_MAXINT );
+        }
+      }
+
+      elev = dem_sample ( dem, col, row );
+      if ( elev == VIK_DEM_INVALID_ELEVATION )
+        continue;
+
+      if ( render->type == DEM_TYPE_GRADIENT )
+        index = render->lut[CLAMP ( dem_sample_change ( dem, col, row, skip, elev ), 0, 65535 )];
+      else
+        index = render->lut[elev + 32768];
+
+      memcpy ( p, render->palette[index], 4 );
+    }
+  }
+}
+
+static void dem_tile_draw ( DemRender *render, DemTile *tile )
+{
+  gdouble xs[DEM_TILE_SIZE], ys[DEM_TILE_SIZE];
+  struct LatLon sw, ne, corner;
+  GList *iter;
+
+  dem_tile_coords ( render, tile->key.x * DEM_TILE_SIZE, TRUE, xs );
+  dem_tile_coords ( render, tile->key.y * DEM_TILE_SIZE, FALSE, ys );
+
+  /* Bounds of the tile, a bit bigger in UTM as the corners are not north or south of each other */
+  dem_tile_to_latlon ( render, xs[0], ys[DEM_TILE_SIZE-1], &sw );
+  dem_tile_to_latlon ( render, xs[DEM_TILE_SIZE-1], ys[0], &ne );
+  dem_tile_to_latlon ( render, xs[0], ys[0], &corner );
+  sw.lon = MIN ( sw.lon, corner.lon );
+  ne.lat = MAX ( ne.lat, corner.lat );
+  dem_tile_to_latlon ( render, xs[DEM_TILE_SIZE-1], ys[DEM_TILE_SIZE-1], &corner );
+  sw.lat = MIN ( sw.lat, corner.lat );
+  ne.lon = MAX ( ne.lon, corner.lon );
+
+  for ( iter = render->sources; iter; iter = iter->next ) {
+    DemSource *source = iter->data;
+    if ( source->sw.lat > ne.lat || source->ne.lat < sw.lat ||
+         source->sw.lon > ne.lon || source->ne.lon < sw.lon )
+      continue;
+    if ( ! tile->pixbuf ) {
+      tile->pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, DEM_TILE_SIZE, DEM_TILE_SIZE );
+      gdk_pixbuf_fill ( tile->pixbuf, 0 );
+    }
+    dem_tile_draw_dem ( render, source->dem, xs, ys,
+                        gdk_pixbuf_get_pixels ( tile->pixbuf ), gdk_pixbuf_get_rowstride ( tile->pixbuf ) );
+  }
+}
+
+static void dem_tile_thread ( DemTileJob *job, gpointer user_data )
+{
+  DemRender *render = job->render;
+
+  dem_tile_draw ( render, job->tile );
+
+  g_mutex_lock ( render->mutex );
+  render->tiles_left--;
+  g_cond_signal ( render->cond );
+  g_mutex_unlock ( render->mutex );
+  g_slice_free ( DemTileJob, job );
+}
+
+static void dem_tiles_draw ( DemRender *render, GList *tiles )
+{
+  GList *iter;
+
+  if ( ! tiles->next || ! g_thread_supported () ) {
+    for ( iter = tiles; iter; iter = iter->next )
+      dem_tile_draw ( render, iter->data );
+    return;
+  }
+
+  g_static_mutex_lock ( &dem_tile_pool_mutex );
+  if ( ! dem_tile_pool )
+    dem_tile_pool = g_thread_pool_new ( (GFunc) dem_tile_thread, NULL, util_get_number_of_cpus(), FALSE, NULL );
+  g_static_mutex_unlock ( &dem_tile_pool_mutex );
+
+  render->mutex = g_mutex_new ();
+  render->cond = g_cond_new ();
+  render->tiles_left = g_list_length ( tiles );
+
+  for ( iter = tiles; iter; iter = iter->next ) {
+    DemTileJob *job = g_slice_new ( DemTileJob );
+    job->render = render;
+    job->tile = iter->data;
+    g_thread_pool_push ( dem_tile_pool, job, NULL );
+  }
+
+  g_mutex_lock ( render->mutex );
+  while ( render->tiles_left > 0 )
+    g_cond_wait ( render->cond, render->mutex );
+  g_mutex_unlock ( render->mutex );
+
+  g_cond_free ( render->cond );
+  g_mutex_free ( render->mutex );
+}
+
+static void dem_get_bounds ( VikDEM *dem, struct LatLon *sw, struct LatLon *ne )
+{
+  if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
+    ne->lat = dem->max_north / 3600.0;
+    ne->lon = dem->max_east / 3600.0;
+    sw->lat = dem->min_north / 3600.0;
+    sw->lon = dem->min_east / 3600.0;
+  } else {
+    struct UTM ne_utm = { dem->max_north, dem->max_east, dem->utm_zone, dem->utm_letter };
+    struct UTM sw_utm = { dem->min_north, dem->min_east, dem->utm_zone, dem->utm_letter };
+    a_coords_utm_to_latlon ( &ne_utm, ne );
+    a_coords_utm_to_latlon ( &sw_utm, sw );
+  }
+}
+
+static void dem_layer_draw_tiles ( VikDEMLayer *vdl, VikViewport *vp, GList *dems )
+{
+  const VikCoord *center = vik_viewport_get_center ( vp );
+  gint width = vik_viewport_get_width ( vp );
+  gint height = vik_viewport_get_height ( vp );
+  DemRender render;
+  DemTileKey key;
+  GList *visible = NULL, *missing = NULL, *iter;
+  gdouble center_x, center_y;
+  gint64 origin_x, origin_y;
+  gint tx1, ty1, tx2, ty2;
+  gsize signature = 0;
+
+  memset ( &render, 0, sizeof(render) );
+  render.mode = vik_viewport_get_drawmode ( vp );
+  render.xmpp = vik_viewport_get_xmpp ( vp );
+  render.ympp = vik_viewport_get_ympp ( vp );
+  render.type = vdl->type;
+
+  if ( render.mode == VIK_VIEWPORT_DRAWMODE_UTM ) {
+    render.zone = center->utm_zone;
+    render.letter = center->utm_letter;
+    center_x = center->east_west / render.xmpp;
+    center_y = -center->north_south / render.ympp;
+  }
+  else {
+    center_x = center->east_west * DEM_TILE_PIXELS_PER_DEGREE / render.xmpp;
+    if ( render.mode == VIK_VIEWPORT_DRAWMODE_MERCATOR )
+      center_y = -MERCLAT(center->north_south) * DEM_TILE_PIXELS_PER_DEGREE / render.ympp;
+    else
+      center_y = -center->north_south * DEM_TILE_PIXELS_PER_DEGREE / render.ympp;
+  }
+
+  /* Start again if any of the DEMs have been loaded or dropped since */
+  for ( iter = dems; iter; iter = iter->next ) {
+    DemSource *source = g_new ( DemSource, 1 );
+    source->dem = iter->data;
+    dem_get_bounds ( source->dem, &source->sw, &source->ne );
+    render.sources = g_list_append ( render.sources, source );
+    signature = signature * 31 + GPOINTER_TO_SIZE(iter->data);
+  }
+  if ( signature != vdl->tiles_dems ) {
+    dem_layer_tiles_clear ( vdl );
+    vdl->tiles_dems = signature;
+  }
+
+  if ( vdl->type == DEM_TYPE_GRADIENT ) {
+    render.lut = vdl->gradient_lut;
+    render.palette = dem_gradient_palette;
+  }
+  else {
+    render.lut = vdl->height_lut;
+    render.palette = vdl->height_palette;
+  }
+
+  origin_x = (gint64) floor ( center_x - width / 2 );
+  origin_y = (gint64) floor ( center_y - height / 2 );
+  tx1 = (gint) floor ( origin_x / (gdouble) DEM_TILE_SIZE );
+  ty1 = (gint) floor ( origin_y / (gdouble) DEM_TILE_SIZE );
+  tx2 = (gint) floor ( (origin_x + width - 1) / (gdouble) DEM_TILE_SIZE );
+  ty2 = (gint) floor ( (origin_y + height - 1) / (gdouble) DEM_TILE_SIZE );
+
+  key.xmpp = render.xmpp;
+  key.ympp = render.ympp;
+  key.mode = render.mode;
+  key.zone = render.zone;
+  for ( key.y = ty1; key.y <= ty2; key.y++ ) {
+    for ( key.x = tx1; key.x <= tx2; key.x++ ) {
+      DemTile *tile = g_hash_table_lookup ( vdl->tiles, &key );
+      if ( tile )
+        g_queue_remove ( vdl->tiles_lru, tile );
+      else {
+        tile = g_slice_new0 ( DemTile );
+        tile->key = key;
+        g_hash_table_insert ( vdl->tiles, &tile->key, tile );
+        missing = g_list_prepend ( missing, tile );
+      }
+      g_queue_push_head ( vdl->tiles_lru, tile );
+      visible = g_list_prepend ( visible, tile );
+    }
+  }
+
+  if ( missing )
+    dem_tiles_draw ( &render, missing );
+
+  if ( ! vdl->screen || gdk_pixbuf_get_width ( vdl->screen ) != width || gdk_pixbuf_get_height ( vdl->screen ) != height ) {
+    if ( vdl->screen )
+      g_object_unref ( vdl->screen );
+    vdl->screen = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, width, height );
+  }
+  gdk_pixbuf_fill ( vdl->screen, 0 );
+
+  {
+    gint x1 = width, y1 = height, x2 = 0, y2 = 0;
+    for ( iter = visible; iter; iter = iter->next ) {
+      DemTile *tile = iter->data;
+      gint sx, sy, src_x, src_y, w, h;
+      if ( ! tile->pixbuf )
+        continue;
+      sx = (gint) ((gint64) tile->key.x * DEM_TILE_SIZE - origin_x);
+      sy = (gint) ((gint64) tile->key.y * DEM_TILE_SIZE - origin_y);
+      src_x = MAX ( 0, -sx );
+      src_y = MAX ( 0, -sy );
+      w = MIN ( DEM_TILE_SIZE, width - sx ) - src_x;
+      h = MIN ( DEM_TILE_SIZE, height - sy ) - src_y;
+      gdk_pixbuf_copy_area ( tile->pixbuf, src_x, src_y, w, h, vdl->screen, sx + src_x, sy + src_y );
+      x1 = MIN ( x1, sx + src_x );
+      y1 = MIN ( y1, sy + src_y );
+      x2 = MAX ( x2, sx + src_x + w );
+      y2 = MAX ( y2, sy + src_y + h );
+    }
+    if ( x2 > x1 && y2 > y1 )
+      vik_viewport_draw_pixbuf ( vp, vdl->screen, x1, y1, x1, y1, x2 - x1, y2 - y1 );
+  }
+
+  while ( g_queue_get_length ( vdl->tiles_lru ) > DEM_TILE_CACHE_SIZE )
+    g_hash_table_remove ( vdl->tiles, &((DemTile *) g_queue_pop_tail ( vdl->tiles_lru ))->key );
+
+  g_list_free ( visible );
+  g_list_free ( missing );
+  for ( iter = render.sources; iter; iter = iter->next )
+    g_free ( iter->data );
+  g_list_free ( render.sources );
+}
+
+static void dem_layer_tiles_init ( VikDEMLayer *vdl )
+{
+  static gboolean palettes_done = FALSE;
+  if ( ! palettes_done ) {
+    dem_palette_init ( dem_height_palette, dem_height_colors, DEM_N_HEIGHT_COLORS );
+    dem_palette_init ( dem_gradient_palette, dem_gradient_colors, DEM_N_GRADIENT_COLORS );
+    palettes_done = TRUE;
+  }
+  memcpy ( vdl->height_palette, dem_height_palette, sizeof(dem_height_palette) );
+
+  vdl->tiles = g_hash_table_new_full ( (GHashFunc) dem_tile_key_hash, (GEqualFunc) dem_tile_key_equal, NULL, (GDestroyNotify) dem_tile_free );
+  vdl->tiles_lru = g_queue_new ();
+  vdl->height_lut = g_malloc0 ( 65536 );
+  vdl->gradient_lut = g_malloc0 ( 65536 );
+}
+
+static void dem_layer_tiles_changed ( VikDEMLayer *vdl )
+{
+  // Below the minimum is in the configurable colour
+  vdl->height_palette[0][0] = vdl->color.red >> 8;
+  vdl->height_palette[0][1] = vdl->color.green >> 8;
+  vdl->height_palette[0][2] = vdl->color.blue >> 8;
+  dem_layer_make_luts ( vdl );
+  dem_layer_tiles_clear ( vdl );
+}
+
+static void dem_layer_tiles_free ( VikDEMLayer *vdl )
+{
+  g_queue_free ( vdl->tiles_lru );
+  g_hash_table_destroy ( vdl->tiles );
+  g_free ( vdl->height_lut );
+  g_free ( vdl->gradient_lut );
+  if ( vdl->screen )
+    g_object_unref ( vdl->screen );
+}
+
 /* return the continent for the specified lat, lon */
 /* TODO */
 static const gchar *srtm_continent_dir ( gint lat, gint lon )
@@ -810,6 +1352,7 @@ static const gchar *srtm_continent_dir ( gint lat, gint lon )
 static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp )
 {
   GList *dems_iter = vdl->files;
+  GList *dems = NULL;
   VikDEM *dem;
 
 
@@ -825,9 +1368,18 @@ static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp )
   while ( dems_iter ) {
     dem = a_dems_get ( (const char *) (dems_iter->data) );
     if ( dem )
-      vik_dem_layer_draw_dem ( vdl, vp, dem );
+      dems = g_list_prepend ( dems, dem );
     dems_iter = dems_iter->next;
   }
+  dems = g_list_reverse ( dems );
+
+  if ( vik_viewport_get_drawmode ( vp ) == VIK_VIEWPORT_DRAWMODE_EXPEDIA )
+    for ( dems_iter = dems; dems_iter; dems_iter = dems_iter->next )
+      vik_dem_layer_draw_dem ( vdl, vp, dems_iter->data );
+  else if ( dems )
+    dem_layer_draw_tiles ( vdl, vp, dems );
+
+  g_list_free ( dems );
 }
 
 static void dem_layer_free ( VikDEMLayer *vdl )
@@ -844,6 +1396,8 @@ static void dem_layer_free ( VikDEMLayer *vdl )
   g_free ( vdl->gcsgradient );
 
   a_dems_list_free ( vdl->files );
+
+  dem_layer_tiles_free ( vdl );
 }
 
 VikDEMLayer *dem_layer_create ( VikViewport *vp )
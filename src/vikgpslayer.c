@@ -670,31 +670,16 @@ static void vik_gps_layer_draw ( VikGpsLayer *vgl, VikViewport *vp )
 {
   gint i;
   VikLayer *vl;
-  VikLayer *trigger = VIK_LAYER(vik_viewport_get_trigger( vp ));
 
   for (i = 0; i < NUM_TRW; i++) {
     vl = VIK_LAYER(vgl->trw_children[i]);
-    if (vl == trigger) {
-      if ( vik_viewport_get_half_drawn ( vp ) ) {
-        vik_viewport_set_half_drawn ( vp, FALSE );
-        vik_viewport_snapshot_load( vp );
-      } else {
-        vik_viewport_snapshot_save( vp );
-      }
-    }
+    vik_viewport_surface_reach ( vp, vl, vl->visible );
     if (!vik_viewport_get_half_drawn(vp))
       vik_layer_draw ( vl, vp );
   }
 #if defined (VIK_CONFIG_REALTIME_GPS_TRACKING) && defined (GPSD_API_MAJOR_VERSION)
+  // Realtime updates are signalled by its TRW layer, so this is drawn with it
   if (vgl->realtime_tracking) {
-    if (VIK_LAYER(vgl) == trigger) {
-      if ( vik_viewport_get_half_drawn ( vp ) ) {
-        vik_viewport_set_half_drawn ( vp, FALSE );
-        vik_viewport_snapshot_load( vp );
-      } else {
-        vik_viewport_snapshot_save( vp );
-      }
-    }
     if (!vik_viewport_get_half_drawn(vp))
       realtime_tracking_draw(vgl, vp);
   }
@@ -1557,6 +1542,7 @@ static void create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forced)
           ((cur_timestamp - last_timestamp) < 2)) {
         g_free(last_tp->data);
         vgl->realtime_track->trackpoints = g_list_delete_link(vgl->realtime_track->trackpoints, last_tp);
+        vik_track_changed ( vgl->realtime_track );
         replace = TRUE;
       }
       if (replace ||
@@ -1583,6 +1569,7 @@ static void create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forced)
              vik_trw_layer_get_coord_mode(vgl->trw_children[TRW_REALTIME]), &ll);
 
         vgl->realtime_track->trackpoints = g_list_append(vgl->realtime_track->trackpoints, tp);
+        vik_track_changed ( vgl->realtime_track );
         vgl->realtime_fix.dirty = FALSE;
         vgl->realtime_fix.satellites_used = 0;
         vgl->last_fix = vgl->realtime_fix;
@@ -82,10 +82,27 @@ static void vik_layer_class_init (VikLayerClass *klass)
  */
 static gboolean idle_draw ( VikLayer *vl )
 {
+  // Updates asked for from now on need another signal
+  g_atomic_int_set ( &vl->update_pending, FALSE );
   g_signal_emit ( G_OBJECT(vl), layer_signals[VL_UPDATE_SIGNAL], 0 );
   return FALSE; // Nothing else to do
 }
 
+/**
+ * Queue the "update" signal, unless one is already waiting to go
+ *  so that a run of updates (e.g. one per downloaded tile) is signalled once
+ */
+static void queue_draw ( VikLayer *vl, gboolean from_background )
+{
+  if ( ! g_atomic_int_compare_and_exchange ( &vl->update_pending, FALSE, TRUE ) )
+    return;
+
+  if ( from_background )
+    gdk_threads_add_idle ( (GSourceFunc) idle_draw, vl );
+  else
+    g_idle_add ( (GSourceFunc) idle_draw, vl );
+}
+
 /**
  * Draw specified layer
  */
@@ -95,11 +112,8 @@ void vik_layer_emit_update ( VikLayer *vl )
     vik_window_set_redraw_trigger(vl);
 
     // Only ever draw when there is time to do so
-    if ( g_thread_self() != vik_window_get_thread (VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl))) )
-      // Drawing requested from another (background) thread, so handle via the gdk thread method
-      gdk_threads_add_idle ( (GSourceFunc) idle_draw, vl );
-    else
-      g_idle_add ( (GSourceFunc) idle_draw, vl );
+    // Drawing requested from another (background) thread is handled via the gdk thread method
+    queue_draw ( vl, g_thread_self() != vik_window_get_thread (VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl))) );
   }
 }
 
@@ -110,7 +124,7 @@ void vik_layer_emit_update ( VikLayer *vl )
 void vik_layer_emit_update_although_invisible ( VikLayer *vl )
 {
   vik_window_set_redraw_trigger(vl);
-  g_idle_add ( (GSourceFunc) idle_draw, vl );
+  queue_draw ( vl, FALSE );
 }
 
 /* doesn't set the trigger. should be done by aggregate layer when child emits update. */
@@ -119,7 +133,7 @@ void vik_layer_emit_update_secondary ( VikLayer *vl )
   if ( vl->visible )
     // TODO: this can used from the background - eg in acquire
     //       so will need to flow background update status through too
-    g_idle_add ( (GSourceFunc) idle_draw, vl );
+    queue_draw ( vl, FALSE );
 }
 
 static VikLayerInterface *vik_layer_interfaces[VIK_LAYER_NUM_TYPES] = {
@@ -272,7 +286,7 @@ void vik_layer_marshall ( VikLayer *vl, guint8 **data, gint *len )
   }
 }
 
-void vik_layer_marshall_params ( VikLayer *vl, guint8 **data, gint *datalen )
+static void layer_marshall_params ( VikLayer *vl, guint8 **data, gint *datalen, gboolean is_file_operation )
 {
   VikLayerParam *params = vik_layer_get_interface(vl->type)->params;
   VikLayerFuncGetParam get_param = vik_layer_get_interface(vl->type)->get_param;
@@ -293,7 +307,7 @@ void vik_layer_marshall_params ( VikLayer *vl, guint8 **data, gint *datalen )
     for ( i = 0; i < params_count; i++ )
     {
       g_debug("%s: %s", __FUNCTION__, params[i].name);
-      d = get_param(vl, i, FALSE);
+      d = get_param(vl, i, is_file_operation);
       switch ( params[i].type )
       {
       case VIK_LAYER_PARAM_STRING: 
@@ -331,7 +345,23 @@ void vik_layer_marshall_params ( VikLayer *vl, guint8 **data, gint *datalen )
 #undef vlm_append
 }
 
-void vik_layer_unmarshall_params ( VikLayer *vl, guint8 *data, gint datalen, VikViewport *vvp )
+void vik_layer_marshall_params ( VikLayer *vl, guint8 **data, gint *datalen )
+{
+  layer_marshall_params ( vl, data, datalen, FALSE );
+}
+
+/**
+ * vik_layer_marshall_params_for_file:
+ *
+ * As vik_layer_marshall_params() but with the values as saved in a file
+ *  rather than as shown, e.g. heights not in the preferred units
+ */
+void vik_layer_marshall_params_for_file ( VikLayer *vl, guint8 **data, gint *datalen )
+{
+  layer_marshall_params ( vl, data, datalen, TRUE );
+}
+
+static void layer_unmarshall_params ( VikLayer *vl, guint8 *data, gint datalen, VikViewport *vvp, gboolean is_file_operation )
 {
   VikLayerParam *params = vik_layer_get_interface(vl->type)->params;
   VikLayerFuncSetParam set_param = vik_layer_get_interface(vl->type)->set_param;
@@ -365,7 +395,7 @@ void vik_layer_unmarshall_params ( VikLayer *vl, guint8 *data, gint datalen, Vik
 	s[vlm_size]=0;
 	vlm_read(s);
 	d.s = s;
-	set_param(vl, i, d, vvp, FALSE);
+	set_param(vl, i, d, vvp, is_file_operation);
 	g_free(s);
 	break;
       case VIK_LAYER_PARAM_STRING_LIST:  {
@@ -381,20 +411,30 @@ void vik_layer_unmarshall_params ( VikLayer *vl, guint8 *data, gint datalen, Vik
           list = g_list_append ( list, s );
         }
         d.sl = list;
-        set_param(vl, i, d, vvp, FALSE);
+        set_param(vl, i, d, vvp, is_file_operation);
         /* don't free -- string list is responsibility of the layer */
 
         break;
         }
       default:
 	vlm_read(&d);
-	set_param(vl, i, d, vvp, FALSE);
+	set_param(vl, i, d, vvp, is_file_operation);
 	break;
       }
     }
   }
 }
 
+void vik_layer_unmarshall_params ( VikLayer *vl, guint8 *data, gint datalen, VikViewport *vvp )
+{
+  layer_unmarshall_params ( vl, data, datalen, vvp, FALSE );
+}
+
+void vik_layer_unmarshall_params_for_file ( VikLayer *vl, guint8 *data, gint datalen, VikViewport *vvp )
+{
+  layer_unmarshall_params ( vl, data, datalen, vvp, TRUE );
+}
+
 VikLayer *vik_layer_unmarshall ( guint8 *data, gint len, VikViewport *vvp )
 {
   header_t *header;
@@ -61,6 +61,8 @@ struct _VikLayer {
 
   /* for explicit "polymorphism" (function type switching) */
   VikLayerTypeEnum type;
+
+  gint update_pending; /* An "update" is already queued, set atomically */
 };
 
 /* I think most of these are ignored,
@@ -286,6 +288,8 @@ void      vik_layer_marshall ( VikLayer *vl, guint8 **data, gint *len );
 VikLayer *vik_layer_unmarshall ( guint8 *data, gint len, VikViewport *vvp );
 void      vik_layer_marshall_params ( VikLayer *vl, guint8 **data, gint *len );
 void      vik_layer_unmarshall_params ( VikLayer *vl, guint8 *data, gint len, VikViewport *vvp );
+void      vik_layer_marshall_params_for_file ( VikLayer *vl, guint8 **data, gint *len );
+void      vik_layer_unmarshall_params_for_file ( VikLayer *vl, guint8 *data, gint len, VikViewport *vvp );
 
 const gchar *vik_layer_sublayer_rename_request ( VikLayer *l, const gchar *newname, gpointer vlp, gint subtype, gpointer sublayer, GtkTreeIter *iter );
 
@@ -520,8 +520,12 @@ gboolean vik_layers_panel_properties ( VikLayersPanel *vlp )
 
 void vik_layers_panel_draw_all ( VikLayersPanel *vlp )
 {
-  if ( vlp->vvp && VIK_LAYER(vlp->toplayer)->visible )
-    vik_aggregate_layer_draw ( vlp->toplayer, vlp->vvp );
+  if ( vlp->vvp ) {
+    vik_viewport_surface_reach ( vlp->vvp, vlp->toplayer, VIK_LAYER(vlp->toplayer)->visible );
+    // Even when half drawn, as a changed layer may be found within
+    if ( VIK_LAYER(vlp->toplayer)->visible )
+      vik_aggregate_layer_draw ( vlp->toplayer, vlp->vvp );
+  }
 }
 
 void vik_layers_panel_cut_selected ( VikLayersPanel *vlp )
@@ -540,10 +544,6 @@ void vik_layers_panel_cut_selected ( VikLayersPanel *vlp )
     VikAggregateLayer *parent = vik_treeview_item_get_parent ( vlp->vt, &iter );
     if ( parent )
     {
-      /* reset trigger if trigger deleted */
-      if ( vik_layers_panel_get_selected ( vlp ) == vik_viewport_get_trigger ( vlp->vvp ) )
-        vik_viewport_set_trigger ( vlp->vvp, NULL );
-
       a_clipboard_copy_selected ( vlp );
 
       if (IS_VIK_AGGREGATE_LAYER(parent)) {
@@ -604,10 +604,6 @@ void vik_layers_panel_delete_selected ( VikLayersPanel *vlp )
     VikAggregateLayer *parent = vik_treeview_item_get_parent ( vlp->vt, &iter );
     if ( parent )
     {
-      /* reset trigger if trigger deleted */
-      if ( vik_layers_panel_get_selected ( vlp ) == vik_viewport_get_trigger ( vlp->vvp ) )
-        vik_viewport_set_trigger ( vlp->vvp, NULL );
-
       if (IS_VIK_AGGREGATE_LAYER(parent)) {
         if ( vik_aggregate_layer_delete ( parent, &iter ) )
 	  vik_layers_panel_emit_update ( vlp );
@@ -55,10 +55,15 @@
 #include "vikmapsourcedefault.h"
 #include "maputils.h"
 #include "mapcache.h"
+#include "dircache.h"
 #include "background.h"
 #include "preferences.h"
+#include "util.h"
 #include "vikmapslayer.h"
 #include "icons/icons.h"
+#ifdef VIK_CONFIG_MBTILES
+#include "mbtiles.h"
+#endif
 
 /****** MAP TYPES ******/
 
@@ -96,7 +101,7 @@ static gboolean maps_layer_download_release ( VikMapsLayer *vml, GdkEventButton
 static gboolean maps_layer_download_click ( VikMapsLayer *vml, GdkEventButton *event, VikViewport *vvp );
 static gpointer maps_layer_download_create ( VikWindow *vw, VikViewport *vvp );
 static void maps_layer_set_cache_dir ( VikMapsLayer *vml, const gchar *dir );
-static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload );
+static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload, gboolean onscreen_only );
 static void maps_layer_add_menu_items ( VikMapsLayer *vml, GtkMenu *menu, VikLayersPanel *vlp );
 static guint map_uniq_id_to_index ( guint uniq_id );
 
@@ -127,6 +132,10 @@ VikLayerParam maps_layer_params[] = {
   { VIK_LAYER_MAPS, "mapzoom", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Zoom Level:"), VIK_LAYER_WIDGET_COMBOBOX, params_mapzooms, NULL,
     N_("Determines the method of displaying map tiles for the current zoom level. 'Viking Zoom Level' uses the best matching level, otherwise setting a fixed value will always use map tiles of the specified value regardless of the actual zoom level."),
     mapzoom_default },
+#ifdef VIK_CONFIG_MBTILES
+  { VIK_LAYER_MAPS, "mbtiles", VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("MBTiles File:"), VIK_LAYER_WIDGET_FILEENTRY, NULL, NULL,
+    N_("Read the tiles from this MBTiles file instead of the maps directory. Tiles are not downloaded into it."), NULL },
+#endif
 };
 
 enum {
@@ -136,6 +145,9 @@ enum {
   PARAM_AUTODOWNLOAD,
   PARAM_ONLYMISSING,
   PARAM_MAPZOOM,
+#ifdef VIK_CONFIG_MBTILES
+  PARAM_MBTILES_FILE,
+#endif
   NUM_PARAMS
 };
 
@@ -234,6 +246,17 @@ struct _VikMapsLayer {
 
   gboolean license_notice_shown; // FALSE for new maps only, otherwise
                                  // TRUE for saved maps & other layer changes as we don't need to show it again
+
+  struct _MapDecodeContext *decode_ctx;
+
+  /* Range of tiles last drawn, so autodownloads can skip tiles no longer on screen */
+  gint onscreen_x0, onscreen_y0, onscreen_xf, onscreen_yf;
+  gint onscreen_z, onscreen_scale;
+
+#ifdef VIK_CONFIG_MBTILES
+  gchar *mbtiles_file;
+  VikMBTiles *mbtiles; /* NULL when tiles are read from cache_dir */
+#endif
 };
 
 enum { REDOWNLOAD_NONE = 0,    /* download only missing maps */
@@ -242,15 +265,92 @@ enum { REDOWNLOAD_NONE = 0,    /* download only missing maps */
        REDOWNLOAD_ALL,         /* download all maps */
        DOWNLOAD_OR_REFRESH };  /* download missing maps and refresh cache */
 
+static VikLayerParamScale params_connections_scale = { 1, 16, 1, 0 };
+
 static VikLayerParam prefs[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "maplayer_default_dir", VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("Default maplayer directory:"), VIK_LAYER_WIDGET_FOLDERENTRY, NULL, NULL, N_("Choose a directory to store cached Map tiles for this layer") },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "maps_download_connections", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Parallel map downloads:"), VIK_LAYER_WIDGET_SPINBUTTON, &params_connections_scale, NULL,
+    N_("Number of connections used at the same time to download map tiles from a server") },
 };
 
+/* Tiles found on disk are decoded, alpha blended and shrunk by a pool of worker threads */
+static GThreadPool *decode_pool = NULL;
+static gint decode_stopping = 0; /* Set on uninit, so queued tiles are freed without being decoded */
+/* Tiles queued or being decoded, so a redraw doesn't queue them again */
+static GHashTable *decode_pending = NULL;
+static GMutex *decode_mutex = NULL;
+/* When set, tiles are decoded in the drawing thread, eg when generating an image file */
+static gint decode_synchronous = 0;
+
+/* Tiles queued for download by any download job, so overlapping jobs don't fetch them twice */
+static GHashTable *download_claimed = NULL;
+static GMutex *download_claimed_mutex = NULL;
+/* Protects the on screen tile range of all layers */
+static GMutex *onscreen_mutex = NULL;
+
+/* Redraws requested by decoded tiles within this time (ms) are merged into one */
+#define DECODE_REDRAW_DELAY 50
+
+/* Shared between a layer and its queued tiles, so it may outlive the layer */
+typedef struct _MapDecodeContext {
+  gint ref_count;
+  GMutex *mutex;
+  VikMapsLayer *vml; /* NULL once the layer has been freed */
+  gboolean redraw_pending;
+} MapDecodeContext;
+
+typedef struct {
+  MapDecodeContext *ctx;
+  gchar *filename;
+#ifdef VIK_CONFIG_MBTILES
+  VikMBTiles *mbtiles; /* When set, read the tile from here rather than filename */
+#endif
+  gchar *pending_key;
+  MapCoord mapcoord;
+  guint8 type;
+  guint8 alpha;
+  gdouble xshrinkfactor, yshrinkfactor;
+} MapDecodeJob;
+
+static void decode_tile_thread ( gpointer data, gpointer user_data );
+
 void maps_layer_init ()
 {
   VikLayerParamData tmp;
   tmp.s = maps_layer_default_dir();
   a_preferences_register(prefs, tmp, VIKING_PREFERENCES_GROUP_KEY);
+  tmp.u = 4;
+  a_preferences_register(&prefs[1], tmp, VIKING_PREFERENCES_GROUP_KEY);
+
+  download_claimed = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  download_claimed_mutex = g_mutex_new ();
+  onscreen_mutex = g_mutex_new ();
+
+  decode_pending = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  decode_mutex = g_mutex_new ();
+  /* Without a pool tiles are simply decoded in the drawing thread */
+  decode_pool = g_thread_pool_new ( decode_tile_thread, NULL, util_get_number_of_cpus(), FALSE, NULL );
+}
+
+void maps_layer_uninit ()
+{
+  if ( decode_pool ) {
+    /* Skip decoding the queued tiles, but let their jobs run to free them */
+    g_atomic_int_set ( &decode_stopping, 1 );
+    g_thread_pool_free ( decode_pool, FALSE, TRUE );
+    decode_pool = NULL;
+  }
+  g_hash_table_destroy ( decode_pending );
+  decode_pending = NULL;
+  g_mutex_free ( decode_mutex );
+  decode_mutex = NULL;
+
+  g_hash_table_destroy ( download_claimed );
+  download_claimed = NULL;
+  g_mutex_free ( download_claimed_mutex );
+  download_claimed_mutex = NULL;
+  g_mutex_free ( onscreen_mutex );
+  onscreen_mutex = NULL;
 }
 
 /****************************************/
@@ -488,6 +588,22 @@ static guint map_uniq_id_to_index ( guint uniq_id )
   return NUM_MAP_TYPES; /* no such thing */
 }
 
+#ifdef VIK_CONFIG_MBTILES
+static void maps_layer_set_mbtiles_file ( VikMapsLayer *vml, const gchar *filename )
+{
+  if ( vml->mbtiles )
+    vik_mbtiles_unref ( vml->mbtiles );
+  vml->mbtiles = NULL;
+  g_free ( vml->mbtiles_file );
+  vml->mbtiles_file = NULL;
+
+  if ( filename && filename[0] ) {
+    vml->mbtiles_file = g_strdup ( filename );
+    vml->mbtiles = vik_mbtiles_open ( filename );
+  }
+}
+#endif
+
 static gboolean maps_layer_set_param ( VikMapsLayer *vml, guint16 id, VikLayerParamData data, VikViewport *vvp, gboolean is_file_operation )
 {
   // When loading from a file don't need the license reminder
@@ -511,6 +627,9 @@ static gboolean maps_layer_set_param ( VikMapsLayer *vml, guint16 id, VikLayerPa
                           vml->xmapzoom = __mapzooms_x [data.u];
                           vml->ymapzoom = __mapzooms_y [data.u];
                         }else g_warning (_("Unknown Map Zoom")); break;
+#ifdef VIK_CONFIG_MBTILES
+    case PARAM_MBTILES_FILE: maps_layer_set_mbtiles_file ( vml, data.s ); break;
+#endif
   }
   return TRUE;
 }
@@ -526,6 +645,9 @@ static VikLayerParamData maps_layer_get_param ( VikMapsLayer *vml, guint16 id, g
     case PARAM_AUTODOWNLOAD: rv.u = vml->autodownload; break;
     case PARAM_ONLYMISSING: rv.u = vml->adl_only_missing; break;
     case PARAM_MAPZOOM: rv.u = vml->mapzoom_id; break;
+#ifdef VIK_CONFIG_MBTILES
+    case PARAM_MBTILES_FILE: rv.s = vml->mbtiles_file ? vml->mbtiles_file : ""; break;
+#endif
   }
   return rv;
 }
@@ -549,13 +671,32 @@ static VikMapsLayer *maps_layer_new ( VikViewport *vvp )
   vml->dl_right_click_menu = NULL;
   vml->license_notice_shown = FALSE;
 
+  vml->decode_ctx = g_new0 ( MapDecodeContext, 1 );
+  vml->decode_ctx->ref_count = 1;
+  vml->decode_ctx->mutex = g_mutex_new ();
+  vml->decode_ctx->vml = vml;
+
+  vml->onscreen_scale = G_MAXINT;
+
   return vml;
 }
 
+static void decode_context_unref ( MapDecodeContext *ctx );
+
 static void maps_layer_free ( VikMapsLayer *vml )
 {
+  /* Tiles still being decoded must not refer to this layer anymore */
+  g_mutex_lock ( vml->decode_ctx->mutex );
+  vml->decode_ctx->vml = NULL;
+  g_mutex_unlock ( vml->decode_ctx->mutex );
+  decode_context_unref ( vml->decode_ctx );
+  vml->decode_ctx = NULL;
+
   g_free ( vml->cache_dir );
   vml->cache_dir = NULL;
+#ifdef VIK_CONFIG_MBTILES
+  maps_layer_set_mbtiles_file ( vml, NULL );
+#endif
   if ( vml->dl_right_click_menu )
     g_object_ref_sink ( G_OBJECT(vml->dl_right_click_menu) );
   g_free(vml->last_center);
@@ -647,7 +788,186 @@ static GdkPixbuf *pixbuf_shrink ( GdkPixbuf *pixbuf, gdouble xshrinkfactor, gdou
   return tmp;
 }
 
-static GdkPixbuf *get_pixbuf( VikMapsLayer *vml, gint mode, MapCoord *mapcoord, gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
+/* Apply the layer's alpha and shrink factors to a freshly read tile */
+static GdkPixbuf *prepare_tile ( GdkPixbuf *pixbuf, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  if ( alpha < 255 )
+    pixbuf = pixbuf_set_alpha ( pixbuf, alpha );
+  if ( xshrinkfactor != 1.0 || yshrinkfactor != 1.0 )
+    pixbuf = pixbuf_shrink ( pixbuf, xshrinkfactor, yshrinkfactor );
+  return pixbuf;
+}
+
+static GdkPixbuf *load_tile ( const gchar *filename, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  GError *gx = NULL;
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( filename, &gx );
+
+  /* free the pixbuf on error */
+  if (gx)
+  {
+    if ( gx->domain != GDK_PIXBUF_ERROR || gx->code != GDK_PIXBUF_ERROR_CORRUPT_IMAGE )
+      g_warning ( _("Couldn't open image file: %s"), gx->message );
+
+    g_error_free ( gx );
+    if ( pixbuf )
+      g_object_unref ( G_OBJECT(pixbuf) );
+    return NULL;
+  }
+
+  return prepare_tile ( pixbuf, alpha, xshrinkfactor, yshrinkfactor );
+}
+
+#ifdef VIK_CONFIG_MBTILES
+static GdkPixbuf *load_mbtile ( VikMBTiles *mbtiles, MapCoord *mapcoord, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  GdkPixbuf *pixbuf = vik_mbtiles_get_pixbuf ( mbtiles, mapcoord->x, mapcoord->y, 17 - mapcoord->scale );
+  if ( ! pixbuf )
+    return NULL;
+  return prepare_tile ( pixbuf, alpha, xshrinkfactor, yshrinkfactor );
+}
+#endif
+
+static void decode_context_unref ( MapDecodeContext *ctx )
+{
+  if ( g_atomic_int_dec_and_test ( &ctx->ref_count ) ) {
+    g_mutex_free ( ctx->mutex );
+    g_free ( ctx );
+  }
+}
+
+/**
+ * Run in the main loop once the delay has passed, so a burst of decoded tiles gives one redraw
+ */
+static gboolean decode_redraw_timeout ( MapDecodeContext *ctx )
+{
+  VikMapsLayer *vml;
+
+  g_mutex_lock ( ctx->mutex );
+  ctx->redraw_pending = FALSE;
+  vml = ctx->vml;
+  g_mutex_unlock ( ctx->mutex );
+
+  if ( vml )
+    vik_layer_emit_update ( VIK_LAYER(vml) );
+
+  decode_context_unref ( ctx );
+  return FALSE;
+}
+
+static void decode_context_request_redraw ( MapDecodeContext *ctx )
+{
+  g_mutex_lock ( ctx->mutex );
+  if ( ctx->vml && ! ctx->redraw_pending ) {
+    ctx->redraw_pending = TRUE;
+    g_atomic_int_inc ( &ctx->ref_count );
+    gdk_threads_add_timeout ( DECODE_REDRAW_DELAY, (GSourceFunc) decode_redraw_timeout, ctx );
+  }
+  g_mutex_unlock ( ctx->mutex );
+}
+
+static void decode_tile_thread ( gpointer data, gpointer user_data )
+{
+  MapDecodeJob *job = data;
+  GdkPixbuf *pixbuf = NULL;
+  gboolean alive;
+
+  g_mutex_lock ( job->ctx->mutex );
+  alive = ( job->ctx->vml != NULL ) && ! g_atomic_int_get ( &decode_stopping );
+  g_mutex_unlock ( job->ctx->mutex );
+
+  if ( alive ) {
+#ifdef VIK_CONFIG_MBTILES
+    if ( job->mbtiles )
+      pixbuf = load_mbtile ( job->mbtiles, &job->mapcoord, job->alpha, job->xshrinkfactor, job->yshrinkfactor );
+    else
+#endif
+    pixbuf = load_tile ( job->filename, job->alpha, job->xshrinkfactor, job->yshrinkfactor );
+    if ( pixbuf ) {
+      a_mapcache_add ( pixbuf, job->mapcoord.x, job->mapcoord.y, job->mapcoord.z,
+                       job->type, job->mapcoord.scale, job->alpha, job->xshrinkfactor, job->yshrinkfactor );
+      g_object_unref ( pixbuf );
+    }
+  }
+
+  /* Only once it is in the cache, so a redraw won't queue it again */
+  g_mutex_lock ( decode_mutex );
+  g_hash_table_remove ( decode_pending, job->pending_key );
+  g_mutex_unlock ( decode_mutex );
+
+  if ( pixbuf )
+    decode_context_request_redraw ( job->ctx );
+
+  decode_context_unref ( job->ctx );
+#ifdef VIK_CONFIG_MBTILES
+  if ( job->mbtiles )
+    vik_mbtiles_unref ( job->mbtiles );
+#endif
+  g_free ( job->filename );
+  g_slice_free ( MapDecodeJob, job );
+}
+
+/**
+ * Queue the tile for decoding, unless it is already queued
+ */
+static void decode_tile_queue ( VikMapsLayer *vml, MapCoord *mapcoord, const gchar *filename, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  gchar *key = g_strdup_printf ( "%s-%d-%.3f-%.3f", filename, vml->alpha, xshrinkfactor, yshrinkfactor );
+  MapDecodeJob *job;
+
+  g_mutex_lock ( decode_mutex );
+  if ( g_hash_table_lookup ( decode_pending, key ) ) {
+    g_mutex_unlock ( decode_mutex );
+    g_free ( key );
+    return;
+  }
+  /* Owns the key */
+  g_hash_table_insert ( decode_pending, key, GINT_TO_POINTER(1) );
+  g_mutex_unlock ( decode_mutex );
+
+  job = g_slice_new ( MapDecodeJob );
+  job->ctx = vml->decode_ctx;
+  g_atomic_int_inc ( &job->ctx->ref_count );
+  job->filename = g_strdup ( filename );
+#ifdef VIK_CONFIG_MBTILES
+  job->mbtiles = vml->mbtiles ? vik_mbtiles_ref ( vml->mbtiles ) : NULL;
+#endif
+  job->pending_key = key;
+  job->mapcoord = *mapcoord;
+  job->type = vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype));
+  job->alpha = vml->alpha;
+  job->xshrinkfactor = xshrinkfactor;
+  job->yshrinkfactor = yshrinkfactor;
+
+  g_thread_pool_push ( decode_pool, job, NULL );
+}
+
+/**
+ * maps_layer_set_synchronous_decode:
+ *
+ * When TRUE, tiles are decoded while drawing rather than by the worker threads,
+ *  so a single draw pass gives the complete image (eg for saving to a file).
+ * Calls can be nested.
+ */
+void maps_layer_set_synchronous_decode ( gboolean synchronous )
+{
+  if ( synchronous )
+    decode_synchronous++;
+  else if ( decode_synchronous > 0 )
+    decode_synchronous--;
+}
+
+/**
+ * @cache_only: Don't look for the tile on disk
+ * @pending:    If not NULL, set to TRUE when the tile has been queued for decoding
+ *
+ * Tiles not in the memory cache are queued for decoding by the worker threads,
+ *  and drawn by a later redraw.
+ *
+ * Returns: a new reference to the tile's pixbuf (or NULL if not available),
+ *  which the caller must unref after use.
+ */
+static GdkPixbuf *get_pixbuf( VikMapsLayer *vml, gint mode, MapCoord *mapcoord, gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor, gboolean cache_only, gboolean *pending )
 {
   GdkPixbuf *pixbuf;
 
@@ -655,7 +975,30 @@ static GdkPixbuf *get_pixbuf( VikMapsLayer *vml, gint mode, MapCoord *mapcoord,
   pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
                             mode, mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor );
 
-  if ( ! pixbuf ) {
+#ifdef VIK_CONFIG_MBTILES
+  if ( ! pixbuf && ! cache_only && vml->mbtiles ) {
+    /* Only used to identify the tile while it is being decoded */
+    g_snprintf ( filename_buf, buf_len, "%s" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d",
+                 vml->mbtiles_file, 17 - mapcoord->scale, mapcoord->x, mapcoord->y );
+    if ( decode_pool && ! decode_synchronous ) {
+      if ( vik_mbtiles_has_tile ( vml->mbtiles, mapcoord->x, mapcoord->y, 17 - mapcoord->scale ) ) {
+        decode_tile_queue ( vml, mapcoord, filename_buf, xshrinkfactor, yshrinkfactor );
+        if ( pending )
+          *pending = TRUE;
+      }
+    }
+    else {
+      pixbuf = load_mbtile ( vml->mbtiles, mapcoord, vml->alpha, xshrinkfactor, yshrinkfactor );
+      if ( pixbuf )
+        a_mapcache_add ( pixbuf, mapcoord->x, mapcoord->y,
+            mapcoord->z, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype)),
+            mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor );
+    }
+    return pixbuf;
+  }
+#endif
+
+  if ( ! pixbuf && ! cache_only ) {
     if ( vik_map_source_is_direct_file_access (MAPS_LAYER_NTH_TYPE(vml->maptype)) )
       g_snprintf ( filename_buf, buf_len, DIRECTDIRACCESS,
 		   vml->cache_dir, (17 - mapcoord->scale), mapcoord->x, mapcoord->y, ".png" );
@@ -664,28 +1007,17 @@ static GdkPixbuf *get_pixbuf( VikMapsLayer *vml, gint mode, MapCoord *mapcoord,
 		   vml->cache_dir, mode,
 		   mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y );
 
-    if ( g_file_test ( filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
+    if ( a_dircache_file_exists ( filename_buf ) )
     {
-      GError *gx = NULL;
-      pixbuf = gdk_pixbuf_new_from_file ( filename_buf, &gx );
-
-      /* free the pixbuf on error */
-      if (gx)
-      {
-        if ( gx->domain != GDK_PIXBUF_ERROR || gx->code != GDK_PIXBUF_ERROR_CORRUPT_IMAGE )
-          g_warning ( _("Couldn't open image file: %s"), gx->message );
-
-        g_error_free ( gx );
+      if ( decode_pool && ! decode_synchronous ) {
+        decode_tile_queue ( vml, mapcoord, filename_buf, xshrinkfactor, yshrinkfactor );
+        if ( pending )
+          *pending = TRUE;
+      }
+      else {
+        pixbuf = load_tile ( filename_buf, vml->alpha, xshrinkfactor, yshrinkfactor );
         if ( pixbuf )
-          g_object_unref ( G_OBJECT(pixbuf) );
-        pixbuf = NULL;
-      } else {
-          if ( vml->alpha < 255 )
-            pixbuf = pixbuf_set_alpha ( pixbuf, vml->alpha );
-          if ( xshrinkfactor != 1.0 || yshrinkfactor != 1.0 )
-            pixbuf = pixbuf_shrink ( pixbuf, xshrinkfactor, yshrinkfactor );
-
-          a_mapcache_add ( pixbuf, mapcoord->x, mapcoord->y, 
+          a_mapcache_add ( pixbuf, mapcoord->x, mapcoord->y,
               mapcoord->z, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype)),
               mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor );
       }
@@ -697,8 +1029,13 @@ static GdkPixbuf *get_pixbuf( VikMapsLayer *vml, gint mode, MapCoord *mapcoord,
 static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
 {
   const VikCoord *center = vik_viewport_get_center ( vvp );
+  GtkWidget *toplevel = gtk_widget_get_toplevel ( GTK_WIDGET(vvp) );
+
+  if ( ! IS_VIK_WINDOW(toplevel) )
+    /* Offscreen viewport (eg rendering an image): only use tiles already there */
+    return FALSE;
 
-  if (vik_window_get_pan_move (VIK_WINDOW(VIK_GTK_WINDOW_FROM_WIDGET(GTK_WIDGET(vvp)))))
+  if (vik_window_get_pan_move (VIK_WINDOW(toplevel)))
     /* D'n'D pan in action: do not download */
     return FALSE;
 
@@ -768,6 +1105,15 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
     gint ymin = MIN(ulm.y, brm.y), ymax = MAX(ulm.y, brm.y);
     gint mode = vik_map_source_get_uniq_id(map);
 
+    g_mutex_lock ( onscreen_mutex );
+    vml->onscreen_x0 = xmin;
+    vml->onscreen_xf = xmax;
+    vml->onscreen_y0 = ymin;
+    vml->onscreen_yf = ymax;
+    vml->onscreen_z = ulm.z;
+    vml->onscreen_scale = ulm.scale;
+    g_mutex_unlock ( onscreen_mutex );
+
     VikCoord coord;
     gint xx, yy, width, height;
     GdkPixbuf *pixbuf;
@@ -782,16 +1128,20 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
     }
 
     guint max_path_len = strlen(vml->cache_dir) + 40;
+#ifdef VIK_CONFIG_MBTILES
+    if ( vml->mbtiles_file )
+      max_path_len = MAX ( max_path_len, strlen(vml->mbtiles_file) + 40 );
+#endif
     gchar *path_buf = g_malloc ( max_path_len * sizeof(char) );
 
     if ( (!existence_only) && vml->autodownload  && should_start_autodownload(vml, vvp)) {
       g_debug("%s: Starting autodownload", __FUNCTION__);
       if ( !vml->adl_only_missing && vik_map_source_supports_download_only_new (map) )
         // Try to download newer tiles
-        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NEW );
+        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NEW, TRUE );
       else
         // Download only missing tiles
-        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NONE );
+        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NONE, TRUE );
     }
 
     if ( vik_map_source_get_tilesize_x(map) == 0 && !existence_only ) {
@@ -799,7 +1149,7 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
         for ( y = ymin; y <= ymax; y++ ) {
           ulm.x = x;
           ulm.y = y;
-          pixbuf = get_pixbuf ( vml, mode, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor );
+          pixbuf = get_pixbuf ( vml, mode, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor, FALSE, NULL );
           if ( pixbuf ) {
             width = gdk_pixbuf_get_width ( pixbuf );
             height = gdk_pixbuf_get_height ( pixbuf );
@@ -810,6 +1160,7 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
             yy -= (height/2);
 
             vik_viewport_draw_pixbuf ( vvp, pixbuf, 0, 0, xx, yy, width, height );
+            g_object_unref ( pixbuf );
           }
         }
       }
@@ -842,6 +1193,12 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
           ulm.y = y;
 
           if ( existence_only ) {
+            gboolean exists;
+#ifdef VIK_CONFIG_MBTILES
+            if ( vml->mbtiles )
+              exists = vik_mbtiles_has_tile ( vml->mbtiles, ulm.x, ulm.y, 17 - ulm.scale );
+            else {
+#endif
 	    if ( vik_map_source_is_direct_file_access (MAPS_LAYER_NTH_TYPE(vml->maptype)) )
 	      g_snprintf ( path_buf, max_path_len, DIRECTDIRACCESS,
 			   vml->cache_dir, (17 - ulm.scale), ulm.x, ulm.y, ".png" );
@@ -849,12 +1206,18 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
 	      g_snprintf ( path_buf, max_path_len, DIRSTRUCTURE,
 			   vml->cache_dir, mode,
 			   ulm.scale, ulm.z, ulm.x, ulm.y );
-            if ( g_file_test ( path_buf, G_FILE_TEST_EXISTS ) == TRUE ) {
+            exists = a_dircache_file_exists ( path_buf );
+#ifdef VIK_CONFIG_MBTILES
+            }
+#endif
+            if ( exists ) {
 	      GdkGC *black_gc = gtk_widget_get_style(GTK_WIDGET(vvp))->black_gc;
               vik_viewport_draw_line ( vvp, black_gc, xx+tilesize_x_ceil, yy, xx, yy+tilesize_y_ceil );
             }
           } else {
             int scale_inc;
+            /* While the tile itself is being decoded, only use other zoom levels already in memory as a stand-in */
+            gboolean pending = FALSE;
             for (scale_inc = 0; scale_inc < 4; scale_inc ++) {
               /* try with correct then smaller zooms */
               int scale_factor = 1 << scale_inc;  /*  2^scale_inc */
@@ -862,7 +1225,8 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
               ulm2.x = ulm.x / scale_factor;
               ulm2.y = ulm.y / scale_factor;
               ulm2.scale = ulm.scale + scale_inc;
-              pixbuf = get_pixbuf ( vml, mode, &ulm2, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
+              pixbuf = get_pixbuf ( vml, mode, &ulm2, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor,
+                                    pending, (scale_inc == 0) ? &pending : NULL );
               if ( pixbuf ) {
                 gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
                 gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
@@ -870,6 +1234,7 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
                 printf("maps_layer_draw_section - x=%d, y=%d, z=%d, src_x=%d, src_y=%d, xx=%d, yy=%d - %x\n", ulm.x, ulm.y, ulm.scale, src_x, src_y, (int)xx, (int)yy, vvp);
 #endif
                 vik_viewport_draw_pixbuf ( vvp, pixbuf, src_x, src_y, xx, yy, tilesize_x_ceil, tilesize_y_ceil );
+                g_object_unref ( pixbuf );
                 break;
               }
             }
@@ -888,13 +1253,14 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
                     MapCoord ulm3 = ulm2;
                     ulm3.x += pict_x;
                     ulm3.y += pict_y;
-                    pixbuf = get_pixbuf ( vml, mode, &ulm3, path_buf, max_path_len, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor );
+                    pixbuf = get_pixbuf ( vml, mode, &ulm3, path_buf, max_path_len, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor, pending, NULL );
                     if ( pixbuf ) {
                       gint src_x = 0;
                       gint src_y = 0;
                       gint dest_x = xx + pict_x * (tilesize_x_ceil / scale_factor);
                       gint dest_y = yy + pict_y * (tilesize_y_ceil / scale_factor);
                       vik_viewport_draw_pixbuf ( vvp, pixbuf, src_x, src_y, dest_x, dest_y, tilesize_x_ceil / scale_factor, tilesize_y_ceil / scale_factor );
+                      g_object_unref ( pixbuf );
                     }
                   }
                 }
@@ -963,6 +1329,7 @@ typedef struct {
   gint mapstoget;
   gint redownload;
   gboolean refresh_display;
+  gboolean onscreen_only; /* skip tiles that have scrolled off screen since the request */
   VikMapsLayer *vml;
   VikViewport *vvp;
   gboolean map_layer_alive;
@@ -987,11 +1354,184 @@ static void weak_ref_cb(gpointer ptr, GObject * dead_vml)
   g_mutex_unlock(mdi->mutex);
 }
 
-static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
+/* Number of downloaded tiles after which the memory cache and display get updated,
+   or sooner once the first of them has waited the redraw interval */
+#define DOWNLOAD_BATCH_SIZE 16
+
+/* Bounds of the tiles downloaded since the last update */
+typedef struct {
+  gint x0, y0, xf, yf;
+  guint count;
+  GTimeVal started; /* When the first tile was added */
+} DownloadBatch;
+
+static void download_batch_add ( DownloadBatch *batch, gint x, gint y )
+{
+  if ( batch->count == 0 ) {
+    batch->x0 = batch->xf = x;
+    batch->y0 = batch->yf = y;
+    g_get_current_time ( &batch->started );
+  }
+  else {
+    batch->x0 = MIN(batch->x0, x);
+    batch->xf = MAX(batch->xf, x);
+    batch->y0 = MIN(batch->y0, y);
+    batch->yf = MAX(batch->yf, y);
+  }
+  batch->count++;
+}
+
+/**
+ * Returns: TRUE when the batch's tiles should be shown now
+ */
+static gboolean download_batch_due ( DownloadBatch *batch )
+{
+  GTimeVal now;
+  glong waited;
+
+  if ( batch->count == 0 )
+    return FALSE;
+  if ( batch->count >= DOWNLOAD_BATCH_SIZE )
+    return TRUE;
+  g_get_current_time ( &now );
+  waited = (now.tv_sec - batch->started.tv_sec) * 1000 + (now.tv_usec - batch->started.tv_usec) / 1000;
+  return waited >= (glong) a_vik_get_redraw_interval ();
+}
+
+/**
+ * Drop the batch's tiles from the memory cache in one go and request a single redraw
+ */
+static void download_batch_flush ( MapDownloadInfo *mdi, DownloadBatch *batch )
+{
+  if ( batch->count == 0 )
+    return;
+
+  g_mutex_lock(mdi->mutex);
+  a_mapcache_remove_rectangle ( batch->x0, batch->y0, batch->xf, batch->yf, mdi->mapcoord.z,
+                                vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)), mdi->mapcoord.scale );
+  if (mdi->refresh_display && mdi->map_layer_alive) {
+    /* TODO: check if it's on visible area */
+    vik_layer_emit_update ( VIK_LAYER(mdi->vml) ); // NB update display from background
+  }
+  g_mutex_unlock(mdi->mutex);
+  batch->count = 0;
+}
+
+/**
+ * Decide what to do with the existing (or not) tile whose filename is in mdi->filename_buf
+ * Returns: FALSE if there is nothing to do for this tile
+ */
+static gboolean download_tile_check ( MapDownloadInfo *mdi, gboolean *need_download, gboolean *remove_mem_cache )
+{
+  if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+    *need_download = TRUE;
+    *remove_mem_cache = TRUE;
+
+  } else {  /* in case map file already exists */
+    switch (mdi->redownload) {
+      case REDOWNLOAD_NONE:
+        return FALSE;
+
+      case REDOWNLOAD_BAD:
+      {
+        /* see if this one is bad or what */
+        GError *gx = NULL;
+        GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( mdi->filename_buf, &gx );
+        if (gx || (!pixbuf)) {
+          g_remove ( mdi->filename_buf );
+          a_dircache_file_removed ( mdi->filename_buf );
+          *need_download = TRUE;
+          *remove_mem_cache = TRUE;
+          g_error_free ( gx );
+
+        } else {
+          g_object_unref ( pixbuf );
+        }
+        break;
+      }
+
+      case REDOWNLOAD_NEW:
+        *need_download = TRUE;
+        *remove_mem_cache = TRUE;
+        break;
+
+      case REDOWNLOAD_ALL:
+        /* FIXME: need a better way than to erase file in case of server/network problem */
+        g_remove ( mdi->filename_buf );
+        a_dircache_file_removed ( mdi->filename_buf );
+        *need_download = TRUE;
+        *remove_mem_cache = TRUE;
+        break;
+
+      case DOWNLOAD_OR_REFRESH:
+        *remove_mem_cache = TRUE;
+        break;
+
+      default:
+        g_warning ( "redownload state %d unknown\n", mdi->redownload);
+    }
+  }
+
+  return TRUE;
+}
+
+/**
+ * Claim the tile for this download job
+ * Returns: FALSE if another job has already queued it
+ */
+static gboolean download_tile_claim ( const gchar *filename )
+{
+  gboolean claimed = FALSE;
+  g_mutex_lock ( download_claimed_mutex );
+  if ( ! g_hash_table_lookup ( download_claimed, filename ) ) {
+    g_hash_table_insert ( download_claimed, g_strdup(filename), GINT_TO_POINTER(1) );
+    claimed = TRUE;
+  }
+  g_mutex_unlock ( download_claimed_mutex );
+  return claimed;
+}
+
+static void download_tile_release ( const gchar *filename )
+{
+  g_mutex_lock ( download_claimed_mutex );
+  g_hash_table_remove ( download_claimed, filename );
+  g_mutex_unlock ( download_claimed_mutex );
+}
+
+/**
+ * Returns: TRUE if the tile is no longer wanted on screen (only relevant for autodownloads)
+ */
+static gboolean download_tile_offscreen ( MapDownloadInfo *mdi, gint x, gint y )
+{
+  gboolean offscreen = TRUE;
+
+  if ( ! mdi->onscreen_only )
+    return FALSE;
+
+  g_mutex_lock(mdi->mutex);
+  if ( mdi->map_layer_alive ) {
+    VikMapsLayer *vml = mdi->vml;
+    g_mutex_lock ( onscreen_mutex );
+    if ( vml->onscreen_scale == mdi->mapcoord.scale ) {
+      /* Other UTM zones are drawn separately, so only check tiles of the zone last drawn */
+      if ( vml->onscreen_z != mdi->mapcoord.z )
+        offscreen = FALSE;
+      else
+        offscreen = ( x < vml->onscreen_x0 || x > vml->onscreen_xf || y < vml->onscreen_y0 || y > vml->onscreen_yf );
+    }
+    g_mutex_unlock ( onscreen_mutex );
+  }
+  g_mutex_unlock(mdi->mutex);
+  return offscreen;
+}
+
+static int map_download_thread_serial ( MapDownloadInfo *mdi, gpointer threaddata )
 {
   void *handle = vik_map_source_download_handle_init(MAPS_LAYER_NTH_TYPE(mdi->maptype));
   guint donemaps = 0;
   gint x, y;
+  DownloadBatch batch;
+  batch.count = 0;
   for ( x = mdi->x0; x <= mdi->xf; x++ )
   {
     for ( y = mdi->y0; y <= mdi->yf; y++ )
@@ -1005,56 +1545,16 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
       donemaps++;
       int res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ); /* this also calls testcancel */
       if (res != 0) {
+        download_batch_flush ( mdi, &batch );
         vik_map_source_download_handle_cleanup(MAPS_LAYER_NTH_TYPE(mdi->maptype), handle);
         return -1;
       }
 
-      if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
-        need_download = TRUE;
-        remove_mem_cache = TRUE;
-
-      } else {  /* in case map file already exists */
-        switch (mdi->redownload) {
-          case REDOWNLOAD_NONE:
-            continue;
-
-          case REDOWNLOAD_BAD:
-          {
-            /* see if this one is bad or what */
-            GError *gx = NULL;
-            GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( mdi->filename_buf, &gx );
-            if (gx || (!pixbuf)) {
-              g_remove ( mdi->filename_buf );
-              need_download = TRUE;
-              remove_mem_cache = TRUE;
-              g_error_free ( gx );
-
-            } else {
-              g_object_unref ( pixbuf );
-            }
-            break;
-          }
+      if ( download_tile_offscreen ( mdi, x, y ) )
+        continue;
 
-          case REDOWNLOAD_NEW:
-            need_download = TRUE;
-            remove_mem_cache = TRUE;
-            break;
-
-          case REDOWNLOAD_ALL:
-            /* FIXME: need a better way than to erase file in case of server/network problem */
-            g_remove ( mdi->filename_buf );
-            need_download = TRUE;
-            remove_mem_cache = TRUE;
-            break;
-
-          case DOWNLOAD_OR_REFRESH:
-            remove_mem_cache = TRUE;
-            break;
-
-          default:
-            g_warning ( "redownload state %d unknown\n", mdi->redownload);
-        }
-      }
+      if ( ! download_tile_check ( mdi, &need_download, &remove_mem_cache ) )
+        continue;
 
       mdi->mapcoord.x = x; mdi->mapcoord.y = y;
 
@@ -1063,19 +1563,164 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
           continue;
       }
 
-      g_mutex_lock(mdi->mutex);
-      if (remove_mem_cache)
-          a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)), mdi->mapcoord.scale );
-      if (mdi->refresh_display && mdi->map_layer_alive) {
-        /* TODO: check if it's on visible area */
-        vik_layer_emit_update ( VIK_LAYER(mdi->vml) ); // NB update display from background
+      if (remove_mem_cache) {
+        download_batch_add ( &batch, x, y );
+        if ( download_batch_due ( &batch ) )
+          download_batch_flush ( mdi, &batch );
       }
-      g_mutex_unlock(mdi->mutex);
       mdi->mapcoord.x = mdi->mapcoord.y = 0; /* we're temporarily between downloads */
 
     }
   }
+  download_batch_flush ( mdi, &batch );
   vik_map_source_download_handle_cleanup(MAPS_LAYER_NTH_TYPE(mdi->maptype), handle);
+  return 0;
+}
+
+typedef struct {
+  gint x, y;
+  gint dist; /* squared distance (in tiles) from the centre of the requested area */
+} DownloadTile;
+
+static gint download_tile_compare ( gconstpointer a, gconstpointer b )
+{
+  return ((const DownloadTile *)a)->dist - ((const DownloadTile *)b)->dist;
+}
+
+/* A tile being transferred by map_download_thread_parallel() */
+typedef struct {
+  MapDownloadInfo *mdi;
+  DownloadBatch *batch;
+  gint x, y;
+} DownloadTileTransfer;
+
+static void download_tile_done ( const gchar *filename, int result, DownloadTileTransfer *dtt )
+{
+  /* Any tile downloaded needs showing */
+  if ( result == 0 ) {
+    download_batch_add ( dtt->batch, dtt->x, dtt->y );
+    if ( download_batch_due ( dtt->batch ) )
+      download_batch_flush ( dtt->mdi, dtt->batch );
+  }
+  download_tile_release ( filename );
+  g_free ( dtt );
+}
+
+/**
+ * Download the tiles nearest the centre first, over several connections at once
+ */
+static int map_download_thread_parallel ( MapDownloadInfo *mdi, gpointer threaddata )
+{
+  VikMapSourceDefault *map = VIK_MAP_SOURCE_DEFAULT(MAPS_LAYER_NTH_TYPE(mdi->maptype));
+  DownloadMapOptions *options = vik_map_source_default_get_download_options ( map );
+  gchar *hostname = vik_map_source_default_get_hostname ( map );
+  guint connections = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "maps_download_connections")->u;
+  DownloadMulti *dm = a_download_multi_new ( connections );
+  GArray *tiles = g_array_sized_new ( FALSE, FALSE, sizeof(DownloadTile), (mdi->xf - mdi->x0 + 1) * (mdi->yf - mdi->y0 + 1) );
+  gint xc = (mdi->x0 + mdi->xf) / 2, yc = (mdi->y0 + mdi->yf) / 2;
+  guint donemaps = 0, next = 0;
+  gint x, y;
+  int ret = 0;
+  DownloadBatch batch;
+  batch.count = 0;
+
+  for ( x = mdi->x0; x <= mdi->xf; x++ )
+    for ( y = mdi->y0; y <= mdi->yf; y++ ) {
+      DownloadTile tile = { x, y, (x-xc)*(x-xc) + (y-yc)*(y-yc) };
+      g_array_append_val ( tiles, tile );
+    }
+  g_array_sort ( tiles, download_tile_compare );
+
+  /* No single tile is being downloaded, so cancelling must not remove any
+     (partial files are removed by the transfers themselves) */
+  mdi->mapcoord.x = mdi->mapcoord.y = 0;
+
+  do {
+    /* Keep all the connections busy */
+    while ( next < tiles->len && a_download_multi_has_free_slot ( dm ) ) {
+      DownloadTile *tile = &g_array_index ( tiles, DownloadTile, next++ );
+      gboolean remove_mem_cache = FALSE;
+      gboolean need_download = FALSE;
+
+      donemaps++;
+      if ( a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ) != 0 ) { /* this also calls testcancel */
+        ret = -1;
+        goto finish;
+      }
+
+      if ( download_tile_offscreen ( mdi, tile->x, tile->y ) )
+        continue;
+
+      g_snprintf ( mdi->filename_buf, mdi->maxlen, DIRSTRUCTURE,
+                   mdi->cache_dir, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
+                   mdi->mapcoord.scale, mdi->mapcoord.z, tile->x, tile->y );
+
+      if ( ! download_tile_claim ( mdi->filename_buf ) )
+        continue;
+
+      if ( ! download_tile_check ( mdi, &need_download, &remove_mem_cache ) ) {
+        download_tile_release ( mdi->filename_buf );
+        continue;
+      }
+
+      if ( need_download ) {
+        MapCoord mapcoord = mdi->mapcoord;
+        DownloadTileTransfer *dtt = g_new0 ( DownloadTileTransfer, 1 );
+        gchar *uri;
+
+        mapcoord.x = tile->x;
+        mapcoord.y = tile->y;
+        uri = vik_map_source_default_get_uri ( map, &mapcoord );
+
+        dtt->mdi = mdi;
+        dtt->batch = &batch;
+        dtt->x = tile->x;
+        dtt->y = tile->y;
+        if ( a_download_multi_add ( dm, hostname, uri, mdi->filename_buf, options, FALSE, (DownloadMultiFunc) download_tile_done, dtt ) != 0 ) {
+          g_free ( dtt );
+          download_tile_release ( mdi->filename_buf );
+        }
+        g_free ( uri );
+      }
+      else {
+        if ( remove_mem_cache )
+          download_batch_add ( &batch, tile->x, tile->y );
+        download_tile_release ( mdi->filename_buf );
+      }
+    }
+
+    if ( a_background_testcancel ( threaddata ) != 0 ) {
+      ret = -1;
+      goto finish;
+    }
+    if ( download_batch_due ( &batch ) )
+      download_batch_flush ( mdi, &batch );
+  } while ( a_download_multi_wait ( dm, 100 ) > 0 || next < tiles->len );
+
+ finish:
+  /* Aborts any transfers still in progress */
+  a_download_multi_free ( dm );
+  download_batch_flush ( mdi, &batch );
+  g_array_free ( tiles, TRUE );
+  g_free ( hostname );
+  return ret;
+}
+
+static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
+{
+  int ret;
+
+  /* Parallel downloads need to know the URL of each tile,
+     and are only the same as the map source's own downloading for plain HTTP */
+  if ( VIK_IS_MAP_SOURCE_DEFAULT(MAPS_LAYER_NTH_TYPE(mdi->maptype)) &&
+       vik_map_source_default_is_plain_http ( VIK_MAP_SOURCE_DEFAULT(MAPS_LAYER_NTH_TYPE(mdi->maptype)) ) )
+    ret = map_download_thread_parallel ( mdi, threaddata );
+  else
+    ret = map_download_thread_serial ( mdi, threaddata );
+
+  if ( ret != 0 )
+    return ret;
+
   g_mutex_lock(mdi->mutex);
   if (mdi->map_layer_alive)
     g_object_weak_unref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
@@ -1093,11 +1738,12 @@ static void mdi_cancel_cleanup ( MapDownloadInfo *mdi )
     if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
     {
       g_remove ( mdi->filename_buf );
+      a_dircache_file_removed ( mdi->filename_buf );
     }
   }
 }
 
-static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload )
+static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload, gboolean onscreen_only )
 {
   gdouble xzoom = vml->xmapzoom ? vml->xmapzoom : vik_viewport_get_xmpp ( vvp );
   gdouble yzoom = vml->ymapzoom ? vml->ymapzoom : vik_viewport_get_ympp ( vvp );
@@ -1107,6 +1753,11 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
   // Don't ever attempt download on direct access
   if ( vik_map_source_is_direct_file_access ( map ) )
     return;
+#ifdef VIK_CONFIG_MBTILES
+  // Nor into a packed file, which is only read
+  if ( vml->mbtiles )
+    return;
+#endif
 
   if ( vik_map_source_coord_to_mapcoord ( map, ul, xzoom, yzoom, &ulm ) 
     && vik_map_source_coord_to_mapcoord ( map, br, xzoom, yzoom, &brm ) )
@@ -1129,6 +1780,7 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
     mdi->mapcoord = ulm;
 
     mdi->redownload = redownload;
+    mdi->onscreen_only = onscreen_only;
 
     mdi->x0 = MIN(ulm.x, brm.x);
     mdi->xf = MAX(ulm.x, brm.x);
@@ -1198,6 +1850,11 @@ void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord
   // Don't ever attempt download on direct access
   if ( vik_map_source_is_direct_file_access ( map ) )
     return;
+#ifdef VIK_CONFIG_MBTILES
+  // Nor into a packed file, which is only read
+  if ( vml->mbtiles )
+    return;
+#endif
 
   if (!vik_map_source_coord_to_mapcoord(map, ul, zoom, zoom, &ulm) 
     || !vik_map_source_coord_to_mapcoord(map, br, zoom, zoom, &brm)) {
@@ -1222,6 +1879,7 @@ void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord
   mdi->mapcoord = ulm;
 
   mdi->redownload = REDOWNLOAD_NONE;
+  mdi->onscreen_only = FALSE;
 
   mdi->x0 = MIN(ulm.x, brm.x);
   mdi->xf = MAX(ulm.x, brm.x);
@@ -1267,17 +1925,17 @@ void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord
 
 static void maps_layer_redownload_bad ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD, FALSE );
 }
 
 static void maps_layer_redownload_all ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_ALL );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_ALL, FALSE );
 }
 
 static void maps_layer_redownload_new ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_NEW );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_NEW, FALSE );
 }
 
 /**
@@ -1352,7 +2010,7 @@ static gboolean maps_layer_download_release ( VikMapsLayer *vml, GdkEventButton
       VikCoord ul, br;
       vik_viewport_screen_to_coord ( vvp, MAX(0, MIN(event->x, vml->dl_tool_x)), MAX(0, MIN(event->y, vml->dl_tool_y)), &ul );
       vik_viewport_screen_to_coord ( vvp, MIN(vik_viewport_get_width(vvp), MAX(event->x, vml->dl_tool_x)), MIN(vik_viewport_get_height(vvp), MAX ( event->y, vml->dl_tool_y ) ), &br );
-      start_download_thread ( vml, vvp, &ul, &br, DOWNLOAD_OR_REFRESH );
+      start_download_thread ( vml, vvp, &ul, &br, DOWNLOAD_OR_REFRESH, FALSE );
       vml->dl_tool_x = vml->dl_tool_y = -1;
       return TRUE;
     }
@@ -1459,7 +2117,7 @@ static void download_onscreen_maps ( gpointer vml_vvp[2], gint redownload )
   if ( vik_map_source_get_drawmode(map) == vp_drawmode &&
        vik_map_source_coord_to_mapcoord ( map, &ul, xzoom, yzoom, &ulm ) &&
        vik_map_source_coord_to_mapcoord ( map, &br, xzoom, yzoom, &brm ) )
-    start_download_thread ( vml, vvp, &ul, &br, redownload );
+    start_download_thread ( vml, vvp, &ul, &br, redownload, FALSE );
   else if (vik_map_source_get_drawmode(map) != vp_drawmode) {
     const gchar *drawmode_name = vik_viewport_get_drawmode_name (vvp, vik_map_source_get_drawmode(map));
     gchar *err = g_strdup_printf(_("Wrong drawmode for this map.\nSelect \"%s\" from View menu and try again."), _(drawmode_name));
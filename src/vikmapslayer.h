@@ -48,6 +48,8 @@ GType vik_maps_layer_get_type ();
 typedef struct _VikMapsLayer VikMapsLayer;
 
 void maps_layer_init ();
+void maps_layer_uninit ();
+void maps_layer_set_synchronous_decode ( gboolean synchronous );
 void maps_layer_register_map_source ( VikMapSource *map );
 void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom);
 gint vik_maps_layer_get_map_type(VikMapsLayer *vml);
@@ -473,3 +473,17 @@ vik_map_source_default_get_download_options( VikMapSourceDefault *self )
 
 	return (*klass->get_download_options)(self);
 }
+
+/**
+ * vik_map_source_default_is_plain_http:
+ *
+ * Returns: TRUE if tiles are downloaded simply by HTTP from the hostname and uri,
+ *  rather than by a download method of a subclass
+ */
+gboolean
+vik_map_source_default_is_plain_http( VikMapSourceDefault *self )
+{
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE_DEFAULT (self), FALSE);
+
+	return VIK_MAP_SOURCE_GET_CLASS(self)->download == _download;
+}
@@ -0,0 +1,299 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <glib.h>
+#include "vikspatialindex.h"
+
+/*
+ * Finds the items whose lat/lon bounds overlap an area, without looking
+ *  at every item.
+ *
+ * Items are kept in a hierarchy of grids, each with cells twice the size
+ *  of the one below. An item goes in the lowest grid whose cells are at
+ *  least as big as the item, in the cell holding its south west corner,
+ *  so it only spreads over that cell and the next ones north and east.
+ * A search then looks at a few cells in each grid, or at every occupied
+ *  cell of a grid when the area is bigger than that.
+ *
+ * Only occupied cells are kept, so adding, moving and removing an item
+ *  costs about the same whatever the number of items.
+ */
+
+/* Cell size of the lowest grid in degrees, about 27m of latitude */
+#define SI_MIN_CELL (1.0/4096.0)
+/* The cells of the top grid are 1024 degrees, so fit anything */
+#define SI_LEVELS 23
+
+typedef struct {
+  gint x, y;
+  GPtrArray *entries;
+} SpatialCell;
+
+typedef struct {
+  gpointer item;
+  LatLonBBox bbox;
+  guint level;
+  SpatialCell *cell;
+} SpatialEntry;
+
+struct _VikSpatialIndex {
+  GHashTable *grids[SI_LEVELS]; /* of SpatialCell, keyed on themselves */
+  GHashTable *entries;          /* item -> SpatialEntry */
+  LatLonBBox bounds;
+  gboolean bounds_valid;
+};
+
+typedef struct {
+  const LatLonBBox *bbox;
+  gint x1, y1, x2, y2;
+  VikSpatialIndexFunc func;
+  gpointer user_data;
+} SpatialQuery;
+
+/* Unlike BBOX_INTERSECT, touching counts, as a point has no area */
+#define SI_OVERLAP(a,b) ((a).south <= (b).north && (a).north >= (b).south && (a).west <= (b).east && (a).east >= (b).west)
+
+static guint cell_hash ( const SpatialCell *cell )
+{
+  return ((guint) cell->x * 73856093u) ^ ((guint) cell->y * 19349663u);
+}
+
+static gboolean cell_equal ( const SpatialCell *a, const SpatialCell *b )
+{
+  return a->x == b->x && a->y == b->y;
+}
+
+static void cell_free ( SpatialCell *cell )
+{
+  g_ptr_array_free ( cell->entries, TRUE );
+  g_slice_free ( SpatialCell, cell );
+}
+
+static void entry_free ( SpatialEntry *entry )
+{
+  g_slice_free ( SpatialEntry, entry );
+}
+
+static gdouble cell_size ( guint level )
+{
+  return ldexp ( SI_MIN_CELL, level );
+}
+
+static gint cell_coord ( gdouble degrees, gdouble size )
+{
+  // Keep searches of huge areas within gint
+  return (gint) floor ( CLAMP ( degrees, -1000.0, 1000.0 ) / size );
+}
+
+static guint bbox_level ( const LatLonBBox *bbox )
+{
+  gdouble extent = MAX ( bbox->north - bbox->south, bbox->east - bbox->west );
+  guint level = 0;
+  while ( level < SI_LEVELS - 1 && cell_size ( level ) < extent )
+    level++;
+  return level;
+}
+
+VikSpatialIndex *vik_spatial_index_new ()
+{
+  VikSpatialIndex *si = g_new0 ( VikSpatialIndex, 1 );
+  guint i;
+  for ( i = 0; i < SI_LEVELS; i++ )
+    si->grids[i] = g_hash_table_new_full ( (GHashFunc) cell_hash, (GEqualFunc) cell_equal, (GDestroyNotify) cell_free, NULL );
+  si->entries = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) entry_free );
+  return si;
+}
+
+void vik_spatial_index_free ( VikSpatialIndex *si )
+{
+  guint i;
+  for ( i = 0; i < SI_LEVELS; i++ )
+    g_hash_table_destroy ( si->grids[i] );
+  g_hash_table_destroy ( si->entries );
+  g_free ( si );
+}
+
+/**
+ * vik_spatial_index_insert:
+ * @item: Anything, only compared by pointer
+ *
+ * Adds the item, or moves it if it is already in the index.
+ */
+void vik_spatial_index_insert ( VikSpatialIndex *si, gpointer item, const LatLonBBox *bbox )
+{
+  SpatialEntry *entry;
+  SpatialCell key, *cell;
+  gdouble size;
+
+  vik_spatial_index_remove ( si, item );
+
+  entry = g_slice_new ( SpatialEntry );
+  entry->item = item;
+  entry->bbox = *bbox;
+  entry->level = bbox_level ( bbox );
+
+  size = cell_size ( entry->level );
+  key.x = cell_coord ( bbox->west, size );
+  key.y = cell_coord ( bbox->south, size );
+  cell = g_hash_table_lookup ( si->grids[entry->level], &key );
+  if ( ! cell ) {
+    cell = g_slice_new ( SpatialCell );
+    cell->x = key.x;
+    cell->y = key.y;
+    cell->entries = g_ptr_array_new ();
+    g_hash_table_insert ( si->grids[entry->level], cell, cell );
+  }
+  g_ptr_array_add ( cell->entries, entry );
+  entry->cell = cell;
+
+  if ( g_hash_table_size ( si->entries ) == 0 ) {
+    si->bounds = *bbox;
+    si->bounds_valid = TRUE;
+  }
+  else if ( si->bounds_valid ) {
+    si->bounds.south = MIN ( si->bounds.south, bbox->south );
+    si->bounds.north = MAX ( si->bounds.north, bbox->north );
+    si->bounds.west = MIN ( si->bounds.west, bbox->west );
+    si->bounds.east = MAX ( si->bounds.east, bbox->east );
+  }
+  g_hash_table_insert ( si->entries, item, entry );
+}
+
+void vik_spatial_index_remove ( VikSpatialIndex *si, gpointer item )
+{
+  SpatialEntry *entry = g_hash_table_lookup ( si->entries, item );
+  if ( ! entry )
+    return;
+
+  g_ptr_array_remove_fast ( entry->cell->entries, entry );
+  if ( entry->cell->entries->len == 0 )
+    g_hash_table_remove ( si->grids[entry->level], entry->cell );
+
+  // Only work out the bounds again when next wanted, if this was on the edge
+  if ( entry->bbox.south <= si->bounds.south || entry->bbox.north >= si->bounds.north ||
+       entry->bbox.west <= si->bounds.west || entry->bbox.east >= si->bounds.east )
+    si->bounds_valid = FALSE;
+
+  g_hash_table_remove ( si->entries, item );
+}
+
+void vik_spatial_index_remove_all ( VikSpatialIndex *si )
+{
+  guint i;
+  for ( i = 0; i < SI_LEVELS; i++ )
+    g_hash_table_remove_all ( si->grids[i] );
+  g_hash_table_remove_all ( si->entries );
+  si->bounds_valid = FALSE;
+}
+
+guint vik_spatial_index_size ( VikSpatialIndex *si )
+{
+  return g_hash_table_size ( si->entries );
+}
+
+static void query_cell ( SpatialCell *cell, SpatialQuery *query )
+{
+  guint i;
+  for ( i = 0; i < cell->entries->len; i++ ) {
+    SpatialEntry *entry = g_ptr_array_index ( cell->entries, i );
+    if ( SI_OVERLAP ( entry->bbox, *query->bbox ) )
+      query->func ( entry->item, query->user_data );
+  }
+}
+
+static void query_cell_in_range ( gpointer key, SpatialCell *cell, SpatialQuery *query )
+{
+  if ( cell->x >= query->x1 && cell->x <= query->x2 && cell->y >= query->y1 && cell->y <= query->y2 )
+    query_cell ( cell, query );
+}
+
+/**
+ * vik_spatial_index_query:
+ *
+ * Calls @func for each item overlapping @bbox, in no particular order.
+ * The index must not be changed by @func.
+ */
+void vik_spatial_index_query ( VikSpatialIndex *si, const LatLonBBox *bbox, VikSpatialIndexFunc func, gpointer user_data )
+{
+  SpatialQuery query;
+  guint level;
+
+  query.bbox = bbox;
+  query.func = func;
+  query.user_data = user_data;
+
+  for ( level = 0; level < SI_LEVELS; level++ ) {
+    GHashTable *grid = si->grids[level];
+    gdouble size = cell_size ( level );
+    guint occupied = g_hash_table_size ( grid );
+
+    if ( occupied == 0 )
+      continue;
+
+    // Items reach at most one cell north and east of their own
+    query.x1 = cell_coord ( bbox->west, size ) - 1;
+    query.y1 = cell_coord ( bbox->south, size ) - 1;
+    query.x2 = cell_coord ( bbox->east, size );
+    query.y2 = cell_coord ( bbox->north, size );
+
+    if ( (gdouble) (query.x2 - query.x1 + 1) * (query.y2 - query.y1 + 1) > occupied )
+      g_hash_table_foreach ( grid, (GHFunc) query_cell_in_range, &query );
+    else {
+      SpatialCell key, *cell;
+      for ( key.x = query.x1; key.x <= query.x2; key.x++ )
+        for ( key.y = query.y1; key.y <= query.y2; key.y++ )
+          if ( (cell = g_hash_table_lookup ( grid, &key )) )
+            query_cell ( cell, &query );
+    }
+  }
+}
+
+static void bounds_add_entry ( gpointer item, SpatialEntry *entry, VikSpatialIndex *si )
+{
+  if ( ! si->bounds_valid ) {
+    si->bounds = entry->bbox;
+    si->bounds_valid = TRUE;
+    return;
+  }
+  si->bounds.south = MIN ( si->bounds.south, entry->bbox.south );
+  si->bounds.north = MAX ( si->bounds.north, entry->bbox.north );
+  si->bounds.west = MIN ( si->bounds.west, entry->bbox.west );
+  si->bounds.east = MAX ( si->bounds.east, entry->bbox.east );
+}
+
+/**
+ * vik_spatial_index_get_bounds:
+ *
+ * Returns: FALSE when there are no items
+ */
+gboolean vik_spatial_index_get_bounds ( VikSpatialIndex *si, LatLonBBox *bbox )
+{
+  if ( g_hash_table_size ( si->entries ) == 0 )
+    return FALSE;
+
+  if ( ! si->bounds_valid )
+    g_hash_table_foreach ( si->entries, (GHFunc) bounds_add_entry, si );
+
+  *bbox = si->bounds;
+  return TRUE;
+}
@@ -0,0 +1,44 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef __VIKING_SPATIALINDEX_H
+#define __VIKING_SPATIALINDEX_H
+
+#include <glib.h>
+#include "bbox.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VikSpatialIndex VikSpatialIndex;
+
+typedef void (*VikSpatialIndexFunc) ( gpointer item, gpointer user_data );
+
+VikSpatialIndex *vik_spatial_index_new ();
+void vik_spatial_index_free ( VikSpatialIndex *si );
+
+void vik_spatial_index_insert ( VikSpatialIndex *si, gpointer item, const LatLonBBox *bbox );
+void vik_spatial_index_remove ( VikSpatialIndex *si, gpointer item );
+void vik_spatial_index_remove_all ( VikSpatialIndex *si );
+guint vik_spatial_index_size ( VikSpatialIndex *si );
+
+void vik_spatial_index_query ( VikSpatialIndex *si, const LatLonBBox *bbox, VikSpatialIndexFunc func, gpointer user_data );
+gboolean vik_spatial_index_get_bounds ( VikSpatialIndex *si, LatLonBBox *bbox );
+
+G_END_DECLS
+
+#endif
@@ -39,6 +39,337 @@
 #include "globals.h"
 #include "dems.h"
 
+/*
+ * Running totals along a track from its first point, so positions can be
+ *  found by binary search rather than walking the track measuring it.
+ */
+struct _VikTrackIndex {
+  guint n_points;
+  VikTrackpoint **tps;
+  gdouble *dist;      /* Including gaps */
+  time_t *times;
+  gboolean times_sorted;
+  gdouble *ascent;
+  gdouble *descent;
+};
+
+static VikTrackIndex *track_index_new ( GList *trackpoints )
+{
+  VikTrackIndex *idx = g_new0 ( VikTrackIndex, 1 );
+  GList *iter;
+  guint i;
+
+  idx->n_points = g_list_length ( trackpoints );
+  idx->tps = g_new ( VikTrackpoint *, idx->n_points );
+  idx->dist = g_new ( gdouble, idx->n_points );
+  idx->times = g_new ( time_t, idx->n_points );
+  idx->ascent = g_new ( gdouble, idx->n_points );
+  idx->descent = g_new ( gdouble, idx->n_points );
+  idx->times_sorted = TRUE;
+
+  for ( iter = trackpoints, i = 0; iter; iter = iter->next, i++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    idx->tps[i] = tp;
+    idx->times[i] = tp->timestamp;
+    if ( i == 0 ) {
+      idx->dist[i] = idx->ascent[i] = idx->descent[i] = 0.0;
+      continue;
+    }
+    gdouble inc = vik_coord_diff ( &(tp->coord), &(idx->tps[i-1]->coord) );
+    gdouble climb = tp->altitude - idx->tps[i-1]->altitude;
+    idx->dist[i] = idx->dist[i-1] + inc;
+    idx->ascent[i] = idx->ascent[i-1] + (climb > 0 ? climb : 0);
+    idx->descent[i] = idx->descent[i-1] - (climb < 0 ? climb : 0);
+    if ( idx->times[i] < idx->times[i-1] )
+      idx->times_sorted = FALSE;
+  }
+  return idx;
+}
+
+static void track_index_free ( VikTrackIndex *idx )
+{
+  g_free ( idx->tps );
+  g_free ( idx->dist );
+  g_free ( idx->times );
+  g_free ( idx->ascent );
+  g_free ( idx->descent );
+  g_free ( idx );
+}
+
+/* The index is only a cache, so may be built for a const track */
+static VikTrackIndex *track_get_index ( const VikTrack *tr )
+{
+  if ( ! tr->index )
+    ((VikTrack *) tr)->index = track_index_new ( tr->trackpoints );
+  return tr->index;
+}
+
+/* Error allowed for the most detailed simplified level, in metres; each level doubles it */
+#define SIMPLIFIED_MIN_ERROR 1.0
+#define SIMPLIFIED_LEVELS 16
+/* As used for UTM */
+#define SIMPLIFIED_EARTH_RADIUS 6378137.0
+
+/*
+ * Douglas-Peucker simplifications of a track at several levels of detail.
+ * Each point's significance is the largest error for which it is still
+ *  kept, so a level is made of the points more significant than its error.
+ */
+struct _VikTrackSimplified {
+  guint n_points;
+  VikTrackpoint **tps;
+  gfloat *significance;
+  GList *levels[SIMPLIFIED_LEVELS]; /* Made when first asked for */
+};
+
+typedef struct {
+  guint first;
+  guint last;
+  gfloat bound; /* A point can't be more significant than the one that split this range */
+} SimplifyRange;
+
+/* Distance from point (px,py) to the line segment (ax,ay)-(bx,by) */
+static gdouble segment_distance ( gdouble px, gdouble py, gdouble ax, gdouble ay, gdouble bx, gdouble by )
+{
+  gdouble dx = bx - ax, dy = by - ay;
+  gdouble len2 = dx * dx + dy * dy;
+  gdouble t = len2 > 0 ? ((px - ax) * dx + (py - ay) * dy) / len2 : 0;
+  if ( t < 0 ) t = 0;
+  else if ( t > 1 ) t = 1;
+  dx = ax + t * dx - px;
+  dy = ay + t * dy - py;
+  return sqrt ( dx * dx + dy * dy );
+}
+
+static VikTrackSimplified *track_simplified_new ( GList *trackpoints )
+{
+  VikTrackSimplified *ts = g_new0 ( VikTrackSimplified, 1 );
+  GArray *stack = g_array_new ( FALSE, FALSE, sizeof(SimplifyRange) );
+  SimplifyRange range;
+  struct LatLon ll;
+  gdouble *xs, *ys, lat_sum = 0.0, scale;
+  GList *iter;
+  guint i, start;
+
+  ts->n_points = g_list_length ( trackpoints );
+  ts->tps = g_new ( VikTrackpoint *, ts->n_points );
+  ts->significance = g_new ( gfloat, ts->n_points );
+  xs = g_new ( gdouble, ts->n_points );
+  ys = g_new ( gdouble, ts->n_points );
+
+  /* Planar metres, good enough for deciding what is visible */
+  for ( iter = trackpoints, i = 0; iter; iter = iter->next, i++ ) {
+    ts->tps[i] = VIK_TRACKPOINT(iter->data);
+    vik_coord_to_latlon ( &(ts->tps[i]->coord), &ll );
+    xs[i] = ll.lon;
+    ys[i] = ll.lat;
+    lat_sum += ll.lat;
+  }
+  scale = ts->n_points ? cos ( DEG2RAD(lat_sum / ts->n_points) ) : 1.0;
+  for ( i = 0; i < ts->n_points; i++ ) {
+    xs[i] = DEG2RAD(xs[i]) * SIMPLIFIED_EARTH_RADIUS * scale;
+    ys[i] = DEG2RAD(ys[i]) * SIMPLIFIED_EARTH_RADIUS;
+  }
+
+  /* Each segment is simplified on its own, always keeping its ends */
+  for ( start = 0, i = 1; i <= ts->n_points; i++ ) {
+    if ( i == ts->n_points || ts->tps[i]->newsegment ) {
+      ts->significance[start] = ts->significance[i-1] = G_MAXFLOAT;
+      range.first = start;
+      range.last = i - 1;
+      range.bound = G_MAXFLOAT;
+      g_array_append_val ( stack, range );
+      start = i;
+    }
+  }
+
+  /* The usual recursion, without recursing as tracks can be very long */
+  while ( stack->len ) {
+    SimplifyRange r = g_array_index ( stack, SimplifyRange, stack->len - 1 );
+    gdouble max_dist = -1.0;
+    guint max_i = r.first;
+
+    g_array_set_size ( stack, stack->len - 1 );
+    if ( r.last - r.first < 2 )
+      continue;
+
+    for ( i = r.first + 1; i < r.last; i++ ) {
+      gdouble d = segment_distance ( xs[i], ys[i], xs[r.first], ys[r.first], xs[r.last], ys[r.last] );
+      if ( d > max_dist ) {
+        max_dist = d;
+        max_i = i;
+      }
+    }
+    ts->significance[max_i] = MIN ( max_dist, r.bound );
+
+    range.bound = ts->significance[max_i];
+    range.first = r.first;
+    range.last = max_i;
+    g_array_append_val ( stack, range );
+    range.first = max_i;
+    range.last = r.last;
+    g_array_append_val ( stack, range );
+  }
+
+  g_array_free ( stack, TRUE );
+  g_free ( xs );
+  g_free ( ys );
+  return ts;
+}
+
+static void track_simplified_free ( VikTrackSimplified *ts )
+{
+  guint i;
+  for ( i = 0; i < SIMPLIFIED_LEVELS; i++ )
+    g_list_free ( ts->levels[i] );
+  g_free ( ts->tps );
+  g_free ( ts->significance );
+  g_free ( ts );
+}
+
+/**
+ * vik_track_get_simplified_trackpoints:
+ * @max_error: How far, in metres, the simplified track may stray from the
+ *  original; for drawing, the size of a pixel
+ *
+ * The returned list shares the trackpoints of the track but has its own
+ *  links, so only suits reading and is only valid until the track changes.
+ * As nodes are not those of the track, use the full list for editing.
+ *
+ * Returns: A list of the trackpoints needed to show the track to within
+ *  @max_error, or the track's own list when there is no such saving
+ */
+GList *vik_track_get_simplified_trackpoints ( const VikTrack *tr, gdouble max_error )
+{
+  VikTrackSimplified *ts;
+  gint level = 0;
+  guint i;
+
+  if ( max_error < SIMPLIFIED_MIN_ERROR || ! tr->trackpoints )
+    return tr->trackpoints;
+
+  /* The coarsest level within max_error */
+  while ( level < SIMPLIFIED_LEVELS - 1 && SIMPLIFIED_MIN_ERROR * (2 << level) <= max_error )
+    level++;
+
+  if ( ! tr->simplified )
+    ((VikTrack *) tr)->simplified = track_simplified_new ( tr->trackpoints );
+  ts = tr->simplified;
+
+  if ( ! ts->levels[level] ) {
+    gfloat error = SIMPLIFIED_MIN_ERROR * (1 << level);
+    GList *tps = NULL;
+    i = ts->n_points;
+    while ( i-- )
+      if ( ts->significance[i] > error )
+        tps = g_list_prepend ( tps, ts->tps[i] );
+    ts->levels[level] = tps;
+  }
+  return ts->levels[level];
+}
+
+/*
+ * Totals for a whole track, filled in one pass when first asked for
+ *  and kept until the track changes.
+ */
+struct _VikTrackStats {
+  guint generation;
+  gulong n_points;
+  guint n_segments;
+  gdouble length;
+  gdouble length_including_gaps;
+  gboolean has_alt;
+  gdouble min_alt;
+  gdouble max_alt;
+  struct LatLon maxmin[2];
+  /* Filled separately, as it depends on the stop length asked for */
+  gboolean has_moving_speed;
+  int moving_stop_length;
+  gdouble moving_speed;
+};
+
+static void track_stats_fill ( VikTrackStats *st, const VikTrack *tr )
+{
+  VikTrackIter iter;
+  const VikCoord *prev = NULL;
+  struct LatLon ll;
+
+  memset ( st, 0, sizeof(VikTrackStats) );
+  st->generation = tr->generation;
+  st->min_alt = 25000;
+  st->max_alt = -5000;
+
+  for ( vik_track_iter_init ( &iter, tr ); vik_track_iter_valid ( &iter ); vik_track_iter_next ( &iter ) ) {
+    const VikCoord *coord = vik_track_iter_coord ( &iter );
+    st->n_points++;
+
+    vik_coord_to_latlon ( coord, &ll );
+    if ( ! prev ) {
+      st->maxmin[0] = st->maxmin[1] = ll;
+      st->n_segments = 1;
+      /* As ever, assume a track with an altitude at the start has them throughout */
+      st->has_alt = vik_track_iter_altitude ( &iter ) != VIK_DEFAULT_ALTITUDE;
+    }
+    else {
+      gdouble inc = vik_coord_diff ( coord, prev );
+      st->length_including_gaps += inc;
+      if ( vik_track_iter_newsegment ( &iter ) )
+        st->n_segments++;
+      else
+        st->length += inc;
+
+      /* The first point has never counted towards the altitude range */
+      if ( st->has_alt ) {
+        gdouble alt = vik_track_iter_altitude ( &iter );
+        if ( alt > st->max_alt )
+          st->max_alt = alt;
+        if ( alt < st->min_alt )
+          st->min_alt = alt;
+      }
+
+      if ( ll.lat > st->maxmin[0].lat ) st->maxmin[0].lat = ll.lat;
+      if ( ll.lat < st->maxmin[1].lat ) st->maxmin[1].lat = ll.lat;
+      if ( ll.lon > st->maxmin[0].lon ) st->maxmin[0].lon = ll.lon;
+      if ( ll.lon < st->maxmin[1].lon ) st->maxmin[1].lon = ll.lon;
+    }
+    prev = coord;
+  }
+}
+
+/* As with the index, stats are only a cache so may be filled for a const track */
+static VikTrackStats *track_get_stats ( const VikTrack *tr )
+{
+  VikTrack *t = (VikTrack *) tr;
+  if ( ! t->stats )
+    t->stats = g_new ( VikTrackStats, 1 );
+  else if ( t->stats->generation == tr->generation )
+    return t->stats;
+  track_stats_fill ( t->stats, tr );
+  return t->stats;
+}
+
+/**
+ * vik_track_changed:
+ *
+ * To be called after changing the trackpoints of a track, whether
+ *  the list itself or the values of any point.
+ *
+ * Anything kept about a track elsewhere can compare the track's
+ *  generation with the one it was made for, to know it is out of date.
+ */
+void vik_track_changed ( VikTrack *tr )
+{
+  tr->generation++;
+  if ( tr->index ) {
+    track_index_free ( tr->index );
+    tr->index = NULL;
+  }
+  if ( tr->simplified ) {
+    track_simplified_free ( tr->simplified );
+    tr->simplified = NULL;
+  }
+}
+
 VikTrack *vik_track_new()
 {
   VikTrack *tr = g_malloc0 ( sizeof ( VikTrack ) );
@@ -116,6 +447,8 @@ void vik_track_free(VikTrack *tr)
     g_free ( tr->description );
   g_list_foreach ( tr->trackpoints, (GFunc) g_free, NULL );
   g_list_free( tr->trackpoints );
+  vik_track_changed ( tr );
+  g_free ( tr->stats );
   if (tr->property_dialog)
     if ( GTK_IS_WIDGET(tr->property_dialog) )
       gtk_widget_destroy ( GTK_WIDGET(tr->property_dialog) );
@@ -182,49 +515,36 @@ VikTrackpoint *vik_trackpoint_copy(VikTrackpoint *tp)
   return rv;
 }
 
-gdouble vik_track_get_length(const VikTrack *tr)
+static gdouble iter_get_length ( VikTrackIter iter, gboolean include_gaps )
 {
   gdouble len = 0.0;
-  if ( tr->trackpoints )
+  const VikCoord *prev;
+  if ( vik_track_iter_valid ( &iter ) )
   {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
+    prev = vik_track_iter_coord ( &iter );
+    for ( vik_track_iter_next ( &iter ); vik_track_iter_valid ( &iter ); vik_track_iter_next ( &iter ) )
     {
-      if ( ! VIK_TRACKPOINT(iter->data)->newsegment )
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      iter = iter->next;
+      if ( include_gaps || ! vik_track_iter_newsegment ( &iter ) )
+        len += vik_coord_diff ( vik_track_iter_coord ( &iter ), prev );
+      prev = vik_track_iter_coord ( &iter );
     }
   }
   return len;
 }
 
+gdouble vik_track_get_length(const VikTrack *tr)
+{
+  return track_get_stats ( tr )->length;
+}
+
 gdouble vik_track_get_length_including_gaps(const VikTrack *tr)
 {
-  gdouble len = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                              &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      iter = iter->next;
-    }
-  }
-  return len;
+  return track_get_stats ( tr )->length_including_gaps;
 }
 
 gulong vik_track_get_tp_count(const VikTrack *tr)
 {
-  gulong num = 0;
-  GList *iter = tr->trackpoints;
-  while ( iter )
-  {
-    num++;
-    iter = iter->next;
-  }
-  return num;
+  return track_get_stats ( tr )->n_points;
 }
 
 gulong vik_track_get_dup_point_count ( const VikTrack *tr )
@@ -265,6 +585,8 @@ gulong vik_track_remove_dup_points ( VikTrack *tr )
     else
       iter = iter->next;
   }
+  if ( num )
+    vik_track_changed ( tr );
   return num;
 }
 
@@ -315,6 +637,8 @@ gulong vik_track_remove_same_time_points ( VikTrack *tr )
     else
       iter = iter->next;
   }
+  if ( num )
+    vik_track_changed ( tr );
   return num;
 }
 
@@ -341,20 +665,12 @@ void vik_track_to_routepoints ( VikTrack *tr )
 
     iter = iter->next;
   }
+  vik_track_changed ( tr );
 }
 
 guint vik_track_get_segment_count(const VikTrack *tr)
 {
-  guint num = 1;
-  GList *iter = tr->trackpoints;
-  if ( !iter )
-    return 0;
-  while ( (iter = iter->next) )
-  {
-    if ( VIK_TRACKPOINT(iter->data)->newsegment )
-      num++;
-  }
-  return num;
+  return track_get_stats ( tr )->n_segments;
 }
 
 VikTrack **vik_track_split_into_segments(VikTrack *t, guint *ret_len)
@@ -413,6 +729,8 @@ guint vik_track_merge_segments(VikTrack *tr)
       num++;
     }
   }
+  if ( num )
+    vik_track_changed ( tr );
   return num;
 }
 
@@ -436,6 +754,7 @@ void vik_track_reverse ( VikTrack *tr )
     }
     iter = iter->prev;
   }
+  vik_track_changed ( tr );
 }
 
 gdouble vik_track_get_average_speed(const VikTrack *tr)
@@ -475,6 +794,11 @@ gdouble vik_track_get_average_speed_moving (const VikTrack *tr, int stop_length_
 {
   gdouble len = 0.0;
   guint32 time = 0;
+  VikTrackStats *st = track_get_stats ( tr );
+
+  if ( st->has_moving_speed && st->moving_stop_length == stop_length_seconds )
+    return st->moving_speed;
+
   if ( tr->trackpoints )
   {
     GList *iter = tr->trackpoints->next;
@@ -494,7 +818,10 @@ gdouble vik_track_get_average_speed_moving (const VikTrack *tr, int stop_length_
       iter = iter->next;
     }
   }
-  return (time == 0) ? 0 : ABS(len/time);
+  st->moving_speed = (time == 0) ? 0 : ABS(len/time);
+  st->moving_stop_length = stop_length_seconds;
+  st->has_moving_speed = TRUE;
+  return st->moving_speed;
 }
 
 gdouble vik_track_get_max_speed(const VikTrack *tr)
@@ -528,11 +855,13 @@ void vik_track_convert ( VikTrack *tr, VikCoordMode dest_mode )
     vik_coord_convert ( &(VIK_TRACKPOINT(iter->data)->coord), dest_mode );
     iter = iter->next;
   }
+  vik_track_changed ( tr );
 }
 
 /* I understood this when I wrote it ... maybe ... Basically it eats up the
  * proper amounts of length on the track and averages elevation over that. */
-gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
+/* @dist is the distance of each point from the first, including gaps */
+static gdouble *elevation_map_make ( guint n, const gdouble *dist, const gdouble *alts, const guint8 *flags, guint16 num_chunks )
 {
   gdouble *pts;
   gdouble total_length, chunk_length, current_dist, current_area_under_curve, current_seg_length, dist_along_seg = 0.0;
@@ -540,36 +869,34 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
   guint16 current_chunk;
   gboolean ignore_it = FALSE;
 
-  GList *iter = tr->trackpoints;
+  /* i is the start of the current segment, j its end */
+  guint i = 0, j = 1;
 
-  if (!iter || !iter->next) /* zero- or one-point track */
-	  return NULL;
+  if ( n < 2 ) /* zero- or one-point track */
+    return NULL;
 
   { /* test if there's anything worth calculating */
     gboolean okay = FALSE;
-    while ( iter )
+    guint k;
+    for ( k = 0; k < n; k++ )
     {
       // Sometimes a GPS device (or indeed any random file) can have stupid numbers for elevations
       // Since when is 9.9999e+24 a valid elevation!!
       // This can happen when a track (with no elevations) is uploaded to a GPS device and then redownloaded (e.g. using a Garmin Legend EtrexHCx)
       // Some protection against trying to work with crazily massive numbers (otherwise get SIGFPE, Arithmetic exception)
-      if ( VIK_TRACKPOINT(iter->data)->altitude != VIK_DEFAULT_ALTITUDE &&
-	   VIK_TRACKPOINT(iter->data)->altitude < 1E9 ) {
+      if ( alts[k] != VIK_DEFAULT_ALTITUDE && alts[k] < 1E9 ) {
         okay = TRUE; break;
       }
-      iter = iter->next;
     }
     if ( ! okay )
       return NULL;
   }
 
-  iter = tr->trackpoints;
-
   g_assert ( num_chunks < 16000 );
 
   pts = g_malloc ( sizeof(gdouble) * num_chunks );
 
-  total_length = vik_track_get_length_including_gaps ( tr );
+  total_length = dist[n-1];
   chunk_length = total_length / num_chunks;
 
   /* Zero chunk_length (eg, track of 2 tp with the same loc) will cause crash */
@@ -583,10 +910,9 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
   current_chunk = 0;
   current_seg_length = 0;
 
-  current_seg_length = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-      &(VIK_TRACKPOINT(iter->next->data)->coord) );
-  altitude1 = VIK_TRACKPOINT(iter->data)->altitude;
-  altitude2 = VIK_TRACKPOINT(iter->next->data)->altitude;
+  current_seg_length = dist[j] - dist[i];
+  altitude1 = alts[i];
+  altitude2 = alts[j];
   dist_along_seg = 0;
 
   while ( current_chunk < num_chunks ) {
@@ -620,18 +946,17 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
       } else { current_dist = current_area_under_curve = 0; } /* should only happen if first current_seg_length == 0 */
 
       /* get intervening segs */
-      iter = iter->next;
-      while ( iter && iter->next ) {
-        current_seg_length = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-            &(VIK_TRACKPOINT(iter->next->data)->coord) );
-        altitude1 = VIK_TRACKPOINT(iter->data)->altitude;
-        altitude2 = VIK_TRACKPOINT(iter->next->data)->altitude;
-        ignore_it = VIK_TRACKPOINT(iter->next->data)->newsegment;
+      i = j++;
+      while ( j < n ) {
+        current_seg_length = dist[j] - dist[i];
+        altitude1 = alts[i];
+        altitude2 = alts[j];
+        ignore_it = (flags[j] & VIK_TRACK_COLUMNS_NEWSEGMENT) != 0;
 
         if ( chunk_length - current_dist >= current_seg_length ) {
           current_dist += current_seg_length;
           current_area_under_curve += current_seg_length * (altitude1+altitude2) * 0.5;
-          iter = iter->next;
+          i = j++;
         } else {
           break;
         }
@@ -639,12 +964,12 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
 
       /* final seg */
       dist_along_seg = chunk_length - current_dist;
-      if ( ignore_it || ( iter && !iter->next ) ) {
+      if ( ignore_it || j >= n ) {
         pts[current_chunk] = current_area_under_curve / current_dist;
-        if (!iter->next) {
-          int i;
-          for (i = current_chunk + 1; i < num_chunks; i++)
-            pts[i] = pts[current_chunk];
+        if ( j >= n ) {
+          int c;
+          for (c = current_chunk + 1; c < num_chunks; c++)
+            pts[c] = pts[current_chunk];
           break;
         }
       } 
@@ -661,12 +986,39 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
   return pts;
 }
 
+gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
+{
+  VikTrackIndex *idx = track_get_index ( tr );
+  gdouble *pts, *alts;
+  guint8 *flags;
+  guint i;
+
+  if ( idx->n_points < 2 ) /* zero- or one-point track */
+    return NULL;
+
+  alts = g_malloc ( sizeof(gdouble) * idx->n_points );
+  flags = g_malloc ( idx->n_points );
+  for ( i = 0; i < idx->n_points; i++ ) {
+    alts[i] = idx->tps[i]->altitude;
+    flags[i] = idx->tps[i]->newsegment ? VIK_TRACK_COLUMNS_NEWSEGMENT : 0;
+  }
+  pts = elevation_map_make ( idx->n_points, idx->dist, alts, flags, num_chunks );
+  g_free ( alts );
+  g_free ( flags );
+  return pts;
+}
+
 
 void vik_track_get_total_elevation_gain(const VikTrack *tr, gdouble *up, gdouble *down)
 {
   gdouble diff;
   *up = *down = 0;
-  if ( tr->trackpoints && VIK_TRACKPOINT(tr->trackpoints->data)->altitude != VIK_DEFAULT_ALTITUDE )
+  if ( tr->index && tr->index->n_points && tr->index->tps[0]->altitude != VIK_DEFAULT_ALTITUDE )
+  {
+    *up = tr->index->ascent[tr->index->n_points-1];
+    *down = tr->index->descent[tr->index->n_points-1];
+  }
+  else if ( tr->trackpoints && VIK_TRACKPOINT(tr->trackpoints->data)->altitude != VIK_DEFAULT_ALTITUDE )
   {
     GList *iter = tr->trackpoints->next;
     while (iter)
@@ -723,19 +1075,21 @@ gdouble *vik_track_make_gradient_map ( const VikTrack *tr, guint16 num_chunks )
 /* by Alex Foobarian */
 gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *v, *s, *t;
+  gdouble *v, *s;
+  time_t *t;
   gdouble duration, chunk_dur;
   time_t t1, t2;
-  int i, pt_count, numpts, index;
-  GList *iter;
+  int i, index;
+  VikTrackIndex *idx;
 
   if ( ! tr->trackpoints )
     return NULL;
 
   g_assert ( num_chunks < 16000 );
 
-  t1 = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  t2 = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
+  idx = track_get_index ( tr );
+  t1 = idx->times[0];
+  t2 = idx->times[idx->n_points-1];
   duration = t2 - t1;
 
   if ( !t1 || !t2 || !duration )
@@ -745,25 +1099,12 @@ gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
     g_warning("negative duration: unsorted trackpoint timestamps?");
     return NULL;
   }
-  pt_count = vik_track_get_tp_count(tr);
 
   v = g_malloc ( sizeof(gdouble) * num_chunks );
   chunk_dur = duration / num_chunks;
 
-  s = g_malloc(sizeof(double) * pt_count);
-  t = g_malloc(sizeof(double) * pt_count);
-
-  iter = tr->trackpoints->next;
-  numpts = 0;
-  s[0] = 0;
-  t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  numpts++;
-  while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
-    t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
-    numpts++;
-    iter = iter->next;
-  }
+  s = idx->dist;
+  t = idx->times;
 
   /* In the following computation, we iterate through periods of time of duration chunk_dur.
    * The first period begins at the beginning of the track.  The last period ends at the end of the track.
@@ -789,8 +1130,6 @@ gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
       v[i] = 0;
     }
   }
-  g_free(s);
-  g_free(t);
   return v;
 }
 
@@ -799,17 +1138,19 @@ gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
  */
 gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *v, *s, *t;
+  gdouble *v, *s;
+  time_t *t;
   gdouble duration, chunk_dur;
   time_t t1, t2;
-  int i, pt_count, numpts, index;
-  GList *iter;
+  int i, index;
+  VikTrackIndex *idx;
 
   if ( ! tr->trackpoints )
     return NULL;
 
-  t1 = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  t2 = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
+  idx = track_get_index ( tr );
+  t1 = idx->times[0];
+  t2 = idx->times[idx->n_points-1];
   duration = t2 - t1;
 
   if ( !t1 || !t2 || !duration )
@@ -819,25 +1160,12 @@ gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
     g_warning("negative duration: unsorted trackpoint timestamps?");
     return NULL;
   }
-  pt_count = vik_track_get_tp_count(tr);
 
   v = g_malloc ( sizeof(gdouble) * num_chunks );
   chunk_dur = duration / num_chunks;
 
-  s = g_malloc(sizeof(double) * pt_count);
-  t = g_malloc(sizeof(double) * pt_count);
-
-  iter = tr->trackpoints->next;
-  numpts = 0;
-  s[0] = 0;
-  t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  numpts++;
-  while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
-    t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
-    numpts++;
-    iter = iter->next;
-  }
+  s = idx->dist;
+  t = idx->times;
 
   /* In the following computation, we iterate through periods of time of duration chunk_dur.
    * The first period begins at the beginning of the track.  The last period ends at the end of the track.
@@ -863,8 +1191,6 @@ gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
       v[i] = 0;
     }
   }
-  g_free(s);
-  g_free(t);
   return v;
 }
 
@@ -895,8 +1221,9 @@ gdouble *vik_track_make_elevation_time_map ( const VikTrack *tr, guint16 num_chu
   if ( ! okay )
     return NULL;
 
-  t1 = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  t2 = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
+  VikTrackIndex *idx = track_get_index ( tr );
+  t1 = idx->times[0];
+  t2 = idx->times[idx->n_points-1];
   duration = t2 - t1;
 
   if ( !t1 || !t2 || !duration )
@@ -906,27 +1233,16 @@ gdouble *vik_track_make_elevation_time_map ( const VikTrack *tr, guint16 num_chu
     g_warning("negative duration: unsorted trackpoint timestamps?");
     return NULL;
   }
-  gint pt_count = vik_track_get_tp_count(tr);
-
-  // Reset iterator back to the beginning
-  iter = tr->trackpoints;
 
   gdouble *pts = g_malloc ( sizeof(gdouble) * num_chunks ); // The return altitude values
-  gdouble *s = g_malloc(sizeof(double) * pt_count); // calculation altitudes
-  gdouble *t = g_malloc(sizeof(double) * pt_count); // calculation times
+  gdouble *s = g_malloc(sizeof(double) * idx->n_points); // calculation altitudes
+  time_t *t = idx->times; // calculation times
 
   chunk_dur = duration / num_chunks;
 
-  s[0] = VIK_TRACKPOINT(iter->data)->altitude;
-  t[0] = VIK_TRACKPOINT(iter->data)->timestamp;
-  iter = tr->trackpoints->next;
-  gint numpts = 1;
-  while (iter) {
-    s[numpts] = VIK_TRACKPOINT(iter->data)->altitude;
-    t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
-    numpts++;
-    iter = iter->next;
-  }
+  guint numpts;
+  for ( numpts = 0; numpts < idx->n_points; numpts++ )
+    s[numpts] = idx->tps[numpts]->altitude;
 
  /* In the following computation, we iterate through periods of time of duration chunk_dur.
    * The first period begins at the beginning of the track.  The last period ends at the end of the track.
@@ -953,7 +1269,6 @@ gdouble *vik_track_make_elevation_time_map ( const VikTrack *tr, guint16 num_chu
     }
   }
   g_free(s);
-  g_free(t);
 
   return pts;
 }
@@ -963,17 +1278,19 @@ gdouble *vik_track_make_elevation_time_map ( const VikTrack *tr, guint16 num_chu
  */
 gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *v, *s, *t;
+  gdouble *v, *s;
+  time_t *t;
   time_t t1, t2;
-  gint i, pt_count, numpts, index;
-  GList *iter;
+  gint i, index;
   gdouble duration, total_length, chunk_length;
+  VikTrackIndex *idx;
 
   if ( ! tr->trackpoints )
     return NULL;
 
-  t1 = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  t2 = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
+  idx = track_get_index ( tr );
+  t1 = idx->times[0];
+  t2 = idx->times[idx->n_points-1];
   duration = t2 - t1;
 
   if ( !t1 || !t2 || !duration )
@@ -984,30 +1301,18 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
     return NULL;
   }
 
-  total_length = vik_track_get_length_including_gaps ( tr );
+  total_length = idx->dist[idx->n_points-1];
   chunk_length = total_length / num_chunks;
-  pt_count = vik_track_get_tp_count(tr);
 
   if (chunk_length <= 0) {
     return NULL;
   }
 
   v = g_malloc ( sizeof(gdouble) * num_chunks );
-  s = g_malloc ( sizeof(double) * pt_count );
-  t = g_malloc ( sizeof(double) * pt_count );
 
   // No special handling of segments ATM...
-  iter = tr->trackpoints->next;
-  numpts = 0;
-  s[0] = 0;
-  t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  numpts++;
-  while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
-    t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
-    numpts++;
-    iter = iter->next;
-  }
+  s = idx->dist;
+  t = idx->times;
 
   // Iterate through a portion of the track to get an average speed for that part
   // This will essentially interpolate between segments, which I think is right given the usage of 'get_length_including_gaps'
@@ -1030,95 +1335,152 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
       v[i] = 0;
     }
   }
-  g_free(s);
-  g_free(t);
   return v;
 }
 
+/* First point at least @dist along the track from @first, or n_points if none */
+static guint index_search_dist ( const VikTrackIndex *idx, guint first, gdouble dist )
+{
+  guint lo = first, hi = idx->n_points;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( idx->dist[mid] >= dist )
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+/* First point with a timestamp of at least @t, or n_points if none */
+static guint index_search_time ( const VikTrackIndex *idx, time_t t )
+{
+  guint lo = 0, hi = idx->n_points;
+  if ( ! idx->times_sorted ) {
+    while ( lo < hi && idx->times[lo] < t )
+      lo++;
+    return lo;
+  }
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( idx->times[mid] >= t )
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
 /* by Alex Foobarian */
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_dist ( VikTrack *tr, gdouble reldist, gdouble *meters_from_start )
 {
-  gdouble dist = vik_track_get_length_including_gaps(tr) * reldist;
-  gdouble current_dist = 0.0;
-  gdouble current_inc = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    GList *last_iter = NULL;
-    gdouble last_dist = 0.0;
-    while (iter)
-    {
-      current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      last_dist = current_dist;
-      current_dist += current_inc;
-      if ( current_dist >= dist )
-        break;
-      last_iter = iter;
-      iter = iter->next;
-    }
-    if (!iter) { /* passing the end the track */
-      if (last_iter) {
-        if (meters_from_start)
-          *meters_from_start = last_dist;
-        return(VIK_TRACKPOINT(last_iter->data));
-      }
-      else
-        return NULL;
-    }
-    /* we've gone past the dist already, was prev trackpoint closer? */
-    /* should do a vik_coord_average_weighted() thingy. */
-    if ( iter->prev && abs(current_dist-current_inc-dist) < abs(current_dist-dist) ) {
-      if (meters_from_start)
-        *meters_from_start = last_dist;
-      iter = iter->prev;
-    }
-    else
-      if (meters_from_start)
-        *meters_from_start = current_dist;
+  VikTrackIndex *idx;
+  gdouble dist;
+  guint i;
 
-    return VIK_TRACKPOINT(iter->data);
+  if ( ! tr->trackpoints || ! tr->trackpoints->next )
+    return NULL;
 
-  }
-  return NULL;
+  idx = track_get_index ( tr );
+  dist = idx->dist[idx->n_points-1] * reldist;
+  i = index_search_dist ( idx, 1, dist );
+
+  if ( i == idx->n_points ) /* passing the end the track */
+    i = idx->n_points - 1;
+  /* we've gone past the dist already, was prev trackpoint closer? */
+  /* should do a vik_coord_average_weighted() thingy. */
+  else if ( fabs(idx->dist[i-1]-dist) < fabs(idx->dist[i]-dist) )
+    i--;
+
+  if (meters_from_start)
+    *meters_from_start = idx->dist[i];
+  return idx->tps[i];
 }
 
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_time ( VikTrack *tr, gdouble reltime, time_t *seconds_from_start )
 {
+  VikTrackIndex *idx;
   time_t t_pos, t_start, t_end, t_total;
-  t_start = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  t_end = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
-  t_total = t_end - t_start;
-
-  t_pos = t_start + t_total * reltime;
+  guint i;
 
   if ( !tr->trackpoints )
     return NULL;
 
-  GList *iter = tr->trackpoints;
+  idx = track_get_index ( tr );
+  t_start = idx->times[0];
+  t_end = idx->times[idx->n_points-1];
+  t_total = t_end - t_start;
 
-  while (iter) {
-    if (VIK_TRACKPOINT(iter->data)->timestamp == t_pos)
-      break;
-    if (VIK_TRACKPOINT(iter->data)->timestamp > t_pos) {
-      if (iter->prev == NULL)  /* first trackpoint */
-        break;
-      time_t t_before = t_pos - VIK_TRACKPOINT(iter->prev)->timestamp;
-      time_t t_after = VIK_TRACKPOINT(iter->data)->timestamp - t_pos;
-      if (t_before <= t_after)
-        iter = iter->prev;
-      break;
-    }
-    else if ((iter->next == NULL) && (t_pos < (VIK_TRACKPOINT(iter->data)->timestamp + 3))) /* last trackpoint: accommodate for round-off */
-      break;
-    iter = iter->next;
+  t_pos = t_start + t_total * reltime;
+
+  i = index_search_time ( idx, t_pos );
+  if ( i == idx->n_points ) {
+    /* last trackpoint: accommodate for round-off */
+    if ( t_pos < t_end + 3 )
+      i = idx->n_points - 1;
+    else
+      return NULL;
+  }
+  else if ( idx->times[i] > t_pos && i > 0 ) {
+    time_t t_before = t_pos - idx->times[i-1];
+    time_t t_after = idx->times[i] - t_pos;
+    if (t_before <= t_after)
+      i--;
   }
 
-  if (!iter)
-    return NULL;
   if (seconds_from_start)
-    *seconds_from_start = VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  return VIK_TRACKPOINT(iter->data);
+    *seconds_from_start = idx->times[i] - t_start;
+  return idx->tps[i];
+}
+
+/**
+ * vik_track_get_tp_index_by_dist:
+ *
+ * Returns: The index of the first trackpoint at least @meters_from_start
+ *  along the track (including gaps), the last one if the track is shorter,
+ *  or -1 for an empty track
+ */
+gint vik_track_get_tp_index_by_dist ( const VikTrack *tr, gdouble meters_from_start )
+{
+  VikTrackIndex *idx;
+  guint i;
+
+  if ( ! tr->trackpoints )
+    return -1;
+
+  idx = track_get_index ( tr );
+  i = index_search_dist ( idx, 0, meters_from_start );
+  return MIN ( i, idx->n_points - 1 );
+}
+
+/**
+ * vik_track_get_tp_index_by_time:
+ *
+ * Returns: The index of the first trackpoint with a timestamp at or
+ *  after @timestamp, or -1 if there is none
+ */
+gint vik_track_get_tp_index_by_time ( const VikTrack *tr, time_t timestamp )
+{
+  VikTrackIndex *idx;
+  guint i;
+
+  if ( ! tr->trackpoints )
+    return -1;
+
+  idx = track_get_index ( tr );
+  i = index_search_time ( idx, timestamp );
+  return i < idx->n_points ? (gint) i : -1;
+}
+
+VikTrackpoint *vik_track_get_tp_by_index ( const VikTrack *tr, guint index )
+{
+  VikTrackIndex *idx;
+
+  if ( ! tr->trackpoints )
+    return NULL;
+
+  idx = track_get_index ( tr );
+  return index < idx->n_points ? idx->tps[index] : NULL;
 }
 
 VikTrackpoint* vik_track_get_tp_by_max_speed ( const VikTrack *tr )
@@ -1199,27 +1561,56 @@ VikTrackpoint* vik_track_get_tp_by_min_alt ( const VikTrack *tr )
   return min_alt_tp;
 }
 
-gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt )
+static gboolean iter_get_minmax_alt ( VikTrackIter iter, gdouble *min_alt, gdouble *max_alt )
 {
   *min_alt = 25000;
   *max_alt = -5000;
-  if ( tr && tr->trackpoints && tr->trackpoints->data && (VIK_TRACKPOINT(tr->trackpoints->data)->altitude != VIK_DEFAULT_ALTITUDE) ) {
-    GList *iter = tr->trackpoints->next;
+  if ( vik_track_iter_valid ( &iter ) && (vik_track_iter_altitude ( &iter ) != VIK_DEFAULT_ALTITUDE) ) {
     gdouble tmp_alt;
-    while (iter)
+    for ( vik_track_iter_next ( &iter ); vik_track_iter_valid ( &iter ); vik_track_iter_next ( &iter ) )
     {
-      tmp_alt = VIK_TRACKPOINT(iter->data)->altitude;
+      tmp_alt = vik_track_iter_altitude ( &iter );
       if ( tmp_alt > *max_alt )
         *max_alt = tmp_alt;
       if ( tmp_alt < *min_alt )
         *min_alt = tmp_alt;
-      iter = iter->next;
     }
     return TRUE;
   }
   return FALSE;
 }
 
+gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt )
+{
+  VikTrackStats *st;
+  *min_alt = 25000;
+  *max_alt = -5000;
+  if ( !tr )
+    return FALSE;
+  st = track_get_stats ( tr );
+  if ( !st->has_alt )
+    return FALSE;
+  *min_alt = st->min_alt;
+  *max_alt = st->max_alt;
+  return TRUE;
+}
+
+/**
+ * vik_track_get_bounds:
+ * @maxmin: Set to the north east and south west corners of the track
+ *
+ * Returns: FALSE for a track with no points, when @maxmin is left alone
+ */
+gboolean vik_track_get_bounds ( const VikTrack *tr, struct LatLon maxmin[2] )
+{
+  VikTrackStats *st = track_get_stats ( tr );
+  if ( !st->n_points )
+    return FALSE;
+  maxmin[0] = st->maxmin[0];
+  maxmin[1] = st->maxmin[1];
+  return TRUE;
+}
+
 void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *datalen)
 {
   GList *tps;
@@ -1307,17 +1698,26 @@ VikTrack *vik_track_unmarshall (guint8 *data, guint datalen)
 void vik_track_apply_dem_data ( VikTrack *tr )
 {
   GList *tp_iter;
-  gint16 elev;
-  tp_iter = tr->trackpoints;
-  while ( tp_iter ) {
-    /* TODO: of the 4 possible choices we have for choosing an elevation
-     * (trackpoint in between samples), choose the one with the least elevation change
-     * as the last */
-    elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(tp_iter->data)->coord), VIK_DEM_INTERPOL_BEST );
-    if ( elev != VIK_DEM_INVALID_ELEVATION )
-      VIK_TRACKPOINT(tp_iter->data)->altitude = elev;
-    tp_iter = tp_iter->next;
-  }
+  guint n = g_list_length ( tr->trackpoints );
+  VikCoord *coords = g_new ( VikCoord, n );
+  gint16 *elevs = g_new ( gint16, n );
+  guint i;
+
+  for ( tp_iter = tr->trackpoints, i = 0; tp_iter; tp_iter = tp_iter->next, i++ )
+    coords[i] = VIK_TRACKPOINT(tp_iter->data)->coord;
+
+  /* TODO: of the 4 possible choices we have for choosing an elevation
+   * (trackpoint in between samples), choose the one with the least elevation change
+   * as the last */
+  a_dems_get_elev_by_coords ( coords, n, VIK_DEM_INTERPOL_BEST, elevs, NULL );
+
+  for ( tp_iter = tr->trackpoints, i = 0; tp_iter; tp_iter = tp_iter->next, i++ )
+    if ( elevs[i] != VIK_DEM_INVALID_ELEVATION )
+      VIK_TRACKPOINT(tp_iter->data)->altitude = elevs[i];
+  vik_track_changed ( tr );
+
+  g_free ( elevs );
+  g_free ( coords );
 }
 
 /**
@@ -1331,8 +1731,10 @@ void vik_track_apply_dem_data_last_trackpoint ( VikTrack *tr )
   if ( tr->trackpoints ) {
     /* As in vik_track_apply_dem_data above - use 'best' interpolation method */
     elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->coord), VIK_DEM_INTERPOL_BEST );
-    if ( elev != VIK_DEM_INVALID_ELEVATION )
+    if ( elev != VIK_DEM_INVALID_ELEVATION ) {
       VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->altitude = elev;
+      vik_track_changed ( tr );
+    }
   }
 }
 
@@ -1348,6 +1750,8 @@ void vik_track_steal_and_append_trackpoints ( VikTrack *t1, VikTrack *t2 )
   } else
     t1->trackpoints = t2->trackpoints;
   t2->trackpoints = NULL;
+  vik_track_changed ( t1 );
+  vik_track_changed ( t2 );
 }
 
 /**
@@ -1382,6 +1786,7 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
       g_list_free( iter );
 
       prev->next = NULL;
+      vik_track_changed ( tr );
 
       return rv;
     }
@@ -1394,6 +1799,223 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
   g_list_foreach ( tr->trackpoints, (GFunc) g_free, NULL );
   g_list_free( tr->trackpoints );
   tr->trackpoints = NULL;
+  vik_track_changed ( tr );
   return rv;
 }
 
+void vik_track_iter_init ( VikTrackIter *iter, const VikTrack *tr )
+{
+  iter->node = tr->trackpoints;
+  iter->cols = NULL;
+  iter->index = 0;
+}
+
+void vik_track_iter_init_columns ( VikTrackIter *iter, const VikTrackColumns *cols )
+{
+  iter->node = NULL;
+  iter->cols = cols;
+  iter->index = 0;
+}
+
+/* Whether tp has any of the fields only kept when used */
+static gboolean trackpoint_has_gps_fields ( const VikTrackpoint *tp )
+{
+  return !isnan(tp->speed) || !isnan(tp->course) || tp->nsats || tp->fix_mode ||
+    tp->hdop != VIK_DEFAULT_DOP || tp->vdop != VIK_DEFAULT_DOP || tp->pdop != VIK_DEFAULT_DOP;
+}
+
+static void columns_alloc_gps_fields ( VikTrackColumns *cols )
+{
+  guint i;
+  cols->speeds = g_new ( gdouble, cols->n_allocated );
+  cols->courses = g_new ( gdouble, cols->n_allocated );
+  for ( i = 0; i < cols->n_points; i++ )
+    cols->speeds[i] = cols->courses[i] = NAN;
+  cols->nsats = g_new0 ( guint16, cols->n_allocated );
+  cols->fix_modes = g_new0 ( gint8, cols->n_allocated );
+  /* VIK_DEFAULT_DOP is 0 */
+  cols->hdops = g_new0 ( gdouble, cols->n_allocated );
+  cols->vdops = g_new0 ( gdouble, cols->n_allocated );
+  cols->pdops = g_new0 ( gdouble, cols->n_allocated );
+}
+
+static void columns_resize ( VikTrackColumns *cols, guint n_allocated )
+{
+  cols->n_allocated = n_allocated;
+  cols->coords = g_renew ( VikCoord, cols->coords, n_allocated );
+  cols->timestamps = g_renew ( time_t, cols->timestamps, n_allocated );
+  cols->altitudes = g_renew ( gdouble, cols->altitudes, n_allocated );
+  cols->flags = g_renew ( guint8, cols->flags, n_allocated );
+  if ( cols->speeds ) {
+    cols->speeds = g_renew ( gdouble, cols->speeds, n_allocated );
+    cols->courses = g_renew ( gdouble, cols->courses, n_allocated );
+    cols->nsats = g_renew ( guint16, cols->nsats, n_allocated );
+    cols->fix_modes = g_renew ( gint8, cols->fix_modes, n_allocated );
+    cols->hdops = g_renew ( gdouble, cols->hdops, n_allocated );
+    cols->vdops = g_renew ( gdouble, cols->vdops, n_allocated );
+    cols->pdops = g_renew ( gdouble, cols->pdops, n_allocated );
+  }
+}
+
+/**
+ * vik_track_columns_new:
+ * @n_reserve: Number of points to make room for, which may be 0
+ */
+VikTrackColumns *vik_track_columns_new ( guint n_reserve )
+{
+  VikTrackColumns *cols = g_new0 ( VikTrackColumns, 1 );
+  if ( n_reserve )
+    columns_resize ( cols, n_reserve );
+  return cols;
+}
+
+VikTrackColumns *vik_track_columns_new_from_track ( const VikTrack *tr )
+{
+  VikTrackColumns *cols = vik_track_columns_new ( g_list_length ( tr->trackpoints ) );
+  GList *iter;
+  for ( iter = tr->trackpoints; iter; iter = iter->next )
+    vik_track_columns_append ( cols, VIK_TRACKPOINT(iter->data) );
+  return cols;
+}
+
+void vik_track_columns_free ( VikTrackColumns *cols )
+{
+  g_free ( cols->coords );
+  g_free ( cols->timestamps );
+  g_free ( cols->altitudes );
+  g_free ( cols->flags );
+  g_free ( cols->speeds );
+  g_free ( cols->courses );
+  g_free ( cols->nsats );
+  g_free ( cols->fix_modes );
+  g_free ( cols->hdops );
+  g_free ( cols->vdops );
+  g_free ( cols->pdops );
+  g_free ( cols );
+}
+
+void vik_track_columns_append ( VikTrackColumns *cols, const VikTrackpoint *tp )
+{
+  guint i = cols->n_points;
+
+  if ( i == cols->n_allocated )
+    columns_resize ( cols, MAX ( 64, cols->n_allocated * 2 ) );
+  if ( !cols->speeds && trackpoint_has_gps_fields ( tp ) )
+    columns_alloc_gps_fields ( cols );
+
+  cols->coords[i] = tp->coord;
+  cols->timestamps[i] = tp->timestamp;
+  cols->altitudes[i] = tp->altitude;
+  cols->flags[i] = (tp->newsegment ? VIK_TRACK_COLUMNS_NEWSEGMENT : 0) |
+                   (tp->has_timestamp ? VIK_TRACK_COLUMNS_HAS_TIMESTAMP : 0);
+  if ( cols->speeds ) {
+    cols->speeds[i] = tp->speed;
+    cols->courses[i] = tp->course;
+    cols->nsats[i] = MIN ( tp->nsats, G_MAXUINT16 );
+    cols->fix_modes[i] = tp->fix_mode;
+    cols->hdops[i] = tp->hdop;
+    cols->vdops[i] = tp->vdop;
+    cols->pdops[i] = tp->pdop;
+  }
+  cols->n_points++;
+}
+
+/**
+ * vik_track_columns_get_trackpoint:
+ *
+ * Fill in @tp with the point at @i.
+ */
+void vik_track_columns_get_trackpoint ( const VikTrackColumns *cols, guint i, VikTrackpoint *tp )
+{
+  g_return_if_fail ( i < cols->n_points );
+
+  tp->coord = cols->coords[i];
+  tp->timestamp = cols->timestamps[i];
+  tp->altitude = cols->altitudes[i];
+  tp->newsegment = (cols->flags[i] & VIK_TRACK_COLUMNS_NEWSEGMENT) != 0;
+  tp->has_timestamp = (cols->flags[i] & VIK_TRACK_COLUMNS_HAS_TIMESTAMP) != 0;
+  if ( cols->speeds ) {
+    tp->speed = cols->speeds[i];
+    tp->course = cols->courses[i];
+    tp->nsats = cols->nsats[i];
+    tp->fix_mode = cols->fix_modes[i];
+    tp->hdop = cols->hdops[i];
+    tp->vdop = cols->vdops[i];
+    tp->pdop = cols->pdops[i];
+  } else {
+    tp->speed = tp->course = NAN;
+    tp->nsats = 0;
+    tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+    tp->hdop = tp->vdop = tp->pdop = VIK_DEFAULT_DOP;
+  }
+}
+
+/**
+ * vik_track_columns_to_trackpoints:
+ *
+ * Returns: A newly allocated list of newly allocated trackpoints,
+ *  suitable for the trackpoints of a #VikTrack
+ */
+GList *vik_track_columns_to_trackpoints ( const VikTrackColumns *cols )
+{
+  GList *tps = NULL;
+  guint i = cols->n_points;
+  while ( i-- ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    vik_track_columns_get_trackpoint ( cols, i, tp );
+    tps = g_list_prepend ( tps, tp );
+  }
+  return tps;
+}
+
+/**
+ * vik_track_columns_get_size:
+ *
+ * Returns: The memory allocated for the columns, in bytes
+ */
+gsize vik_track_columns_get_size ( const VikTrackColumns *cols )
+{
+  gsize per_point = sizeof(VikCoord) + sizeof(time_t) + sizeof(gdouble) + sizeof(guint8);
+  if ( cols->speeds )
+    per_point += 5 * sizeof(gdouble) + sizeof(guint16) + sizeof(gint8);
+  return sizeof(VikTrackColumns) + per_point * cols->n_allocated;
+}
+
+gdouble vik_track_columns_get_length ( const VikTrackColumns *cols )
+{
+  VikTrackIter iter;
+  vik_track_iter_init_columns ( &iter, cols );
+  return iter_get_length ( iter, FALSE );
+}
+
+gdouble vik_track_columns_get_length_including_gaps ( const VikTrackColumns *cols )
+{
+  VikTrackIter iter;
+  vik_track_iter_init_columns ( &iter, cols );
+  return iter_get_length ( iter, TRUE );
+}
+
+gboolean vik_track_columns_get_minmax_alt ( const VikTrackColumns *cols, gdouble *min_alt, gdouble *max_alt )
+{
+  VikTrackIter iter;
+  vik_track_iter_init_columns ( &iter, cols );
+  return iter_get_minmax_alt ( iter, min_alt, max_alt );
+}
+
+gdouble *vik_track_columns_make_elevation_map ( const VikTrackColumns *cols, guint16 num_chunks )
+{
+  gdouble *pts, *dist;
+  guint i;
+
+  if ( cols->n_points < 2 )
+    return NULL;
+
+  /* Summed as for the track index, so both give the same map */
+  dist = g_malloc ( sizeof(gdouble) * cols->n_points );
+  dist[0] = 0.0;
+  for ( i = 1; i < cols->n_points; i++ )
+    dist[i] = dist[i-1] + vik_coord_diff ( &(cols->coords[i]), &(cols->coords[i-1]) );
+  pts = elevation_map_make ( cols->n_points, dist, cols->altitudes, cols->flags, num_chunks );
+  g_free ( dist );
+  return pts;
+}
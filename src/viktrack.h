@@ -61,6 +61,10 @@ struct _VikTrackpoint {
 //  This is simpler than having to rewrite particularly every track function for route version
 //   given that they do the same things
 //  Mostly this matters in the display in deciding where and how they are shown
+typedef struct _VikTrackIndex VikTrackIndex;
+typedef struct _VikTrackStats VikTrackStats;
+typedef struct _VikTrackSimplified VikTrackSimplified;
+
 typedef struct _VikTrack VikTrack;
 struct _VikTrack {
   GList *trackpoints;
@@ -73,6 +77,10 @@ struct _VikTrack {
   GtkWidget *property_dialog;
   gboolean has_color;
   GdkColor color;
+  VikTrackIndex *index; /* Built when needed, dropped by vik_track_changed() */
+  guint generation;     /* Incremented by vik_track_changed() */
+  VikTrackStats *stats; /* Filled when needed, for one generation */
+  VikTrackSimplified *simplified; /* Built when needed, dropped by vik_track_changed() */
 };
 
 VikTrack *vik_track_new();
@@ -93,6 +101,7 @@ guint vik_track_get_segment_count(const VikTrack *tr);
 VikTrack **vik_track_split_into_segments(VikTrack *tr, guint *ret_len);
 guint vik_track_merge_segments(VikTrack *tr);
 void vik_track_reverse(VikTrack *tr);
+void vik_track_changed(VikTrack *tr);
 
 gulong vik_track_get_dup_point_count ( const VikTrack *vt );
 gulong vik_track_remove_dup_points ( VikTrack *vt );
@@ -110,6 +119,9 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
 void vik_track_get_total_elevation_gain(const VikTrack *tr, gdouble *up, gdouble *down);
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_dist ( VikTrack *tr, gdouble reldist, gdouble *meters_from_start );
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_time ( VikTrack *tr, gdouble reldist, time_t *seconds_from_start );
+gint vik_track_get_tp_index_by_dist ( const VikTrack *tr, gdouble meters_from_start );
+gint vik_track_get_tp_index_by_time ( const VikTrack *tr, time_t timestamp );
+VikTrackpoint *vik_track_get_tp_by_index ( const VikTrack *tr, guint index );
 VikTrackpoint *vik_track_get_tp_by_max_speed ( const VikTrack *tr );
 VikTrackpoint *vik_track_get_tp_by_max_alt ( const VikTrack *tr );
 VikTrackpoint *vik_track_get_tp_by_min_alt ( const VikTrack *tr );
@@ -119,6 +131,7 @@ gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks );
 gdouble *vik_track_make_elevation_time_map ( const VikTrack *tr, guint16 num_chunks );
 gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks );
 gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt );
+gboolean vik_track_get_bounds ( const VikTrack *tr, struct LatLon maxmin[2] );
 void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *len);
 VikTrack *vik_track_unmarshall (guint8 *data, guint datalen);
 
@@ -127,11 +140,80 @@ void vik_track_apply_dem_data_last_trackpoint ( VikTrack *tr );
 
 void vik_track_steal_and_append_trackpoints ( VikTrack *t1, VikTrack *t2 );
 
+GList *vik_track_get_simplified_trackpoints ( const VikTrack *tr, gdouble max_error );
+
 VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr );
 
 void vik_track_set_property_dialog(VikTrack *tr, GtkWidget *dialog);
 void vik_track_clear_property_dialog(VikTrack *tr);
 
+/*
+ * Trackpoints packed into one contiguous array per field, rather than
+ *  a GList of separately allocated VikTrackpoints.
+ * This is the layout of tracks in .vikb files (see binfile.c).
+ * The less common GPS fields (speed, course, satellites, fix and DOPs)
+ *  are only allocated once a point has a value for one of them.
+ */
+#define VIK_TRACK_COLUMNS_NEWSEGMENT    (1<<0)
+#define VIK_TRACK_COLUMNS_HAS_TIMESTAMP (1<<1)
+
+typedef struct _VikTrackColumns VikTrackColumns;
+struct _VikTrackColumns {
+  guint n_points;
+  guint n_allocated;
+  VikCoord *coords;
+  time_t *timestamps;
+  gdouble *altitudes;
+  guint8 *flags;
+  /* NULL while no point has any of these */
+  gdouble *speeds;
+  gdouble *courses;
+  guint16 *nsats;
+  gint8 *fix_modes;
+  gdouble *hdops;
+  gdouble *vdops;
+  gdouble *pdops;
+};
+
+VikTrackColumns *vik_track_columns_new ( guint n_reserve );
+VikTrackColumns *vik_track_columns_new_from_track ( const VikTrack *tr );
+void vik_track_columns_free ( VikTrackColumns *cols );
+void vik_track_columns_append ( VikTrackColumns *cols, const VikTrackpoint *tp );
+void vik_track_columns_get_trackpoint ( const VikTrackColumns *cols, guint i, VikTrackpoint *tp );
+GList *vik_track_columns_to_trackpoints ( const VikTrackColumns *cols );
+gsize vik_track_columns_get_size ( const VikTrackColumns *cols );
+
+gdouble vik_track_columns_get_length ( const VikTrackColumns *cols );
+gdouble vik_track_columns_get_length_including_gaps ( const VikTrackColumns *cols );
+gboolean vik_track_columns_get_minmax_alt ( const VikTrackColumns *cols, gdouble *min_alt, gdouble *max_alt );
+gdouble *vik_track_columns_make_elevation_map ( const VikTrackColumns *cols, guint16 num_chunks );
+
+/*
+ * Walks the points of either a track or packed columns in order:
+ *
+ *  VikTrackIter iter;
+ *  for ( vik_track_iter_init ( &iter, tr ); vik_track_iter_valid ( &iter ); vik_track_iter_next ( &iter ) )
+ *    ... vik_track_iter_coord ( &iter ) ...
+ *
+ * Code reading points this way does not depend on how they are stored.
+ */
+typedef struct {
+  GList *node;
+  const VikTrackColumns *cols;
+  guint index;
+} VikTrackIter;
+
+void vik_track_iter_init ( VikTrackIter *iter, const VikTrack *tr );
+void vik_track_iter_init_columns ( VikTrackIter *iter, const VikTrackColumns *cols );
+
+#define vik_track_iter_valid(it) ((it)->cols ? (it)->index < (it)->cols->n_points : (it)->node != NULL)
+#define vik_track_iter_next(it) ((it)->index++, (it)->node = (it)->cols ? NULL : (it)->node->next)
+#define vik_track_iter_coord(it) ((it)->cols ? &((it)->cols->coords[(it)->index]) : &(VIK_TRACKPOINT((it)->node->data)->coord))
+#define vik_track_iter_altitude(it) ((it)->cols ? (it)->cols->altitudes[(it)->index] : VIK_TRACKPOINT((it)->node->data)->altitude)
+#define vik_track_iter_newsegment(it) ((it)->cols ? ((it)->cols->flags[(it)->index] & VIK_TRACK_COLUMNS_NEWSEGMENT) != 0 : VIK_TRACKPOINT((it)->node->data)->newsegment)
+#define vik_track_iter_has_timestamp(it) ((it)->cols ? ((it)->cols->flags[(it)->index] & VIK_TRACK_COLUMNS_HAS_TIMESTAMP) != 0 : VIK_TRACKPOINT((it)->node->data)->has_timestamp)
+#define vik_track_iter_timestamp(it) ((it)->cols ? (it)->cols->timestamps[(it)->index] : VIK_TRACKPOINT((it)->node->data)->timestamp)
+
 G_END_DECLS
 
 #endif
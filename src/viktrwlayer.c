@@ -41,6 +41,7 @@
 #include "garminsymbols.h"
 #include "thumbnails.h"
 #include "background.h"
+#include "vikspatialindex.h"
 #include "gpx.h"
 #include "babel.h"
 #include "dem.h"
@@ -118,6 +119,28 @@ typedef enum {
   FS_NUM_SIZES
 } font_size_t;
 
+/* Trackpoints are indexed by the bounds of runs of up to this many */
+#define TRACK_CHUNK_POINTS 64
+
+typedef struct {
+  gpointer id;
+  VikTrack *trk;
+  GList *first;
+  guint n_points;
+} TrackChunk;
+
+typedef struct {
+  VikTrack *trk;
+  guint generation; /* of the track when indexed */
+  GPtrArray *chunks;
+} TrackChunks;
+
+/* Tracks or routes of a layer, by where their trackpoints are */
+typedef struct {
+  VikSpatialIndex *si; /* of TrackChunk */
+  GHashTable *tracks;  /* track id -> TrackChunks */
+} TrwTrackIndex;
+
 struct _VikTrwLayer {
   VikLayer vl;
   GHashTable *tracks;
@@ -127,6 +150,9 @@ struct _VikTrwLayer {
   GHashTable *waypoints_iters;
   GHashTable *waypoints;
   GtkTreeIter tracks_iter, routes_iter, waypoints_iter;
+  /* Spatial indexes in lat/lon, for drawing and clicking on what is in view */
+  TrwTrackIndex tracks_index, routes_index;
+  VikSpatialIndex *waypoints_index; /* of waypoint ids */
   gboolean tracks_visible, routes_visible, waypoints_visible;
   guint8 drawmode;
   guint8 drawpoints;
@@ -228,6 +254,7 @@ struct DrawingParams {
   const VikCoord *center;
   gboolean one_zone, lat_lon;
   gdouble ce1, ce2, cn1, cn2;
+  LatLonBBox bbox; // only when one_zone or lat_lon
 };
 
 static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp );
@@ -236,7 +263,6 @@ static void trw_layer_delete_item ( gpointer pass_along[6] );
 static void trw_layer_copy_item_cb ( gpointer pass_along[6] );
 static void trw_layer_cut_item_cb ( gpointer pass_along[6] );
 
-static void trw_layer_find_maxmin_waypoints ( const gpointer id, const VikWaypoint *w, struct LatLon maxmin[2] );
 static void trw_layer_find_maxmin_tracks ( const gpointer id, const VikTrack *trk, struct LatLon maxmin[2] );
 static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2]);
 
@@ -1177,6 +1203,142 @@ static guint strcase_hash(gconstpointer v)
 }
 */
 
+static void track_chunks_free ( TrackChunks *tc )
+{
+  g_ptr_array_foreach ( tc->chunks, (GFunc) g_free, NULL );
+  g_ptr_array_free ( tc->chunks, TRUE );
+  g_free ( tc );
+}
+
+static void trw_track_index_init ( TrwTrackIndex *ti )
+{
+  ti->si = vik_spatial_index_new ();
+  ti->tracks = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) track_chunks_free );
+}
+
+static void trw_track_index_free ( TrwTrackIndex *ti )
+{
+  vik_spatial_index_free ( ti->si );
+  g_hash_table_destroy ( ti->tracks );
+}
+
+static void trw_track_index_remove ( TrwTrackIndex *ti, gpointer id )
+{
+  TrackChunks *tc = g_hash_table_lookup ( ti->tracks, id );
+  guint i;
+  if ( ! tc )
+    return;
+  for ( i = 0; i < tc->chunks->len; i++ )
+    vik_spatial_index_remove ( ti->si, g_ptr_array_index ( tc->chunks, i ) );
+  g_hash_table_remove ( ti->tracks, id );
+}
+
+static void trw_track_index_remove_all ( TrwTrackIndex *ti )
+{
+  vik_spatial_index_remove_all ( ti->si );
+  g_hash_table_remove_all ( ti->tracks );
+}
+
+static void latlon_bbox_extend ( LatLonBBox *bbox, const struct LatLon *ll )
+{
+  bbox->south = MIN ( bbox->south, ll->lat );
+  bbox->north = MAX ( bbox->north, ll->lat );
+  bbox->west = MIN ( bbox->west, ll->lon );
+  bbox->east = MAX ( bbox->east, ll->lon );
+}
+
+static void trw_track_index_add ( TrwTrackIndex *ti, gpointer id, VikTrack *trk )
+{
+  TrackChunks *tc;
+  TrackChunk *chunk = NULL;
+  LatLonBBox bbox;
+  GList *iter;
+
+  trw_track_index_remove ( ti, id );
+
+  tc = g_new ( TrackChunks, 1 );
+  tc->trk = trk;
+  tc->generation = trk->generation;
+  tc->chunks = g_ptr_array_new ();
+
+  for ( iter = trk->trackpoints; iter; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    struct LatLon ll;
+    vik_coord_to_latlon ( &(tp->coord), &ll );
+
+    if ( chunk && ( tp->newsegment || chunk->n_points == TRACK_CHUNK_POINTS ) ) {
+      // The line to this point belongs to the previous run too
+      if ( ! tp->newsegment )
+        latlon_bbox_extend ( &bbox, &ll );
+      g_ptr_array_add ( tc->chunks, chunk );
+      vik_spatial_index_insert ( ti->si, chunk, &bbox );
+      chunk = NULL;
+    }
+    if ( ! chunk ) {
+      chunk = g_new ( TrackChunk, 1 );
+      chunk->id = id;
+      chunk->trk = trk;
+      chunk->first = iter;
+      chunk->n_points = 0;
+      bbox.south = bbox.north = ll.lat;
+      bbox.west = bbox.east = ll.lon;
+    }
+    else
+      latlon_bbox_extend ( &bbox, &ll );
+    chunk->n_points++;
+  }
+  if ( chunk ) {
+    g_ptr_array_add ( tc->chunks, chunk );
+    vik_spatial_index_insert ( ti->si, chunk, &bbox );
+  }
+
+  g_hash_table_insert ( ti->tracks, id, tc );
+}
+
+static void trw_track_index_check ( gpointer id, VikTrack *trk, TrwTrackIndex *ti )
+{
+  TrackChunks *tc = g_hash_table_lookup ( ti->tracks, id );
+  if ( ! tc || tc->trk != trk || tc->generation != trk->generation )
+    trw_track_index_add ( ti, id, trk );
+}
+
+static gboolean trw_track_index_is_gone ( gpointer id, TrackChunks *tc, gpointer data[2] )
+{
+  TrwTrackIndex *ti = data[0];
+  guint i;
+  if ( g_hash_table_lookup ( (GHashTable *) data[1], id ) == tc->trk )
+    return FALSE;
+  for ( i = 0; i < tc->chunks->len; i++ )
+    vik_spatial_index_remove ( ti->si, g_ptr_array_index ( tc->chunks, i ) );
+  return TRUE;
+}
+
+/*
+ * Tracks are changed from many places, which all mark the track as changed,
+ *  so rather than following each one, a track is indexed again when its
+ *  generation is not the one indexed. This is one comparison per track.
+ */
+static void trw_track_index_update ( TrwTrackIndex *ti, GHashTable *tracks )
+{
+  g_hash_table_foreach ( tracks, (GHFunc) trw_track_index_check, ti );
+
+  // Deleting always goes through the layer, but make sure
+  if ( g_hash_table_size ( ti->tracks ) != g_hash_table_size ( tracks ) ) {
+    gpointer data[2] = { ti, tracks };
+    g_hash_table_foreach_remove ( ti->tracks, (GHRFunc) trw_track_index_is_gone, data );
+  }
+}
+
+static void trw_layer_index_waypoint ( VikTrwLayer *vtl, gpointer id, VikWaypoint *wp )
+{
+  struct LatLon ll;
+  LatLonBBox bbox;
+  vik_coord_to_latlon ( &(wp->coord), &ll );
+  bbox.south = bbox.north = ll.lat;
+  bbox.west = bbox.east = ll.lon;
+  vik_spatial_index_insert ( vtl->waypoints_index, id, &bbox );
+}
+
 // Stick a 1 at the end of the function name to make it more unique
 //  thus more easily searchable in a simple text editor
 static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
@@ -1203,6 +1365,10 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
   rv->routes = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) vik_track_free );
   rv->routes_iters = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
 
+  trw_track_index_init ( &rv->tracks_index );
+  trw_track_index_init ( &rv->routes_index );
+  rv->waypoints_index = vik_spatial_index_new ();
+
   rv->image_cache = g_queue_new(); // Must be performed before set_params via set_defaults
 
   vik_layer_set_defaults ( VIK_LAYER(rv), vvp );
@@ -1223,6 +1389,10 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   g_hash_table_destroy(trwlayer->waypoints);
   g_hash_table_destroy(trwlayer->tracks);
 
+  trw_track_index_free ( &trwlayer->tracks_index );
+  trw_track_index_free ( &trwlayer->routes_index );
+  vik_spatial_index_free ( trwlayer->waypoints_index );
+
   /* ODC: replace with GArray */
   trw_layer_free_track_gcs ( trwlayer );
 
@@ -1255,7 +1425,8 @@ static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, Vi
 {
   dp->vtl = vtl;
   dp->vp = vp;
-  dp->vw = (VikWindow *)VIK_GTK_WINDOW_FROM_LAYER(dp->vtl);
+  // No window when drawing a layer that was only loaded (eg rendering from the command line)
+  dp->vw = VIK_LAYER(vtl)->vt ? (VikWindow *)VIK_GTK_WINDOW_FROM_LAYER(dp->vtl) : NULL;
   dp->xmpp = vik_viewport_get_xmpp ( vp );
   dp->ympp = vik_viewport_get_ympp ( vp );
   dp->width = vik_viewport_get_width ( vp );
@@ -1289,6 +1460,19 @@ static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, Vi
     dp->cn1 = bottomright.north_south;
     dp->cn2 = upperleft.north_south;
   }
+
+  if ( ( dp->one_zone || dp->lat_lon ) && dp->width && dp->height )
+  {
+    /* same leniency as above, for finding what is in view from the spatial indexes */
+    gdouble margin_lat, margin_lon;
+    vik_viewport_get_min_max_lat_lon ( vp, &dp->bbox.south, &dp->bbox.north, &dp->bbox.west, &dp->bbox.east );
+    margin_lat = (dp->bbox.north - dp->bbox.south) * 500 / dp->height;
+    margin_lon = (dp->bbox.east - dp->bbox.west) * 500 / dp->width;
+    dp->bbox.south -= margin_lat;
+    dp->bbox.north += margin_lat;
+    dp->bbox.west -= margin_lon;
+    dp->bbox.east += margin_lon;
+  }
 }
 
 /*
@@ -1323,6 +1507,40 @@ static void draw_utm_skip_insignia ( VikViewport *vvp, GdkGC *gc, gint x, gint y
   vik_viewport_draw_line ( vvp, gc, x+5, y-5, x-5, y+5 );
 }
 
+/*
+ * Screen positions of trackpoints, in order along the track,
+ *  worked out a block at a time with vik_viewport_coords_to_screen()
+ */
+#define TRACK_PROJECTION_BLOCK 256
+
+typedef struct {
+  VikViewport *vp;
+  GList *list; /* Next trackpoint to put in the block */
+  guint n, i;
+  VikCoord coords[TRACK_PROJECTION_BLOCK];
+  gint xs[TRACK_PROJECTION_BLOCK], ys[TRACK_PROJECTION_BLOCK];
+} TrackProjection;
+
+static void track_projection_init ( TrackProjection *tpj, VikViewport *vp, GList *list )
+{
+  tpj->vp = vp;
+  tpj->list = list;
+  tpj->n = tpj->i = 0;
+}
+
+static void track_projection_next ( TrackProjection *tpj, gint *x, gint *y )
+{
+  if ( tpj->i == tpj->n ) {
+    for ( tpj->n = 0; tpj->list && tpj->n < TRACK_PROJECTION_BLOCK; tpj->list = tpj->list->next, tpj->n++ )
+      tpj->coords[tpj->n] = VIK_TRACKPOINT(tpj->list->data)->coord;
+    vik_viewport_coords_to_screen ( tpj->vp, tpj->coords, sizeof(VikCoord), tpj->n, tpj->xs, tpj->ys );
+    tpj->i = 0;
+  }
+  *x = tpj->xs[tpj->i];
+  *y = tpj->ys[tpj->i];
+  tpj->i++;
+}
+
 static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct DrawingParams *dp, gboolean draw_track_outline )
 {
   /* TODO: this function is a mess, get rid of any redundancy */
@@ -1349,6 +1567,11 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
   if ( ! track->visible )
     return;
 
+  /* No need to draw detail smaller than a pixel, except for tracks being edited.
+     Stops depend on the time to the next actual trackpoint, so need all of them. */
+  if ( track != dp->vtl->current_track && track != dp->vtl->current_tp_track && !dp->vtl->drawstops )
+    list = vik_track_get_simplified_trackpoints ( track, dp->xmpp );
+
   /* admittedly this is not an efficient way to do it because we go through the whole GC thing all over... */
   if ( dp->vtl->bg_line_thickness && !draw_track_outline )
     trw_layer_draw_track ( id, track, dp, TRUE );
@@ -1398,11 +1621,17 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 
   if (list) {
     int x, y, oldx, oldy;
+    // Screen positions of this and the previous trackpoint, even when not drawn
+    gint tpx, tpy, prevx, prevy;
+    TrackProjection tpj;
     VikTrackpoint *tp = VIK_TRACKPOINT(list->data);
   
     tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
 
-    vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+    track_projection_init ( &tpj, dp->vp, list );
+    track_projection_next ( &tpj, &tpx, &tpy );
+    x = tpx;
+    y = tpy;
 
     // Draw the first point as something a bit different from the normal points
     // ATM it's slightly bigger and a triangle
@@ -1429,6 +1658,9 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     {
       tp = VIK_TRACKPOINT(list->data);
       tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
+      prevx = tpx;
+      prevy = tpy;
+      track_projection_next ( &tpj, &tpx, &tpy );
 
       /* check some stuff -- but only if we're in UTM and there's only ONE ZONE; or lat lon */
       if ( (!dp->one_zone && !dp->lat_lon) ||     /* UTM & zones; do everything */
@@ -1436,7 +1668,8 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
              tp->coord.east_west < dp->ce2 && tp->coord.east_west > dp->ce1 &&  /* both UTM and lat lon */
              tp->coord.north_south > dp->cn1 && tp->coord.north_south < dp->cn2 ) )
       {
-        vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+        x = tpx;
+        y = tpy;
 
 	/*
 	 * If points are the same in display coordinates, don't draw.
@@ -1490,8 +1723,10 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
           if ( drawpoints && dp->vtl->coord_mode == VIK_COORD_UTM && tp->coord.utm_zone != dp->center->utm_zone )
             draw_utm_skip_insignia (  dp->vp, main_gc, x, y);
 
-          if (!useoldvals)
-            vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &oldx, &oldy );
+          if (!useoldvals) {
+            oldx = prevx;
+            oldy = prevy;
+          }
 
           if ( draw_track_outline ) {
             vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y);
@@ -1552,7 +1787,8 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
           VikTrackpoint *tp2 = VIK_TRACKPOINT(list->prev->data);
           if ( dp->vtl->coord_mode != VIK_COORD_UTM || tp->coord.utm_zone == dp->center->utm_zone )
           {
-            vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+            x = tpx;
+            y = tpy;
 
             if ( !drawing_highlight && (dp->vtl->drawmode == DRAWMODE_BY_SPEED) ) {
               main_gc = g_array_index(dp->vtl->track_gc, GdkGC *, track_section_colour_by_speed ( dp->vtl, tp, tp2, average_speed, low_speed, high_speed ));
@@ -1576,7 +1812,8 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	     */
 	    if ( x != oldx && y != oldy )
 	      {
-		vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &x, &y );
+		x = prevx;
+		y = prevy;
 		draw_utm_skip_insignia ( dp->vp, main_gc, x, y );
 	      }
           }
@@ -1773,6 +2010,29 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
   }
 }
 
+static void trw_layer_draw_waypoint_id ( gpointer id, struct DrawingParams *dp )
+{
+  VikWaypoint *wp = g_hash_table_lookup ( dp->vtl->waypoints, id );
+  if ( wp )
+    trw_layer_draw_waypoint ( id, wp, dp );
+}
+
+static void trw_layer_collect_chunk_track ( TrackChunk *chunk, GHashTable *tracks )
+{
+  g_hash_table_insert ( tracks, chunk->id, chunk->trk );
+}
+
+static void trw_layer_draw_tracks_in_view ( TrwTrackIndex *ti, GHashTable *tracks, struct DrawingParams *dp )
+{
+  // A track shows up once for each of its runs in view
+  GHashTable *in_view = g_hash_table_new ( g_direct_hash, g_direct_equal );
+
+  trw_track_index_update ( ti, tracks );
+  vik_spatial_index_query ( ti->si, &dp->bbox, (VikSpatialIndexFunc) trw_layer_collect_chunk_track, in_view );
+  g_hash_table_foreach ( in_view, (GHFunc) trw_layer_draw_track_cb, dp );
+  g_hash_table_destroy ( in_view );
+}
+
 static void trw_layer_draw ( VikTrwLayer *l, gpointer data )
 {
   static struct DrawingParams dp;
@@ -1780,6 +2040,19 @@ static void trw_layer_draw ( VikTrwLayer *l, gpointer data )
 
   init_drawing_params ( &dp, l, VIK_VIEWPORT(data) );
 
+  if ( dp.one_zone || dp.lat_lon ) {
+    if ( l->tracks_visible )
+      trw_layer_draw_tracks_in_view ( &l->tracks_index, l->tracks, &dp );
+
+    if ( l->routes_visible )
+      trw_layer_draw_tracks_in_view ( &l->routes_index, l->routes, &dp );
+
+    if ( l->waypoints_visible )
+      vik_spatial_index_query ( l->waypoints_index, &dp.bbox, (VikSpatialIndexFunc) trw_layer_draw_waypoint_id, &dp );
+    return;
+  }
+
+  // Multiple UTM zones in view, so no simple bounds
   if ( l->tracks_visible )
     g_hash_table_foreach ( l->tracks, (GHFunc) trw_layer_draw_track_cb, &dp );
 
@@ -2539,46 +2812,51 @@ VikTrack *vik_trw_layer_get_route ( VikTrwLayer *vtl, const gchar *name )
   return g_hash_table_find ( vtl->routes, (GHRFunc) trw_layer_track_find, (gpointer) name );
 }
 
-static void trw_layer_find_maxmin_waypoints ( const gpointer id, const VikWaypoint *w, struct LatLon maxmin[2] )
+static void trw_layer_find_maxmin_tracks ( const gpointer id, const VikTrack *trk, struct LatLon maxmin[2] )
 {
-  static VikCoord fixme;
-  vik_coord_copy_convert ( &(w->coord), VIK_COORD_LATLON, &fixme );
-  if ( VIK_LATLON(&fixme)->lat > maxmin[0].lat || maxmin[0].lat == 0.0 )
-    maxmin[0].lat = VIK_LATLON(&fixme)->lat;
-  if ( VIK_LATLON(&fixme)->lat < maxmin[1].lat || maxmin[1].lat == 0.0 )
-    maxmin[1].lat = VIK_LATLON(&fixme)->lat;
-  if ( VIK_LATLON(&fixme)->lon > maxmin[0].lon || maxmin[0].lon == 0.0 )
-    maxmin[0].lon = VIK_LATLON(&fixme)->lon;
-  if ( VIK_LATLON(&fixme)->lon < maxmin[1].lon || maxmin[1].lon == 0.0 )
-    maxmin[1].lon = VIK_LATLON(&fixme)->lon;
+  struct LatLon trk_maxmin[2];
+
+  // The track keeps its own bounds, so no need to look at every point
+  if ( ! vik_track_get_bounds ( trk, trk_maxmin ) )
+    return;
+
+  if ( trk_maxmin[0].lat > maxmin[0].lat || maxmin[0].lat == 0.0 )
+    maxmin[0].lat = trk_maxmin[0].lat;
+  if ( trk_maxmin[1].lat < maxmin[1].lat || maxmin[1].lat == 0.0 )
+    maxmin[1].lat = trk_maxmin[1].lat;
+  if ( trk_maxmin[0].lon > maxmin[0].lon || maxmin[0].lon == 0.0 )
+    maxmin[0].lon = trk_maxmin[0].lon;
+  if ( trk_maxmin[1].lon < maxmin[1].lon || maxmin[1].lon == 0.0 )
+    maxmin[1].lon = trk_maxmin[1].lon;
 }
 
-static void trw_layer_find_maxmin_tracks ( const gpointer id, const VikTrack *trk, struct LatLon maxmin[2] )
+static void trw_layer_find_maxmin_index ( VikSpatialIndex *si, struct LatLon maxmin[2] )
 {
-  GList *tr = trk->trackpoints;
-  static VikCoord fixme;
+  LatLonBBox bbox;
 
-  while ( tr )
-  {
-    vik_coord_copy_convert ( &(VIK_TRACKPOINT(tr->data)->coord), VIK_COORD_LATLON, &fixme );
-    if ( VIK_LATLON(&fixme)->lat > maxmin[0].lat || maxmin[0].lat == 0.0 )
-      maxmin[0].lat = VIK_LATLON(&fixme)->lat;
-    if ( VIK_LATLON(&fixme)->lat < maxmin[1].lat || maxmin[1].lat == 0.0 )
-      maxmin[1].lat = VIK_LATLON(&fixme)->lat;
-    if ( VIK_LATLON(&fixme)->lon > maxmin[0].lon || maxmin[0].lon == 0.0 )
-      maxmin[0].lon = VIK_LATLON(&fixme)->lon;
-    if ( VIK_LATLON(&fixme)->lon < maxmin[1].lon || maxmin[1].lon == 0.0 )
-      maxmin[1].lon = VIK_LATLON(&fixme)->lon;
-    tr = tr->next;
-  }
+  // The index keeps its bounds, so no need to look at every item
+  if ( ! vik_spatial_index_get_bounds ( si, &bbox ) )
+    return;
+
+  if ( bbox.north > maxmin[0].lat || maxmin[0].lat == 0.0 )
+    maxmin[0].lat = bbox.north;
+  if ( bbox.south < maxmin[1].lat || maxmin[1].lat == 0.0 )
+    maxmin[1].lat = bbox.south;
+  if ( bbox.east > maxmin[0].lon || maxmin[0].lon == 0.0 )
+    maxmin[0].lon = bbox.east;
+  if ( bbox.west < maxmin[1].lon || maxmin[1].lon == 0.0 )
+    maxmin[1].lon = bbox.west;
 }
 
 static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2])
 {
+  trw_track_index_update ( &vtl->tracks_index, vtl->tracks );
+  trw_track_index_update ( &vtl->routes_index, vtl->routes );
+
   // Continually reuse maxmin to find the latest maximum and minimum values
-  g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_find_maxmin_waypoints, maxmin );
-  g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_find_maxmin_tracks, maxmin );
-  g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_find_maxmin_tracks, maxmin );
+  trw_layer_find_maxmin_index ( vtl->waypoints_index, maxmin );
+  trw_layer_find_maxmin_index ( vtl->tracks_index.si, maxmin );
+  trw_layer_find_maxmin_index ( vtl->routes_index.si, maxmin );
 }
 
 gboolean vik_trw_layer_find_center ( VikTrwLayer *vtl, VikCoord *dest )
@@ -2832,6 +3110,22 @@ static gboolean trw_layer_waypoint_find_uuid ( const gpointer id, const VikWaypo
   return FALSE;
 }
 
+/**
+ * vik_trw_layer_waypoint_moved:
+ *
+ * To be called after changing the position of a waypoint of the layer
+ *  from outside of it.
+ */
+void vik_trw_layer_waypoint_moved ( VikTrwLayer *vtl, VikWaypoint *wp )
+{
+  wpu_udata udata;
+  udata.wp   = wp;
+  udata.uuid = NULL;
+
+  if ( g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_waypoint_find_uuid, &udata ) && udata.uuid )
+    trw_layer_index_waypoint ( vtl, udata.uuid, wp );
+}
+
 static void trw_layer_goto_wp ( gpointer layer_and_vlp[2] )
 {
   GtkWidget *dia = gtk_dialog_new_with_buttons (_("Find"),
@@ -3267,7 +3561,8 @@ static void trw_layer_auto_routes_view ( gpointer lav[2] )
 
   if ( g_hash_table_size (vtl->routes) > 0 ) {
     struct LatLon maxmin[2] = { {0,0}, {0,0} };
-    g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_find_maxmin_tracks, maxmin );
+    trw_track_index_update ( &vtl->routes_index, vtl->routes );
+    trw_layer_find_maxmin_index ( vtl->routes_index.si, maxmin );
     trw_layer_zoom_to_show_latlons ( vtl, vik_layers_panel_get_viewport (vlp), maxmin );
     vik_layers_panel_emit_update ( vlp );
   }
@@ -3288,7 +3583,8 @@ static void trw_layer_auto_tracks_view ( gpointer lav[2] )
 
   if ( g_hash_table_size (vtl->tracks) > 0 ) {
     struct LatLon maxmin[2] = { {0,0}, {0,0} };
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_find_maxmin_tracks, maxmin );
+    trw_track_index_update ( &vtl->tracks_index, vtl->tracks );
+    trw_layer_find_maxmin_index ( vtl->tracks_index.si, maxmin );
     trw_layer_zoom_to_show_latlons ( vtl, vik_layers_panel_get_viewport (vlp), maxmin );
     vik_layers_panel_emit_update ( vlp );
   }
@@ -3314,7 +3610,7 @@ static void trw_layer_auto_waypoints_view ( gpointer lav[2] )
   else if ( g_hash_table_size (vtl->waypoints) > 1 )
   {
     struct LatLon maxmin[2] = { {0,0}, {0,0} };
-    g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_find_maxmin_waypoints, maxmin );
+    trw_layer_find_maxmin_index ( vtl->waypoints_index, maxmin );
     trw_layer_zoom_to_show_latlons ( vtl, vik_layers_panel_get_viewport (vlp), maxmin );
   }
 
@@ -3647,6 +3943,7 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
 
   highest_wp_number_add_wp(vtl, name);
   g_hash_table_insert ( vtl->waypoints, GUINT_TO_POINTER(wp_uuid), wp );
+  trw_layer_index_waypoint ( vtl, GUINT_TO_POINTER(wp_uuid), wp );
  
 }
 
@@ -3680,6 +3977,7 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
   }
 
   g_hash_table_insert ( vtl->tracks, GUINT_TO_POINTER(tr_uuid), t );
+  trw_track_index_add ( &vtl->tracks_index, GUINT_TO_POINTER(tr_uuid), t );
 
   trw_layer_update_treeview ( vtl, t, GUINT_TO_POINTER(tr_uuid) );
 }
@@ -3714,6 +4012,7 @@ void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
   }
 
   g_hash_table_insert ( vtl->routes, GUINT_TO_POINTER(rt_uuid), t );
+  trw_track_index_add ( &vtl->routes_index, GUINT_TO_POINTER(rt_uuid), t );
 
   trw_layer_update_treeview ( vtl, t, GUINT_TO_POINTER(rt_uuid) );
 }
@@ -3917,6 +4216,7 @@ gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk )
       if ( it ) {
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
         g_hash_table_remove ( vtl->tracks_iters, udata.uuid );
+        trw_track_index_remove ( &vtl->tracks_index, udata.uuid );
         g_hash_table_remove ( vtl->tracks, udata.uuid );
 
 	// If last sublayer, then remove sublayer container
@@ -3966,6 +4266,7 @@ gboolean vik_trw_layer_delete_route ( VikTrwLayer *vtl, VikTrack *trk )
       if ( it ) {
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
         g_hash_table_remove ( vtl->routes_iters, udata.uuid );
+        trw_track_index_remove ( &vtl->routes_index, udata.uuid );
         g_hash_table_remove ( vtl->routes, udata.uuid );
 
         // If last sublayer, then remove sublayer container
@@ -4007,6 +4308,7 @@ static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp )
         g_hash_table_remove ( vtl->waypoints_iters, udata.uuid );
 
         highest_wp_number_remove_wp(vtl, wp->name);
+        vik_spatial_index_remove ( vtl->waypoints_index, udata.uuid );
         g_hash_table_remove ( vtl->waypoints, udata.uuid ); // last because this frees the name
 
 	// If last sublayer, then remove sublayer container
@@ -4120,6 +4422,7 @@ void vik_trw_layer_delete_all_routes ( VikTrwLayer *vtl )
 
   g_hash_table_foreach(vtl->routes_iters, (GHFunc) remove_item_from_treeview, VIK_LAYER(vtl)->vt);
   g_hash_table_remove_all(vtl->routes_iters);
+  trw_track_index_remove_all ( &vtl->routes_index );
   g_hash_table_remove_all(vtl->routes);
 
   vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter) );
@@ -4138,6 +4441,7 @@ void vik_trw_layer_delete_all_tracks ( VikTrwLayer *vtl )
 
   g_hash_table_foreach(vtl->tracks_iters, (GHFunc) remove_item_from_treeview, VIK_LAYER(vtl)->vt);
   g_hash_table_remove_all(vtl->tracks_iters);
+  trw_track_index_remove_all ( &vtl->tracks_index );
   g_hash_table_remove_all(vtl->tracks);
 
   vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter) );
@@ -4155,6 +4459,7 @@ void vik_trw_layer_delete_all_waypoints ( VikTrwLayer *vtl )
 
   g_hash_table_foreach(vtl->waypoints_iters, (GHFunc) remove_item_from_treeview, VIK_LAYER(vtl)->vt);
   g_hash_table_remove_all(vtl->waypoints_iters);
+  vik_spatial_index_remove_all ( vtl->waypoints_index );
   g_hash_table_remove_all(vtl->waypoints);
 
   vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter) );
@@ -4253,6 +4558,9 @@ static void trw_layer_properties_item ( gpointer pass_along[7] )
       gboolean updated = FALSE;
       a_dialog_waypoint ( VIK_GTK_WINDOW_FROM_LAYER(vtl), wp->name, wp, vtl->coord_mode, FALSE, &updated );
 
+      // The position may have been edited
+      trw_layer_index_waypoint ( vtl, pass_along[3], wp );
+
       if ( updated && pass_along[6] )
         vik_treeview_item_set_icon ( VIK_LAYER(vtl)->vt, pass_along[6], get_wp_sym_small (wp->symbol) );
 
@@ -4465,6 +4773,56 @@ static void trw_layer_extend_track_end_route_finder ( gpointer pass_along[6] )
 }
 #endif
 
+/* Tracks with more points get their DEM data in the background, this many points per progress step */
+#define DEM_APPLY_SLICE 65536
+
+/* Structure for applying DEM data to a track in the background thread */
+typedef struct {
+  VikTrack *trk;    // Referenced, and only touched in the main loop
+  VikCoord *coords; // Copy of the trackpoint coordinates
+  gint16 *elevs;
+  guint n;
+  guint generation; // Of the track when the coordinates were copied
+  gboolean complete;
+} dem_apply_thread_data;
+
+static gboolean dem_apply_finish ( dem_apply_thread_data *datd )
+{
+  /* Unless the track was changed meanwhile */
+  if ( datd->complete && datd->trk->generation == datd->generation ) {
+    GList *iter;
+    guint i;
+    for ( iter = datd->trk->trackpoints, i = 0; iter; iter = iter->next, i++ )
+      if ( datd->elevs[i] != VIK_DEM_INVALID_ELEVATION )
+        VIK_TRACKPOINT(iter->data)->altitude = datd->elevs[i];
+    vik_track_changed ( datd->trk );
+  }
+  vik_track_free ( datd->trk );
+  g_free ( datd->coords );
+  g_free ( datd->elevs );
+  g_free ( datd );
+  return FALSE;
+}
+
+static int dem_apply_thread ( dem_apply_thread_data *datd, gpointer threaddata )
+{
+  guint start;
+
+  datd->complete = TRUE;
+  for ( start = 0; start < datd->n; start += DEM_APPLY_SLICE ) {
+    guint count = MIN ( DEM_APPLY_SLICE, datd->n - start );
+    if ( a_dems_get_elev_by_coords ( datd->coords + start, count, VIK_DEM_INTERPOL_BEST, datd->elevs + start, threaddata ) != 0 ||
+         a_background_thread_progress ( threaddata, ((gdouble) start + count) / datd->n ) != 0 ) {
+      datd->complete = FALSE;
+      break;
+    }
+  }
+
+  /* Results are applied (and the data freed) in the main loop, as the track may be being edited */
+  gdk_threads_add_idle ( (GSourceFunc) dem_apply_finish, datd );
+  return datd->complete ? 0 : -1;
+}
+
 static void trw_layer_apply_dem_data ( gpointer pass_along[6] )
 {
   /* TODO: check & warn if no DEM data, or no applicable DEM data. */
@@ -4476,8 +4834,36 @@ static void trw_layer_apply_dem_data ( gpointer pass_along[6] )
   else
     track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, pass_along[3] );
 
-  if ( track )
+  if ( ! track )
+    return;
+
+  guint n = g_list_length ( track->trackpoints );
+  if ( n <= DEM_APPLY_SLICE ) {
     vik_track_apply_dem_data ( track );
+    return;
+  }
+
+  dem_apply_thread_data *datd = g_malloc0 ( sizeof(dem_apply_thread_data) );
+  GList *iter;
+  guint i;
+  datd->n = n;
+  datd->coords = g_new ( VikCoord, n );
+  datd->elevs = g_new ( gint16, n );
+  for ( iter = track->trackpoints, i = 0; iter; iter = iter->next, i++ )
+    datd->coords[i] = VIK_TRACKPOINT(iter->data)->coord;
+  vik_track_ref ( track );
+  datd->trk = track;
+  datd->generation = track->generation;
+
+  gchar *tmp = g_strdup_printf ( _("Applying DEM data to %s..."), track->name ? track->name : "" );
+  a_background_thread ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
+                        tmp,
+                        (vik_thr_func) dem_apply_thread,
+                        datd,
+                        NULL, /* freed by dem_apply_finish() */
+                        NULL,
+                        (n + DEM_APPLY_SLICE - 1) / DEM_APPLY_SLICE );
+  g_free ( tmp );
 }
 
 static void trw_layer_goto_track_endpoint ( gpointer pass_along[6] )
@@ -4793,6 +5179,7 @@ static void trw_layer_merge_with_other ( gpointer pass_along[6] )
         else
           vik_trw_layer_delete_track (vtl, merge_track);
         track->trackpoints = g_list_sort(track->trackpoints, trackpoint_compare);
+        vik_track_changed ( track );
       }
     }
     /* TODO: free data before free merge_list */
@@ -5090,6 +5477,7 @@ static void trw_layer_merge_by_timestamp ( gpointer pass_along[6] )
     }
 
     orig_trk->trackpoints = g_list_sort(orig_trk->trackpoints, trackpoint_compare);
+    vik_track_changed ( orig_trk );
   }
 
   g_list_free(nearby_tracks);
@@ -5116,6 +5504,7 @@ static void trw_layer_split_at_selected_trackpoint ( VikTrwLayer *vtl, gint subt
 
       vtl->current_tpl->next->prev = newglist; /* end old track here */
       vtl->current_tpl->next = NULL;
+      vik_track_changed ( vtl->current_tp_track );
 
       vtl->current_tpl = newglist; /* change tp to first of new track. */
       vtl->current_tp_track = tr;
@@ -6713,6 +7102,7 @@ static void trw_layer_insert_tp_after_current_tp ( VikTrwLayer *vtl )
     gint index =  g_list_index ( trk->trackpoints, tp_current );
     if ( index > -1 ) {
       trk->trackpoints = g_list_insert ( trk->trackpoints, tp_new, index+1 );
+      vik_track_changed ( trk );
     }
   }
 }
@@ -6771,6 +7161,7 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
       // Delete current trackpoint
       vik_trackpoint_free ( vtl->current_tpl->data );
       tr->trackpoints = g_list_delete_link ( tr->trackpoints, vtl->current_tpl );
+      vik_track_changed ( tr );
 
       // Set to current to the available adjacent trackpoint
       vtl->current_tpl = new_tpl;
@@ -6786,6 +7177,7 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
       // Delete current trackpoint
       vik_trackpoint_free ( vtl->current_tpl->data );
       tr->trackpoints = g_list_delete_link ( tr->trackpoints, vtl->current_tpl );
+      vik_track_changed ( tr );
       trw_layer_cancel_current_tp ( vtl, FALSE );
     }
   }
@@ -6806,8 +7198,11 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
     trw_layer_insert_tp_after_current_tp ( vtl );
     vik_layer_emit_update(VIK_LAYER(vtl));
   }
-  else if ( response == VIK_TRW_LAYER_TPWIN_DATA_CHANGED )
+  else if ( response == VIK_TRW_LAYER_TPWIN_DATA_CHANGED ) {
+    if ( vtl->current_tp_track )
+      vik_track_changed ( vtl->current_tp_track );
     vik_layer_emit_update(VIK_LAYER(vtl));
+  }
 }
 
 static void trw_layer_tpwin_init ( VikTrwLayer *vtl )
@@ -6838,6 +7233,7 @@ typedef struct {
   gpointer *closest_wp_id;
   VikWaypoint *closest_wp;
   VikViewport *vvp;
+  GHashTable *waypoints; /* set by trw_layer_search_closest_wp */
 } WPSearchParams;
 
 typedef struct {
@@ -6882,15 +7278,24 @@ static void waypoint_search_closest_tp ( gpointer id, VikWaypoint *wp, WPSearchP
     }
 }
 
-static void track_search_closest_tp ( gpointer id, VikTrack *t, TPSearchParams *params )
+static void waypoint_id_search_closest_tp ( gpointer id, WPSearchParams *params )
+{
+  VikWaypoint *wp = g_hash_table_lookup ( params->waypoints, id );
+  if ( wp )
+    waypoint_search_closest_tp ( id, wp, params );
+}
+
+static void track_chunk_search_closest_tp ( TrackChunk *chunk, TPSearchParams *params )
 {
-  GList *tpl = t->trackpoints;
+  gpointer id = chunk->id;
+  GList *tpl = chunk->first;
   VikTrackpoint *tp;
+  guint i;
 
-  if ( !t->visible )
+  if ( !chunk->trk->visible )
     return;
 
-  while (tpl)
+  for ( i = 0; i < chunk->n_points; i++ )
   {
     gint x, y;
     tp = VIK_TRACKPOINT(tpl->data);
@@ -6911,6 +7316,44 @@ static void track_search_closest_tp ( gpointer id, VikTrack *t, TPSearchParams *
   }
 }
 
+/* Lat/lon bounds of a square of pixels around a point of the viewport */
+static void trw_layer_click_bbox ( VikViewport *vvp, gint x, gint y, gint slack, LatLonBBox *bbox )
+{
+  gint i;
+  slack++; // for rounding
+  for ( i = 0; i < 4; i++ ) {
+    VikCoord coord;
+    struct LatLon ll;
+    vik_viewport_screen_to_coord ( vvp, x + (i & 1 ? slack : -slack), y + (i & 2 ? slack : -slack), &coord );
+    vik_coord_to_latlon ( &coord, &ll );
+    if ( i == 0 ) {
+      bbox->south = bbox->north = ll.lat;
+      bbox->west = bbox->east = ll.lon;
+    }
+    else
+      latlon_bbox_extend ( bbox, &ll );
+  }
+}
+
+/* Only looks at the trackpoints of the runs around the click */
+static void trw_layer_search_closest_tp ( TrwTrackIndex *ti, GHashTable *tracks, TPSearchParams *params )
+{
+  LatLonBBox bbox;
+  trw_track_index_update ( ti, tracks );
+  trw_layer_click_bbox ( params->vvp, params->x, params->y, TRACKPOINT_SIZE_APPROX, &bbox );
+  vik_spatial_index_query ( ti->si, &bbox, (VikSpatialIndexFunc) track_chunk_search_closest_tp, params );
+}
+
+static void trw_layer_search_closest_wp ( VikTrwLayer *vtl, WPSearchParams *params )
+{
+  LatLonBBox bbox;
+  // Waypoint images can be clicked anywhere on, thumbnails are up to 128 pixels
+  gint slack = MAX ( WAYPOINT_SIZE_APPROX, MAX ( vtl->image_size, 128 ) / 2 );
+  params->waypoints = vtl->waypoints;
+  trw_layer_click_bbox ( params->vvp, params->x, params->y, slack, &bbox );
+  vik_spatial_index_query ( vtl->waypoints_index, &bbox, (VikSpatialIndexFunc) waypoint_id_search_closest_tp, params );
+}
+
 // ATM: Leave this as 'Track' only.
 //  Not overly bothered about having a snap to route trackpoint capability
 static VikTrackpoint *closest_tp_in_five_pixel_interval ( VikTrwLayer *vtl, VikViewport *vvp, gint x, gint y )
@@ -6921,7 +7364,7 @@ static VikTrackpoint *closest_tp_in_five_pixel_interval ( VikTrwLayer *vtl, VikV
   params.vvp = vvp;
   params.closest_track_id = NULL;
   params.closest_tp = NULL;
-  g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &params);
+  trw_layer_search_closest_tp ( &vtl->tracks_index, vtl->tracks, &params );
   return params.closest_tp;
 }
 
@@ -6933,7 +7376,7 @@ static VikWaypoint *closest_wp_in_five_pixel_interval ( VikTrwLayer *vtl, VikVie
   params.vvp = vvp;
   params.closest_wp = NULL;
   params.closest_wp_id = NULL;
-  g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_search_closest_tp, &params);
+  trw_layer_search_closest_wp ( vtl, &params );
   return params.closest_wp;
 }
 
@@ -7006,11 +7449,15 @@ static gboolean trw_layer_select_release ( VikTrwLayer *vtl, GdkEventButton *eve
     marker_end_move ( t );
 
     // Determine if working on a waypoint or a trackpoint
-    if ( t->is_waypoint )
+    if ( t->is_waypoint ) {
       vtl->current_wp->coord = new_coord;
+      trw_layer_index_waypoint ( vtl, vtl->current_wp_id, vtl->current_wp );
+    }
     else {
       if ( vtl->current_tpl ) {
         VIK_TRACKPOINT(vtl->current_tpl->data)->coord = new_coord;
+        if ( vtl->current_tp_track )
+          vik_track_changed ( vtl->current_tp_track );
       
 	if ( vtl->tpwin )
           if ( vtl->current_tp_track )
@@ -7055,7 +7502,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
     wp_params.closest_wp_id = NULL;
     wp_params.closest_wp = NULL;
 
-    g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_search_closest_tp, &wp_params);
+    trw_layer_search_closest_wp ( vtl, &wp_params );
 
     if ( wp_params.closest_wp )  {
 
@@ -7092,7 +7539,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
   tp_params.closest_tp = NULL;
 
   if (vtl->tracks_visible) {
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &tp_params);
+    trw_layer_search_closest_tp ( &vtl->tracks_index, vtl->tracks, &tp_params );
 
     if ( tp_params.closest_tp )  {
 
@@ -7127,7 +7574,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
 
   // Try again for routes
   if (vtl->routes_visible) {
-    g_hash_table_foreach ( vtl->routes, (GHFunc) track_search_closest_tp, &tp_params);
+    trw_layer_search_closest_tp ( &vtl->routes_index, vtl->routes, &tp_params );
 
     if ( tp_params.closest_tp )  {
 
@@ -7359,7 +7806,7 @@ static gboolean tool_edit_waypoint_click ( VikTrwLayer *vtl, GdkEventButton *eve
   params.closest_wp_id = NULL;
   /* TODO: should get track listitem so we can break it up, make a new track, mess it up, all that. */
   params.closest_wp = NULL;
-  g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_search_closest_tp, &params);
+  trw_layer_search_closest_wp ( vtl, &params );
   if ( vtl->current_wp == params.closest_wp && vtl->current_wp != NULL )
   {
     // how do we get here?
@@ -7462,6 +7909,7 @@ static gboolean tool_edit_waypoint_release ( VikTrwLayer *vtl, GdkEventButton *e
     marker_end_move ( t );
 
     vtl->current_wp->coord = new_coord;
+    trw_layer_index_waypoint ( vtl, vtl->current_wp_id, vtl->current_wp );
     vik_layer_emit_update ( VIK_LAYER(vtl) );
     return TRUE;
   }
@@ -7723,6 +8171,7 @@ static gboolean tool_new_track_key_press ( VikTrwLayer *vtl, GdkEventKey *event,
       GList *last = g_list_last(vtl->current_track->trackpoints);
       g_free ( last->data );
       vtl->current_track->trackpoints = g_list_remove_link ( vtl->current_track->trackpoints, last );
+      vik_track_changed ( vtl->current_track );
     }
 
     update_statusbar ( vtl );
@@ -7763,6 +8212,7 @@ static gboolean tool_new_track_or_route_click ( VikTrwLayer *vtl, GdkEventButton
       GList *last = g_list_last(vtl->current_track->trackpoints);
       g_free ( last->data );
       vtl->current_track->trackpoints = g_list_remove_link ( vtl->current_track->trackpoints, last );
+      vik_track_changed ( vtl->current_track );
     }
     update_statusbar ( vtl );
 
@@ -7778,6 +8228,7 @@ static gboolean tool_new_track_or_route_click ( VikTrwLayer *vtl, GdkEventButton
       GList *last = g_list_last(vtl->current_track->trackpoints);
       g_free ( last->data );
       vtl->current_track->trackpoints = g_list_remove_link ( vtl->current_track->trackpoints, last );
+      vik_track_changed ( vtl->current_track );
       /* undo last, then end */
       vtl->current_track = NULL;
     }
@@ -7802,6 +8253,7 @@ static gboolean tool_new_track_or_route_click ( VikTrwLayer *vtl, GdkEventButton
 
   if ( vtl->current_track ) {
     vtl->current_track->trackpoints = g_list_append ( vtl->current_track->trackpoints, tp );
+    vik_track_changed ( vtl->current_track );
     /* Auto attempt to get elevation from DEM data (if it's available) */
     vik_track_apply_dem_data_last_trackpoint ( vtl->current_track );
   }
@@ -7938,7 +8390,7 @@ static gboolean tool_edit_trackpoint_click ( VikTrwLayer *vtl, GdkEventButton *e
   }
 
   if ( vtl->tracks_visible )
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &params);
+    trw_layer_search_closest_tp ( &vtl->tracks_index, vtl->tracks, &params );
 
   if ( params.closest_tp )
   {
@@ -7953,7 +8405,7 @@ static gboolean tool_edit_trackpoint_click ( VikTrwLayer *vtl, GdkEventButton *e
   }
 
   if ( vtl->routes_visible )
-    g_hash_table_foreach ( vtl->routes, (GHFunc) track_search_closest_tp, &params);
+    trw_layer_search_closest_tp ( &vtl->routes_index, vtl->routes, &params );
 
   if ( params.closest_tp )
   {
@@ -8026,6 +8478,8 @@ static gboolean tool_edit_trackpoint_release ( VikTrwLayer *vtl, GdkEventButton
     }
 
     VIK_TRACKPOINT(vtl->current_tpl->data)->coord = new_coord;
+    if ( vtl->current_tp_track )
+      vik_track_changed ( vtl->current_tp_track );
 
     marker_end_move ( t );
 
@@ -70,6 +70,7 @@ void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t );
 
 // Waypoint returned is the first one
 VikWaypoint *vik_trw_layer_get_waypoint ( VikTrwLayer *vtl, const gchar *name );
+void vik_trw_layer_waypoint_moved ( VikTrwLayer *vtl, VikWaypoint *wp );
 
 // Track returned is the first one
 VikTrack *vik_trw_layer_get_track ( VikTrwLayer *vtl, const gchar *name );
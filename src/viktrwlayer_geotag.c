@@ -271,6 +271,7 @@ static void trw_layer_geotag_process ( geotag_options_t *options )
 					if ( current_wp ) {
 						// Existing wp found, so set new position, comment and image
 						current_wp = a_geotag_waypoint_positioned ( options->image, wp->coord, wp->altitude, &name, current_wp );
+						vik_trw_layer_waypoint_moved ( options->vtl, current_wp );
 						updated_waypoint = TRUE;
 					}
 				}
@@ -2688,6 +2688,7 @@ static void propwin_response_cb( GtkDialog *dialog, gint resp, PropWidgets *widg
                                                            widgets->tr->name);
         iter->prev->next = NULL;
         iter->prev = NULL;
+        vik_track_changed ( tr );
         VikTrack *tr_right = vik_track_new();
         if ( tr->comment )
           vik_track_set_comment ( tr_right, tr->comment );
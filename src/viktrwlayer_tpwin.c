@@ -113,6 +113,7 @@ static void tpwin_sync_alt_to_tp ( VikTrwLayerTpwin *tpwin )
       tpwin->cur_tp->altitude = gtk_spin_button_get_value ( tpwin->alt );
       g_critical("Houston, we've had a problem. height=%d", height_units);
     }
+    gtk_dialog_response ( GTK_DIALOG(tpwin), VIK_TRW_LAYER_TPWIN_DATA_CHANGED );
   }
 }
 
@@ -125,6 +126,7 @@ static void tpwin_sync_ts_to_tp ( VikTrwLayerTpwin *tpwin )
 	  {
 		  tpwin->cur_tp->timestamp = gtk_datetime_get_timestamp(tpwin->datetime);
 		  vik_trw_layer_tpwin_set_tp_ts(tpwin, tpwin->cur_tp);
+		  gtk_dialog_response ( GTK_DIALOG(tpwin), VIK_TRW_LAYER_TPWIN_DATA_CHANGED );
 	  }
   }
 }
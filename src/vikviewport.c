@@ -53,8 +53,11 @@ static gdouble EASTING_OFFSET = 500000.0;
 
 static gint PAD = 10;
 
+static void surfaces_drop_all ( VikViewport *vvp );
+
 static void viewport_finalize ( GObject *gob );
 static void viewport_utm_zone_check ( VikViewport *vvp );
+static void viewport_init_gcs ( VikViewport *vvp );
 
 static gboolean calcxy(double *x, double *y, double lg, double lt, double zero_long, double zero_lat, double pixelfact_x, double pixelfact_y, gint mapSizeX2, gint mapSizeY2 );
 static gboolean calcxy_rev(double *lg, double *lt, gint x, gint y, double zero_long, double zero_lat, double pixelfact_x, double pixelfact_y, gint mapSizeX2, gint mapSizeY2 );
@@ -98,10 +101,24 @@ struct _VikViewport {
   /* subset of coord types. lat lon can be plotted in 2 ways, google or exp. */
   VikViewportDrawMode drawmode;
 
-  /* trigger stuff */
-  gpointer trigger;
-  GdkPixmap *snapshot_buffer;
+  /* Retained surfaces: what was drawn before each layer, so drawing can resume at a changed layer */
+  GHashTable *surfaces;   /* Layer -> ViewportSurface, NULL unless in use */
+  VikCoord surfaces_center; /* Viewport state the surfaces are for */
+  gdouble surfaces_xmpp, surfaces_ympp;
+  gint surfaces_width, surfaces_height;
+  VikViewportDrawMode surfaces_drawmode;
+  gboolean surfaces_missing; /* A changed layer had no surface to resume from */
+  GStaticMutex surfaces_mutex;
+  GHashTable *surfaces_changed;  /* Layers changed since drawing started, may be added to from other threads */
+  GHashTable *surfaces_changing; /* Layers changed before the current drawing */
   gboolean half_drawn;
+
+  /* What the layers drew, without the scale etc. on top, kept while panning */
+  GdkPixmap *scroll_buffer;
+  VikCoord scroll_center; /* Where scroll_buffer is centred */
+  gdouble scroll_xmpp, scroll_ympp;
+
+  gboolean offscreen; /* Never shown, see vik_viewport_new_offscreen() */
 };
 
 static gdouble
@@ -179,9 +196,14 @@ vik_viewport_init ( VikViewport *vvp )
   vvp->draw_centermark = TRUE;
   vvp->draw_highlight = TRUE;
 
-  vvp->trigger = NULL;
-  vvp->snapshot_buffer = NULL;
+  vvp->surfaces = NULL;
+  vvp->surfaces_missing = FALSE;
+  g_static_mutex_init ( &vvp->surfaces_mutex );
+  vvp->surfaces_changed = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  vvp->surfaces_changing = NULL;
   vvp->half_drawn = FALSE;
+  vvp->scroll_buffer = NULL;
+  vvp->offscreen = FALSE;
 
   g_signal_connect (G_OBJECT(vvp), "configure_event", G_CALLBACK(vik_viewport_configure), NULL);
 
@@ -259,12 +281,23 @@ void vik_viewport_set_highlight_thickness ( VikViewport *vvp, gint thickness )
   gdk_gc_set_line_attributes ( vvp->highlight_gc, thickness, GDK_LINE_SOLID, GDK_CAP_ROUND, GDK_JOIN_ROUND );
 }
 
+/*
+ * What pixmaps and GCs are made for: the viewport's window,
+ *  or the screen for offscreen viewports which never have one
+ */
+static GdkDrawable *viewport_drawable ( VikViewport *vvp )
+{
+  if ( GTK_WIDGET(vvp)->window )
+    return GTK_WIDGET(vvp)->window;
+  return gdk_get_default_root_window ();
+}
+
 GdkGC *vik_viewport_new_gc ( VikViewport *vvp, const gchar *colorname, gint thickness )
 {
   GdkGC *rv = NULL;
   GdkColor color;
 
-  rv = gdk_gc_new ( GTK_WIDGET(vvp)->window );
+  rv = gdk_gc_new ( viewport_drawable ( vvp ) );
   if ( gdk_color_parse ( colorname, &color ) )
     gdk_gc_set_rgb_fg_color ( rv, &color );
   else
@@ -277,7 +310,7 @@ GdkGC *vik_viewport_new_gc_from_color ( VikViewport *vvp, GdkColor *color, gint
 {
   GdkGC *rv;
 
-  rv = gdk_gc_new ( GTK_WIDGET(vvp)->window );
+  rv = gdk_gc_new ( viewport_drawable ( vvp ) );
   gdk_gc_set_rgb_fg_color ( rv, color );
   gdk_gc_set_line_attributes ( rv, thickness, GDK_LINE_SOLID, GDK_CAP_ROUND, GDK_JOIN_ROUND );
   return rv;
@@ -289,12 +322,7 @@ void vik_viewport_configure_manually ( VikViewport *vvp, gint width, guint heigh
   vvp->height = height;
   if ( vvp->scr_buffer )
     g_object_unref ( G_OBJECT ( vvp->scr_buffer ) );
-  vvp->scr_buffer = gdk_pixmap_new ( GTK_WIDGET(vvp)->window, vvp->width, vvp->height, -1 );
-
-  /* TODO trigger: only if this is enabled !!! */
-  if ( vvp->snapshot_buffer )
-    g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
-  vvp->snapshot_buffer = gdk_pixmap_new ( GTK_WIDGET(vvp)->window, vvp->width, vvp->height, -1 );
+  vvp->scr_buffer = gdk_pixmap_new ( viewport_drawable ( vvp ), vvp->width, vvp->height, -1 );
 }
 
 
@@ -315,14 +343,13 @@ gboolean vik_viewport_configure ( VikViewport *vvp )
 
   vvp->scr_buffer = gdk_pixmap_new ( GTK_WIDGET(vvp)->window, vvp->width, vvp->height, -1 );
 
-  /* TODO trigger: only if enabled! */
-  if ( vvp->snapshot_buffer )
-    g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
-
-  vvp->snapshot_buffer = gdk_pixmap_new ( GTK_WIDGET(vvp)->window, vvp->width, vvp->height, -1 );
-  /* TODO trigger */
+  viewport_init_gcs ( vvp );
+  return FALSE;
+}
 
-  /* this is down here so it can get a GC (necessary?) */
+/* this is done after there is a pixmap so it can get a GC (necessary?) */
+static void viewport_init_gcs ( VikViewport *vvp )
+{
   if ( !vvp->background_gc )
   {
     vvp->background_gc = vik_viewport_new_gc ( vvp, DEFAULT_BACKGROUND_COLOR, 1 );
@@ -336,8 +363,44 @@ gboolean vik_viewport_configure ( VikViewport *vvp )
   if ( !vvp->scale_bg_gc) {
     vvp->scale_bg_gc = vik_viewport_new_gc(vvp, "grey", 3);
   }
+}
+
+/**
+ * vik_viewport_new_offscreen:
+ * @like: Viewport to take the position, zoom, draw mode and colours from, or NULL
+ *
+ * A viewport which is never shown, only drawn into its pixmap
+ *  (eg for rendering images independently of the window).
+ *
+ * Returns: a new viewport, to be freed with g_object_unref()
+ */
+VikViewport *vik_viewport_new_offscreen ( VikViewport *like, gint width, gint height )
+{
+  VikViewport *vvp = vik_viewport_new ();
+
+  g_object_ref_sink ( vvp );
+  vvp->offscreen = TRUE;
+  // Its style is normally attached on being shown, but text is drawn with it
+  gtk_widget_ensure_style ( GTK_WIDGET(vvp) );
+  GTK_WIDGET(vvp)->style = gtk_style_attach ( GTK_WIDGET(vvp)->style, viewport_drawable ( vvp ) );
+
+  vik_viewport_configure_manually ( vvp, width, height );
+  viewport_init_gcs ( vvp );
 
-  return FALSE;	
+  if ( like ) {
+    vik_viewport_set_drawmode ( vvp, like->drawmode );
+    vvp->center = like->center;
+    vvp->xmpp = like->xmpp;
+    vvp->ympp = like->ympp;
+    if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_UTM )
+      viewport_utm_zone_check ( vvp );
+    vik_viewport_set_background_gdkcolor ( vvp, &like->background_color );
+    vik_viewport_set_highlight_gdkcolor ( vvp, &like->highlight_color );
+    vvp->draw_scale = like->draw_scale;
+    vvp->draw_centermark = like->draw_centermark;
+    vvp->draw_highlight = like->draw_highlight;
+  }
+  return vvp;
 }
 
 static void viewport_finalize ( GObject *gob )
@@ -349,8 +412,20 @@ static void viewport_finalize ( GObject *gob )
   if ( vvp->scr_buffer )
     g_object_unref ( G_OBJECT ( vvp->scr_buffer ) );
 
-  if ( vvp->snapshot_buffer )
-    g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
+  if ( vvp->surfaces ) {
+    surfaces_drop_all ( vvp );
+    g_hash_table_destroy ( vvp->surfaces );
+  }
+  if ( vvp->scroll_buffer )
+    g_object_unref ( G_OBJECT ( vvp->scroll_buffer ) );
+
+  if ( vvp->offscreen )
+    gtk_style_detach ( GTK_WIDGET(vvp)->style );
+
+  g_hash_table_destroy ( vvp->surfaces_changed );
+  if ( vvp->surfaces_changing )
+    g_hash_table_destroy ( vvp->surfaces_changing );
+  g_static_mutex_free ( &vvp->surfaces_mutex );
 
   if ( vvp->alpha_pixbuf )
     g_object_unref ( G_OBJECT ( vvp->alpha_pixbuf ) );
@@ -893,7 +968,7 @@ void vik_viewport_screen_to_coord ( VikViewport *vvp, int x, int y, VikCoord *co
 
 void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int *x, int *y )
 {
-  static VikCoord tmp;
+  VikCoord tmp;
   g_return_if_fail ( vvp != NULL );
 
   if ( coord->mode != vvp->coord_mode )
@@ -934,6 +1009,96 @@ void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int
   }
 }
 
+/*
+ * Each loop below has the constants of the viewport worked out beforehand
+ *  and no other branches, so the compiler can vectorise it.
+ * The sums are the same as vik_viewport_coord_to_screen(), so the results are too.
+ */
+
+#define COORD_AT(coords,stride,i) ((const VikCoord *) ((const guint8 *) (coords) + (gsize) (i) * (stride)))
+
+static void coords_to_screen_utm ( VikViewport *vvp, const VikCoord *coords, gsize stride, guint n, gint *xs, gint *ys )
+{
+  const gdouble ce = vvp->center.east_west, cn = vvp->center.north_south;
+  const gdouble xmpp = vvp->xmpp, ympp = vvp->ympp;
+  const gdouble zone_width = vvp->utm_zone_width;
+  const gint half_width = vvp->width / 2, half_height = vvp->height / 2;
+  const gint zone = vvp->center.utm_zone;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    const VikCoord *c = COORD_AT(coords, stride, i);
+    xs[i] = ( (c->east_west - ce) / xmpp ) + half_width - (zone - c->utm_zone) * zone_width / xmpp;
+    ys[i] = half_height - ( (c->north_south - cn) / ympp );
+  }
+
+  if ( vvp->one_utm_zone )
+    for ( i = 0; i < n; i++ )
+      if ( COORD_AT(coords, stride, i)->utm_zone != zone )
+        xs[i] = ys[i] = VIK_VIEWPORT_UTM_WRONG_ZONE;
+}
+
+static void coords_to_screen_latlon ( VikViewport *vvp, const VikCoord *coords, gsize stride, guint n, gint *xs, gint *ys )
+{
+  const gdouble clon = vvp->center.east_west, clat = vvp->center.north_south;
+  const gdouble kx = 65536.0 / 180 / vvp->xmpp, ky = 65536.0 / 180 / vvp->ympp;
+  const gint half_width = vvp->width / 2, half_height = vvp->height / 2;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    const VikCoord *c = COORD_AT(coords, stride, i);
+    xs[i] = half_width + (kx * (c->east_west - clon))*256.0;
+    ys[i] = half_height + (ky * (clat - c->north_south))*256.0;
+  }
+}
+
+static void coords_to_screen_mercator ( VikViewport *vvp, const VikCoord *coords, gsize stride, guint n, gint *xs, gint *ys )
+{
+  const gdouble clon = vvp->center.east_west, mclat = MERCLAT(vvp->center.north_south);
+  const gdouble kx = 65536.0 / 180 / vvp->xmpp, ky = 65536.0 / 180 / vvp->ympp;
+  const gint half_width = vvp->width / 2, half_height = vvp->height / 2;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    const VikCoord *c = COORD_AT(coords, stride, i);
+    xs[i] = half_width + (kx * (c->east_west - clon))*256.0;
+    ys[i] = half_height + (ky * (mclat - MERCLAT(c->north_south)))*256.0;
+  }
+}
+
+/**
+ * vik_viewport_coords_to_screen:
+ * @coords: The first of @n coordinates
+ * @stride: Bytes from one coordinate to the next, so they can be part of larger structures
+ * @xs:     Array of @n to fill in
+ * @ys:     Array of @n to fill in
+ *
+ * As vik_viewport_coord_to_screen() for many coordinates at once, but much quicker.
+ * Safe to use from other threads, as long as the viewport is not changed meanwhile.
+ */
+void vik_viewport_coords_to_screen ( VikViewport *vvp, const VikCoord *coords, gsize stride, guint n, gint *xs, gint *ys )
+{
+  guint i;
+  g_return_if_fail ( vvp != NULL );
+
+  for ( i = 0; i < n; i++ )
+    if ( COORD_AT(coords, stride, i)->mode != vvp->coord_mode )
+      break;
+  if ( i < n || vvp->drawmode == VIK_VIEWPORT_DRAWMODE_EXPEDIA ) {
+    // Not worth a special case
+    for ( i = 0; i < n; i++ )
+      vik_viewport_coord_to_screen ( vvp, COORD_AT(coords, stride, i), &xs[i], &ys[i] );
+    return;
+  }
+
+  if ( vvp->coord_mode == VIK_COORD_UTM )
+    coords_to_screen_utm ( vvp, coords, stride, n, xs, ys );
+  else if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_LATLON )
+    coords_to_screen_latlon ( vvp, coords, stride, n, xs, ys );
+  else if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR )
+    coords_to_screen_mercator ( vvp, coords, stride, n, xs, ys );
+}
+
 void a_viewport_clip_line ( gint *x1, gint *y1, gint *x2, gint *y2 )
 {
   if ( *x1 > 20000 || *x1 < -20000 ) {
@@ -1186,25 +1351,320 @@ VikViewportDrawMode vik_viewport_get_drawmode ( VikViewport *vvp )
   return vvp->drawmode;
 }
 
-/******** triggering *******/
-void vik_viewport_set_trigger ( VikViewport *vp, gpointer trigger )
+/******** retained surfaces *******/
+/* What was drawn before a layer, with the copyrights and logos added for it */
+typedef struct {
+  GdkPixmap *pixmap;
+  GSList *copyrights;
+  GSList *logos;
+} ViewportSurface;
+
+static void surface_free ( ViewportSurface *surface )
+{
+  g_object_unref ( G_OBJECT ( surface->pixmap ) );
+  g_slist_foreach ( surface->copyrights, (GFunc)g_free, NULL );
+  g_slist_free ( surface->copyrights );
+  g_slist_free ( surface->logos );
+  g_free ( surface );
+}
+
+static GSList *copyrights_copy ( GSList *copyrights )
 {
-  vp->trigger = trigger;
+  GSList *copy = NULL;
+  for ( ; copyrights; copyrights = copyrights->next )
+    copy = g_slist_prepend ( copy, g_strdup ( copyrights->data ) );
+  return g_slist_reverse ( copy );
 }
 
-gpointer vik_viewport_get_trigger ( VikViewport *vp )
+static void surface_layer_finalized ( VikViewport *vp, GObject *layer )
 {
-  return vp->trigger;
+  g_hash_table_remove ( vp->surfaces, layer );
 }
 
-void vik_viewport_snapshot_save ( VikViewport *vp )
+static void surface_remove ( VikViewport *vp, gpointer layer )
 {
-  gdk_draw_drawable ( vp->snapshot_buffer, vp->background_gc, vp->scr_buffer, 0, 0, 0, 0, -1, -1 );
+  if ( g_hash_table_remove ( vp->surfaces, layer ) )
+    g_object_weak_unref ( G_OBJECT(layer), (GWeakNotify) surface_layer_finalized, vp );
 }
 
-void vik_viewport_snapshot_load ( VikViewport *vp )
+static void surface_weak_unref ( gpointer layer, ViewportSurface *surface, VikViewport *vp )
+{
+  g_object_weak_unref ( G_OBJECT(layer), (GWeakNotify) surface_layer_finalized, vp );
+}
+
+static void surfaces_drop_all ( VikViewport *vp )
+{
+  g_hash_table_foreach ( vp->surfaces, (GHFunc) surface_weak_unref, vp );
+  g_hash_table_remove_all ( vp->surfaces );
+}
+
+/**
+ * vik_viewport_surfaces_drop_all:
+ *
+ * Forget all the surfaces, so that the next drawing starts from scratch.
+ * Needed when something other than the layers changes how they are drawn,
+ *  such as the background or highlight color.
+ */
+void vik_viewport_surfaces_drop_all ( VikViewport *vp )
 {
-  gdk_draw_drawable ( vp->scr_buffer, vp->background_gc, vp->snapshot_buffer, 0, 0, 0, 0, -1, -1 );
+  if ( vp->surfaces )
+    surfaces_drop_all ( vp );
+}
+
+/**
+ * vik_viewport_surfaces_invalidate:
+ * @layer: The layer that needs drawing again
+ *
+ * May be called from any thread.
+ */
+void vik_viewport_surfaces_invalidate ( VikViewport *vp, gpointer layer )
+{
+  g_static_mutex_lock ( &vp->surfaces_mutex );
+  g_hash_table_insert ( vp->surfaces_changed, layer, layer );
+  g_static_mutex_unlock ( &vp->surfaces_mutex );
+}
+
+/**
+ * vik_viewport_surfaces_begin:
+ * @resume: Whether drawing may start from the lowest changed layer
+ *
+ * Start drawing all the layers, keeping a surface for each layer of
+ *  what was drawn before it. When resuming, nothing is drawn until the
+ *  lowest changed layer is reached, which starts from its surface.
+ *
+ * Returns: %TRUE if resuming, which is only possible when some layers
+ *  have changed and the viewport has not moved, zoomed or resized
+ *  since the surfaces were made.
+ */
+gboolean vik_viewport_surfaces_begin ( VikViewport *vp, gboolean resume )
+{
+  if ( ! vp->surfaces )
+    vp->surfaces = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) surface_free );
+
+  g_static_mutex_lock ( &vp->surfaces_mutex );
+  if ( vp->surfaces_changing )
+    g_hash_table_destroy ( vp->surfaces_changing );
+  vp->surfaces_changing = vp->surfaces_changed;
+  vp->surfaces_changed = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  g_static_mutex_unlock ( &vp->surfaces_mutex );
+
+  if ( g_hash_table_size ( vp->surfaces_changing ) == 0 )
+    resume = FALSE;
+
+  if ( ! vik_coord_equals ( &vp->surfaces_center, &vp->center ) ||
+       vp->surfaces_xmpp != vp->xmpp || vp->surfaces_ympp != vp->ympp ||
+       vp->surfaces_width != vp->width || vp->surfaces_height != vp->height ||
+       vp->surfaces_drawmode != vp->drawmode ) {
+    surfaces_drop_all ( vp );
+    vp->surfaces_center = vp->center;
+    vp->surfaces_xmpp = vp->xmpp;
+    vp->surfaces_ympp = vp->ympp;
+    vp->surfaces_width = vp->width;
+    vp->surfaces_height = vp->height;
+    vp->surfaces_drawmode = vp->drawmode;
+    resume = FALSE;
+  }
+
+  vp->surfaces_missing = FALSE;
+  vp->half_drawn = resume;
+  return resume;
+}
+
+/**
+ * vik_viewport_surfaces_end:
+ *
+ * Returns: %FALSE if drawing could not resume at the changed layers,
+ *  in which case everything should be drawn again without resuming.
+ */
+gboolean vik_viewport_surfaces_end ( VikViewport *vp )
+{
+  gboolean ok = ! ( vp->half_drawn || vp->surfaces_missing );
+  vp->half_drawn = FALSE;
+  if ( vp->surfaces_changing ) {
+    g_hash_table_destroy ( vp->surfaces_changing );
+    vp->surfaces_changing = NULL;
+  }
+  return ok;
+}
+
+/**
+ * vik_viewport_surface_reach:
+ * @layer: The layer about to be drawn
+ * @keep:  Whether to keep a surface for the layer (e.g. it is visible)
+ *
+ * Layers containing other layers call this before drawing each of them.
+ * Layers are only drawn when not vik_viewport_get_half_drawn().
+ */
+void vik_viewport_surface_reach ( VikViewport *vp, gpointer layer, gboolean keep )
+{
+  ViewportSurface *surface;
+
+  // Only between vik_viewport_surfaces_begin() and _end()
+  if ( ! vp->surfaces_changing )
+    return;
+
+  if ( vp->half_drawn ) {
+    if ( g_hash_table_lookup ( vp->surfaces_changing, layer ) ) {
+      surface = g_hash_table_lookup ( vp->surfaces, layer );
+      if ( surface ) {
+        gdk_draw_drawable ( vp->scr_buffer, vp->background_gc, surface->pixmap, 0, 0, 0, 0, -1, -1 );
+        // The layers skipped over will not add theirs again
+        vik_viewport_reset_copyrights ( vp );
+        vik_viewport_reset_logos ( vp );
+        vp->copyrights = copyrights_copy ( surface->copyrights );
+        vp->logos = g_slist_copy ( surface->logos );
+        vp->half_drawn = FALSE;
+      }
+      else
+        // Layers below have been skipped, so it must all be drawn again
+        vp->surfaces_missing = TRUE;
+    }
+    return;
+  }
+
+  if ( ! keep ) {
+    // Would be out of date when next wanted
+    surface_remove ( vp, layer );
+    return;
+  }
+
+  surface = g_hash_table_lookup ( vp->surfaces, layer );
+  if ( ! surface ) {
+    surface = g_new0 ( ViewportSurface, 1 );
+    surface->pixmap = gdk_pixmap_new ( vp->scr_buffer, vp->width, vp->height, -1 );
+    g_hash_table_insert ( vp->surfaces, layer, surface );
+    g_object_weak_ref ( G_OBJECT(layer), (GWeakNotify) surface_layer_finalized, vp );
+  }
+  else {
+    g_slist_foreach ( surface->copyrights, (GFunc)g_free, NULL );
+    g_slist_free ( surface->copyrights );
+    g_slist_free ( surface->logos );
+  }
+  gdk_draw_drawable ( surface->pixmap, vp->background_gc, vp->scr_buffer, 0, 0, 0, 0, -1, -1 );
+  surface->copyrights = copyrights_copy ( vp->copyrights );
+  surface->logos = g_slist_copy ( vp->logos );
+}
+
+/******** scrolling *******/
+/**
+ * vik_viewport_scroll_keep:
+ *
+ * Keep what the layers have drawn, before anything is drawn over them,
+ *  so that vik_viewport_scroll() can move it.
+ */
+void vik_viewport_scroll_keep ( VikViewport *vp )
+{
+  gint w = 0, h = 0;
+
+  if ( vp->scroll_buffer )
+    gdk_drawable_get_size ( GDK_DRAWABLE(vp->scroll_buffer), &w, &h );
+  if ( w != vp->width || h != vp->height ) {
+    if ( vp->scroll_buffer )
+      g_object_unref ( G_OBJECT ( vp->scroll_buffer ) );
+    vp->scroll_buffer = gdk_pixmap_new ( vp->scr_buffer, vp->width, vp->height, -1 );
+  }
+  gdk_draw_drawable ( vp->scroll_buffer, vp->background_gc, vp->scr_buffer, 0, 0, 0, 0, -1, -1 );
+  vp->scroll_center = vp->center;
+  vp->scroll_xmpp = vp->xmpp;
+  vp->scroll_ympp = vp->ympp;
+}
+
+/**
+ * vik_viewport_scroll_release:
+ *
+ * Free what was kept by vik_viewport_scroll_keep().
+ */
+void vik_viewport_scroll_release ( VikViewport *vp )
+{
+  if ( vp->scroll_buffer ) {
+    g_object_unref ( G_OBJECT ( vp->scroll_buffer ) );
+    vp->scroll_buffer = NULL;
+  }
+}
+
+/*
+ * Draw the layers for the area @r of the screen only, by making the
+ *  viewport cover just that area while drawing into a pixmap of its size
+ */
+static void scroll_draw_area ( VikViewport *vp, const GdkRectangle *r, VikViewportDrawFunc draw_func, gpointer data )
+{
+  GdkPixmap *buffer = vp->scr_buffer;
+  VikCoord center = vp->center;
+  gint width = vp->width, height = vp->height;
+  // Logos are not deduplicated, so keep those of the whole drawing
+  //  rather than adding them again for every strip
+  GSList *logos = vp->logos;
+
+  vik_viewport_screen_to_coord ( vp, r->x + r->width/2, r->y + r->height/2, &vp->center );
+  vp->width = r->width;
+  vp->height = r->height;
+  vp->scr_buffer = gdk_pixmap_new ( buffer, r->width, r->height, -1 );
+  gdk_draw_rectangle ( vp->scr_buffer, vp->background_gc, TRUE, 0, 0, r->width, r->height );
+
+  vp->logos = NULL;
+  draw_func ( data );
+  vik_viewport_reset_logos ( vp );
+  vp->logos = logos;
+
+  gdk_draw_drawable ( vp->scroll_buffer, vp->background_gc, vp->scr_buffer, 0, 0, r->x, r->y, r->width, r->height );
+  g_object_unref ( G_OBJECT ( vp->scr_buffer ) );
+  vp->scr_buffer = buffer;
+  vp->center = center;
+  vp->width = width;
+  vp->height = height;
+}
+
+/**
+ * vik_viewport_scroll:
+ * @dx, @dy: Pixels the view has moved by, since the centre was moved by -@dx, -@dy
+ * @draw_func: Draws all the layers, given @data
+ *
+ * Move what was kept by vik_viewport_scroll_keep() and only draw the strips
+ *  uncovered, leaving the result in the viewport (and kept for the next scroll).
+ * Only Mercator and Lat/Lon draw modes can be drawn in pieces like this,
+ *  as otherwise how coordinates are placed depends on the centre.
+ *
+ * Returns: %FALSE if nothing suitable was kept, when the whole viewport needs drawing.
+ */
+gboolean vik_viewport_scroll ( VikViewport *vp, gint dx, gint dy, VikViewportDrawFunc draw_func, gpointer data )
+{
+  GdkRectangle strips[2];
+  gint x, y, i, n = 0;
+
+  if ( ! vp->scroll_buffer || vp->coord_mode != VIK_COORD_LATLON ||
+       ( vp->drawmode != VIK_VIEWPORT_DRAWMODE_MERCATOR && vp->drawmode != VIK_VIEWPORT_DRAWMODE_LATLON ) )
+    return FALSE;
+  if ( ABS(dx) >= vp->width || ABS(dy) >= vp->height || vp->xmpp != vp->scroll_xmpp || vp->ympp != vp->scroll_ympp )
+    return FALSE;
+  gdk_drawable_get_size ( GDK_DRAWABLE(vp->scroll_buffer), &x, &y );
+  if ( x != vp->width || y != vp->height || vp->scroll_center.mode != vp->center.mode )
+    return FALSE;
+
+  // Check the centre moved as expected (allowing for rounding)
+  vik_viewport_coord_to_screen ( vp, &vp->scroll_center, &x, &y );
+  if ( ABS(x - vp->width/2 - dx) > 1 || ABS(y - vp->height/2 - dy) > 1 )
+    return FALSE;
+
+  gdk_draw_drawable ( vp->scroll_buffer, vp->background_gc, vp->scroll_buffer, 0, 0, dx, dy, vp->width, vp->height );
+
+  if ( dx ) {
+    strips[n].x = dx > 0 ? 0 : vp->width + dx;
+    strips[n].y = 0;
+    strips[n].width = ABS(dx);
+    strips[n++].height = vp->height;
+  }
+  if ( dy ) {
+    strips[n].x = dx > 0 ? dx : 0;
+    strips[n].y = dy > 0 ? 0 : vp->height + dy;
+    strips[n].width = vp->width - ABS(dx);
+    strips[n++].height = ABS(dy);
+  }
+  for ( i = 0; i < n; i++ )
+    scroll_draw_area ( vp, &strips[i], draw_func, data );
+
+  vp->scroll_center = vp->center;
+  gdk_draw_drawable ( vp->scr_buffer, vp->background_gc, vp->scroll_buffer, 0, 0, 0, 0, -1, -1 );
+  return TRUE;
 }
 
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn)
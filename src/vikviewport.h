@@ -60,6 +60,7 @@ GType vik_viewport_get_type ();
 
 /* Viking initialization */
 VikViewport *vik_viewport_new ();
+VikViewport *vik_viewport_new_offscreen ( VikViewport *like, gint width, gint height );
 void vik_viewport_configure_manually ( VikViewport *vvp, gint width, guint height ); /* for off-screen viewports */
 gboolean vik_viewport_configure ( VikViewport *vp ); 
 
@@ -67,6 +68,7 @@ gboolean vik_viewport_configure ( VikViewport *vp );
 /* coordinate transformations */
 void vik_viewport_screen_to_coord ( VikViewport *vvp, int x, int y, VikCoord *coord );
 void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int *x, int *y );
+void vik_viewport_coords_to_screen ( VikViewport *vvp, const VikCoord *coords, gsize stride, guint n, gint *xs, gint *ys );
 
 
 /* viewport scale */
@@ -110,11 +112,18 @@ VikViewportDrawMode vik_viewport_get_drawmode ( VikViewport *vvp );
    /* Do not forget to update vik_viewport_get_drawmode_name() if you modify VikViewportDrawMode */
 
 
-/* Triggers */
-void vik_viewport_set_trigger ( VikViewport *vp, gpointer trigger );
-gpointer vik_viewport_get_trigger ( VikViewport *vp );
-void vik_viewport_snapshot_save ( VikViewport *vp );
-void vik_viewport_snapshot_load ( VikViewport *vp );
+/* Retained surfaces for redrawing from a changed layer */
+void vik_viewport_surfaces_drop_all ( VikViewport *vp );
+void vik_viewport_surfaces_invalidate ( VikViewport *vp, gpointer layer );
+gboolean vik_viewport_surfaces_begin ( VikViewport *vp, gboolean resume );
+gboolean vik_viewport_surfaces_end ( VikViewport *vp );
+void vik_viewport_surface_reach ( VikViewport *vp, gpointer layer, gboolean keep );
+
+/* Scrolling what has been drawn while panning */
+typedef void (*VikViewportDrawFunc) ( gpointer data );
+void vik_viewport_scroll_keep ( VikViewport *vp );
+void vik_viewport_scroll_release ( VikViewport *vp );
+gboolean vik_viewport_scroll ( VikViewport *vp, gint dx, gint dy, VikViewportDrawFunc draw_func, gpointer data );
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn);
 gboolean vik_viewport_get_half_drawn( VikViewport *vp );
 
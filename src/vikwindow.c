@@ -32,6 +32,7 @@
 #include "vikgoto.h"
 #include "dems.h"
 #include "mapcache.h"
+#include "dircache.h"
 #include "print.h"
 #include "preferences.h"
 #include "viklayer_defaults.h"
@@ -40,6 +41,7 @@
 #include "garminsymbols.h"
 #include "vikmapslayer.h"
 #include "geonamessearch.h"
+#include "render.h"
 
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
@@ -79,6 +81,7 @@ static const gchar *window_get_filename ( VikWindow *vw );
 static VikWindow *window_new ();
 
 static void draw_update ( VikWindow *vw );
+static void draw_schedule ( VikWindow *vw );
 
 static void newwindow_cb ( GtkAction *a, VikWindow *vw );
 
@@ -182,9 +185,10 @@ struct _VikWindow {
   GtkUIManager *uim;
 
   GThread  *thread;
-  /* half-drawn update */
-  VikLayer *trigger;
-  VikCoord trigger_center;
+  /* Redraw scheduling */
+  guint redraw_source;   /* Pending redraw, or 0 */
+  GTimer *redraw_timer;  /* Since the last redraw started */
+  VikWindowRedrawStats redraw_stats;
 
   /* Store at this level for highlighted selection drawing since it applies to the viewport and the layers panel */
   /* Only one of these items can be selected at the same time */
@@ -356,6 +360,15 @@ static void window_finalize ( GObject *gob )
 
   a_background_remove_window ( vw );
 
+  if ( vw->redraw_source )
+    g_source_remove ( vw->redraw_source );
+  g_timer_destroy ( vw->redraw_timer );
+  if ( vik_debug )
+    g_debug ( "%s: %u redraws requested, %u performed, %.1f ms per frame (max %.1f ms)", __FUNCTION__,
+              vw->redraw_stats.requested, vw->redraw_stats.performed,
+              vw->redraw_stats.performed ? vw->redraw_stats.total_frame * 1000 / vw->redraw_stats.performed : 0.0,
+              vw->redraw_stats.max_frame * 1000 );
+
   G_OBJECT_CLASS(parent_class)->finalize(gob);
 }
 
@@ -488,6 +501,10 @@ static void vik_window_init ( VikWindow *vw )
   vw->draw_image_height = DRAW_IMAGE_DEFAULT_HEIGHT;
   vw->draw_image_save_as_png = DRAW_IMAGE_DEFAULT_SAVE_AS_PNG;
 
+  vw->redraw_source = 0;
+  vw->redraw_timer = g_timer_new ();
+  memset ( &vw->redraw_stats, 0, sizeof(vw->redraw_stats) );
+
   main_vbox = gtk_vbox_new(FALSE, 1);
   gtk_container_add (GTK_CONTAINER (vw), main_vbox);
 
@@ -511,7 +528,8 @@ static void vik_window_init ( VikWindow *vw )
   g_signal_connect_swapped (G_OBJECT(vw->viking_vvp), "button_press_event", G_CALLBACK(draw_click), vw);
   g_signal_connect_swapped (G_OBJECT(vw->viking_vvp), "button_release_event", G_CALLBACK(draw_release), vw);
   g_signal_connect_swapped (G_OBJECT(vw->viking_vvp), "motion_notify_event", G_CALLBACK(draw_mouse_motion), vw);
-  g_signal_connect_swapped (G_OBJECT(vw->viking_vlp), "update", G_CALLBACK(draw_update), vw);
+  // Layer updates are drawn together rather than one after another
+  g_signal_connect_swapped (G_OBJECT(vw->viking_vlp), "update", G_CALLBACK(draw_schedule), vw);
 
   // Allow key presses to be processed anywhere
   g_signal_connect_swapped (G_OBJECT (vw), "key_press_event", G_CALLBACK (key_press_event), vw);
@@ -665,6 +683,39 @@ static void draw_update ( VikWindow *vw )
   draw_sync (vw);
 }
 
+static gboolean draw_scheduled ( VikWindow *vw )
+{
+  vw->redraw_source = 0;
+  draw_update ( vw );
+  return FALSE;
+}
+
+/*
+ * Redraw for layer updates: at most once per redraw interval,
+ *  however many updates arrive in between (e.g. one per downloaded map tile)
+ */
+static void draw_schedule ( VikWindow *vw )
+{
+  gdouble since;
+  guint interval;
+
+  vw->redraw_stats.requested++;
+  if ( vw->redraw_source )
+    return;
+
+  interval = a_vik_get_redraw_interval ();
+  since = g_timer_elapsed ( vw->redraw_timer, NULL ) * 1000;
+  if ( vw->redraw_stats.performed == 0 || since >= interval )
+    vw->redraw_source = gdk_threads_add_idle ( (GSourceFunc) draw_scheduled, vw );
+  else
+    vw->redraw_source = gdk_threads_add_timeout ( interval - (guint) since, (GSourceFunc) draw_scheduled, vw );
+}
+
+const VikWindowRedrawStats *vik_window_get_redraw_stats ( VikWindow *vw )
+{
+  return &vw->redraw_stats;
+}
+
 static void draw_sync ( VikWindow *vw )
 {
   vik_viewport_sync(vw->viking_vvp);
@@ -708,7 +759,8 @@ void vik_window_set_redraw_trigger(VikLayer *vl)
 {
   VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl));
   if (NULL != vw)
-    vw->trigger = vl;
+    // Only this layer and those above it need drawing again
+    vik_viewport_surfaces_invalidate ( vw->viking_vvp, vl );
 }
 
 static void window_configure_event ( VikWindow *vw )
@@ -726,30 +778,71 @@ static void window_configure_event ( VikWindow *vw )
   }
 }
 
-static void draw_redraw ( VikWindow *vw )
+/*
+ * Draw the layers, from the lowest changed one when possible
+ * Returns FALSE if everything needs drawing after all
+ */
+static gboolean draw_layers ( VikWindow *vw, gboolean resume )
 {
-  VikCoord old_center = vw->trigger_center;
-  vw->trigger_center = *(vik_viewport_get_center(vw->viking_vvp));
-  VikLayer *new_trigger = vw->trigger;
-  vw->trigger = NULL;
-  VikLayer *old_trigger = VIK_LAYER(vik_viewport_get_trigger(vw->viking_vvp));
-
-  if ( ! new_trigger )
-    ; /* do nothing -- have to redraw everything. */
-  else if ( (old_trigger != new_trigger) || !vik_coord_equals(&old_center, &vw->trigger_center) || (new_trigger->type == VIK_LAYER_AGGREGATE) )
-    vik_viewport_set_trigger ( vw->viking_vvp, new_trigger ); /* todo: set to half_drawn mode if new trigger is above old */
-  else
-    vik_viewport_set_half_drawn ( vw->viking_vvp, TRUE );
-
-  /* actually draw */
-  vik_viewport_clear ( vw->viking_vvp);
+  if ( ! vik_viewport_surfaces_begin ( vw->viking_vvp, resume ) )
+    vik_viewport_clear ( vw->viking_vvp );
   vik_layers_panel_draw_all ( vw->viking_vlp );
+  return vik_viewport_surfaces_end ( vw->viking_vvp );
+}
+
+/*
+ * Draw what goes over the layers and count the frame
+ */
+static void draw_overlays ( VikWindow *vw )
+{
   vik_viewport_draw_scale ( vw->viking_vvp );
   vik_viewport_draw_copyright ( vw->viking_vvp );
   vik_viewport_draw_centermark ( vw->viking_vvp );
   vik_viewport_draw_logo ( vw->viking_vvp );
 
-  vik_viewport_set_half_drawn ( vw->viking_vvp, FALSE ); /* just in case. */
+  vw->redraw_stats.performed++;
+  vw->redraw_stats.last_frame = g_timer_elapsed ( vw->redraw_timer, NULL );
+  vw->redraw_stats.total_frame += vw->redraw_stats.last_frame;
+  if ( vw->redraw_stats.last_frame > vw->redraw_stats.max_frame )
+    vw->redraw_stats.max_frame = vw->redraw_stats.last_frame;
+}
+
+static void draw_redraw ( VikWindow *vw )
+{
+  // This brings everything up to date, so any scheduled redraw is not needed
+  if ( vw->redraw_source ) {
+    g_source_remove ( vw->redraw_source );
+    vw->redraw_source = 0;
+  }
+  g_timer_start ( vw->redraw_timer );
+
+  /* actually draw */
+  if ( ! draw_layers ( vw, TRUE ) )
+    draw_layers ( vw, FALSE );
+  // While panning keep the layers' picture, to move it for the next motion
+  if ( vw->pan_x != -1 )
+    vik_viewport_scroll_keep ( vw->viking_vvp );
+  draw_overlays ( vw );
+}
+
+/*
+ * Move the picture by the pan since the last drawing
+ *  and only draw the strips uncovered, otherwise draw everything
+ */
+static void draw_pan ( VikWindow *vw, gint dx, gint dy )
+{
+  if ( vw->redraw_source ) {
+    // Layers have changed meanwhile
+    draw_update ( vw );
+    return;
+  }
+  g_timer_start ( vw->redraw_timer );
+  if ( ! vik_viewport_scroll ( vw->viking_vvp, dx, dy, (VikViewportDrawFunc) vik_layers_panel_draw_all, vw->viking_vlp ) ) {
+    draw_update ( vw );
+    return;
+  }
+  draw_overlays ( vw );
+  draw_sync ( vw );
 }
 
 gboolean draw_buf_done = TRUE;
@@ -797,12 +890,14 @@ static void draw_click (VikWindow *vw, GdkEventButton *event)
 static void vik_window_pan_move (VikWindow *vw, GdkEventMotion *event)
 {
   if ( vw->pan_x != -1 ) {
+    gint dx = (gint) event->x - vw->pan_x;
+    gint dy = (gint) event->y - vw->pan_y;
     vik_viewport_set_center_screen ( vw->viking_vvp, vik_viewport_get_width(vw->viking_vvp)/2 - event->x + vw->pan_x,
                                      vik_viewport_get_height(vw->viking_vvp)/2 - event->y + vw->pan_y );
     vw->pan_move = TRUE;
     vw->pan_x = event->x;
     vw->pan_y = event->y;
-    draw_update ( vw );
+    draw_pan ( vw, dx, dy );
   }
 }
 
@@ -884,6 +979,8 @@ static void vik_window_pan_release ( VikWindow *vw, GdkEventButton *event )
                                       vik_viewport_get_height(vw->viking_vvp)/2 - event->y + vw->pan_y );
   vw->pan_move = FALSE;
   vw->pan_x = vw->pan_y = -1;
+  // Everything is drawn again once the panning ends
+  vik_viewport_scroll_release ( vw->viking_vvp );
   draw_update ( vw );
 }
 
@@ -2301,6 +2398,7 @@ static void load_file ( GtkAction *a, VikWindow *vw )
     gtk_file_filter_set_name( filter, _("Viking") );
     gtk_file_filter_add_pattern ( filter, "*.vik" );
     gtk_file_filter_add_pattern ( filter, "*.viking" );
+    gtk_file_filter_add_pattern ( filter, "*.vikb" );
     gtk_file_chooser_add_filter (GTK_FILE_CHOOSER(vw->open_dia), filter);
 
     // NB could have filters for gpspoint (*.gps,*.gpsoint?) + gpsmapper (*.gsm,*.gpsmapper?)
@@ -2384,6 +2482,7 @@ static gboolean save_file_as ( GtkAction *a, VikWindow *vw )
     gtk_file_filter_set_name( filter, _("Viking") );
     gtk_file_filter_add_pattern ( filter, "*.vik" );
     gtk_file_filter_add_pattern ( filter, "*.viking" );
+    gtk_file_filter_add_pattern ( filter, "*.vikb" );
     gtk_file_chooser_add_filter (GTK_FILE_CHOOSER(vw->save_dia), filter);
     // Default to a Viking file
     gtk_file_chooser_set_filter (GTK_FILE_CHOOSER(vw->save_dia), filter);
@@ -2393,7 +2492,7 @@ static gboolean save_file_as ( GtkAction *a, VikWindow *vw )
   }
   // Auto append / replace extension with '.vik' to the suggested file name as it's going to be a Viking File
   gchar* auto_save_name = g_strdup ( window_get_filename ( vw ) );
-  if ( ! check_file_ext ( auto_save_name, ".vik" ) )
+  if ( ! check_file_ext ( auto_save_name, ".vik" ) && ! check_file_ext ( auto_save_name, ".vikb" ) )
     auto_save_name = g_strconcat ( auto_save_name, ".vik", NULL );
 
   gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER(vw->save_dia), auto_save_name);
@@ -2514,6 +2613,8 @@ static void goto_address( GtkAction *a, VikWindow *vw)
 static void mapcache_flush_cb ( GtkAction *a, VikWindow *vw )
 {
   a_mapcache_flush();
+  /* Also notice tiles added to the map directories outside of Viking */
+  a_dircache_flush();
 }
 
 static void layer_defaults_cb ( GtkAction *a, VikWindow *vw )
@@ -2540,6 +2641,8 @@ static void preferences_cb ( GtkAction *a, VikWindow *vw )
   if (wp_icon_size != a_vik_get_use_large_waypoint_icons())
     clear_garmin_icon_syms ();
 
+  // Any preference may change how layers are drawn
+  vik_viewport_surfaces_drop_all ( vw->viking_vvp );
   draw_update ( vw );
 }
 
@@ -2620,11 +2723,6 @@ static void zoom_to_cb ( GtkAction *a, VikWindow *vw )
 
 static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png )
 {
-  /* more efficient way: stuff draws directly to pixbuf (fork viewport) */
-  GdkPixbuf *pixbuf_to_save;
-  gdouble old_xmpp, old_ympp;
-  GError *error = NULL;
-
   GtkWidget *msgbox = gtk_message_dialog_new ( GTK_WINDOW(vw),
                                                GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
                                                GTK_MESSAGE_INFO,
@@ -2642,117 +2740,21 @@ static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h,
   // At least the empty box can give a clue something's going on + the statusbar msg...
   // Windows version under Wine OK!
 
-  /* backup old zoom & set new */
-  old_xmpp = vik_viewport_get_xmpp ( vw->viking_vvp );
-  old_ympp = vik_viewport_get_ympp ( vw->viking_vvp );
-  vik_viewport_set_zoom ( vw->viking_vvp, zoom );
-
-  /* reset width and height: */
-  vik_viewport_configure_manually ( vw->viking_vvp, w, h );
-
-  /* draw all layers */
-  draw_redraw ( vw );
-
-  /* save buffer as file. */
-  pixbuf_to_save = gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap ( vw->viking_vvp )), NULL, 0, 0, 0, 0, w, h);
-  if ( !pixbuf_to_save ) {
-    g_warning("Failed to generate internal pixmap size: %d x %d", w, h);
-    gtk_message_dialog_set_markup ( GTK_MESSAGE_DIALOG(msgbox), _("Failed to generate internal image.\n\nTry creating a smaller image.") );
-    goto cleanup;
-  }
-
-  gdk_pixbuf_save ( pixbuf_to_save, fn, save_as_png ? "png" : "jpeg", &error, NULL );
-  if (error)
-  {
-    g_warning("Unable to write to file %s: %s", fn, error->message );
-    gtk_message_dialog_set_markup ( GTK_MESSAGE_DIALOG(msgbox), _("Failed to generate image file.") );
-    g_error_free (error);
-  }
-  else {
-    // Success
+  /* drawn offscreen, so the window's viewport is untouched */
+  if ( a_render_image_file ( vik_layers_panel_get_top_layer ( vw->viking_vlp ), vw->viking_vvp, fn, w, h, zoom, save_as_png ) )
     gtk_message_dialog_set_markup ( GTK_MESSAGE_DIALOG(msgbox), _("Image file generated.") );
-  }
-  g_object_unref ( G_OBJECT(pixbuf_to_save) );
+  else
+    gtk_message_dialog_set_markup ( GTK_MESSAGE_DIALOG(msgbox), _("Failed to generate image file.") );
 
- cleanup:
   vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, "" );
   gtk_dialog_add_button ( GTK_DIALOG(msgbox), GTK_STOCK_OK, GTK_RESPONSE_OK );
   gtk_dialog_run ( GTK_DIALOG(msgbox) ); // Don't care about the result
-
-  /* pretend like nothing happened ;) */
-  vik_viewport_set_xmpp ( vw->viking_vvp, old_xmpp );
-  vik_viewport_set_ympp ( vw->viking_vvp, old_ympp );
-  vik_viewport_configure ( vw->viking_vvp );
-  draw_update ( vw );
 }
 
 static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png, guint tiles_w, guint tiles_h )
 {
-  gulong size = sizeof(gchar) * (strlen(fn) + 15);
-  gchar *name_of_file = g_malloc ( size );
-  guint x = 1, y = 1;
-  struct UTM utm_orig, utm;
-
-  /* *** copied from above *** */
-  GdkPixbuf *pixbuf_to_save;
-  gdouble old_xmpp, old_ympp;
-  GError *error = NULL;
-
-  /* backup old zoom & set new */
-  old_xmpp = vik_viewport_get_xmpp ( vw->viking_vvp );
-  old_ympp = vik_viewport_get_ympp ( vw->viking_vvp );
-  vik_viewport_set_zoom ( vw->viking_vvp, zoom );
-
-  /* reset width and height: do this only once for all images (same size) */
-  vik_viewport_configure_manually ( vw->viking_vvp, w, h );
-  /* *** end copy from above *** */
-
-  g_assert ( vik_viewport_get_coord_mode ( vw->viking_vvp ) == VIK_COORD_UTM );
-
-  g_mkdir(fn,0777);
-
-  utm_orig = *((const struct UTM *)vik_viewport_get_center ( vw->viking_vvp ));
-
-  for ( y = 1; y <= tiles_h; y++ )
-  {
-    for ( x = 1; x <= tiles_w; x++ )
-    {
-      g_snprintf ( name_of_file, size, "%s%cy%d-x%d.%s", fn, G_DIR_SEPARATOR, y, x, save_as_png ? "png" : "jpg" );
-      utm = utm_orig;
-      if ( tiles_w & 0x1 )
-        utm.easting += ((gdouble)x - ceil(((gdouble)tiles_w)/2)) * (w*zoom);
-      else
-        utm.easting += ((gdouble)x - (((gdouble)tiles_w)+1)/2) * (w*zoom);
-      if ( tiles_h & 0x1 ) /* odd */
-        utm.northing -= ((gdouble)y - ceil(((gdouble)tiles_h)/2)) * (h*zoom);
-      else /* even */
-        utm.northing -= ((gdouble)y - (((gdouble)tiles_h)+1)/2) * (h*zoom);
-
-      /* move to correct place. */
-      vik_viewport_set_center_utm ( vw->viking_vvp, &utm );
-
-      draw_redraw ( vw );
-
-      /* save buffer as file. */
-      pixbuf_to_save = gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap ( vw->viking_vvp )), NULL, 0, 0, 0, 0, w, h);
-      gdk_pixbuf_save ( pixbuf_to_save, name_of_file, save_as_png ? "png" : "jpeg", &error, NULL );
-      if (error)
-      {
-        g_warning("Unable to write to file %s: %s", name_of_file, error->message );
-        g_error_free (error);
-      }
-
-      g_object_unref ( G_OBJECT(pixbuf_to_save) );
-    }
-  }
-
-  vik_viewport_set_center_utm ( vw->viking_vvp, &utm_orig );
-  vik_viewport_set_xmpp ( vw->viking_vvp, old_xmpp );
-  vik_viewport_set_ympp ( vw->viking_vvp, old_ympp );
-  vik_viewport_configure ( vw->viking_vvp );
-  draw_update ( vw );
-
-  g_free ( name_of_file );
+  /* drawn offscreen, with the images saved in parallel */
+  a_render_image_dir ( vik_layers_panel_get_top_layer ( vw->viking_vlp ), vw->viking_vvp, fn, w, h, zoom, save_as_png, tiles_w, tiles_h );
 }
 
 static void draw_to_image_file_current_window_cb(GtkWidget* widget,GdkEventButton *event,gpointer *pass_along)
@@ -3102,6 +3104,7 @@ static void set_draw_highlight ( GtkAction *a, VikWindow *vw )
   g_assert(check_box);
   gboolean state = gtk_check_menu_item_get_active ( GTK_CHECK_MENU_ITEM(check_box));
   vik_viewport_set_draw_highlight (  vw->viking_vvp, state );
+  vik_viewport_surfaces_drop_all ( vw->viking_vvp );
   draw_update ( vw );
 }
 
@@ -3115,6 +3118,7 @@ static void set_bg_color ( GtkAction *a, VikWindow *vw )
   {
     gtk_color_selection_get_current_color ( GTK_COLOR_SELECTION(GTK_COLOR_SELECTION_DIALOG(colorsd)->colorsel), color );
     vik_viewport_set_background_gdkcolor ( vw->viking_vvp, color );
+    vik_viewport_surfaces_drop_all ( vw->viking_vvp );
     draw_update ( vw );
   }
   g_free ( color );
@@ -3131,6 +3135,7 @@ static void set_highlight_color ( GtkAction *a, VikWindow *vw )
   {
     gtk_color_selection_get_current_color ( GTK_COLOR_SELECTION(GTK_COLOR_SELECTION_DIALOG(colorsd)->colorsel), color );
     vik_viewport_set_highlight_gdkcolor ( vw->viking_vvp, color );
+    vik_viewport_surfaces_drop_all ( vw->viking_vvp );
     draw_update ( vw );
   }
   g_free ( color );
@@ -67,6 +67,26 @@ void vik_window_signal_statusbar_update (VikWindow *vw, const gchar* message, vi
 
 void vik_window_set_redraw_trigger(struct _VikLayer *vl);
 
+/**
+ * VikWindowRedrawStats:
+ * @requested: redraws asked for by layer updates
+ * @performed: redraws of the viewport actually done, for any reason
+ * @last_frame: seconds taken by the last redraw
+ * @max_frame: seconds taken by the longest redraw
+ * @total_frame: seconds taken by all redraws
+ *
+ * Counters of the redraw scheduler.
+ */
+typedef struct {
+  guint requested;
+  guint performed;
+  gdouble last_frame;
+  gdouble max_frame;
+  gdouble total_frame;
+} VikWindowRedrawStats;
+
+const VikWindowRedrawStats *vik_window_get_redraw_stats ( VikWindow *vw );
+
 void vik_window_enable_layer_tool ( VikWindow *vw, gint layer_id, gint tool_id );
 
 gpointer vik_window_get_selected_trw_layer ( VikWindow *vw ); /* return type VikTrwLayer */
@@ -0,0 +1,295 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <glib.h>
+#include "vikwritebuf.h"
+#include "coords.h"
+#include "util.h"
+
+/*
+ * Text output for the file writers, built up in memory and written out
+ *  in large blocks, rather than a small printf and allocation per value.
+ */
+
+/* Write out to the file once this much is buffered */
+#define WRITE_BUF_FLUSH_SIZE (256*1024)
+#define WRITE_BUF_NO_DAY G_MINLONG
+
+struct _VikWriteBuf {
+  GString *str;
+  FILE *file;  /* NULL when only kept in memory */
+  glong day;   /* Days since 1970 of date[] */
+  gchar date[16];
+};
+
+/**
+ * vik_write_buf_new:
+ * @f: File to write to, or NULL to only collect the text
+ */
+VikWriteBuf *vik_write_buf_new ( FILE *f )
+{
+  VikWriteBuf *wb = g_new ( VikWriteBuf, 1 );
+  wb->str = g_string_sized_new ( f ? WRITE_BUF_FLUSH_SIZE + 4096 : 4096 );
+  wb->file = f;
+  wb->day = WRITE_BUF_NO_DAY;
+  wb->date[0] = '\0';
+  return wb;
+}
+
+/**
+ * vik_write_buf_free:
+ *
+ * Writes out anything remaining to the file first.
+ */
+void vik_write_buf_free ( VikWriteBuf *wb )
+{
+  vik_write_buf_flush ( wb );
+  g_string_free ( wb->str, TRUE );
+  g_free ( wb );
+}
+
+/**
+ * vik_write_buf_free_to_string:
+ *
+ * For a buffer made without a file.
+ *
+ * Returns: The text collected, to be freed with g_string_free()
+ */
+GString *vik_write_buf_free_to_string ( VikWriteBuf *wb )
+{
+  GString *str = wb->str;
+  g_free ( wb );
+  return str;
+}
+
+void vik_write_buf_flush ( VikWriteBuf *wb )
+{
+  if ( ! wb->file || wb->str->len == 0 )
+    return;
+  fwrite ( wb->str->str, 1, wb->str->len, wb->file );
+  g_string_truncate ( wb->str, 0 );
+}
+
+static inline void write_buf_check ( VikWriteBuf *wb )
+{
+  if ( wb->file && wb->str->len >= WRITE_BUF_FLUSH_SIZE )
+    vik_write_buf_flush ( wb );
+}
+
+void vik_write_buf_append ( VikWriteBuf *wb, const gchar *s )
+{
+  g_string_append ( wb->str, s );
+  write_buf_check ( wb );
+}
+
+/**
+ * vik_write_buf_append_double:
+ *
+ * Without locale and with as few digits as read back the same value,
+ *  see a_coords_dtostr_buffer()
+ */
+void vik_write_buf_append_double ( VikWriteBuf *wb, gdouble d )
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  a_coords_dtostr_buffer ( d, buf );
+  g_string_append ( wb->str, buf );
+  write_buf_check ( wb );
+}
+
+void vik_write_buf_append_int ( VikWriteBuf *wb, glong i )
+{
+  gchar buf[24];
+  gchar *p = buf + sizeof(buf);
+  gulong u = i < 0 ? -(gulong)i : (gulong)i;
+
+  *--p = '\0';
+  do {
+    *--p = '0' + u % 10;
+    u /= 10;
+  } while ( u );
+  if ( i < 0 )
+    *--p = '-';
+
+  g_string_append ( wb->str, p );
+  write_buf_check ( wb );
+}
+
+static inline void put_2digits ( gchar *p, guint v )
+{
+  p[0] = '0' + v / 10;
+  p[1] = '0' + v % 10;
+}
+
+/**
+ * vik_write_buf_append_iso8601:
+ *
+ * Same text as g_time_val_to_iso8601() for whole seconds,
+ *  but only works out the date when the day changes, as along a track.
+ */
+void vik_write_buf_append_iso8601 ( VikWriteBuf *wb, time_t t )
+{
+  glong day = (glong) (t / 86400);
+  glong secs = (glong) (t % 86400);
+  gchar hms[10];
+
+  if ( secs < 0 ) {
+    secs += 86400;
+    day--;
+  }
+
+  if ( day != wb->day ) {
+    GDate date;
+    // Julian day 1 is 0001-01-01, 719163 days before 1970-01-01,
+    //  and day 3652059 is 9999-12-31
+    if ( day <= -719163 || day > 3652059 - 719163 ) {
+      GTimeVal tv = { t, 0 };
+      gchar *tmp = g_time_val_to_iso8601 ( &tv );
+      vik_write_buf_append ( wb, tmp );
+      g_free ( tmp );
+      return;
+    }
+    g_date_clear ( &date, 1 );
+    g_date_set_julian ( &date, (guint32) (day + 719163) );
+    g_snprintf ( wb->date, sizeof(wb->date), "%04d-%02d-%02dT",
+                 g_date_get_year ( &date ), g_date_get_month ( &date ), g_date_get_day ( &date ) );
+    wb->day = day;
+  }
+
+  put_2digits ( hms, secs / 3600 );
+  hms[2] = ':';
+  put_2digits ( hms + 3, (secs / 60) % 60 );
+  hms[5] = ':';
+  put_2digits ( hms + 6, secs % 60 );
+  hms[8] = 'Z';
+  hms[9] = '\0';
+
+  g_string_append ( wb->str, wb->date );
+  g_string_append_len ( wb->str, hms, 9 );
+  write_buf_check ( wb );
+}
+
+void vik_write_buf_printf ( VikWriteBuf *wb, const gchar *format, ... )
+{
+  va_list args;
+  va_start ( args, format );
+  g_string_append_vprintf ( wb->str, format, args );
+  va_end ( args );
+  write_buf_check ( wb );
+}
+
+/* Parallel writing of items */
+
+typedef struct {
+  VikWriteBufItemFunc func;
+  gpointer user_data;
+  GMutex *mutex;
+  GCond *cond;
+} WriteBatch;
+
+typedef struct {
+  WriteBatch *batch;
+  gpointer item;
+  VikWriteBuf *wb;
+  gboolean done;
+} WriteJob;
+
+static GThreadPool *write_pool = NULL;
+static GStaticMutex write_pool_mutex = G_STATIC_MUTEX_INIT;
+
+static void write_job_thread ( WriteJob *job, gpointer user_data )
+{
+  WriteBatch *batch = job->batch;
+
+  batch->func ( job->item, job->wb, batch->user_data );
+
+  g_mutex_lock ( batch->mutex );
+  job->done = TRUE;
+  g_cond_signal ( batch->cond );
+  g_mutex_unlock ( batch->mutex );
+}
+
+/**
+ * vik_write_buf_append_items:
+ * @func: Writes one item, must be safe to call from several threads at once
+ *
+ * Writes each of the items in turn, as if calling @func on each.
+ * The items are written into separate buffers spread over all processors,
+ *  which are then added here in order.
+ */
+void vik_write_buf_append_items ( VikWriteBuf *wb, GList *items, VikWriteBufItemFunc func, gpointer user_data )
+{
+  WriteBatch batch;
+  WriteJob *jobs;
+  guint n = g_list_length ( items );
+  guint window, pushed, i;
+
+  if ( n < 2 || ! g_thread_supported () ) {
+    for ( ; items; items = items->next )
+      func ( items->data, wb, user_data );
+    return;
+  }
+
+  g_static_mutex_lock ( &write_pool_mutex );
+  if ( ! write_pool )
+    write_pool = g_thread_pool_new ( (GFunc) write_job_thread, NULL, util_get_number_of_cpus(), FALSE, NULL );
+  g_static_mutex_unlock ( &write_pool_mutex );
+
+  batch.func = func;
+  batch.user_data = user_data;
+  batch.mutex = g_mutex_new ();
+  batch.cond = g_cond_new ();
+
+  jobs = g_new0 ( WriteJob, n );
+  for ( i = 0; i < n; i++, items = items->next ) {
+    jobs[i].batch = &batch;
+    jobs[i].item = items->data;
+  }
+
+  // Only so many items ahead of the one being written out, to limit the memory used
+  window = 2 * util_get_number_of_cpus ();
+  for ( pushed = 0; pushed < n && pushed < window; pushed++ ) {
+    jobs[pushed].wb = vik_write_buf_new ( NULL );
+    g_thread_pool_push ( write_pool, &jobs[pushed], NULL );
+  }
+
+  for ( i = 0; i < n; i++ ) {
+    g_mutex_lock ( batch.mutex );
+    while ( ! jobs[i].done )
+      g_cond_wait ( batch.cond, batch.mutex );
+    g_mutex_unlock ( batch.mutex );
+
+    g_string_append_len ( wb->str, jobs[i].wb->str->str, jobs[i].wb->str->len );
+    write_buf_check ( wb );
+    vik_write_buf_free ( jobs[i].wb );
+
+    if ( pushed < n ) {
+      jobs[pushed].wb = vik_write_buf_new ( NULL );
+      g_thread_pool_push ( write_pool, &jobs[pushed], NULL );
+      pushed++;
+    }
+  }
+
+  g_free ( jobs );
+  g_cond_free ( batch.cond );
+  g_mutex_free ( batch.mutex );
+}
@@ -0,0 +1,47 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef __VIKING_WRITEBUF_H
+#define __VIKING_WRITEBUF_H
+
+#include <stdio.h>
+#include <time.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VikWriteBuf VikWriteBuf;
+
+VikWriteBuf *vik_write_buf_new ( FILE *f );
+void vik_write_buf_free ( VikWriteBuf *wb );
+GString *vik_write_buf_free_to_string ( VikWriteBuf *wb );
+void vik_write_buf_flush ( VikWriteBuf *wb );
+
+void vik_write_buf_append ( VikWriteBuf *wb, const gchar *s );
+void vik_write_buf_append_double ( VikWriteBuf *wb, gdouble d );
+void vik_write_buf_append_int ( VikWriteBuf *wb, glong i );
+void vik_write_buf_append_iso8601 ( VikWriteBuf *wb, time_t t );
+void vik_write_buf_printf ( VikWriteBuf *wb, const gchar *format, ... ) G_GNUC_PRINTF (2, 3);
+
+typedef void (*VikWriteBufItemFunc) ( gpointer item, VikWriteBuf *wb, gpointer user_data );
+
+void vik_write_buf_append_items ( VikWriteBuf *wb, GList *items, VikWriteBufItemFunc func, gpointer user_data );
+
+G_END_DECLS
+
+#endif
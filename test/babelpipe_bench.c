@@ -0,0 +1,150 @@
+/*
+ * Times a round trip of a layer of several long tracks through
+ *  'gpsbabel -i gpx -o gpx', streamed through named pipes, against
+ *  writing a temporary file, running gpsbabel into another one and
+ *  reading that back as was done before.
+ *
+ * Both ways are checked to bring back all the trackpoints.
+ * Skipped when gpsbabel is not in the PATH.
+ *
+ * Usage: babelpipe_bench [points] [tracks]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <babel.h>
+#include <gpx.h>
+#include <viklayer.h>
+
+static VikTrack *make_track ( guint n, guint seed )
+{
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0 + seed * 0.01, 5.0 };
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += g_random_double_range ( -1e-4, 1.1e-4 );
+    ll.lon += g_random_double_range ( -1e-4, 1.1e-4 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->altitude = 1000 + 500 * sin ( i / 5000.0 );
+    tp->timestamp = 1262304000 + seed * 86400 * 30 + i;
+    tp->has_timestamp = TRUE;
+    tp->newsegment = (i % 100000) == 0;
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  return tr;
+}
+
+static void count_points ( gpointer id, VikTrack *trk, gulong *count )
+{
+  *count += vik_track_get_tp_count ( trk );
+}
+
+/* As filters and imports went through temporary files before */
+static gboolean old_round_trip ( const gchar *gpsbabel, VikTrwLayer *vtl, VikTrwLayer *vtl_read )
+{
+  gchar *name_src, *name_dst;
+  gint fd_src = g_file_open_tmp ( "tmp-viking.XXXXXX", &name_src, NULL );
+  gint fd_dst = g_file_open_tmp ( "tmp-viking.XXXXXX", &name_dst, NULL );
+  gchar *args[] = { (gchar *) gpsbabel, "-i", "gpx", "-f", name_src, "-o", "gpx", "-F", name_dst, NULL };
+  gboolean ret = FALSE;
+  FILE *f;
+
+  f = fdopen ( fd_src, "w" );
+  a_gpx_write_file ( vtl, f, NULL );
+  fclose ( f );
+  close ( fd_dst );
+
+  if ( g_spawn_sync ( NULL, args, NULL, G_SPAWN_STDOUT_TO_DEV_NULL, NULL, NULL, NULL, NULL, NULL, NULL ) ) {
+    if ( (f = g_fopen ( name_dst, "r" )) ) {
+      ret = a_gpx_read_file ( vtl_read, f );
+      fclose ( f );
+    }
+  }
+
+  g_remove ( name_src );
+  g_remove ( name_dst );
+  g_free ( name_src );
+  g_free ( name_dst );
+  return ret;
+}
+
+static gboolean pipe_round_trip ( const gchar *gpsbabel, VikTrwLayer *vtl, VikTrwLayer *vtl_read )
+{
+  BabelFeed *feed = a_babel_feed_new ( vtl, NULL );
+  gboolean ret = FALSE;
+
+  if ( feed ) {
+    ret = a_babel_convert_from ( vtl_read, "-i gpx", a_babel_feed_get_filename ( feed ), NULL, NULL, NULL );
+    a_babel_feed_free ( feed );
+  }
+  return ret;
+}
+
+typedef gboolean (*RoundTripFunc) ( const gchar *gpsbabel, VikTrwLayer *vtl, VikTrwLayer *vtl_read );
+
+static gboolean time_round_trip ( const gchar *what, RoundTripFunc func, const gchar *gpsbabel, VikTrwLayer *vtl, guint n )
+{
+  VikLayer *vl_read = vik_layer_create ( VIK_LAYER_TRW, NULL, NULL, 0 );
+  GTimer *timer = g_timer_new ();
+  gulong count = 0;
+  gboolean ok;
+  gdouble secs;
+
+  ok = func ( gpsbabel, vtl, VIK_TRW_LAYER(vl_read) );
+  secs = g_timer_elapsed ( timer, NULL );
+  g_hash_table_foreach ( vik_trw_layer_get_tracks ( VIK_TRW_LAYER(vl_read) ), (GHFunc) count_points, &count );
+
+  printf ( "%-6s %.3fs, %.3f us/point\n", what, secs, secs * 1e6 / n );
+  g_timer_destroy ( timer );
+  g_object_unref ( vl_read );
+
+  if ( !ok || count != n ) {
+    fprintf ( stderr, "%s: read back %lu points, expected %u\n", what, count, n );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint n = argc > 1 ? atoi ( argv[1] ) : 500000;
+  guint tracks = argc > 2 ? atoi ( argv[2] ) : 8;
+  gchar *gpsbabel = g_find_program_in_path ( "gpsbabel" );
+  VikLayer *vl;
+  gboolean ok;
+  guint i;
+
+  if ( !gpsbabel ) {
+    printf ( "gpsbabel not found, skipped\n" );
+    return 0;
+  }
+
+  g_type_init ();
+  g_thread_init ( NULL );
+  a_babel_init ();
+  g_random_set_seed ( 42 );
+
+  vl = vik_layer_create ( VIK_LAYER_TRW, NULL, NULL, 0 );
+  for ( i = 0; i < tracks; i++ ) {
+    gchar *name = g_strdup_printf ( "track %u", i );
+    vik_trw_layer_add_track ( VIK_TRW_LAYER(vl), name, make_track ( n / tracks, i ) );
+    g_free ( name );
+  }
+  n = (n / tracks) * tracks;
+  printf ( "%u points in %u tracks\n", n, tracks );
+
+  ok = time_round_trip ( "files", old_round_trip, gpsbabel, VIK_TRW_LAYER(vl), n );
+  ok = time_round_trip ( "pipes", pipe_round_trip, gpsbabel, VIK_TRW_LAYER(vl), n ) && ok;
+
+  a_babel_uninit ();
+  g_object_unref ( vl );
+  g_free ( gpsbabel );
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+/*
+ * Measures applying DEM elevations to a long synthetic track,
+ *  one point at a time versus the batch API.
+ *
+ * A few SRTM tiles with generated elevations are written to a temporary
+ *  directory and loaded, then a random walk track is made across them.
+ *
+ * Usage: dem_bench [points]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "dems.h"
+
+#define TILES_SIDE 3
+#define SRTM_ROWS 1201
+
+static gchar *write_tile ( const gchar *dir, gint lat, gint lon )
+{
+  gchar *name = g_strdup_printf ( "N%02dE%03d.hgt", lat, lon );
+  gchar *path = g_build_filename ( dir, name, NULL );
+  gint16 *samples = g_new ( gint16, SRTM_ROWS * SRTM_ROWS );
+  gint r, c;
+
+  for ( r = 0; r < SRTM_ROWS; r++ )
+    for ( c = 0; c < SRTM_ROWS; c++ )
+      samples[r * SRTM_ROWS + c] = GINT16_TO_BE ( (gint16) (1000 + 500 * sin ( (lat * SRTM_ROWS + r) / 300.0 ) * cos ( (lon * SRTM_ROWS + c) / 200.0 )) );
+
+  g_file_set_contents ( path, (gchar *) samples, SRTM_ROWS * SRTM_ROWS * sizeof(gint16), NULL );
+  g_free ( samples );
+  g_free ( name );
+  return path;
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint n = argc > 1 ? atoi ( argv[1] ) : 1000000;
+  gchar *name = g_strdup_printf ( "viking-dem-bench-%d", (int) getpid () );
+  gchar *dir = g_build_filename ( g_get_tmp_dir (), name, NULL );
+  GList *files = NULL, *iter;
+  VikCoord *coords = g_new ( VikCoord, n );
+  gint16 *single = g_new ( gint16, n );
+  gint16 *batch = g_new ( gint16, n );
+  struct LatLon ll = { 46.5, 7.5 };
+  GTimer *timer;
+  gdouble t_single, t_batch;
+  guint i, differ = 0;
+  gint lat, lon;
+
+  g_type_init ();
+  g_thread_init ( NULL );
+  g_mkdir_with_parents ( dir, 0777 );
+
+  for ( lat = 45; lat < 45 + TILES_SIDE; lat++ )
+    for ( lon = 6; lon < 6 + TILES_SIDE; lon++ ) {
+      gchar *path = write_tile ( dir, lat, lon );
+      a_dems_load ( path );
+      files = g_list_prepend ( files, path );
+    }
+
+  /* About 10 m between points, bouncing off the edges of the tiles */
+  for ( i = 0; i < n; i++ ) {
+    ll.lat += g_random_double_range ( -0.0001, 0.0001 );
+    ll.lon += g_random_double_range ( -0.0001, 0.0001 );
+    ll.lat = CLAMP ( ll.lat, 45.01, 45 + TILES_SIDE - 0.01 );
+    ll.lon = CLAMP ( ll.lon, 6.01, 6 + TILES_SIDE - 0.01 );
+    vik_coord_load_from_latlon ( &coords[i], VIK_COORD_LATLON, &ll );
+  }
+
+  timer = g_timer_new ();
+  for ( i = 0; i < n; i++ )
+    single[i] = a_dems_get_elev_by_coord ( &coords[i], VIK_DEM_INTERPOL_BEST );
+  t_single = g_timer_elapsed ( timer, NULL );
+
+  g_timer_start ( timer );
+  a_dems_get_elev_by_coords ( coords, n, VIK_DEM_INTERPOL_BEST, batch, NULL );
+  t_batch = g_timer_elapsed ( timer, NULL );
+  g_timer_destroy ( timer );
+
+  for ( i = 0; i < n; i++ )
+    if ( single[i] != batch[i] )
+      differ++;
+
+  printf ( "%u points: one at a time %.3fs, batch %.3fs (%.1fx)\n", n, t_single, t_batch, t_single / t_batch );
+
+  for ( iter = files; iter; iter = iter->next ) {
+    a_dems_unref ( iter->data );
+    g_remove ( iter->data );
+    g_free ( iter->data );
+  }
+  g_list_free ( files );
+  g_rmdir ( dir );
+  g_free ( dir );
+  g_free ( name );
+  g_free ( coords );
+  g_free ( single );
+  g_free ( batch );
+
+  if ( differ ) {
+    fprintf ( stderr, "%u elevations differ\n", differ );
+    return 1;
+  }
+  return 0;
+}
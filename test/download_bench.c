@@ -0,0 +1,155 @@
+/*
+ * Measures parallel tile download throughput against a local stub HTTP server.
+ *
+ * The server answers every request with a small tile after a fixed delay,
+ *  to simulate a high latency link.
+ *
+ * Usage: download_bench [tiles] [latency_ms]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "download.h"
+#include "curl_download.h"
+#include "preferences.h"
+
+static gint latency_ms = 50;
+static gchar tile_data[4096];
+
+static gpointer serve_connection ( gpointer data )
+{
+  int fd = GPOINTER_TO_INT(data);
+  gchar buf[2048];
+  gsize len = 0;
+  ssize_t n;
+
+  /* Just read until the end of the request headers */
+  while ( len < sizeof(buf) - 1 && (n = read ( fd, buf + len, sizeof(buf) - 1 - len )) > 0 ) {
+    len += n;
+    buf[len] = '\0';
+    if ( strstr ( buf, "\r\n\r\n" ) )
+      break;
+  }
+
+  g_usleep ( latency_ms * 1000 );
+
+  gchar *header = g_strdup_printf ( "HTTP/1.1 200 OK\r\nContent-Type: image/png\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", (int)sizeof(tile_data) );
+  if ( write ( fd, header, strlen(header) ) < 0 || write ( fd, tile_data, sizeof(tile_data) ) < 0 )
+    g_warning ( "stub server: write failed" );
+  g_free ( header );
+  close ( fd );
+  return NULL;
+}
+
+static gpointer serve ( gpointer data )
+{
+  int sock = GPOINTER_TO_INT(data);
+  int fd;
+  while ( (fd = accept ( sock, NULL, NULL )) >= 0 )
+    g_thread_create ( serve_connection, GINT_TO_POINTER(fd), FALSE, NULL );
+  return NULL;
+}
+
+static int start_server ( void )
+{
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  int sock = socket ( AF_INET, SOCK_STREAM, 0 );
+
+  memset ( &addr, 0, sizeof(addr) );
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+  addr.sin_port = 0;
+  if ( bind ( sock, (struct sockaddr *)&addr, sizeof(addr) ) != 0 || listen ( sock, 64 ) != 0 ) {
+    perror ( "stub server" );
+    exit ( 1 );
+  }
+  getsockname ( sock, (struct sockaddr *)&addr, &addrlen );
+  g_thread_create ( serve, GINT_TO_POINTER(sock), FALSE, NULL );
+  return ntohs ( addr.sin_port );
+}
+
+static guint finished = 0;
+static guint failed = 0;
+
+static void tile_done ( const gchar *fn, int result, gpointer user_data )
+{
+  finished++;
+  if ( result != 0 )
+    failed++;
+}
+
+static void run ( const gchar *hostname, const gchar *dir, guint tiles, guint connections )
+{
+  DownloadMulti *dm = a_download_multi_new ( connections );
+  GTimer *timer = g_timer_new ();
+  guint next = 0;
+
+  finished = failed = 0;
+  do {
+    while ( next < tiles && a_download_multi_has_free_slot ( dm ) ) {
+      gchar *uri = g_strdup_printf ( "/%d/%d.png", connections, next );
+      gchar *fn = g_strdup_printf ( "%s%c%d-%d.png", dir, G_DIR_SEPARATOR, connections, next );
+      if ( a_download_multi_add ( dm, hostname, uri, fn, NULL, FALSE, tile_done, NULL ) != 0 ) {
+        finished++;
+        failed++;
+      }
+      g_free ( uri );
+      g_free ( fn );
+      next++;
+    }
+  } while ( a_download_multi_wait ( dm, 100 ) > 0 || next < tiles );
+
+  g_timer_stop ( timer );
+  printf ( "%2u connections: %u tiles (%u failed) in %.2f s, %.1f tiles/s\n",
+           connections, finished, failed, g_timer_elapsed ( timer, NULL ), finished / g_timer_elapsed ( timer, NULL ) );
+  g_timer_destroy ( timer );
+  a_download_multi_free ( dm );
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint tiles = (argc > 1) ? atoi ( argv[1] ) : 200;
+  guint connections[] = { 1, 4, 16 };
+  guint i;
+
+  if ( argc > 2 )
+    latency_ms = atoi ( argv[2] );
+
+  g_type_init ();
+  g_thread_init ( NULL );
+  a_preferences_init ();
+  a_download_init ();
+  curl_download_init ();
+
+  memset ( tile_data, 0x55, sizeof(tile_data) );
+  gchar *hostname = g_strdup_printf ( "127.0.0.1:%d", start_server () );
+  gchar *dir = g_build_filename ( g_get_tmp_dir (), "viking-download-bench", NULL );
+  g_mkdir_with_parents ( dir, 0700 );
+
+  printf ( "%u tiles, %d ms latency\n", tiles, latency_ms );
+  for ( i = 0; i < G_N_ELEMENTS(connections); i++ )
+    run ( hostname, dir, tiles, connections[i] );
+
+  /* Tidy up the downloaded tiles */
+  GDir *gdir = g_dir_open ( dir, 0, NULL );
+  const gchar *name;
+  while ( (name = g_dir_read_name ( gdir )) ) {
+    gchar *fn = g_build_filename ( dir, name, NULL );
+    g_remove ( fn );
+    g_free ( fn );
+  }
+  g_dir_close ( gdir );
+  g_rmdir ( dir );
+
+  curl_download_uninit ();
+  g_free ( dir );
+  g_free ( hostname );
+  return 0;
+}
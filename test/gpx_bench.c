@@ -0,0 +1,78 @@
+/*
+ * Measures reading GPX files of one track with increasing numbers of
+ *  trackpoints, which should take about the same time per point.
+ *
+ * The files are generated in the temporary directory.
+ *
+ * Usage: gpx_bench [largest points, up to 5000000]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gpx.h>
+#include <viklayer.h>
+
+static gchar *write_gpx ( guint n )
+{
+  gchar *path = g_strdup_printf ( "%s/gpx_bench_%u.gpx", g_get_tmp_dir(), n );
+  FILE *f = g_fopen ( path, "w" );
+  gchar lat[G_ASCII_DTOSTR_BUF_SIZE], lon[G_ASCII_DTOSTR_BUF_SIZE];
+  guint i;
+
+  fprintf ( f, "<?xml version=\"1.0\"?>\n<gpx version=\"1.0\" creator=\"gpx_bench\">\n<trk><name>bench</name><trkseg>\n" );
+  for ( i = 0; i < n; i++ ) {
+    time_t t = 1262304000 + i;
+    struct tm *tm = gmtime ( &t );
+    g_ascii_formatd ( lat, sizeof(lat), "%.6f", 45.0 + (i % 10000) * 1e-5 );
+    g_ascii_formatd ( lon, sizeof(lon), "%.6f", 5.0 + (i / 10000) * 1e-5 );
+    fprintf ( f, "  <trkpt lat=\"%s\" lon=\"%s\"><ele>%u</ele><time>%04d-%02d-%02dT%02d:%02d:%02dZ</time></trkpt>\n",
+              lat, lon, 200 + i % 300,
+              tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec );
+  }
+  fprintf ( f, "</trkseg></trk>\n</gpx>\n" );
+  fclose ( f );
+  return path;
+}
+
+static void count_points ( gpointer name, VikTrack *trk, gulong *count )
+{
+  *count += vik_track_get_tp_count ( trk );
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint largest = argc > 1 ? atoi ( argv[1] ) : 1000000;
+  static const guint sizes[] = { 10000, 100000, 1000000, 5000000 };
+  guint i;
+
+  g_type_init ();
+
+  for ( i = 0; i < G_N_ELEMENTS(sizes) && sizes[i] <= largest; i++ ) {
+    guint n = sizes[i];
+    gchar *path = write_gpx ( n );
+    FILE *f = g_fopen ( path, "r" );
+    VikLayer *vl = vik_layer_create ( VIK_LAYER_TRW, NULL, NULL, 0 );
+    GTimer *timer = g_timer_new ();
+    gulong count = 0;
+    gdouble secs;
+
+    a_gpx_read_file ( VIK_TRW_LAYER(vl), f );
+    secs = g_timer_elapsed ( timer, NULL );
+    fclose ( f );
+
+    g_hash_table_foreach ( vik_trw_layer_get_tracks ( VIK_TRW_LAYER(vl) ), (GHFunc) count_points, &count );
+    printf ( "%8u points: %.3fs, %.3f us/point\n", n, secs, secs * 1e6 / n );
+    if ( count != n ) {
+      fprintf ( stderr, "read %lu points, expected %u\n", count, n );
+      return 1;
+    }
+
+    g_timer_destroy ( timer );
+    g_object_unref ( vl );
+    g_remove ( path );
+    g_free ( path );
+  }
+  return 0;
+}
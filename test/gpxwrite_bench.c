@@ -0,0 +1,153 @@
+/*
+ * Measures writing a layer of several long tracks as GPX and GPSPoint,
+ *  against writing the same GPX with a printf and allocation per value
+ *  as the writer used to.
+ *
+ * The GPX written is read back to check no trackpoints went missing.
+ * The files are written in the temporary directory.
+ *
+ * Usage: gpxwrite_bench [points] [tracks]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gpx.h>
+#include <gpspoint.h>
+#include <viklayer.h>
+
+static VikTrack *make_track ( guint n, guint seed )
+{
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0 + seed * 0.01, 5.0 };
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += g_random_double_range ( -1e-4, 1.1e-4 );
+    ll.lon += g_random_double_range ( -1e-4, 1.1e-4 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->altitude = 1000 + 500 * sin ( i / 5000.0 );
+    tp->timestamp = 1262304000 + seed * 86400 * 30 + i;
+    tp->has_timestamp = TRUE;
+    tp->newsegment = (i % 100000) == 0;
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  return tr;
+}
+
+/* As GPX trackpoints were written before */
+static void old_write_trackpoint ( VikTrackpoint *tp, FILE *f )
+{
+  struct LatLon ll;
+  gchar *s_lat, *s_lon, *s_alt, *time_iso8601;
+  GTimeVal timestamp;
+
+  vik_coord_to_latlon ( &tp->coord, &ll );
+  s_lat = a_coords_dtostr ( ll.lat );
+  s_lon = a_coords_dtostr ( ll.lon );
+  fprintf ( f, "  <trkpt lat=\"%s\" lon=\"%s\">\n", s_lat, s_lon );
+  g_free ( s_lat );
+  g_free ( s_lon );
+
+  s_alt = a_coords_dtostr ( tp->altitude );
+  fprintf ( f, "    <ele>%s</ele>\n", s_alt );
+  g_free ( s_alt );
+
+  timestamp.tv_sec = tp->timestamp;
+  timestamp.tv_usec = 0;
+  time_iso8601 = g_time_val_to_iso8601 ( &timestamp );
+  fprintf ( f, "    <time>%s</time>\n", time_iso8601 );
+  g_free ( time_iso8601 );
+
+  fprintf ( f, "  </trkpt>\n" );
+}
+
+static void old_write_track ( gpointer id, VikTrack *trk, FILE *f )
+{
+  fprintf ( f, "<trk>\n  <name>%s</name>\n  <trkseg>\n", trk->name );
+  g_list_foreach ( trk->trackpoints, (GFunc) old_write_trackpoint, f );
+  fprintf ( f, "  </trkseg>\n</trk>\n" );
+}
+
+static void count_points ( gpointer id, VikTrack *trk, gulong *count )
+{
+  *count += vik_track_get_tp_count ( trk );
+}
+
+typedef void (*WriteFunc) ( VikTrwLayer *vtl, FILE *f );
+
+static void old_write_file ( VikTrwLayer *vtl, FILE *f )
+{
+  g_hash_table_foreach ( vik_trw_layer_get_tracks ( vtl ), (GHFunc) old_write_track, f );
+}
+
+static void gpx_write_file ( VikTrwLayer *vtl, FILE *f )
+{
+  a_gpx_write_file ( vtl, f, NULL );
+}
+
+static void time_write ( const gchar *what, WriteFunc func, VikTrwLayer *vtl, const gchar *path, guint n )
+{
+  FILE *f = g_fopen ( path, "w" );
+  GTimer *timer = g_timer_new ();
+  gdouble secs;
+  long size;
+
+  func ( vtl, f );
+  fflush ( f );
+  secs = g_timer_elapsed ( timer, NULL );
+  size = ftell ( f );
+  fclose ( f );
+
+  printf ( "%-10s %.3fs, %.3f us/point, %.1f MB/s\n", what, secs, secs * 1e6 / n, size / 1048576.0 / secs );
+  g_timer_destroy ( timer );
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint n = argc > 1 ? atoi ( argv[1] ) : 1000000;
+  guint tracks = argc > 2 ? atoi ( argv[2] ) : 16;
+  gchar *path = g_strdup_printf ( "%s/gpxwrite_bench_%d.gpx", g_get_tmp_dir(), (int) getpid () );
+  VikLayer *vl, *vl_read;
+  gulong count = 0;
+  FILE *f;
+  guint i;
+
+  g_type_init ();
+  g_thread_init ( NULL );
+  g_random_set_seed ( 42 );
+
+  vl = vik_layer_create ( VIK_LAYER_TRW, NULL, NULL, 0 );
+  for ( i = 0; i < tracks; i++ ) {
+    gchar *name = g_strdup_printf ( "track %u", i );
+    vik_trw_layer_add_track ( VIK_TRW_LAYER(vl), name, make_track ( n / tracks, i ) );
+    g_free ( name );
+  }
+  n = (n / tracks) * tracks;
+  printf ( "%u points in %u tracks\n", n, tracks );
+
+  time_write ( "old gpx", old_write_file, VIK_TRW_LAYER(vl), path, n );
+  time_write ( "gpspoint", a_gpspoint_write_file, VIK_TRW_LAYER(vl), path, n );
+  time_write ( "gpx", gpx_write_file, VIK_TRW_LAYER(vl), path, n );
+
+  vl_read = vik_layer_create ( VIK_LAYER_TRW, NULL, NULL, 0 );
+  f = g_fopen ( path, "r" );
+  a_gpx_read_file ( VIK_TRW_LAYER(vl_read), f );
+  fclose ( f );
+  g_hash_table_foreach ( vik_trw_layer_get_tracks ( VIK_TRW_LAYER(vl_read) ), (GHFunc) count_points, &count );
+  if ( count != n ) {
+    fprintf ( stderr, "read back %lu points, expected %u\n", count, n );
+    return 1;
+  }
+
+  g_object_unref ( vl_read );
+  g_object_unref ( vl );
+  g_remove ( path );
+  g_free ( path );
+  return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Compares redrawing a window after a change to its bottom layer, which
+ *  draws every layer, against after a change to its top layer, which
+ *  starts from the surface retained for it.
+ *
+ * Needs a display, as it opens a window.
+ *
+ * Usage: layersurface_bench [points] [redraws]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <gtk/gtk.h>
+#include "viking.h"
+#include "background.h"
+#include "preferences.h"
+#include "viklayer_defaults.h"
+
+static VikLayer *make_layer ( VikWindow *vw, guint n )
+{
+  VikLayer *vl = vik_layer_create ( VIK_LAYER_TRW, vik_window_viewport ( vw ), NULL, FALSE );
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0, 5.0 };
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += g_random_double_range ( -1e-4, 1.05e-4 );
+    ll.lon += g_random_double_range ( -1e-4, 1.05e-4 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  vik_trw_layer_add_track ( VIK_TRW_LAYER(vl), "track", tr );
+  // Appended, so drawn above those added before
+  vik_aggregate_layer_add_layer ( vik_layers_panel_get_top_layer ( vik_window_layers_panel ( vw ) ), vl );
+  return vl;
+}
+
+/* Average seconds a redraw takes after the layer changes */
+static gdouble time_redraws ( VikWindow *vw, VikLayer *vl, guint redraws )
+{
+  const VikWindowRedrawStats *stats = vik_window_get_redraw_stats ( vw );
+  gdouble total = 0;
+  guint i;
+
+  for ( i = 0; i < redraws; i++ ) {
+    guint performed = stats->performed;
+    vik_layer_emit_update ( vl );
+    while ( stats->performed == performed )
+      gtk_main_iteration ();
+    total += stats->last_frame;
+  }
+  return total / redraws;
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint n = argc > 1 ? atoi ( argv[1] ) : 500000;
+  guint redraws = argc > 2 ? atoi ( argv[2] ) : 20;
+  VikLayer *bottom, *top;
+  VikWindow *vw;
+  gdouble t_bottom, t_top;
+
+  g_thread_init ( NULL );
+  gdk_threads_init ();
+  if ( ! gtk_init_check ( &argc, &argv ) ) {
+    printf ( "no display, skipped\n" );
+    return 0;
+  }
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_background_init ();
+  g_random_set_seed ( 42 );
+
+  gdk_threads_enter ();
+  vw = vik_window_new_window ();
+  bottom = make_layer ( vw, n );
+  top = make_layer ( vw, n / 100 );
+  vik_trw_layer_auto_set_view ( VIK_TRW_LAYER(bottom), vik_window_viewport ( vw ) );
+  while ( gtk_events_pending () )
+    gtk_main_iteration ();
+
+  t_bottom = time_redraws ( vw, bottom, redraws );
+  t_top = time_redraws ( vw, top, redraws );
+  gdk_threads_leave ();
+
+  printf ( "%u points below, %u above: bottom changed %.2f ms, top changed %.2f ms per redraw\n",
+           n, n / 100, t_bottom * 1000, t_top * 1000 );
+
+  a_background_uninit ();
+  return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Microbenchmark for the map tile cache.
+ *
+ * Replays a synthetic pan/zoom tile access trace (as generated by
+ *  maps_layer_draw_section) against the previous string keyed FIFO cache
+ *  and against the current a_mapcache implementation.
+ *
+ * Usage: mapcache_bench [passes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include "mapcache.h"
+#include "preferences.h"
+
+typedef struct {
+  gint x, y, scale;
+  gdouble shrink;
+} TileAccess;
+
+/* Viewport of 8x6 tiles, matching a typical window at 256 pixel tiles */
+#define VIEW_W 8
+#define VIEW_H 6
+
+static GArray *make_trace ( guint passes )
+{
+  GArray *trace = g_array_new ( FALSE, FALSE, sizeof(TileAccess) );
+  guint pass;
+  gint step, x, y;
+  for ( pass = 0; pass < passes; pass++ ) {
+    gint scale = 2 + (pass % 3);
+    gdouble shrink = (pass % 2) ? 1.0 : 0.5;
+    /* Pan right, then back left, a tile at a time: hot tiles get revisited */
+    for ( step = -40; step < 40; step++ ) {
+      gint x0 = ABS(step);
+      for ( x = x0; x < x0 + VIEW_W; x++ )
+        for ( y = 0; y < VIEW_H; y++ ) {
+          TileAccess ta = { x, y, scale, shrink };
+          g_array_append_val ( trace, ta );
+        }
+    }
+  }
+  return trace;
+}
+
+/*
+ * Reference copy of the previous cache: string keys and FIFO eviction
+ */
+static GHashTable *old_cache = NULL;
+static GQueue *old_queue = NULL;
+static guint32 old_size = 0;
+static guint32 old_max_size = 0;
+
+static void old_add ( GdkPixbuf *pixbuf, gint x, gint y, gint z, guint8 type, guint zoom, guint8 alpha, gdouble xs, gdouble ys )
+{
+  gchar *key = g_strdup_printf ( "%d-%d-%d-%d-%d-%d-%.3f-%.3f", x, y, z, type, zoom, alpha, xs, ys );
+  g_hash_table_insert ( old_cache, key, g_object_ref(pixbuf) );
+  g_queue_push_tail ( old_queue, key );
+  old_size += gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf) + 100;
+  while ( old_size > old_max_size && g_queue_get_length(old_queue) > 1 ) {
+    gchar *oldkey = g_queue_pop_head ( old_queue );
+    GdkPixbuf *buf = g_hash_table_lookup ( old_cache, oldkey );
+    if ( buf ) {
+      old_size -= gdk_pixbuf_get_rowstride(buf) * gdk_pixbuf_get_height(buf) + 100;
+      g_hash_table_remove ( old_cache, oldkey );
+    }
+  }
+}
+
+static GdkPixbuf *old_get ( gint x, gint y, gint z, guint8 type, guint zoom, guint8 alpha, gdouble xs, gdouble ys )
+{
+  static char key[48];
+  g_snprintf ( key, sizeof(key), "%d-%d-%d-%d-%d-%d-%.3f-%.3f", x, y, z, type, zoom, alpha, xs, ys );
+  return g_hash_table_lookup ( old_cache, key );
+}
+
+static void run_old ( GArray *trace, GdkPixbuf *tile )
+{
+  guint i, hits = 0;
+  GTimer *timer = g_timer_new ();
+  for ( i = 0; i < trace->len; i++ ) {
+    TileAccess *ta = &g_array_index ( trace, TileAccess, i );
+    if ( old_get ( ta->x, ta->y, 0, 13, ta->scale, 255, ta->shrink, ta->shrink ) )
+      hits++;
+    else
+      old_add ( tile, ta->x, ta->y, 0, 13, ta->scale, 255, ta->shrink, ta->shrink );
+  }
+  g_timer_stop ( timer );
+  printf ( "string/FIFO cache: %u lookups, %u hits, %.3f s (%.0f lookups/s)\n",
+           trace->len, hits, g_timer_elapsed ( timer, NULL ), trace->len / g_timer_elapsed ( timer, NULL ) );
+  g_timer_destroy ( timer );
+}
+
+static void run_new ( GArray *trace, GdkPixbuf *tile )
+{
+  guint i, hits = 0;
+  GTimer *timer = g_timer_new ();
+  for ( i = 0; i < trace->len; i++ ) {
+    TileAccess *ta = &g_array_index ( trace, TileAccess, i );
+    GdkPixbuf *pixbuf = a_mapcache_get ( ta->x, ta->y, 0, 13, ta->scale, 255, ta->shrink, ta->shrink );
+    if ( pixbuf ) {
+      hits++;
+      g_object_unref ( pixbuf );
+    }
+    else
+      a_mapcache_add ( tile, ta->x, ta->y, 0, 13, ta->scale, 255, ta->shrink, ta->shrink );
+  }
+  g_timer_stop ( timer );
+  printf ( "binary/LRU cache:  %u lookups, %u hits, %.3f s (%.0f lookups/s)\n",
+           trace->len, hits, g_timer_elapsed ( timer, NULL ), trace->len / g_timer_elapsed ( timer, NULL ) );
+  g_timer_destroy ( timer );
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint passes = (argc > 1) ? atoi ( argv[1] ) : 200;
+
+  g_type_init ();
+  g_thread_init ( NULL );
+
+  a_preferences_init ();
+  a_mapcache_init ();
+
+  GdkPixbuf *tile = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, 256, 256 );
+  GArray *trace = make_trace ( passes );
+
+  /* Both caches get the same memory budget */
+  old_max_size = a_preferences_get ( VIKING_PREFERENCES_NAMESPACE "mapcache_size" )->u * 1024 * 1024;
+  old_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_object_unref );
+  old_queue = g_queue_new ();
+
+  run_old ( trace, tile );
+  run_new ( trace, tile );
+
+  g_queue_free ( old_queue );
+  g_hash_table_destroy ( old_cache );
+  a_mapcache_uninit ();
+  a_preferences_uninit ();
+  g_array_free ( trace, TRUE );
+  g_object_unref ( tile );
+  return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * Compares reading map tiles from Viking's one file per tile cache layout
+ *  against reading them from a single MBTiles file.
+ *
+ * Both stores are filled with the same generated tiles, then every tile is
+ *  looked up and decoded twice: the first pass includes opening the files,
+ *  the second is with the OS caches warm.
+ *
+ * Usage: mbtiles_bench [tiles_per_side]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <sqlite3.h>
+#include "mbtiles.h"
+
+#define ZOOM 10
+#define TILE_ID 13
+
+static gchar *tile_path ( const gchar *dir, gint x, gint y )
+{
+  return g_strdup_printf ( "%s" G_DIR_SEPARATOR_S "t%ds%dz0" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d",
+                           dir, TILE_ID, 17 - ZOOM, x, y );
+}
+
+static void fill_stores ( const gchar *dir, const gchar *mbtiles_file, gint side )
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, 256, 256 );
+  sqlite3 *db;
+  sqlite3_stmt *stmt;
+  gint x, y;
+
+  g_assert ( sqlite3_open ( mbtiles_file, &db ) == SQLITE_OK );
+  sqlite3_exec ( db, "CREATE TABLE tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob);"
+                     "CREATE UNIQUE INDEX tile_index ON tiles (zoom_level, tile_column, tile_row);"
+                     "BEGIN;", NULL, NULL, NULL );
+  sqlite3_prepare_v2 ( db, "INSERT INTO tiles VALUES (?,?,?,?)", -1, &stmt, NULL );
+
+  for ( x = 0; x < side; x++ ) {
+    gchar *path = tile_path ( dir, x, 0 );
+    gchar *xdir = g_path_get_dirname ( path );
+    g_mkdir_with_parents ( xdir, 0777 );
+    g_free ( xdir );
+    g_free ( path );
+
+    for ( y = 0; y < side; y++ ) {
+      gchar *buf;
+      gsize len;
+      /* Vary the content so the tiles aren't all identical */
+      gdk_pixbuf_fill ( pixbuf, (x * 2654435761u) ^ (y * 40503u) );
+      gdk_pixbuf_save_to_buffer ( pixbuf, &buf, &len, "png", NULL, NULL );
+
+      path = tile_path ( dir, x, y );
+      g_file_set_contents ( path, buf, len, NULL );
+      g_free ( path );
+
+      sqlite3_reset ( stmt );
+      sqlite3_bind_int ( stmt, 1, ZOOM );
+      sqlite3_bind_int ( stmt, 2, x );
+      sqlite3_bind_int ( stmt, 3, (1 << ZOOM) - 1 - y );
+      sqlite3_bind_blob ( stmt, 4, buf, len, SQLITE_TRANSIENT );
+      sqlite3_step ( stmt );
+      g_free ( buf );
+    }
+  }
+
+  sqlite3_finalize ( stmt );
+  sqlite3_exec ( db, "COMMIT;", NULL, NULL, NULL );
+  sqlite3_close ( db );
+  g_object_unref ( pixbuf );
+}
+
+/* As the maps layer does: check the tile exists, then load it */
+static gdouble read_dir ( const gchar *dir, gint side )
+{
+  GTimer *timer = g_timer_new ();
+  gdouble elapsed;
+  gint x, y;
+  for ( x = 0; x < side; x++ )
+    for ( y = 0; y < side; y++ ) {
+      gchar *path = tile_path ( dir, x, y );
+      if ( g_file_test ( path, G_FILE_TEST_EXISTS ) ) {
+        GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( path, NULL );
+        g_assert ( pixbuf );
+        g_object_unref ( pixbuf );
+      }
+      g_free ( path );
+    }
+  elapsed = g_timer_elapsed ( timer, NULL );
+  g_timer_destroy ( timer );
+  return elapsed;
+}
+
+static gdouble read_mbtiles ( const gchar *mbtiles_file, gint side )
+{
+  GTimer *timer = g_timer_new ();
+  gdouble elapsed;
+  VikMBTiles *mbt = vik_mbtiles_open ( mbtiles_file );
+  gint x, y;
+  g_assert ( mbt );
+  for ( x = 0; x < side; x++ )
+    for ( y = 0; y < side; y++ ) {
+      GdkPixbuf *pixbuf = vik_mbtiles_get_pixbuf ( mbt, x, y, ZOOM );
+      g_assert ( pixbuf );
+      g_object_unref ( pixbuf );
+    }
+  vik_mbtiles_unref ( mbt );
+  elapsed = g_timer_elapsed ( timer, NULL );
+  g_timer_destroy ( timer );
+  return elapsed;
+}
+
+static void remove_tree ( const gchar *path )
+{
+  GDir *dir = g_dir_open ( path, 0, NULL );
+  if ( dir ) {
+    const gchar *name;
+    while ( (name = g_dir_read_name ( dir )) ) {
+      gchar *child = g_build_filename ( path, name, NULL );
+      remove_tree ( child );
+      g_free ( child );
+    }
+    g_dir_close ( dir );
+  }
+  g_remove ( path );
+}
+
+int main ( int argc, char *argv[] )
+{
+  gint side = argc > 1 ? atoi ( argv[1] ) : 32;
+  gint tiles = side * side;
+  gchar *name = g_strdup_printf ( "viking-mbtiles-bench-%d", (int) getpid () );
+  gchar *root = g_build_filename ( g_get_tmp_dir (), name, NULL );
+  gchar *dir = g_build_filename ( root, "cache", NULL );
+  gchar *mbtiles_file = g_build_filename ( root, "tiles.mbtiles", NULL );
+  gint pass;
+
+  g_type_init ();
+  g_mkdir_with_parents ( dir, 0777 );
+
+  fill_stores ( dir, mbtiles_file, side );
+
+  for ( pass = 0; pass < 2; pass++ ) {
+    gdouble t_dir = read_dir ( dir, side );
+    gdouble t_mbt = read_mbtiles ( mbtiles_file, side );
+    printf ( "%s pass: directory %.0f tiles/s, mbtiles %.0f tiles/s\n",
+             pass ? "warm" : "first", tiles / t_dir, tiles / t_mbt );
+  }
+
+  remove_tree ( root );
+  g_free ( mbtiles_file );
+  g_free ( dir );
+  g_free ( root );
+  g_free ( name );
+  return 0;
+}
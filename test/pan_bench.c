@@ -0,0 +1,159 @@
+/*
+ * Compares panning a large window by drawing everything again for each
+ *  motion, as used to happen, against moving what was drawn and only
+ *  drawing the uncovered strips.
+ *
+ * Needs a display, as it opens a window, and moves the pointer over it.
+ * Draws a TRW layer and a coordinate grid; map and DEM layers would need
+ *  tiles or files, so are not used here.
+ *
+ * Usage: pan_bench [points] [motions] [width] [height]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include "viking.h"
+#include "background.h"
+#include "preferences.h"
+#include "viklayer_defaults.h"
+
+#define PAN_STEP 8
+
+static void add_layers ( VikWindow *vw, guint n )
+{
+  VikAggregateLayer *top = vik_layers_panel_get_top_layer ( vik_window_layers_panel ( vw ) );
+  VikLayer *vl = vik_layer_create ( VIK_LAYER_TRW, vik_window_viewport ( vw ), NULL, FALSE );
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0, 5.0 };
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += g_random_double_range ( -1e-4, 1.05e-4 );
+    ll.lon += g_random_double_range ( -1e-4, 1.05e-4 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  vik_trw_layer_add_track ( VIK_TRW_LAYER(vl), "track", tr );
+  vik_aggregate_layer_add_layer ( top, vik_layer_create ( VIK_LAYER_COORD, vik_window_viewport ( vw ), NULL, FALSE ) );
+  vik_aggregate_layer_add_layer ( top, vl );
+  vik_trw_layer_auto_set_view ( VIK_TRW_LAYER(vl), vik_window_viewport ( vw ) );
+}
+
+static void wait_for_redraw ( VikWindow *vw, guint performed )
+{
+  const VikWindowRedrawStats *stats = vik_window_get_redraw_stats ( vw );
+  while ( stats->performed == performed )
+    gtk_main_iteration ();
+}
+
+/* Average seconds per frame when the centre is moved and everything redrawn */
+static gdouble time_full ( VikWindow *vw, guint motions )
+{
+  const VikWindowRedrawStats *stats = vik_window_get_redraw_stats ( vw );
+  VikViewport *vvp = vik_window_viewport ( vw );
+  gdouble total = 0;
+  guint i;
+
+  for ( i = 0; i < motions; i++ ) {
+    guint performed = stats->performed;
+    vik_viewport_set_center_screen ( vvp, vik_viewport_get_width(vvp)/2 - PAN_STEP, vik_viewport_get_height(vvp)/2 - PAN_STEP/2 );
+    vik_layer_emit_update ( VIK_LAYER(vik_layers_panel_get_top_layer ( vik_window_layers_panel ( vw ) )) );
+    wait_for_redraw ( vw, performed );
+    total += stats->last_frame;
+  }
+  return total / motions;
+}
+
+/* Average seconds per frame when dragging with the middle button */
+static gdouble time_pan ( VikWindow *vw, guint motions )
+{
+  const VikWindowRedrawStats *stats = vik_window_get_redraw_stats ( vw );
+  GtkWidget *widget = GTK_WIDGET(vik_window_viewport ( vw ));
+  GdkEvent event;
+  gdouble total = 0, x = 100, y = 100;
+  gint ox, oy;
+  guint i;
+
+  gdk_window_get_origin ( widget->window, &ox, &oy );
+
+  memset ( &event, 0, sizeof(event) );
+  event.button.type = GDK_BUTTON_PRESS;
+  event.button.window = widget->window;
+  event.button.button = 2;
+  event.button.x = x;
+  event.button.y = y;
+  gtk_widget_event ( widget, &event );
+
+  // The first motion draws everything, then keeps it for the others
+  for ( i = 0; i <= motions; i++ ) {
+    guint performed = stats->performed;
+    x += PAN_STEP;
+    y += PAN_STEP/2;
+    // Motion handling asks where the pointer is, so it has to be moved too
+    gdk_display_warp_pointer ( gdk_display_get_default (), gdk_screen_get_default (), ox + x, oy + y );
+    gdk_flush ();
+    memset ( &event, 0, sizeof(event) );
+    event.motion.type = GDK_MOTION_NOTIFY;
+    event.motion.window = widget->window;
+    event.motion.x = x;
+    event.motion.y = y;
+    event.motion.state = GDK_BUTTON2_MASK;
+    gtk_widget_event ( widget, &event );
+    wait_for_redraw ( vw, performed );
+    if ( i )
+      total += stats->last_frame;
+  }
+
+  memset ( &event, 0, sizeof(event) );
+  event.button.type = GDK_BUTTON_RELEASE;
+  event.button.window = widget->window;
+  event.button.button = 2;
+  event.button.x = x;
+  event.button.y = y;
+  gtk_widget_event ( widget, &event );
+  return total / motions;
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint n = argc > 1 ? atoi ( argv[1] ) : 500000;
+  guint motions = argc > 2 ? atoi ( argv[2] ) : 50;
+  gint width = argc > 3 ? atoi ( argv[3] ) : 3840;
+  gint height = argc > 4 ? atoi ( argv[4] ) : 2160;
+  VikWindow *vw;
+  gdouble t_full, t_pan;
+
+  g_thread_init ( NULL );
+  gdk_threads_init ();
+  if ( ! gtk_init_check ( &argc, &argv ) ) {
+    printf ( "no display, skipped\n" );
+    return 0;
+  }
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_background_init ();
+  g_random_set_seed ( 42 );
+
+  gdk_threads_enter ();
+  vw = vik_window_new_window ();
+  gtk_window_resize ( GTK_WINDOW(vw), width, height );
+  add_layers ( vw, n );
+  while ( gtk_events_pending () )
+    gtk_main_iteration ();
+
+  t_full = time_full ( vw, motions );
+  t_pan = time_pan ( vw, motions );
+  gdk_threads_leave ();
+
+  printf ( "%u points, %dx%d viewport: full redraw %.1f fps, scrolled %.1f fps\n",
+           n, vik_viewport_get_width ( vik_window_viewport ( vw ) ), vik_viewport_get_height ( vik_window_viewport ( vw ) ),
+           1 / t_full, 1 / t_pan );
+
+  a_background_uninit ();
+  return 0;
+}
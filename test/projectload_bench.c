@@ -0,0 +1,134 @@
+/*
+ * Compares loading a project of several long tracks saved as a text .vik
+ *  file against the same project saved in the binary .vikb form,
+ *  and checks both load back all the trackpoints.
+ *
+ * Needs a display, as loading a project sets up a viewport.
+ * The files are written in the temporary directory.
+ *
+ * Usage: projectload_bench [points] [tracks]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include "globals.h"
+#include "preferences.h"
+#include "file.h"
+#include "binfile.h"
+
+static VikTrack *make_track ( guint n, guint seed )
+{
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0 + seed * 0.01, 5.0 };
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += g_random_double_range ( -1e-4, 1.1e-4 );
+    ll.lon += g_random_double_range ( -1e-4, 1.1e-4 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->altitude = 1000 + 500 * sin ( i / 5000.0 );
+    tp->timestamp = 1262304000 + seed * 86400 * 30 + i;
+    tp->has_timestamp = TRUE;
+    tp->newsegment = (i % 100000) == 0;
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  return tr;
+}
+
+static void count_points ( gpointer id, VikTrack *trk, gulong *count )
+{
+  *count += vik_track_get_tp_count ( trk );
+}
+
+static gulong count_layer_points ( VikAggregateLayer *top )
+{
+  const GList *iter;
+  gulong count = 0;
+  for ( iter = vik_aggregate_layer_get_children ( top ); iter; iter = iter->next )
+    if ( VIK_LAYER(iter->data)->type == VIK_LAYER_TRW )
+      g_hash_table_foreach ( vik_trw_layer_get_tracks ( VIK_TRW_LAYER(iter->data) ), (GHFunc) count_points, &count );
+  return count;
+}
+
+static gboolean time_load ( const gchar *what, VikViewport *vvp, const gchar *path, guint n )
+{
+  VikAggregateLayer *top = vik_aggregate_layer_new ();
+  GTimer *timer = g_timer_new ();
+  VikLoadType_t answer;
+  gulong count;
+  gdouble secs;
+  struct stat st;
+
+  answer = a_file_load ( top, vvp, path );
+  secs = g_timer_elapsed ( timer, NULL );
+  g_stat ( path, &st );
+  count = count_layer_points ( top );
+
+  printf ( "%-6s %.3fs, %.3f us/point, %.1f MB\n", what, secs, secs * 1e6 / n, st.st_size / 1048576.0 );
+  g_timer_destroy ( timer );
+  g_object_unref ( top );
+
+  if ( answer != LOAD_TYPE_VIK_SUCCESS || count != n ) {
+    fprintf ( stderr, "%s: loaded %lu points, expected %u\n", what, count, n );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint n = argc > 1 ? atoi ( argv[1] ) : 2000000;
+  guint tracks = argc > 2 ? atoi ( argv[2] ) : 20;
+  gchar *vik_path = g_strdup_printf ( "%s/projectload_bench_%d.vik", g_get_tmp_dir(), (int) getpid () );
+  gchar *bin_path = g_strdup_printf ( "%s/projectload_bench_%d" BINFILE_EXT, g_get_tmp_dir(), (int) getpid () );
+  VikAggregateLayer *top;
+  VikViewport *vvp;
+  VikLayer *vl;
+  gboolean ok;
+  guint i;
+
+  if ( ! gtk_init_check ( &argc, &argv ) ) {
+    printf ( "no display, skipped\n" );
+    return 0;
+  }
+  a_preferences_init ();
+  a_vik_preferences_init ();
+
+  vvp = vik_viewport_new ();
+  g_random_set_seed ( 42 );
+
+  top = vik_aggregate_layer_new ();
+  vl = vik_layer_create ( VIK_LAYER_TRW, vvp, NULL, FALSE );
+  for ( i = 0; i < tracks; i++ ) {
+    gchar *name = g_strdup_printf ( "track %u", i );
+    vik_trw_layer_add_track ( VIK_TRW_LAYER(vl), name, make_track ( n / tracks, i ) );
+    g_free ( name );
+  }
+  vik_aggregate_layer_add_layer ( top, vl );
+  n = (n / tracks) * tracks;
+  printf ( "%u points in %u tracks\n", n, tracks );
+
+  // Made once and converted, as a user would
+  a_file_save ( top, vvp, vik_path );
+  g_object_unref ( top );
+  if ( ! a_file_convert ( vik_path, bin_path ) ) {
+    fprintf ( stderr, "converting to %s failed\n", bin_path );
+    return 1;
+  }
+
+  ok = time_load ( "text", vvp, vik_path, n );
+  ok = time_load ( "binary", vvp, bin_path, n ) && ok;
+
+  g_remove ( vik_path );
+  g_remove ( bin_path );
+  g_free ( vik_path );
+  g_free ( bin_path );
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/*
+ * Sends a storm of layer updates from a background thread, as a bulk
+ *  map download does, and reports how many redraws of the window
+ *  were asked for and how many were actually done.
+ *
+ * Needs a display, as it opens a window.
+ *
+ * Usage: redraw_bench [updates] [tracks]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <gtk/gtk.h>
+#include "viking.h"
+#include "background.h"
+#include "preferences.h"
+#include "viklayer_defaults.h"
+
+static VikTrack *make_track ( guint n, guint seed )
+{
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0 + seed * 0.001, 5.0 };
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += g_random_double_range ( -1e-4, 1.1e-4 );
+    ll.lon += g_random_double_range ( -1e-4, 1.1e-4 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  return tr;
+}
+
+typedef struct {
+  VikLayer *vl;
+  guint updates;
+  gint finished;
+} Storm;
+
+static gpointer storm_thread ( Storm *storm )
+{
+  guint i;
+  for ( i = 0; i < storm->updates; i++ ) {
+    vik_layer_emit_update ( storm->vl );
+    g_usleep ( 200 );
+  }
+  g_atomic_int_set ( &storm->finished, TRUE );
+  return NULL;
+}
+
+static gboolean check_finished ( Storm *storm )
+{
+  // Let any last scheduled redraw happen first
+  if ( g_atomic_int_get ( &storm->finished ) && !g_main_context_pending ( NULL ) ) {
+    gtk_main_quit ();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+  Storm storm;
+  guint tracks = argc > 2 ? atoi ( argv[2] ) : 20;
+  const VikWindowRedrawStats *stats;
+  VikWindow *vw;
+  GThread *thread;
+  GTimer *timer;
+  guint requested, performed;
+  gdouble total_frame;
+  guint i;
+
+  g_thread_init ( NULL );
+  gdk_threads_init ();
+  if ( ! gtk_init_check ( &argc, &argv ) ) {
+    printf ( "no display, skipped\n" );
+    return 0;
+  }
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_background_init ();
+  g_random_set_seed ( 42 );
+
+  gdk_threads_enter ();
+  vw = vik_window_new_window ();
+  storm.vl = vik_layer_create ( VIK_LAYER_TRW, vik_window_viewport ( vw ), NULL, FALSE );
+  for ( i = 0; i < tracks; i++ ) {
+    gchar *name = g_strdup_printf ( "track %u", i );
+    vik_trw_layer_add_track ( VIK_TRW_LAYER(storm.vl), name, make_track ( 10000, i ) );
+    g_free ( name );
+  }
+  vik_layers_panel_add_layer ( vik_window_layers_panel ( vw ), storm.vl );
+  vik_trw_layer_auto_set_view ( VIK_TRW_LAYER(storm.vl), vik_window_viewport ( vw ) );
+
+  // Settle the window before counting
+  while ( gtk_events_pending () )
+    gtk_main_iteration ();
+  stats = vik_window_get_redraw_stats ( vw );
+  requested = stats->requested;
+  performed = stats->performed;
+  total_frame = stats->total_frame;
+
+  storm.updates = argc > 1 ? atoi ( argv[1] ) : 2000;
+  storm.finished = FALSE;
+  timer = g_timer_new ();
+  thread = g_thread_create ( (GThreadFunc) storm_thread, &storm, TRUE, NULL );
+  g_timeout_add ( 10, (GSourceFunc) check_finished, &storm );
+  gtk_main ();
+  g_thread_join ( thread );
+
+  requested = stats->requested - requested;
+  performed = stats->performed - performed;
+  printf ( "%u updates in %.3fs: %u redraws requested, %u performed, %.1f ms per frame\n",
+           storm.updates, g_timer_elapsed ( timer, NULL ), requested, performed,
+           performed ? (stats->total_frame - total_frame) * 1000 / performed : 0.0 );
+  g_timer_destroy ( timer );
+
+  gdk_threads_leave ();
+  a_background_uninit ();
+
+  if ( performed == 0 || performed > requested ) {
+    fprintf ( stderr, "expected between 1 and %u redraws\n", requested );
+    return 1;
+  }
+  return 0;
+}
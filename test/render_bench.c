@@ -0,0 +1,143 @@
+/*
+ * Compares saving a directory of images of a layer one after another,
+ *  as the window used to, against a_render_image_dir() which saves each
+ *  image in another thread while drawing the next.
+ * Also checks an image bigger than the chunks it is drawn in can be made.
+ *
+ * Needs a display, but never shows a window.
+ * The images are written in the temporary directory.
+ *
+ * Usage: render_bench [points] [tiles] [size]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include "viking.h"
+#include "preferences.h"
+#include "viklayer_defaults.h"
+#include "render.h"
+
+static VikAggregateLayer *make_layers ( VikViewport *vvp, guint n )
+{
+  VikAggregateLayer *top = vik_aggregate_layer_new ();
+  VikLayer *vl = vik_layer_create ( VIK_LAYER_TRW, vvp, NULL, FALSE );
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0, 5.0 };
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += g_random_double_range ( -1e-4, 1.05e-4 );
+    ll.lon += g_random_double_range ( -1e-4, 1.05e-4 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  vik_trw_layer_add_track ( VIK_TRW_LAYER(vl), "track", tr );
+  vik_aggregate_layer_add_layer ( top, vl );
+  vik_trw_layer_auto_set_view ( VIK_TRW_LAYER(vl), vvp );
+  return top;
+}
+
+static void remove_dir ( const gchar *dirname )
+{
+  GDir *dir = g_dir_open ( dirname, 0, NULL );
+  const gchar *name;
+
+  if ( ! dir )
+    return;
+  while ( ( name = g_dir_read_name ( dir ) ) ) {
+    gchar *path = g_build_filename ( dirname, name, NULL );
+    g_remove ( path );
+    g_free ( path );
+  }
+  g_dir_close ( dir );
+  g_rmdir ( dirname );
+}
+
+/* Each image drawn and then saved before the next, one after another */
+static void save_in_turn ( VikAggregateLayer *top, VikViewport *vvp, const gchar *dirname, guint size, guint tiles )
+{
+  const VikCoord center = *vik_viewport_get_center ( vvp );
+  guint x, y;
+
+  g_mkdir ( dirname, 0777 );
+  for ( y = 1; y <= tiles; y++ ) {
+    for ( x = 1; x <= tiles; x++ ) {
+      gchar *filename = g_strdup_printf ( "%s%cy%d-x%d.png", dirname, G_DIR_SEPARATOR, y, x );
+      GdkPixbuf *pixbuf;
+      VikCoord c;
+
+      vik_viewport_set_center_coord ( vvp, &center );
+      vik_viewport_screen_to_coord ( vvp, vik_viewport_get_width ( vvp )/2 + (gint) ((x - (tiles+1)/2.0) * size),
+                                     vik_viewport_get_height ( vvp )/2 + (gint) ((y - (tiles+1)/2.0) * size), &c );
+      vik_viewport_set_center_coord ( vvp, &c );
+      pixbuf = a_render_pixbuf ( top, vvp, size, size, 0 );
+      gdk_pixbuf_save ( pixbuf, filename, "png", NULL, NULL );
+      g_object_unref ( pixbuf );
+      g_free ( filename );
+    }
+  }
+  vik_viewport_set_center_coord ( vvp, &center );
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint n = argc > 1 ? atoi ( argv[1] ) : 200000;
+  guint tiles = argc > 2 ? atoi ( argv[2] ) : 4;
+  guint size = argc > 3 ? atoi ( argv[3] ) : 1024;
+  gchar *dirname = g_strdup_printf ( "%s/render_bench_%d", g_get_tmp_dir(), (int) getpid () );
+  VikAggregateLayer *top;
+  VikViewport *vvp;
+  GdkPixbuf *pixbuf;
+  GTimer *timer;
+  gdouble t_turn, t_dir;
+  guint failed;
+
+  g_thread_init ( NULL );
+  gdk_threads_init ();
+  if ( ! gtk_init_check ( &argc, &argv ) ) {
+    printf ( "no display, skipped\n" );
+    return 0;
+  }
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  g_random_set_seed ( 42 );
+
+  vvp = vik_viewport_new_offscreen ( NULL, size, size );
+  top = make_layers ( vvp, n );
+  timer = g_timer_new ();
+
+  save_in_turn ( top, vvp, dirname, size, tiles );
+  t_turn = g_timer_elapsed ( timer, NULL );
+  remove_dir ( dirname );
+
+  g_timer_start ( timer );
+  failed = a_render_image_dir ( top, vvp, dirname, size, size, 0, TRUE, tiles, tiles );
+  t_dir = g_timer_elapsed ( timer, NULL );
+  remove_dir ( dirname );
+
+  printf ( "%u points, %ux%u images of %upx: in turn %.3fs, threaded %.3fs\n", n, tiles, tiles, size, t_turn, t_dir );
+  if ( failed ) {
+    fprintf ( stderr, "%u images failed\n", failed );
+    return 1;
+  }
+
+  // Several chunks across and down
+  pixbuf = a_render_pixbuf ( top, vvp, 5000, 3000, 0 );
+  if ( ! pixbuf || gdk_pixbuf_get_width ( pixbuf ) != 5000 || gdk_pixbuf_get_height ( pixbuf ) != 3000 ) {
+    fprintf ( stderr, "5000x3000 image failed\n" );
+    return 1;
+  }
+  g_object_unref ( pixbuf );
+
+  g_timer_destroy ( timer );
+  g_object_unref ( top );
+  g_object_unref ( vvp );
+  g_free ( dirname );
+  return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Compares drawing a long track at several scales using all of its
+ *  trackpoints against its simplified trackpoints.
+ *
+ * As no display is needed, drawing is modelled by projecting each point
+ *  to the screen and counting the lines that would be drawn, skipping
+ *  points on the same pixel as the previous one as the TRW layer does.
+ *
+ * Usage: simplify_bench [points]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <glib.h>
+#include "globals.h"
+#include "viktrack.h"
+
+static VikTrack *make_track ( guint n )
+{
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0, 5.0 };
+  gdouble heading = 0.0;
+  GList *tps = NULL;
+  guint i;
+
+  /* Wandering rather than purely random, more like a real track */
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    heading += g_random_double_range ( -0.3, 0.3 );
+    ll.lat += 5e-5 * cos ( heading );
+    ll.lon += 5e-5 * sin ( heading );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->newsegment = (i % 200000) == 0;
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  return tr;
+}
+
+static guint draw_pass ( GList *list, gdouble mpp )
+{
+  /* Degrees per pixel around 45N */
+  gdouble ypp = mpp / 111000.0, xpp = ypp / cos ( DEG2RAD(45.0) );
+  gint x, y, oldx = G_MININT, oldy = G_MININT;
+  guint lines = 0;
+
+  for ( ; list; list = list->next ) {
+    VikCoord *c = &(VIK_TRACKPOINT(list->data)->coord);
+    x = (gint) ((c->east_west - 5.0) / xpp);
+    y = (gint) ((45.0 - c->north_south) / ypp);
+    if ( x == oldx && y == oldy )
+      continue;
+    if ( ! VIK_TRACKPOINT(list->data)->newsegment )
+      lines++;
+    oldx = x;
+    oldy = y;
+  }
+  return lines;
+}
+
+int main ( int argc, char *argv[] )
+{
+  static const gdouble mpps[] = { 0.5, 2.0, 10.0, 50.0, 250.0, 1000.0 };
+  guint n = argc > 1 ? atoi ( argv[1] ) : 1000000;
+  VikTrack *tr;
+  GTimer *timer;
+  guint i;
+
+  g_random_set_seed ( 42 );
+  tr = make_track ( n );
+  timer = g_timer_new ();
+
+  printf ( "%u points\n", n );
+  printf ( "%8s %10s %10s %10s %10s %10s\n", "m/pixel", "points", "full s", "simple s", "lines", "build s" );
+  for ( i = 0; i < G_N_ELEMENTS(mpps); i++ ) {
+    GList *simple;
+    gdouble t_full, t_simple, t_build;
+    guint lines_full, lines_simple;
+
+    g_timer_start ( timer );
+    lines_full = draw_pass ( tr->trackpoints, mpps[i] );
+    t_full = g_timer_elapsed ( timer, NULL );
+
+    /* The first call at each scale builds what it needs */
+    g_timer_start ( timer );
+    simple = vik_track_get_simplified_trackpoints ( tr, mpps[i] );
+    t_build = g_timer_elapsed ( timer, NULL );
+
+    g_timer_start ( timer );
+    simple = vik_track_get_simplified_trackpoints ( tr, mpps[i] );
+    lines_simple = draw_pass ( simple, mpps[i] );
+    t_simple = g_timer_elapsed ( timer, NULL );
+
+    printf ( "%8.1f %10u %10.4f %10.4f %4u/%-5u %10.4f\n", mpps[i], g_list_length ( simple ),
+             t_full, t_simple, lines_simple, lines_full, t_build );
+  }
+
+  g_timer_destroy ( timer );
+  vik_track_free ( tr );
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Compares finding what is under a click by looking at every item and
+ *  by asking the spatial index, for a layer's worth of waypoints and
+ *  runs of trackpoints, checking both find the same items.
+ *
+ * Usage: spatialindex_bench [waypoints] [tracks]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include "vikspatialindex.h"
+
+#define TRACK_POINTS 1000
+#define CHUNK_POINTS 64
+#define CLICKS 10000
+
+static void count_item ( gpointer item, guint *count )
+{
+  (*count)++;
+}
+
+static void extend ( LatLonBBox *bbox, gdouble lat, gdouble lon )
+{
+  bbox->south = MIN ( bbox->south, lat );
+  bbox->north = MAX ( bbox->north, lat );
+  bbox->west = MIN ( bbox->west, lon );
+  bbox->east = MAX ( bbox->east, lon );
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint n_wps = argc > 1 ? atoi ( argv[1] ) : 50000;
+  guint n_tracks = argc > 2 ? atoi ( argv[2] ) : 2000;
+  GArray *boxes = g_array_new ( FALSE, FALSE, sizeof(LatLonBBox) );
+  VikSpatialIndex *si = vik_spatial_index_new ();
+  GTimer *timer = g_timer_new ();
+  gdouble t_scan, t_index;
+  guint i, j, found_scan = 0, found_index = 0;
+  LatLonBBox *clicks = g_new ( LatLonBBox, CLICKS );
+
+  g_random_set_seed ( 42 );
+
+  /* Spread over a few degrees, like a country's worth of data */
+  for ( i = 0; i < n_wps; i++ ) {
+    LatLonBBox b;
+    b.south = b.north = g_random_double_range ( 44.0, 48.0 );
+    b.west = b.east = g_random_double_range ( 2.0, 8.0 );
+    g_array_append_val ( boxes, b );
+  }
+  for ( i = 0; i < n_tracks; i++ ) {
+    gdouble lat = g_random_double_range ( 44.0, 48.0 ), lon = g_random_double_range ( 2.0, 8.0 );
+    LatLonBBox b = { lat, lat, lon, lon };
+    for ( j = 1; j < TRACK_POINTS; j++ ) {
+      lat += g_random_double_range ( -1e-4, 1e-4 );
+      lon += g_random_double_range ( -1e-4, 1e-4 );
+      extend ( &b, lat, lon );
+      if ( j % CHUNK_POINTS == 0 ) {
+        g_array_append_val ( boxes, b );
+        b.south = b.north = lat;
+        b.west = b.east = lon;
+      }
+    }
+    g_array_append_val ( boxes, b );
+  }
+
+  g_timer_start ( timer );
+  for ( i = 0; i < boxes->len; i++ )
+    vik_spatial_index_insert ( si, GUINT_TO_POINTER(i+1), &g_array_index ( boxes, LatLonBBox, i ) );
+  printf ( "%u items indexed in %.3fs\n", boxes->len, g_timer_elapsed ( timer, NULL ) );
+
+  /* About 10 pixels at a street level zoom */
+  for ( i = 0; i < CLICKS; i++ ) {
+    clicks[i].south = g_random_double_range ( 44.0, 48.0 );
+    clicks[i].north = clicks[i].south + 2e-4;
+    clicks[i].west = g_random_double_range ( 2.0, 8.0 );
+    clicks[i].east = clicks[i].west + 3e-4;
+  }
+
+  g_timer_start ( timer );
+  for ( i = 0; i < CLICKS; i++ )
+    for ( j = 0; j < boxes->len; j++ ) {
+      LatLonBBox *b = &g_array_index ( boxes, LatLonBBox, j );
+      if ( b->south <= clicks[i].north && b->north >= clicks[i].south &&
+           b->west <= clicks[i].east && b->east >= clicks[i].west )
+        found_scan++;
+    }
+  t_scan = g_timer_elapsed ( timer, NULL );
+
+  g_timer_start ( timer );
+  for ( i = 0; i < CLICKS; i++ )
+    vik_spatial_index_query ( si, &clicks[i], (VikSpatialIndexFunc) count_item, &found_index );
+  t_index = g_timer_elapsed ( timer, NULL );
+
+  printf ( "per click: scan %.2f us, index %.2f us, %u items found in all\n",
+           t_scan * 1e6 / CLICKS, t_index * 1e6 / CLICKS, found_index );
+
+  if ( found_scan != found_index ) {
+    fprintf ( stderr, "scan found %u items, index %u\n", found_scan, found_index );
+    return 1;
+  }
+
+  g_free ( clicks );
+  g_timer_destroy ( timer );
+  vik_spatial_index_free ( si );
+  g_array_free ( boxes, TRUE );
+  return 0;
+}
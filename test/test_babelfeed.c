@@ -0,0 +1,214 @@
+/*
+ * Checks GPX passed through the named pipes used with external programs:
+ *  a layer or a track fed to 'cat', whose output is read back through
+ *  the sink pipe, gives back the same points, as the layer was when the
+ *  feed was made. Also that programs which never open the pipes do not
+ *  leave Viking waiting for them.
+ *
+ * Skipped when there is no bash to run the commands.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "babel.h"
+#include "viklayer.h"
+#include "globals.h"
+#include "preferences.h"
+
+/* As babel.c runs shell commands with */
+#define BASH "/bin/bash"
+#define POINTS 5000
+
+static VikTrack *make_track ( guint n, guint seed )
+{
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0 + seed * 0.01, 5.0 };
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += g_random_double_range ( -1e-4, 1.1e-4 );
+    ll.lon += g_random_double_range ( -1e-4, 1.1e-4 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->altitude = 1000 + 500 * sin ( i / 500.0 );
+    tp->timestamp = 1262304000 + seed * 86400 * 30 + i;
+    tp->has_timestamp = TRUE;
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  return tr;
+}
+
+static gboolean tracks_equal ( VikTrack *a, VikTrack *b )
+{
+  GList *ia = a->trackpoints, *ib = b->trackpoints;
+  for ( ; ia && ib; ia = ia->next, ib = ib->next ) {
+    VikTrackpoint *tpa = VIK_TRACKPOINT(ia->data), *tpb = VIK_TRACKPOINT(ib->data);
+    struct LatLon lla, llb;
+    vik_coord_to_latlon ( &tpa->coord, &lla );
+    vik_coord_to_latlon ( &tpb->coord, &llb );
+    if ( lla.lat != llb.lat || lla.lon != llb.lon || tpa->altitude != tpb->altitude ||
+         tpa->has_timestamp != tpb->has_timestamp || tpa->timestamp != tpb->timestamp )
+      return FALSE;
+  }
+  return ! ia && ! ib;
+}
+
+typedef struct {
+  GHashTable *sent;
+  guint found;
+  gboolean ok;
+} Compare;
+
+static void compare_track ( gpointer id, VikTrack *trk, Compare *c )
+{
+  VikTrack *sent = g_hash_table_lookup ( c->sent, trk->name );
+  c->found++;
+  if ( ! sent || ! tracks_equal ( sent, trk ) ) {
+    fprintf ( stderr, "%s read back differently\n", trk->name );
+    c->ok = FALSE;
+  }
+}
+
+static void compare_waypoint ( gpointer id, VikWaypoint *wp, Compare *c )
+{
+  VikWaypoint *sent = g_hash_table_lookup ( c->sent, wp->name );
+  struct LatLon lla, llb;
+  c->found++;
+  if ( sent ) {
+    vik_coord_to_latlon ( &sent->coord, &lla );
+    vik_coord_to_latlon ( &wp->coord, &llb );
+  }
+  if ( ! sent || lla.lat != llb.lat || lla.lon != llb.lon ) {
+    fprintf ( stderr, "%s read back differently\n", wp->name );
+    c->ok = FALSE;
+  }
+}
+
+/* Whether the items read back are those sent, by name */
+static gboolean compare_items ( GHashTable *sent, GHashTable *read, GHFunc compare )
+{
+  Compare c = { sent, 0, TRUE };
+  g_hash_table_foreach ( read, compare, &c );
+  if ( c.found != g_hash_table_size ( sent ) ) {
+    fprintf ( stderr, "%u items read back, %u sent\n", c.found, g_hash_table_size ( sent ) );
+    c.ok = FALSE;
+  }
+  return c.ok;
+}
+
+static void add_by_name ( gpointer id, VikTrack *trk, GHashTable *by_name )
+{
+  g_hash_table_insert ( by_name, trk->name, trk );
+}
+
+static void add_wp_by_name ( gpointer id, VikWaypoint *wp, GHashTable *by_name )
+{
+  g_hash_table_insert ( by_name, wp->name, wp );
+}
+
+/* Runs the command with the feed, reading what it writes into a new layer */
+static VikTrwLayer *run_with_feed ( const gchar *command, BabelFeed *feed, gboolean *ret )
+{
+  VikTrwLayer *vtl_read = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, NULL, FALSE ));
+  gchar *quoted = g_shell_quote ( a_babel_feed_get_filename ( feed ) );
+  gchar *cmd = g_strdup_printf ( command, quoted );
+
+  *ret = a_babel_convert_from_shellcommand ( vtl_read, cmd, NULL, NULL, NULL, NULL );
+  a_babel_feed_free ( feed );
+  g_free ( cmd );
+  g_free ( quoted );
+  return vtl_read;
+}
+
+int main ( int argc, char *argv[] )
+{
+  GHashTable *sent_tracks = g_hash_table_new ( g_str_hash, g_str_equal );
+  GHashTable *sent_routes = g_hash_table_new ( g_str_hash, g_str_equal );
+  GHashTable *sent_waypoints = g_hash_table_new ( g_str_hash, g_str_equal );
+  VikTrwLayer *vtl, *vtl_read;
+  VikTrack *trk;
+  BabelFeed *feed;
+  gboolean ok = TRUE, ret;
+  guint i;
+
+  if ( ! g_file_test ( BASH, G_FILE_TEST_IS_EXECUTABLE ) ) {
+    printf ( "no %s, skipped\n", BASH );
+    return 77;
+  }
+
+  g_type_init ();
+  g_thread_init ( NULL );
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  g_random_set_seed ( 42 );
+
+  // More than a pipe holds, so both ends are written and read as the program runs
+  vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, NULL, FALSE ));
+  for ( i = 0; i < 3; i++ ) {
+    gchar *name = g_strdup_printf ( "track %u", i );
+    vik_trw_layer_add_track ( vtl, name, make_track ( POINTS, i ) );
+    g_free ( name );
+  }
+  trk = make_track ( 50, 3 );
+  trk->is_route = TRUE;
+  vik_trw_layer_add_route ( vtl, "route", trk );
+  for ( i = 0; i < 5; i++ ) {
+    VikWaypoint *wp = vik_waypoint_new ();
+    struct LatLon ll = { 45.0 + i * 1e-3, 5.0 - i * 1e-3 };
+    gchar *name = g_strdup_printf ( "waypoint %u", i );
+    vik_coord_load_from_latlon ( &wp->coord, VIK_COORD_LATLON, &ll );
+    vik_trw_layer_add_waypoint ( vtl, name, wp );
+    g_free ( name );
+  }
+  g_hash_table_foreach ( vik_trw_layer_get_tracks ( vtl ), (GHFunc) add_by_name, sent_tracks );
+  g_hash_table_foreach ( vik_trw_layer_get_routes ( vtl ), (GHFunc) add_by_name, sent_routes );
+  g_hash_table_foreach ( vik_trw_layer_get_waypoints ( vtl ), (GHFunc) add_wp_by_name, sent_waypoints );
+
+  // The layer, with a track added after the feed was made that must not be read back
+  feed = a_babel_feed_new ( vtl, NULL );
+  if ( ! feed ) {
+    fprintf ( stderr, "could not make the feed\n" );
+    return 1;
+  }
+  vik_trw_layer_add_track ( vtl, "added later", make_track ( 10, 4 ) );
+  vtl_read = run_with_feed ( "cat %s", feed, &ret );
+  if ( ! ret ) {
+    fprintf ( stderr, "reading the layer back failed\n" );
+    ok = FALSE;
+  }
+  ok = compare_items ( sent_tracks, vik_trw_layer_get_tracks ( vtl_read ), (GHFunc) compare_track ) && ok;
+  ok = compare_items ( sent_routes, vik_trw_layer_get_routes ( vtl_read ), (GHFunc) compare_track ) && ok;
+  ok = compare_items ( sent_waypoints, vik_trw_layer_get_waypoints ( vtl_read ), (GHFunc) compare_waypoint ) && ok;
+  g_object_unref ( vtl_read );
+
+  // Just a track
+  trk = vik_trw_layer_get_track ( vtl, "track 1" );
+  g_hash_table_remove_all ( sent_tracks );
+  g_hash_table_insert ( sent_tracks, trk->name, trk );
+  vtl_read = run_with_feed ( "cat %s", a_babel_feed_new ( NULL, trk ), &ret );
+  if ( ! ret ) {
+    fprintf ( stderr, "reading the track back failed\n" );
+    ok = FALSE;
+  }
+  ok = compare_items ( sent_tracks, vik_trw_layer_get_tracks ( vtl_read ), (GHFunc) compare_track ) && ok;
+  g_object_unref ( vtl_read );
+
+  // A program that never reads the feed, then one that also never writes its output
+  vtl_read = run_with_feed ( "true %s", a_babel_feed_new ( vtl, NULL ), &ret );
+  g_object_unref ( vtl_read );
+  vtl_read = run_with_feed ( "exit 1; %s", a_babel_feed_new ( vtl, NULL ), &ret );
+  if ( ret || g_hash_table_size ( vik_trw_layer_get_tracks ( vtl_read ) ) ) {
+    fprintf ( stderr, "read something from a program that wrote nothing\n" );
+    ok = FALSE;
+  }
+  g_object_unref ( vtl_read );
+
+  g_hash_table_destroy ( sent_tracks );
+  g_hash_table_destroy ( sent_routes );
+  g_hash_table_destroy ( sent_waypoints );
+  g_object_unref ( vtl );
+  return ok ? 0 : 1;
+}
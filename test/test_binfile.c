@@ -0,0 +1,414 @@
+/*
+ * Checks a project saved in the binary .vikb form loads back the same
+ *  waypoints, tracks and routes, and that damaged files fail to load
+ *  rather than crash or give back bad data: cut short anywhere, with
+ *  the blocks around the cut made to end there too, or with a length
+ *  inside a block running past its end.
+ *
+ * Needs a display, as loading a project sets up a viewport; skipped
+ *  otherwise. The files are written in the temporary directory.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include "viking.h"
+#include "preferences.h"
+#include "file.h"
+#include "binfile.h"
+
+#define POINTS 300
+/* Names whose lengths are damaged in the file */
+#define DAMAGED_NAME "damaged waypoint"
+#define LAYER_NAME "binfile test"
+
+/* The blocks, as laid out in binfile.c */
+#define BLOCK_ALIGN 8
+#define BLOCK_HEADER 16 /* Tag and length */
+#define LAYER_HEADER 8  /* Type and visibility */
+enum { BLOCK_LAYER = 2, BLOCK_TRW_DATA = 4 };
+
+typedef struct {
+  guint32 tag;
+  gsize start; /* Of the header */
+  gsize end;   /* Of the contents */
+} Block;
+
+static VikTrack *make_track ( guint n, gboolean gps_fields )
+{
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0, 5.0 };
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += g_random_double_range ( -1e-4, 1.1e-4 );
+    ll.lon += g_random_double_range ( -1e-4, 1.1e-4 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->altitude = i % 7 ? 1000 + 500 * sin ( i / 50.0 ) : VIK_DEFAULT_ALTITUDE;
+    tp->has_timestamp = i % 5 != 0;
+    tp->timestamp = tp->has_timestamp ? 1262304000 + i : 0;
+    tp->newsegment = (i % 100) == 0;
+    if ( gps_fields && i % 3 ) {
+      tp->speed = i * 0.1;
+      tp->course = i % 360;
+      tp->nsats = i % 12;
+      tp->fix_mode = VIK_GPS_MODE_3D;
+      tp->hdop = 1.5;
+      tp->vdop = 2.5;
+      tp->pdop = 3.5;
+    }
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  return tr;
+}
+
+static VikWaypoint *make_waypoint ( guint i )
+{
+  VikWaypoint *wp = vik_waypoint_new ();
+  struct LatLon ll = { 45.0 + i * 1e-3, 5.0 - i * 1e-3 };
+  vik_coord_load_from_latlon ( &wp->coord, VIK_COORD_LATLON, &ll );
+  wp->altitude = 100.0 * i;
+  wp->visible = i % 2;
+  if ( i % 2 )
+    vik_waypoint_set_comment ( wp, "a comment" );
+  if ( i % 3 )
+    vik_waypoint_set_description ( wp, "a longer description of the waypoint" );
+  vik_waypoint_set_symbol ( wp, i % 4 ? "Flag, Blue" : NULL );
+  return wp;
+}
+
+static VikTrwLayer *make_layer ( VikViewport *vvp )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, vvp, NULL, FALSE ) );
+  VikTrack *tr;
+  guint i;
+
+  for ( i = 0; i < 10; i++ ) {
+    gchar *name = g_strdup_printf ( "waypoint %u", i );
+    vik_trw_layer_add_waypoint ( vtl, name, make_waypoint ( i ) );
+    g_free ( name );
+  }
+  vik_trw_layer_add_waypoint ( vtl, DAMAGED_NAME, make_waypoint ( 10 ) );
+
+  tr = make_track ( POINTS, FALSE );
+  vik_track_set_comment ( tr, "plain" );
+  vik_trw_layer_add_track ( vtl, "plain track", tr );
+  tr = make_track ( POINTS, TRUE );
+  tr->visible = FALSE;
+  vik_trw_layer_add_track ( vtl, "gps track", tr );
+  tr = make_track ( 20, FALSE );
+  tr->is_route = TRUE;
+  vik_trw_layer_add_route ( vtl, "route", tr );
+
+  vik_layer_rename ( VIK_LAYER(vtl), LAYER_NAME );
+  return vtl;
+}
+
+static gboolean str_equal ( const gchar *a, const gchar *b )
+{
+  return a == b || ( a && b && strcmp ( a, b ) == 0 );
+}
+
+static gboolean double_equal ( gdouble a, gdouble b )
+{
+  return a == b || ( isnan ( a ) && isnan ( b ) );
+}
+
+static gboolean trackpoints_equal ( VikTrackpoint *a, VikTrackpoint *b )
+{
+  return memcmp ( &a->coord, &b->coord, sizeof(VikCoord) ) == 0 &&
+         a->newsegment == b->newsegment && a->has_timestamp == b->has_timestamp &&
+         a->timestamp == b->timestamp && a->altitude == b->altitude &&
+         double_equal ( a->speed, b->speed ) && double_equal ( a->course, b->course ) &&
+         a->nsats == b->nsats && a->fix_mode == b->fix_mode &&
+         a->hdop == b->hdop && a->vdop == b->vdop && a->pdop == b->pdop;
+}
+
+static gboolean tracks_equal ( VikTrack *a, VikTrack *b )
+{
+  GList *ia = a->trackpoints, *ib = b->trackpoints;
+  if ( ! str_equal ( a->name, b->name ) || ! str_equal ( a->comment, b->comment ) ||
+       ! str_equal ( a->description, b->description ) ||
+       a->visible != b->visible || a->is_route != b->is_route )
+    return FALSE;
+  for ( ; ia && ib; ia = ia->next, ib = ib->next )
+    if ( ! trackpoints_equal ( VIK_TRACKPOINT(ia->data), VIK_TRACKPOINT(ib->data) ) )
+      return FALSE;
+  return ! ia && ! ib;
+}
+
+static gboolean waypoints_equal ( VikWaypoint *a, VikWaypoint *b )
+{
+  return memcmp ( &a->coord, &b->coord, sizeof(VikCoord) ) == 0 &&
+         a->visible == b->visible && a->altitude == b->altitude &&
+         str_equal ( a->name, b->name ) && str_equal ( a->comment, b->comment ) &&
+         str_equal ( a->description, b->description ) && str_equal ( a->image, b->image ) &&
+         str_equal ( a->symbol, b->symbol );
+}
+
+typedef struct {
+  GHashTable *by_name; /* Of what was saved */
+  gboolean (*equal) ( gpointer a, gpointer b );
+  guint found;
+  gboolean ok;
+} Compare;
+
+static void add_by_name ( gpointer id, VikTrack *trk, GHashTable *by_name )
+{
+  g_hash_table_insert ( by_name, trk->name, trk );
+}
+
+static void add_wp_by_name ( gpointer id, VikWaypoint *wp, GHashTable *by_name )
+{
+  g_hash_table_insert ( by_name, wp->name, wp );
+}
+
+static void compare_track ( gpointer id, VikTrack *trk, Compare *c )
+{
+  VikTrack *saved = g_hash_table_lookup ( c->by_name, trk->name );
+  c->found++;
+  if ( ! saved || ! tracks_equal ( saved, trk ) ) {
+    fprintf ( stderr, "%s loaded differently\n", trk->name );
+    c->ok = FALSE;
+  }
+}
+
+static void compare_waypoint ( gpointer id, VikWaypoint *wp, Compare *c )
+{
+  VikWaypoint *saved = g_hash_table_lookup ( c->by_name, wp->name );
+  c->found++;
+  if ( ! saved || ! waypoints_equal ( saved, wp ) ) {
+    fprintf ( stderr, "%s loaded differently\n", wp->name );
+    c->ok = FALSE;
+  }
+}
+
+/* Whether the items of the loaded layer were all saved the same */
+static gboolean compare_items ( GHashTable *saved, GHashTable *loaded, GHFunc add, GHFunc compare, gboolean all )
+{
+  Compare c = { g_hash_table_new ( g_str_hash, g_str_equal ), NULL, 0, TRUE };
+  g_hash_table_foreach ( saved, add, c.by_name );
+  g_hash_table_foreach ( loaded, compare, &c );
+  if ( all && c.found != g_hash_table_size ( saved ) ) {
+    fprintf ( stderr, "%u items loaded, %u saved\n", c.found, g_hash_table_size ( saved ) );
+    c.ok = FALSE;
+  }
+  g_hash_table_destroy ( c.by_name );
+  return c.ok;
+}
+
+static VikTrwLayer *first_trw ( VikAggregateLayer *top )
+{
+  const GList *iter;
+  for ( iter = vik_aggregate_layer_get_children ( top ); iter; iter = iter->next )
+    if ( VIK_LAYER(iter->data)->type == VIK_LAYER_TRW )
+      return VIK_TRW_LAYER(iter->data);
+  return NULL;
+}
+
+/*
+ * Loads the file and checks what it gives back against vtl.
+ * When @all is FALSE, some items may be missing but none may differ.
+ */
+static VikLoadType_t load_and_compare ( VikViewport *vvp, const gchar *path, VikTrwLayer *vtl, gboolean all, gboolean *same )
+{
+  VikAggregateLayer *top = vik_aggregate_layer_new ();
+  VikLoadType_t answer = a_binfile_read ( top, vvp, path );
+  VikTrwLayer *loaded = first_trw ( top );
+
+  *same = TRUE;
+  if ( loaded ) {
+    *same = compare_items ( vik_trw_layer_get_waypoints ( vtl ), vik_trw_layer_get_waypoints ( loaded ),
+                            (GHFunc) add_wp_by_name, (GHFunc) compare_waypoint, all );
+    *same = compare_items ( vik_trw_layer_get_tracks ( vtl ), vik_trw_layer_get_tracks ( loaded ),
+                            (GHFunc) add_by_name, (GHFunc) compare_track, all ) && *same;
+    *same = compare_items ( vik_trw_layer_get_routes ( vtl ), vik_trw_layer_get_routes ( loaded ),
+                            (GHFunc) add_by_name, (GHFunc) compare_track, all ) && *same;
+  }
+  else if ( all )
+    *same = FALSE;
+  g_object_unref ( top );
+  return answer;
+}
+
+static gboolean save ( VikAggregateLayer *top, VikViewport *vvp, const gchar *path, gchar **contents, gsize *len )
+{
+  FILE *f = g_fopen ( path, "wb" );
+  gboolean ok;
+  if ( ! f )
+    return FALSE;
+  ok = a_binfile_write ( top, vvp, f );
+  fclose ( f );
+  return ok && g_file_get_contents ( path, contents, len, NULL );
+}
+
+/* Finds the blocks from pos up to end, and those within layers */
+static void find_blocks ( const gchar *contents, gsize pos, gsize end, GArray *blocks )
+{
+  guint64 length;
+  Block b;
+
+  for ( pos += (BLOCK_ALIGN - pos % BLOCK_ALIGN) % BLOCK_ALIGN;
+        pos + BLOCK_HEADER <= end;
+        pos += (BLOCK_ALIGN - pos % BLOCK_ALIGN) % BLOCK_ALIGN ) {
+    memcpy ( &b.tag, contents + pos, sizeof(b.tag) );
+    memcpy ( &length, contents + pos + 8, sizeof(length) );
+    b.start = pos;
+    b.end = pos + BLOCK_HEADER + length;
+    g_array_append_val ( blocks, b );
+    if ( b.tag == BLOCK_LAYER )
+      find_blocks ( contents, pos + BLOCK_HEADER + LAYER_HEADER, b.end, blocks );
+    else if ( b.tag == BLOCK_TRW_DATA )
+      find_blocks ( contents, pos + BLOCK_HEADER, b.end, blocks );
+    pos = b.end;
+  }
+}
+
+/*
+ * Writes the file cut short at @cut, with every block the cut falls in
+ *  ending there. Returns whether something is left incomplete, so the
+ *  file must fail to load, rather than just missing the items after.
+ */
+static gboolean write_cut ( const gchar *path, const gchar *contents, gsize cut, GArray *blocks )
+{
+  gchar *data = g_memdup ( contents, cut );
+  gboolean incomplete = FALSE;
+  guint i;
+
+  for ( i = 0; i < blocks->len; i++ ) {
+    Block *b = &g_array_index ( blocks, Block, i );
+    if ( cut <= b->start || cut >= b->end )
+      continue;
+    if ( cut < b->start + BLOCK_HEADER ) {
+      incomplete = TRUE;
+      continue;
+    }
+    {
+      guint64 length = cut - b->start - BLOCK_HEADER;
+      memcpy ( data + b->start + 8, &length, sizeof(length) );
+    }
+    if ( b->tag == BLOCK_LAYER ? cut < b->start + BLOCK_HEADER + LAYER_HEADER : b->tag != BLOCK_TRW_DATA )
+      incomplete = TRUE;
+  }
+  g_file_set_contents ( path, data, cut, NULL );
+  g_free ( data );
+  return incomplete;
+}
+
+/* Whether @cut is close to where a block starts or ends */
+static gboolean near_boundary ( gsize cut, GArray *blocks )
+{
+  guint i;
+  for ( i = 0; i < blocks->len; i++ ) {
+    Block *b = &g_array_index ( blocks, Block, i );
+    if ( cut + 8 > b->start && cut < b->start + BLOCK_HEADER + LAYER_HEADER + 8 )
+      return TRUE;
+    if ( cut + 16 > b->end && cut < b->end + 16 )
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/* Makes the length in front of @name claim to run past the end of the file */
+static gboolean write_damaged ( const gchar *path, const gchar *contents, gsize len, const gchar *name )
+{
+  gchar *data = g_memdup ( contents, len );
+  gint32 huge = 0x7ffffff0;
+  gsize i;
+
+  for ( i = sizeof(huge); i + strlen ( name ) < len; i++ )
+    if ( memcmp ( data + i, name, strlen ( name ) ) == 0 )
+      break;
+  if ( i + strlen ( name ) >= len ) {
+    fprintf ( stderr, "%s is not in the file\n", name );
+    g_free ( data );
+    return FALSE;
+  }
+  memcpy ( data + i - sizeof(huge), &huge, sizeof(huge) );
+  g_file_set_contents ( path, data, len, NULL );
+  g_free ( data );
+  return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+  gchar *path = g_strdup_printf ( "%s/test_binfile_%d" BINFILE_EXT, g_get_tmp_dir(), (int) getpid () );
+  static const gchar *damaged_names[] = { DAMAGED_NAME, LAYER_NAME };
+  GArray *blocks = g_array_new ( FALSE, FALSE, sizeof(Block) );
+  VikAggregateLayer *top;
+  VikViewport *vvp;
+  VikTrwLayer *vtl;
+  gchar *contents, *empty;
+  gsize len, empty_len, cut;
+  gboolean ok = TRUE, same, incomplete;
+  VikLoadType_t answer;
+  guint i;
+
+  if ( ! gtk_init_check ( &argc, &argv ) ) {
+    printf ( "no display, skipped\n" );
+    return 77;
+  }
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  vvp = vik_viewport_new ();
+  g_random_set_seed ( 42 );
+
+  // Just the header and viewport, which come before the layers
+  top = vik_aggregate_layer_new ();
+  if ( ! save ( top, vvp, path, &empty, &empty_len ) ) {
+    fprintf ( stderr, "could not write %s\n", path );
+    return 1;
+  }
+
+  vtl = make_layer ( vvp );
+  vik_aggregate_layer_add_layer ( top, VIK_LAYER(vtl) );
+  if ( ! save ( top, vvp, path, &contents, &len ) ) {
+    fprintf ( stderr, "could not write %s\n", path );
+    return 1;
+  }
+
+  if ( load_and_compare ( vvp, path, vtl, TRUE, &same ) != LOAD_TYPE_VIK_SUCCESS || ! same ) {
+    fprintf ( stderr, "the project did not load back the same\n" );
+    ok = FALSE;
+  }
+
+  // Cut within the layer: at every byte of its start and around each block, else every so often
+  find_blocks ( contents, empty_len, len, blocks );
+  for ( cut = empty_len + 1; cut < len && ok; cut++ ) {
+    if ( cut > empty_len + 2000 && cut % 37 && ! near_boundary ( cut, blocks ) )
+      continue;
+    incomplete = write_cut ( path, contents, cut, blocks );
+    answer = load_and_compare ( vvp, path, vtl, FALSE, &same );
+    if ( ( incomplete && answer == LOAD_TYPE_VIK_SUCCESS ) || ! same ) {
+      fprintf ( stderr, "cut to %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes, the project %s\n",
+                cut, len, same ? "still loaded" : "loaded bad data" );
+      ok = FALSE;
+    }
+  }
+
+  // A waypoint name and the layer name claiming to run past the end of the file
+  for ( i = 0; i < G_N_ELEMENTS(damaged_names); i++ ) {
+    if ( ! write_damaged ( path, contents, len, damaged_names[i] ) ) {
+      ok = FALSE;
+      continue;
+    }
+    if ( load_and_compare ( vvp, path, vtl, FALSE, &same ) == LOAD_TYPE_VIK_SUCCESS || ! same ) {
+      fprintf ( stderr, "with a bad length before %s, the project %s\n",
+                damaged_names[i], same ? "still loaded" : "loaded bad data" );
+      ok = FALSE;
+    }
+  }
+
+  g_remove ( path );
+  g_free ( path );
+  g_free ( contents );
+  g_free ( empty );
+  g_array_free ( blocks, TRUE );
+  g_object_unref ( top );
+  return ok ? 0 : 1;
+}
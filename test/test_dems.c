@@ -0,0 +1,112 @@
+/*
+ * Checks batches of DEM elevations, which are spread over a pool of
+ *  threads when large, give the same as looking up each point in turn,
+ *  with every interpolation method.
+ *
+ * A few SRTM tiles with generated elevations are written to a temporary
+ *  directory and loaded, then points are scattered across them.
+ */
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "dems.h"
+
+#define TILES_SIDE 2
+#define SRTM_ROWS 1201
+/* Several times the chunk each thread is given */
+#define POINTS 200000
+#define RUNS 3
+
+static gchar *write_tile ( const gchar *dir, gint lat, gint lon )
+{
+  gchar *name = g_strdup_printf ( "N%02dE%03d.hgt", lat, lon );
+  gchar *path = g_build_filename ( dir, name, NULL );
+  gint16 *samples = g_new ( gint16, SRTM_ROWS * SRTM_ROWS );
+  gint r, c;
+
+  for ( r = 0; r < SRTM_ROWS; r++ )
+    for ( c = 0; c < SRTM_ROWS; c++ )
+      samples[r * SRTM_ROWS + c] = GINT16_TO_BE ( (gint16) (1000 + 500 * sin ( (lat * SRTM_ROWS + r) / 30.0 ) * cos ( (lon * SRTM_ROWS + c) / 20.0 )) );
+
+  g_file_set_contents ( path, (gchar *) samples, SRTM_ROWS * SRTM_ROWS * sizeof(gint16), NULL );
+  g_free ( samples );
+  g_free ( name );
+  return path;
+}
+
+/* Whether a batch of the first @n points gives the same as each point in turn */
+static gboolean check_batch ( const VikCoord *coords, guint n, VikDemInterpol method )
+{
+  gint16 *single = g_new ( gint16, n );
+  gint16 *batch = g_new ( gint16, n );
+  guint i, run, differ = 0;
+
+  for ( i = 0; i < n; i++ )
+    single[i] = a_dems_get_elev_by_coord ( &coords[i], method );
+
+  // The threads may only get in each other's way now and then
+  for ( run = 0; run < RUNS; run++ ) {
+    a_dems_get_elev_by_coords ( coords, n, method, batch, NULL );
+    for ( i = 0; i < n; i++ )
+      if ( single[i] != batch[i] )
+        differ++;
+  }
+
+  if ( differ )
+    fprintf ( stderr, "%u points, method %d: %u elevations differ\n", n, method, differ );
+  g_free ( single );
+  g_free ( batch );
+  return differ == 0;
+}
+
+int main ( int argc, char *argv[] )
+{
+  static const VikDemInterpol methods[] = { VIK_DEM_INTERPOL_NONE, VIK_DEM_INTERPOL_SIMPLE, VIK_DEM_INTERPOL_BEST };
+  gchar *name = g_strdup_printf ( "viking-test-dems-%d", (int) getpid () );
+  gchar *dir = g_build_filename ( g_get_tmp_dir (), name, NULL );
+  VikCoord *coords = g_new ( VikCoord, POINTS );
+  GList *files = NULL, *iter;
+  gboolean ok = TRUE;
+  gint lat, lon;
+  guint i;
+
+  g_type_init ();
+  g_thread_init ( NULL );
+  g_random_set_seed ( 42 );
+  g_mkdir_with_parents ( dir, 0777 );
+
+  for ( lat = 45; lat < 45 + TILES_SIDE; lat++ )
+    for ( lon = 6; lon < 6 + TILES_SIDE; lon++ ) {
+      gchar *path = write_tile ( dir, lat, lon );
+      a_dems_load ( path );
+      files = g_list_prepend ( files, path );
+    }
+
+  // Mostly on the tiles, and some off them
+  for ( i = 0; i < POINTS; i++ ) {
+    struct LatLon ll;
+    ll.lat = g_random_double_range ( 44.9, 45 + TILES_SIDE + 0.1 );
+    ll.lon = g_random_double_range ( 5.9, 6 + TILES_SIDE + 0.1 );
+    vik_coord_load_from_latlon ( &coords[i], VIK_COORD_LATLON, &ll );
+  }
+
+  for ( i = 0; i < G_N_ELEMENTS(methods); i++ ) {
+    ok = check_batch ( coords, POINTS, methods[i] ) && ok;
+    // Done in the calling thread
+    ok = check_batch ( coords, 1000, methods[i] ) && ok;
+  }
+
+  for ( iter = files; iter; iter = iter->next ) {
+    a_dems_unref ( iter->data );
+    g_remove ( iter->data );
+    g_free ( iter->data );
+  }
+  g_list_free ( files );
+  g_rmdir ( dir );
+  g_free ( dir );
+  g_free ( name );
+  g_free ( coords );
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+/*
+ * Checks the simplified trackpoints of a track at several scales:
+ *  they are in order, keep the ends of every segment, and every
+ *  trackpoint left out lies within the error allowed of the line
+ *  between the trackpoints kept either side of it.
+ */
+#include <stdio.h>
+#include <math.h>
+#include <glib.h>
+#include "globals.h"
+#include "viktrack.h"
+
+#define POINTS 20000
+#define SEGMENT_POINTS 3000
+
+/* As the simplification measures, in planar metres around the track */
+static gdouble lat_scale;
+
+static void to_metres ( VikTrackpoint *tp, gdouble *x, gdouble *y )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( &tp->coord, &ll );
+  *x = DEG2RAD(ll.lon) * 6378137.0 * lat_scale;
+  *y = DEG2RAD(ll.lat) * 6378137.0;
+}
+
+static gdouble segment_distance ( VikTrackpoint *p, VikTrackpoint *a, VikTrackpoint *b )
+{
+  gdouble px, py, ax, ay, bx, by, dx, dy, len2, t;
+  to_metres ( p, &px, &py );
+  to_metres ( a, &ax, &ay );
+  to_metres ( b, &bx, &by );
+  dx = bx - ax;
+  dy = by - ay;
+  len2 = dx * dx + dy * dy;
+  t = len2 > 0 ? ((px - ax) * dx + (py - ay) * dy) / len2 : 0;
+  t = CLAMP ( t, 0, 1 );
+  return hypot ( ax + t * dx - px, ay + t * dy - py );
+}
+
+static VikTrack *make_track ( guint n )
+{
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0, 5.0 };
+  gdouble heading = 0.0;
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    heading += g_random_double_range ( -0.3, 0.3 );
+    ll.lat += 5e-5 * cos ( heading );
+    ll.lon += 5e-5 * sin ( heading );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->newsegment = (i % SEGMENT_POINTS) == 0;
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  return tr;
+}
+
+static gboolean check_simplified ( VikTrack *tr, gdouble max_error )
+{
+  GList *simple = vik_track_get_simplified_trackpoints ( tr, max_error );
+  GList *full, *kept = simple;
+  VikTrackpoint *before = NULL;
+  guint n_kept = 0;
+
+  for ( full = tr->trackpoints; full; full = full->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(full->data);
+    gboolean last_of_segment = ! full->next || VIK_TRACKPOINT(full->next->data)->newsegment;
+
+    if ( kept && kept->data == tp ) {
+      before = tp;
+      kept = kept->next;
+      n_kept++;
+      continue;
+    }
+    if ( tp->newsegment || last_of_segment ) {
+      fprintf ( stderr, "%.0fm: the end of a segment was left out\n", max_error );
+      return FALSE;
+    }
+    // Being in order, the next kept point is the one after it
+    if ( ! before || ! kept ) {
+      fprintf ( stderr, "%.0fm: trackpoints kept out of order\n", max_error );
+      return FALSE;
+    }
+    if ( segment_distance ( tp, before, VIK_TRACKPOINT(kept->data) ) > max_error * 1.001 ) {
+      fprintf ( stderr, "%.0fm: a point %.2fm from the simplified track was left out\n",
+                max_error, segment_distance ( tp, before, VIK_TRACKPOINT(kept->data) ) );
+      return FALSE;
+    }
+  }
+  if ( kept ) {
+    fprintf ( stderr, "%.0fm: trackpoints kept out of order\n", max_error );
+    return FALSE;
+  }
+  printf ( "%6.0fm: %u of %u points\n", max_error, n_kept, g_list_length ( tr->trackpoints ) );
+  return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+  static const gdouble errors[] = { 1.0, 3.0, 10.0, 50.0, 400.0, 5000.0 };
+  VikTrack *tr, *line;
+  GList *simple;
+  gdouble lat_sum = 0.0;
+  struct LatLon ll;
+  GList *iter;
+  gboolean ok = TRUE;
+  guint i;
+
+  g_random_set_seed ( 42 );
+  tr = make_track ( POINTS );
+  for ( iter = tr->trackpoints; iter; iter = iter->next ) {
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), &ll );
+    lat_sum += ll.lat;
+  }
+  lat_scale = cos ( DEG2RAD(lat_sum / POINTS) );
+
+  for ( i = 0; i < G_N_ELEMENTS(errors); i++ )
+    ok = check_simplified ( tr, errors[i] ) && ok;
+
+  // No saving to be had below a metre
+  if ( vik_track_get_simplified_trackpoints ( tr, 0.5 ) != tr->trackpoints ) {
+    fprintf ( stderr, "simplified below the smallest error\n" );
+    ok = FALSE;
+  }
+  vik_track_free ( tr );
+
+  // A straight line only needs its ends
+  line = make_track ( 0 );
+  for ( i = 0; i < 100; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat = 45.0 + i * 1e-4;
+    ll.lon = 5.0;
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    line->trackpoints = g_list_append ( line->trackpoints, tp );
+  }
+  simple = vik_track_get_simplified_trackpoints ( line, 10.0 );
+  if ( g_list_length ( simple ) != 2 || simple->data != line->trackpoints->data ||
+       simple->next->data != g_list_last ( line->trackpoints )->data ) {
+    fprintf ( stderr, "a straight line simplified to %u points\n", g_list_length ( simple ) );
+    ok = FALSE;
+  }
+  vik_track_free ( line );
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/*
+ * Checks the spatial index finds exactly the items a scan of every item
+ *  finds, as items are inserted, removed and moved.
+ */
+#include <stdio.h>
+#include <glib.h>
+#include "vikspatialindex.h"
+
+#define ITEMS 5000
+#define QUERIES 2000
+
+static LatLonBBox boxes[ITEMS+1]; /* By item, 0 unused */
+static gboolean present[ITEMS+1];
+
+static LatLonBBox random_box ( gdouble max_size )
+{
+  LatLonBBox b;
+  b.south = g_random_double_range ( 44.0, 48.0 );
+  b.north = b.south + g_random_double_range ( 0.0, max_size );
+  b.west = g_random_double_range ( 2.0, 8.0 );
+  b.east = b.west + g_random_double_range ( 0.0, max_size );
+  return b;
+}
+
+static gboolean overlap ( const LatLonBBox *a, const LatLonBBox *b )
+{
+  return a->south <= b->north && a->north >= b->south &&
+         a->west <= b->east && a->east >= b->west;
+}
+
+/* Counts the times each item is found */
+static void mark_found ( gpointer item, GHashTable *found )
+{
+  gint times = GPOINTER_TO_INT ( g_hash_table_lookup ( found, item ) );
+  g_hash_table_insert ( found, item, GINT_TO_POINTER(times + 1) );
+}
+
+static gboolean check_queries ( VikSpatialIndex *si, const gchar *when )
+{
+  GHashTable *found = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  guint q, i;
+
+  for ( q = 0; q < QUERIES; q++ ) {
+    LatLonBBox query = random_box ( q % 2 ? 0.01 : 0.5 );
+    g_hash_table_remove_all ( found );
+    vik_spatial_index_query ( si, &query, (VikSpatialIndexFunc) mark_found, found );
+    for ( i = 1; i <= ITEMS; i++ ) {
+      gint expected = present[i] && overlap ( &boxes[i], &query ) ? 1 : 0;
+      gint times = GPOINTER_TO_INT ( g_hash_table_lookup ( found, GUINT_TO_POINTER(i) ) );
+      if ( times != expected ) {
+        fprintf ( stderr, "%s: item %u found %d times, expected %d\n", when, i, times, expected );
+        g_hash_table_destroy ( found );
+        return FALSE;
+      }
+    }
+  }
+  g_hash_table_destroy ( found );
+  return TRUE;
+}
+
+static gboolean check_bounds ( VikSpatialIndex *si )
+{
+  LatLonBBox bounds, expected;
+  gboolean any = FALSE;
+  guint i;
+
+  expected.south = expected.west = G_MAXDOUBLE;
+  expected.north = expected.east = -G_MAXDOUBLE;
+
+  for ( i = 1; i <= ITEMS; i++ )
+    if ( present[i] ) {
+      expected.north = MAX ( expected.north, boxes[i].north );
+      expected.south = MIN ( expected.south, boxes[i].south );
+      expected.east = MAX ( expected.east, boxes[i].east );
+      expected.west = MIN ( expected.west, boxes[i].west );
+      any = TRUE;
+    }
+  if ( vik_spatial_index_get_bounds ( si, &bounds ) != any ) {
+    fprintf ( stderr, "bounds %s\n", any ? "missing" : "given when empty" );
+    return FALSE;
+  }
+  if ( any && ( bounds.north != expected.north || bounds.south != expected.south ||
+                bounds.east != expected.east || bounds.west != expected.west ) ) {
+    fprintf ( stderr, "bounds %f,%f,%f,%f, expected %f,%f,%f,%f\n",
+              bounds.south, bounds.west, bounds.north, bounds.east,
+              expected.south, expected.west, expected.north, expected.east );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+  VikSpatialIndex *si = vik_spatial_index_new ();
+  guint i, n = 0;
+  gboolean ok = TRUE;
+
+  g_random_set_seed ( 42 );
+
+  for ( i = 1; i <= ITEMS; i++ ) {
+    // Mostly points, as waypoints are, and some larger track chunks
+    boxes[i] = random_box ( i % 10 ? 0.0 : 0.05 );
+    vik_spatial_index_insert ( si, GUINT_TO_POINTER(i), &boxes[i] );
+    present[i] = TRUE;
+  }
+  if ( vik_spatial_index_size ( si ) != ITEMS ) {
+    fprintf ( stderr, "size %u after inserting %u\n", vik_spatial_index_size ( si ), ITEMS );
+    ok = FALSE;
+  }
+  ok = ok && check_queries ( si, "inserted" ) && check_bounds ( si );
+
+  for ( i = 1; i <= ITEMS; i += 3 ) {
+    vik_spatial_index_remove ( si, GUINT_TO_POINTER(i) );
+    present[i] = FALSE;
+  }
+  // Inserting again moves an item
+  for ( i = 2; i <= ITEMS; i += 7 ) {
+    boxes[i] = random_box ( 0.01 );
+    vik_spatial_index_insert ( si, GUINT_TO_POINTER(i), &boxes[i] );
+    present[i] = TRUE;
+  }
+  for ( i = 1; i <= ITEMS; i++ )
+    n += present[i];
+  if ( vik_spatial_index_size ( si ) != n ) {
+    fprintf ( stderr, "size %u after removing, expected %u\n", vik_spatial_index_size ( si ), n );
+    ok = FALSE;
+  }
+  ok = ok && check_queries ( si, "removed and moved" ) && check_bounds ( si );
+
+  vik_spatial_index_remove_all ( si );
+  for ( i = 1; i <= ITEMS; i++ )
+    present[i] = FALSE;
+  if ( vik_spatial_index_size ( si ) != 0 ) {
+    fprintf ( stderr, "size %u after removing all\n", vik_spatial_index_size ( si ) );
+    ok = FALSE;
+  }
+  ok = ok && check_queries ( si, "emptied" ) && check_bounds ( si );
+
+  vik_spatial_index_free ( si );
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+/*
+ * Checks drawing resumed from the retained surfaces: only the changed
+ *  layers and those above them are drawn again, and the result, with
+ *  its copyrights and logos, is the same as drawing everything afresh.
+ *  Drawing starts afresh once the viewport has moved, or when a changed
+ *  layer has no surface to resume from.
+ *
+ * Needs a display, as the viewports draw to pixmaps; skipped otherwise.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include "vikviewport.h"
+
+#define WIDTH 300
+#define HEIGHT 200
+#define LAYERS 3
+
+static const gchar *colors[] = { "#c00000", "#00a000", "#0000c0", "#c0c000", "#00c0c0" };
+static const guint32 logo_colors[] = { 0x804000ff, 0x008040ff, 0x400080ff };
+
+/* As much of a layer as the surfaces need: an object to hold them by */
+typedef struct {
+  GObject *obj;
+  gboolean visible;
+  guint version;   /* Changes the color and copyright */
+  GdkPixbuf *logo;
+  gboolean drawn;
+} FakeLayer;
+
+static FakeLayer layers[LAYERS];
+
+static void draw_layer ( VikViewport *vp, guint i )
+{
+  FakeLayer *l = &layers[i];
+  GdkGC *gc = vik_viewport_new_gc ( vp, colors[(i + l->version) % G_N_ELEMENTS(colors)], 1 );
+  gchar *copyright = g_strdup_printf ( "Layer %u v%u", i, l->version );
+
+  // Overlapping, so the order matters
+  vik_viewport_draw_rectangle ( vp, gc, TRUE, 20 + 40 * i, 20 + 30 * i, 120, 90 );
+  vik_viewport_add_copyright ( vp, copyright );
+  vik_viewport_add_logo ( vp, l->logo );
+  l->drawn = TRUE;
+
+  g_free ( copyright );
+  g_object_unref ( gc );
+}
+
+/*
+ * Draws the layers as the window does, resuming if possible.
+ * Returns: What vik_viewport_surfaces_end() gave
+ */
+static gboolean draw_pass ( VikViewport *vp, gboolean resume, gboolean *resumed )
+{
+  guint i;
+
+  for ( i = 0; i < LAYERS; i++ )
+    layers[i].drawn = FALSE;
+
+  *resumed = vik_viewport_surfaces_begin ( vp, resume );
+  if ( ! *resumed )
+    vik_viewport_clear ( vp );
+  for ( i = 0; i < LAYERS; i++ ) {
+    vik_viewport_surface_reach ( vp, layers[i].obj, layers[i].visible );
+    if ( ! vik_viewport_get_half_drawn ( vp ) && layers[i].visible )
+      draw_layer ( vp, i );
+  }
+  return vik_viewport_surfaces_end ( vp );
+}
+
+/* What is shown: the layers with the copyrights and logos on top */
+static GdkPixbuf *snapshot ( VikViewport *vp )
+{
+  vik_viewport_draw_copyright ( vp );
+  vik_viewport_draw_logo ( vp );
+  return gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap ( vp )),
+                                        gdk_colormap_get_system (), 0, 0, 0, 0, WIDTH, HEIGHT );
+}
+
+static gboolean pixbufs_equal ( GdkPixbuf *a, GdkPixbuf *b )
+{
+  gint row, row_len = gdk_pixbuf_get_width ( a ) * gdk_pixbuf_get_n_channels ( a );
+  for ( row = 0; row < gdk_pixbuf_get_height ( a ); row++ )
+    if ( memcmp ( gdk_pixbuf_get_pixels ( a ) + row * gdk_pixbuf_get_rowstride ( a ),
+                  gdk_pixbuf_get_pixels ( b ) + row * gdk_pixbuf_get_rowstride ( b ), row_len ) != 0 )
+      return FALSE;
+  return TRUE;
+}
+
+/*
+ * Draws @vp after the layers in @changed have been invalidated, and checks
+ *  whether it resumed, which layers were drawn before any fresh redraw
+ *  that vik_viewport_surfaces_end() asked for, and that the result is
+ *  the same as drawing everything on @ref.
+ */
+static gboolean check_pass ( const gchar *what, VikViewport *vp, VikViewport *ref, guint changed,
+                             gboolean expect_resumed, guint expect_drawn, gboolean expect_end )
+{
+  GdkPixbuf *got, *expected;
+  gboolean resumed, end, ok = TRUE;
+  guint i, drawn = 0;
+
+  for ( i = 0; i < LAYERS; i++ )
+    if ( changed & (1 << i) )
+      vik_viewport_surfaces_invalidate ( vp, layers[i].obj );
+
+  end = draw_pass ( vp, TRUE, &resumed );
+  for ( i = 0; i < LAYERS; i++ )
+    if ( layers[i].drawn )
+      drawn |= 1 << i;
+  if ( resumed != expect_resumed || drawn != expect_drawn || end != expect_end ) {
+    fprintf ( stderr, "%s: resumed %d, drew layers %#x, end %d; expected %d, %#x, %d\n",
+              what, resumed, drawn, end, expect_resumed, expect_drawn, expect_end );
+    ok = FALSE;
+  }
+  if ( ! end )
+    draw_pass ( vp, FALSE, &resumed );
+  got = snapshot ( vp );
+
+  draw_pass ( ref, FALSE, &resumed );
+  expected = snapshot ( ref );
+
+  if ( ! pixbufs_equal ( got, expected ) ) {
+    fprintf ( stderr, "%s: not the same as drawing everything\n", what );
+    ok = FALSE;
+  }
+  g_object_unref ( got );
+  g_object_unref ( expected );
+  return ok;
+}
+
+int main ( int argc, char *argv[] )
+{
+  VikViewport *vp, *ref;
+  struct LatLon ll = { 51.0, -1.0 };
+  gboolean ok = TRUE;
+  guint i;
+
+  if ( ! gtk_init_check ( &argc, &argv ) ) {
+    printf ( "no display, skipped\n" );
+    return 77;
+  }
+
+  vp = vik_viewport_new_offscreen ( NULL, WIDTH, HEIGHT );
+  ref = vik_viewport_new_offscreen ( NULL, WIDTH, HEIGHT );
+  for ( i = 0; i < LAYERS; i++ ) {
+    layers[i].obj = g_object_new ( G_TYPE_OBJECT, NULL );
+    layers[i].visible = TRUE;
+    layers[i].logo = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, 16, 16 );
+    gdk_pixbuf_fill ( layers[i].logo, logo_colors[i] );
+  }
+
+  // Nothing has changed yet, so all is drawn
+  ok = check_pass ( "first", vp, ref, 0, FALSE, 0x7, TRUE ) && ok;
+
+  layers[2].version++;
+  ok = check_pass ( "top changed", vp, ref, 0x4, TRUE, 0x4, TRUE ) && ok;
+  layers[1].version++;
+  ok = check_pass ( "middle changed", vp, ref, 0x2, TRUE, 0x6, TRUE ) && ok;
+  layers[0].version++;
+  layers[2].version++;
+  ok = check_pass ( "bottom and top changed", vp, ref, 0x5, TRUE, 0x7, TRUE ) && ok;
+
+  layers[1].visible = FALSE;
+  ok = check_pass ( "middle hidden", vp, ref, 0x2, TRUE, 0x4, TRUE ) && ok;
+  layers[2].version++;
+  ok = check_pass ( "top changed over a hidden layer", vp, ref, 0x4, TRUE, 0x4, TRUE ) && ok;
+  // Drawn past while hidden, so its surface is not kept
+  layers[0].version++;
+  ok = check_pass ( "bottom changed", vp, ref, 0x1, TRUE, 0x5, TRUE ) && ok;
+  layers[1].visible = TRUE;
+  ok = check_pass ( "middle shown", vp, ref, 0x2, TRUE, 0x0, FALSE ) && ok;
+
+  vik_viewport_set_center_latlon ( vp, &ll );
+  vik_viewport_set_center_latlon ( ref, &ll );
+  layers[2].version++;
+  ok = check_pass ( "moved", vp, ref, 0x4, FALSE, 0x7, TRUE ) && ok;
+
+  vik_viewport_surfaces_drop_all ( vp );
+  layers[2].version++;
+  ok = check_pass ( "dropped", vp, ref, 0x4, TRUE, 0x0, FALSE ) && ok;
+
+  g_object_unref ( vp );
+  g_object_unref ( ref );
+  for ( i = 0; i < LAYERS; i++ ) {
+    g_object_unref ( layers[i].obj );
+    g_object_unref ( layers[i].logo );
+  }
+  return ok ? 0 : 1;
+}
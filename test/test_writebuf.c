@@ -0,0 +1,124 @@
+/*
+ * Checks the numbers and times the file writers put out through the
+ *  write buffer: doubles in the fewest digits that read back the same
+ *  value, without the locale's decimal separator, integers, and the
+ *  same ISO 8601 times as GLib gives.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <locale.h>
+#include <glib.h>
+#include "vikwritebuf.h"
+
+static gboolean ok = TRUE;
+
+static gchar *format_double ( gdouble d )
+{
+  VikWriteBuf *wb = vik_write_buf_new ( NULL );
+  vik_write_buf_append_double ( wb, d );
+  return g_string_free ( vik_write_buf_free_to_string ( wb ), FALSE );
+}
+
+static void check_double ( gdouble d, const gchar *expected )
+{
+  gchar *s = format_double ( d );
+  if ( strcmp ( s, expected ) != 0 ) {
+    fprintf ( stderr, "%.17g written as %s, expected %s\n", d, s, expected );
+    ok = FALSE;
+  }
+  g_free ( s );
+}
+
+static void check_round_trip ( gdouble d )
+{
+  gchar *s = format_double ( d );
+  if ( g_ascii_strtod ( s, NULL ) != d || strchr ( s, ',' ) ) {
+    fprintf ( stderr, "%.17g written as %s, which does not read back\n", d, s );
+    ok = FALSE;
+  }
+  g_free ( s );
+}
+
+static void check_int ( glong i, const gchar *expected )
+{
+  VikWriteBuf *wb = vik_write_buf_new ( NULL );
+  GString *str;
+  vik_write_buf_append_int ( wb, i );
+  str = vik_write_buf_free_to_string ( wb );
+  if ( strcmp ( str->str, expected ) != 0 ) {
+    fprintf ( stderr, "%ld written as %s, expected %s\n", i, str->str, expected );
+    ok = FALSE;
+  }
+  g_string_free ( str, TRUE );
+}
+
+/* As the GPX writer did before the write buffer */
+static void check_times ( void )
+{
+  VikWriteBuf *wb = vik_write_buf_new ( NULL );
+  GString *str, *expected = g_string_new ( NULL );
+  time_t t = 946684800 - 86400 * 400; /* Across a leap day */
+  guint i;
+
+  for ( i = 0; i < 2000; i++ ) {
+    GTimeVal tv = { t, 0 };
+    gchar *s = g_time_val_to_iso8601 ( &tv );
+    g_string_append ( expected, s );
+    g_string_append_c ( expected, ' ' );
+    g_free ( s );
+    vik_write_buf_append_iso8601 ( wb, t );
+    vik_write_buf_append ( wb, " " );
+    // Mostly seconds apart, as along a track, with some days between
+    t += i % 100 ? g_random_int_range ( 1, 30 ) : g_random_int_range ( 1, 86400 * 40 );
+  }
+  str = vik_write_buf_free_to_string ( wb );
+  if ( strcmp ( str->str, expected->str ) != 0 ) {
+    fprintf ( stderr, "times differ from g_time_val_to_iso8601()\n" );
+    ok = FALSE;
+  }
+  g_string_free ( str, TRUE );
+  g_string_free ( expected, TRUE );
+}
+
+int main ( int argc, char *argv[] )
+{
+  static const gchar *comma_locales[] = { "de_DE.UTF-8", "fr_FR.UTF-8", "de_DE", "fr_FR" };
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  guint i;
+
+  g_random_set_seed ( 42 );
+
+  // The files must not depend on where they are written
+  for ( i = 0; i < G_N_ELEMENTS(comma_locales); i++ )
+    if ( setlocale ( LC_NUMERIC, comma_locales[i] ) )
+      break;
+
+  check_double ( 0.0, "0" );
+  check_double ( 45.1, "45.1" );
+  check_double ( -0.5, "-0.5" );
+  check_double ( 1234.5, "1234.5" );
+  check_double ( 51.477928, "51.477928" );
+  check_double ( 1e-7, "1e-07" );
+  check_double ( 0.1 + 0.2, "0.30000000000000004" );
+
+  for ( i = 0; i < 100000; i++ ) {
+    check_round_trip ( g_random_double_range ( -90.0, 90.0 ) );
+    check_round_trip ( g_random_double_range ( -500.0, 9000.0 ) );
+    // With few digits, as most values read from files have
+    g_ascii_formatd ( buf, sizeof(buf), "%.6f", g_random_double_range ( -180.0, 180.0 ) );
+    check_round_trip ( g_ascii_strtod ( buf, NULL ) );
+  }
+
+  check_int ( 0, "0" );
+  check_int ( 7, "7" );
+  check_int ( -42, "-42" );
+  check_int ( 1262304000, "1262304000" );
+  g_snprintf ( buf, sizeof(buf), "%ld", G_MAXLONG );
+  check_int ( G_MAXLONG, buf );
+  g_snprintf ( buf, sizeof(buf), "%ld", G_MINLONG );
+  check_int ( G_MINLONG, buf );
+
+  check_times ();
+
+  return ok ? 0 : 1;
+}
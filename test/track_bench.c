@@ -0,0 +1,114 @@
+/*
+ * Compares the memory used by, and passes over, a long track stored as
+ *  a list of trackpoints and packed into columns.
+ *
+ * The draw pass only projects each point to screen coordinates,
+ *  as drawing a track does before anything is drawn.
+ *
+ * Usage: track_bench [points]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "viktrack.h"
+
+#define ELEVATION_CHUNKS 500
+
+static VikTrack *make_track ( guint n )
+{
+  VikTrack *tr = vik_track_new ();
+  struct LatLon ll = { 45.0, 5.0 };
+  GList *tps = NULL;
+  guint i;
+
+  for ( i = 0; i < n; i++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += g_random_double_range ( -1e-4, 1.1e-4 );
+    ll.lon += g_random_double_range ( -1e-4, 1.1e-4 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->altitude = 1000 + 500 * sin ( i / 5000.0 );
+    tp->timestamp = 1262304000 + i;
+    tp->has_timestamp = TRUE;
+    tp->newsegment = (i % 100000) == 0;
+    tps = g_list_prepend ( tps, tp );
+  }
+  tr->trackpoints = g_list_reverse ( tps );
+  return tr;
+}
+
+/* Mercator-ish projection to a 1000x1000 screen, summing so the work is not optimised away */
+static glong draw_pass ( VikTrackIter iter )
+{
+  glong sum = 0;
+  for ( ; vik_track_iter_valid ( &iter ); vik_track_iter_next ( &iter ) ) {
+    const VikCoord *c = vik_track_iter_coord ( &iter );
+    gint x = (gint) ((c->east_west - 5.0) * 1000.0);
+    gint y = (gint) ((45.0 - c->north_south) * 1000.0 / cos ( 45.0 * M_PI / 180.0 ));
+    sum += x + y;
+  }
+  return sum;
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint n = argc > 1 ? atoi ( argv[1] ) : 1000000;
+  VikTrack *tr;
+  VikTrackColumns *cols;
+  VikTrackIter iter;
+  GTimer *timer;
+  gdouble len_list, len_cols, t_list, t_cols;
+  gdouble *map_list, *map_cols;
+  glong draw_list, draw_cols;
+
+  g_random_set_seed ( 42 );
+  tr = make_track ( n );
+  timer = g_timer_new ();
+  cols = vik_track_columns_new_from_track ( tr );
+  printf ( "%u points, packed in %.3fs\n", n, g_timer_elapsed ( timer, NULL ) );
+
+  /* Leaves out the allocator's own overhead for each trackpoint */
+  printf ( "memory: list %.1f MB, columns %.1f MB\n",
+           n * (sizeof(GList) + sizeof(VikTrackpoint)) / 1048576.0,
+           vik_track_columns_get_size ( cols ) / 1048576.0 );
+
+  g_timer_start ( timer );
+  len_list = vik_track_get_length ( tr );
+  t_list = g_timer_elapsed ( timer, NULL );
+  g_timer_start ( timer );
+  len_cols = vik_track_columns_get_length ( cols );
+  t_cols = g_timer_elapsed ( timer, NULL );
+  printf ( "length:        list %.3fs, columns %.3fs\n", t_list, t_cols );
+
+  g_timer_start ( timer );
+  map_list = vik_track_make_elevation_map ( tr, ELEVATION_CHUNKS );
+  t_list = g_timer_elapsed ( timer, NULL );
+  g_timer_start ( timer );
+  map_cols = vik_track_columns_make_elevation_map ( cols, ELEVATION_CHUNKS );
+  t_cols = g_timer_elapsed ( timer, NULL );
+  printf ( "elevation map: list %.3fs, columns %.3fs\n", t_list, t_cols );
+
+  g_timer_start ( timer );
+  vik_track_iter_init ( &iter, tr );
+  draw_list = draw_pass ( iter );
+  t_list = g_timer_elapsed ( timer, NULL );
+  g_timer_start ( timer );
+  vik_track_iter_init_columns ( &iter, cols );
+  draw_cols = draw_pass ( iter );
+  t_cols = g_timer_elapsed ( timer, NULL );
+  printf ( "draw:          list %.3fs, columns %.3fs\n", t_list, t_cols );
+
+  if ( len_list != len_cols || draw_list != draw_cols ||
+       !map_list || !map_cols || memcmp ( map_list, map_cols, sizeof(gdouble) * ELEVATION_CHUNKS ) ) {
+    fprintf ( stderr, "results differ between list and columns\n" );
+    return 1;
+  }
+
+  g_free ( map_list );
+  g_free ( map_cols );
+  g_timer_destroy ( timer );
+  vik_track_columns_free ( cols );
+  vik_track_free ( tr );
+  return 0;
+}
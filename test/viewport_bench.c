@@ -0,0 +1,80 @@
+/*
+ * Compares working out the screen positions of many coordinates one at a time
+ *  against all at once, in each draw mode, and checks they agree.
+ *
+ * Needs a display, as a viewport is a widget.
+ *
+ * Usage: viewport_bench [points]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include "globals.h"
+#include "preferences.h"
+#include "vikviewport.h"
+
+int main ( int argc, char *argv[] )
+{
+  static const VikViewportDrawMode modes[] = { VIK_VIEWPORT_DRAWMODE_UTM, VIK_VIEWPORT_DRAWMODE_MERCATOR, VIK_VIEWPORT_DRAWMODE_LATLON };
+  guint n = argc > 1 ? atoi ( argv[1] ) : 1000000;
+  struct LatLon center = { 45.0, 5.0 };
+  VikCoord *coords = g_new ( VikCoord, n );
+  gint *xs1 = g_new ( gint, n ), *ys1 = g_new ( gint, n );
+  gint *xs2 = g_new ( gint, n ), *ys2 = g_new ( gint, n );
+  VikViewport *vvp;
+  GTimer *timer;
+  guint i, m;
+
+  if ( ! gtk_init_check ( &argc, &argv ) ) {
+    printf ( "no display, skipped\n" );
+    return 0;
+  }
+  a_preferences_init ();
+  a_vik_preferences_init ();
+
+  vvp = vik_viewport_new ();
+  timer = g_timer_new ();
+  g_random_set_seed ( 42 );
+
+  printf ( "%u points\n", n );
+  for ( m = 0; m < G_N_ELEMENTS(modes); m++ ) {
+    gdouble t_single, t_batch;
+
+    vik_viewport_set_drawmode ( vvp, modes[m] );
+    vik_viewport_set_center_latlon ( vvp, &center );
+    vik_viewport_set_zoom ( vvp, 4.0 );
+
+    for ( i = 0; i < n; i++ ) {
+      struct LatLon ll;
+      ll.lat = center.lat + g_random_double_range ( -0.05, 0.05 );
+      ll.lon = center.lon + g_random_double_range ( -0.05, 0.05 );
+      vik_coord_load_from_latlon ( &coords[i], vik_viewport_get_coord_mode ( vvp ), &ll );
+    }
+
+    g_timer_start ( timer );
+    for ( i = 0; i < n; i++ )
+      vik_viewport_coord_to_screen ( vvp, &coords[i], &xs1[i], &ys1[i] );
+    t_single = g_timer_elapsed ( timer, NULL );
+
+    g_timer_start ( timer );
+    vik_viewport_coords_to_screen ( vvp, coords, sizeof(VikCoord), n, xs2, ys2 );
+    t_batch = g_timer_elapsed ( timer, NULL );
+
+    printf ( "%-10s single %6.1f Mpoints/s, batch %6.1f Mpoints/s\n",
+             vik_viewport_get_drawmode_name ( vvp, modes[m] ), n / t_single / 1e6, n / t_batch / 1e6 );
+
+    if ( memcmp ( xs1, xs2, n * sizeof(gint) ) || memcmp ( ys1, ys2, n * sizeof(gint) ) ) {
+      fprintf ( stderr, "results differ between single and batch\n" );
+      return 1;
+    }
+  }
+
+  g_timer_destroy ( timer );
+  g_free ( coords );
+  g_free ( xs1 );
+  g_free ( ys1 );
+  g_free ( xs2 );
+  g_free ( ys2 );
+  return 0;
+}
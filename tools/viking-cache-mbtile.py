@@ -111,17 +111,57 @@ def vikcache_to_mbtiles(directory_path, mbtiles_file, **kwargs):
     optimize_database(con)
     return
 
+# Based on mbtiles_to_disk in mbutil
+def mbtiles_to_vikcache(mbtiles_file, directory_path, **kwargs):
+    logger.debug("%s --> %s" % (mbtiles_file, directory_path))
+    con = mbtiles_connect(mbtiles_file)
+    count = 0
+    start_time = time.time()
+    msg = ""
+
+    tiles = con.execute("""select zoom_level, tile_column, tile_row, tile_data from tiles;""")
+    t = tiles.fetchone()
+    while t:
+        z = t[0]
+        x = t[1]
+        # Viking in xyz so always flip
+        y = flip_y(int(z), int(t[2]))
+        # Viking stores '17-zoom level' in the directory name
+        tile_dir = os.path.join(directory_path, 't%ss%dz0' % (kwargs.get('tileid'), 17 - z), str(x))
+        if not os.path.isdir(tile_dir):
+            os.makedirs(tile_dir)
+        tile = os.path.join(tile_dir, str(y))
+        # Don't overwrite tiles that may be newer in the cache
+        if not os.path.exists(tile):
+            f = open(tile, 'wb')
+            f.write(t[3])
+            f.close()
+            count = count + 1
+            if (count % 100) == 0:
+                for c in msg: sys.stdout.write(chr(8))
+                msg = "%s tiles extracted (%d tiles/sec)" % (count, count / (time.time() - start_time))
+                sys.stdout.write(msg)
+        t = tiles.fetchone()
+
+    msg = "\nTotal tiles extracted %s \n" %(count)
+    sys.stdout.write(msg)
+    return
+
 ##
 ## Start of code here
 ##
 parser = OptionParser(usage="""usage: %prog [options] in-map-cache-directory-root  out-file.mbtile
+       %prog [options] in-file.mbtile  out-map-cache-directory-root
     
 Example:
     
 Export Viking's cache files of a map type to an mbtiles file:
 $ viking-cache-mbtile.py -t 17 ~/.viking-maps OSM_Cycle.mbtiles
     
-Import from an MB Tiles into Viking's cache file layour is not available [yet]
+Import the tiles of an mbtiles file into Viking's cache of a map type (existing tiles are kept):
+$ viking-cache-mbtile.py -t 17 OSM_Cycle.mbtiles ~/.viking-maps
+
+Alternatively a Map layer can read the tiles straight from an mbtiles file, see its 'MBTiles File' property.
 
 Note you can use the http://github.com/mapbox/mbutil mbutil script to further handle .mbtiles
 such as converting it into an OSM tile layout and then pointing a new Viking Map at that location with the map type of 'On Disk OSM Layout'""")
@@ -137,15 +177,20 @@ if len(args) != 2:
     parser.print_help()
     sys.exit(1)
 
-if not os.path.isdir(args[0]):
-    sys.stderr.write('Viking Map Cache directory not specified\n')
-    sys.exit(1)
-
-if os.path.isfile(args[1]):
-    sys.stderr.write('Output file already exists!\n')
-    sys.exit(1)
-
 # to mbtiles
 if os.path.isdir(args[0]) and not os.path.isfile(args[0]):
+    if os.path.isfile(args[1]):
+        sys.stderr.write('Output file already exists!\n')
+        sys.exit(1)
     directory_path, mbtiles_file = args
     vikcache_to_mbtiles(directory_path, mbtiles_file, **options.__dict__)
+# from mbtiles
+elif os.path.isfile(args[0]):
+    if os.path.exists(args[1]) and not os.path.isdir(args[1]):
+        sys.stderr.write('Viking Map Cache directory not specified\n')
+        sys.exit(1)
+    mbtiles_file, directory_path = args
+    mbtiles_to_vikcache(mbtiles_file, directory_path, **options.__dict__)
+else:
+    sys.stderr.write('Input is neither a Viking Map Cache directory nor an mbtiles file\n')
+    sys.exit(1)